@@ -0,0 +1,85 @@
+#include "bench_database.h"
+#include "chunk_arena.h"
+#include "postgres_storage.h"
+
+#include <cstdlib>
+#include <memory>
+
+namespace
+{
+    constexpr size_t BENCH_POOL_SIZE = 4;
+}
+
+Database *BenchDatabase::Get()
+{
+    static const std::unique_ptr<Database> database = []() -> std::unique_ptr<Database>
+    {
+        const char *url = std::getenv("DATABASE_URL");
+        if (url == nullptr || *url == '\0')
+        {
+            return nullptr;
+        }
+
+        auto opened = std::make_unique<Database>();
+        opened->Connect(BENCH_POOL_SIZE, url);
+        opened->CreateTables();
+        return opened;
+    }();
+
+    return database.get();
+}
+
+void BenchDatabase::StoreOutputs(const PrevoutMap &prevouts)
+{
+    if (prevouts.empty())
+    {
+        return;
+    }
+
+    ChunkArena arena;
+    OrmRows rows(arena.Resource());
+    rows.reserve(prevouts.size());
+
+    for (const auto &[outpoint, prevout] : prevouts)
+    {
+        // tx_id, output_index, recipients, value
+        OrmRow &row = rows.emplace_back();
+        row.push_back(outpoint.txId);
+        row.push_back(uint64_t{outpoint.vout});
+        row.push_back(std::string_view(prevout.recipients));
+        row.push_back(prevout.value);
+    }
+
+    ManagedConnection conn(*BenchDatabase::Get());
+    pqxx::work tx(*conn);
+    tx.exec(PostgresStorage::BuildInsertStatement("transparent_outputs", PostgresStorage::GetTableColumns("transparent_outputs"), rows, [&tx](const std::string &value)
+                                                  { return tx.quote(value); }));
+    tx.commit();
+}
+
+void BenchDatabase::DeleteBlock(uint64_t height, const OrmStorageMap &orm_storage_map)
+{
+    ManagedConnection conn(*BenchDatabase::Get());
+    pqxx::work tx(*conn);
+
+    // Rows of every table are keyed by the txids of the block, which the transactions rows list
+    std::string txIds;
+    for (const OrmRow &row : orm_storage_map.at("transactions"))
+    {
+        if (!txIds.empty())
+        {
+            txIds += ",";
+        }
+        txIds += tx.quote(std::string(std::get<std::string_view>(row[0])));
+    }
+
+    tx.exec_params("DELETE FROM blocks WHERE height = $1", height);
+    if (!txIds.empty())
+    {
+        for (const char *tableName : {"transactions", "transparent_inputs", "transparent_outputs", "nullifiers", "note_commitments", "transaction_raw"})
+        {
+            tx.exec(std::string("DELETE FROM ") + tableName + " WHERE tx_id IN (" + txIds + ")");
+        }
+    }
+    tx.commit();
+}
@@ -0,0 +1,34 @@
+#ifndef BENCH_DATABASE_H
+#define BENCH_DATABASE_H
+
+#include "chain_resource.h"
+#include "database.h"
+
+/**
+ * BenchDatabase
+ * The PostgreSQL database the storage benchmarks run against, opened from DATABASE_URL with the
+ * tables created as the indexer creates them, in the text schema mode. Benchmarks write fixture rows
+ * to it, so it must be a scratch database. Without DATABASE_URL the storage benchmarks are skipped.
+ */
+class BenchDatabase
+{
+public:
+    /**
+     * @brief Connects and creates the tables on first use.
+     *
+     * @return The database, or nullptr if DATABASE_URL is not set.
+     */
+    static Database *Get();
+
+    /**
+     * @brief Stores an output for each prevout, so they can be resolved from the database.
+     */
+    static void StoreOutputs(const PrevoutMap &prevouts);
+
+    /**
+     * @brief Deletes the rows of a block written from orm_storage_map, so the same block can be written again.
+     */
+    static void DeleteBlock(uint64_t height, const OrmStorageMap &orm_storage_map);
+};
+
+#endif // BENCH_DATABASE_H
@@ -0,0 +1,255 @@
+#include "fixture_blocks.h"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    const std::string FIXTURE_DIRECTORY = "bench/fixtures/";
+
+    /**
+     * Shape of a synthesized block, taken from the mainnet block it stands in for.
+     */
+    struct BlockShape
+    {
+        uint64_t height;
+        size_t numTransactions;
+        size_t inputsPerTransaction;
+        size_t outputsPerTransaction;
+        // Every nth transaction carries Sapling spends and outputs and Orchard actions, 0 for none
+        size_t shieldedEvery;
+        // Every nth transaction spends an output created earlier in the block, 0 for none
+        size_t inBlockSpendEvery;
+    };
+
+    const std::map<std::string, BlockShape> SHAPES{
+        {"small", {419200, 1, 0, 2, 0, 0}},
+        {"median", {1700000, 8, 2, 2, 4, 0}},
+        // A full 2 MB block, whose verbose getblock is above Beast's default 8 MiB body limit
+        {"huge", {1820000, 2800, 3, 3, 4, 10}},
+        // Consolidation transactions sweeping many small outputs, so prevout resolution dominates
+        {"input_heavy", {1500000, 60, 40, 1, 0, 0}}};
+
+    // Deterministic 32 byte hex values, so synthesized fixtures are identical on every run
+    std::string Hash256(uint64_t seed)
+    {
+        std::string hex;
+        hex.reserve(64);
+
+        uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL;
+        for (int i = 0; i < 4; ++i)
+        {
+            state ^= state >> 31;
+            state *= 0xbf58476d1ce4e5b9ULL;
+            state ^= state >> 27;
+
+            char word[17];
+            std::snprintf(word, sizeof(word), "%016llx", static_cast<unsigned long long>(state));
+            hex += word;
+        }
+
+        return hex;
+    }
+
+    std::string Address(uint64_t seed)
+    {
+        static constexpr char BASE58[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+        std::string address{"t1"};
+        uint64_t state = seed * 0x2545f4914f6cdd1dULL + 1;
+        for (int i = 0; i < 33; ++i)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            address += BASE58[state % 58];
+        }
+
+        return address;
+    }
+
+    Json::Value Output(uint64_t seed, uint32_t n)
+    {
+        Json::Value output;
+        output["value"] = static_cast<double>(seed % 100000) / 1000.0;
+        output["n"] = n;
+        output["scriptPubKey"]["type"] = "pubkeyhash";
+        output["scriptPubKey"]["addresses"].append(Address(seed));
+        return output;
+    }
+
+    Json::Value SynthesizeBlock(const BlockShape &shape)
+    {
+        Json::Value block;
+        Json::Value transactions(Json::arrayValue);
+        uint64_t blockSize{1487};
+        std::string previousTxId;
+
+        for (size_t t = 0; t < shape.numTransactions; ++t)
+        {
+            const uint64_t seed = shape.height * 100000 + t;
+            Json::Value tx;
+            tx["txid"] = Hash256(seed);
+            tx["overwintered"] = true;
+            tx["version"] = 4;
+
+            if (t == 0)
+            {
+                Json::Value coinbase;
+                coinbase["coinbase"] = "03" + Hash256(seed).substr(0, 6);
+                coinbase["sequence"] = 4294967295u;
+                tx["vin"].append(coinbase);
+
+                tx["vout"].append(Output(seed, 0));
+                tx["vout"].append(Output(seed + 1, 1));
+            }
+            else
+            {
+                for (size_t i = 0; i < shape.inputsPerTransaction; ++i)
+                {
+                    Json::Value input;
+                    if (i == 0 && shape.inBlockSpendEvery != 0 && t % shape.inBlockSpendEvery == 0 && !previousTxId.empty())
+                    {
+                        input["txid"] = previousTxId;
+                        input["vout"] = 0;
+                    }
+                    else
+                    {
+                        input["txid"] = Hash256(seed * 31 + i + 7);
+                        input["vout"] = static_cast<uint32_t>(i);
+                    }
+
+                    input["sequence"] = 4294967295u;
+                    tx["vin"].append(input);
+                }
+
+                for (size_t o = 0; o < shape.outputsPerTransaction; ++o)
+                {
+                    tx["vout"].append(Output(seed * 17 + o, static_cast<uint32_t>(o)));
+                }
+            }
+
+            tx["vjoinsplit"] = Json::Value(Json::arrayValue);
+            if (shape.shieldedEvery != 0 && t != 0 && t % shape.shieldedEvery == 0)
+            {
+                Json::Value spend;
+                spend["nullifier"] = Hash256(seed * 3 + 1);
+                tx["vShieldedSpend"].append(spend);
+
+                for (uint64_t o = 0; o < 2; ++o)
+                {
+                    Json::Value output;
+                    output["cmu"] = Hash256(seed * 5 + o);
+                    tx["vShieldedOutput"].append(output);
+                }
+
+                for (uint64_t a = 0; a < 2; ++a)
+                {
+                    Json::Value action;
+                    action["nullifier"] = Hash256(seed * 7 + a);
+                    action["cmx"] = Hash256(seed * 11 + a);
+                    tx["orchard"]["actions"].append(action);
+                }
+            }
+
+            // Roughly 150 bytes per transparent input and 34 per output, 2 KiB per shielded bundle
+            uint64_t txSize = 100 + 150 * tx["vin"].size() + 34 * tx["vout"].size() + (tx.isMember("vShieldedOutput") ? 2048 : 0);
+            tx["size"] = static_cast<Json::UInt64>(txSize);
+            tx["hex"] = std::string(txSize * 2, 'a');
+
+            blockSize += txSize;
+            previousTxId = tx["txid"].asString();
+            transactions.append(tx);
+        }
+
+        block["hash"] = Hash256(shape.height);
+        block["height"] = static_cast<Json::UInt64>(shape.height);
+        block["size"] = static_cast<Json::UInt64>(blockSize);
+        block["version"] = 4;
+        block["merkleroot"] = Hash256(shape.height + 1);
+        block["time"] = static_cast<Json::UInt64>(1477641360 + shape.height * 75);
+        block["nonce"] = Hash256(shape.height + 2);
+        block["bits"] = "1c01e5c4";
+        block["difficulty"] = 73551439.5;
+        block["chainwork"] = Hash256(shape.height + 3);
+        block["previousblockhash"] = Hash256(shape.height - 1);
+        block["nextblockhash"] = Hash256(shape.height + 1);
+        block["tx"] = transactions;
+
+        return block;
+    }
+
+    FixtureBlock LoadFixture(const std::string &name)
+    {
+        FixtureBlock fixture;
+        fixture.name = name;
+
+        std::ifstream file(FIXTURE_DIRECTORY + name + ".json");
+        if (file)
+        {
+            std::stringstream contents;
+            contents << file.rdbuf();
+            fixture.json = contents.str();
+
+            Json::CharReaderBuilder builder;
+            std::string errors;
+            std::istringstream stream(fixture.json);
+            if (!Json::parseFromStream(builder, stream, &fixture.block, &errors))
+            {
+                throw std::runtime_error("Invalid fixture " + name + ": " + errors);
+            }
+
+            // Recorded with the RPC envelope or without
+            if (fixture.block.isMember("result"))
+            {
+                fixture.block = Json::Value(fixture.block["result"]);
+            }
+
+            fixture.isRecorded = true;
+            return fixture;
+        }
+
+        fixture.block = SynthesizeBlock(SHAPES.at(name));
+
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        fixture.json = Json::writeString(writer, fixture.block);
+
+        return fixture;
+    }
+}
+
+const std::vector<std::string> &FixtureBlocks::Names()
+{
+    static const std::vector<std::string> names{"small", "median", "huge", "input_heavy"};
+    return names;
+}
+
+const FixtureBlock &FixtureBlocks::Get(const std::string &name)
+{
+    static std::map<std::string, FixtureBlock> fixtures;
+
+    auto fixture = fixtures.find(name);
+    if (fixture == fixtures.end())
+    {
+        fixture = fixtures.emplace(name, LoadFixture(name)).first;
+    }
+
+    return fixture->second;
+}
+
+PrevoutMap FixtureBlocks::ResolvePrevouts(const Block &block)
+{
+    PrevoutMap prevouts;
+    uint64_t seed{0};
+
+    for (const Outpoint &outpoint : block.GetSpentOutpoints())
+    {
+        prevouts.emplace(outpoint, Prevout{1.0, "{\"" + Address(++seed) + "\"}"});
+    }
+
+    return prevouts;
+}
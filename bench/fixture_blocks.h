@@ -0,0 +1,48 @@
+#ifndef FIXTURE_BLOCKS_H
+#define FIXTURE_BLOCKS_H
+
+#include "chain_resource.h"
+
+#include <json/json.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * A getblock (verbosity 2) result used as benchmark input.
+ */
+struct FixtureBlock
+{
+    std::string name;
+    // The serialized JSON, as received from the node
+    std::string json;
+    Json::Value block;
+    // True if read from bench/fixtures, false if synthesized
+    bool isRecorded{false};
+};
+
+/**
+ * FixtureBlocks
+ * The small, median, huge and input heavy blocks the benchmarks run on. Blocks recorded from a mainnet node with
+ * bench/record_fixtures.sh are read from bench/fixtures/<name>.json. A block that has not been
+ * recorded is synthesized with the same shape as its mainnet counterpart, so the suite runs anywhere,
+ * but only recorded blocks give numbers comparable across machines and changes.
+ */
+class FixtureBlocks
+{
+public:
+    static const std::vector<std::string> &Names();
+
+    /**
+     * @brief Returns the named fixture, loading or synthesizing it on first use.
+     */
+    static const FixtureBlock &Get(const std::string &name);
+
+    /**
+     * @brief Resolves every outpoint the block spends from earlier blocks to a one address output,
+     * as the database would before DataToOrmStorageMap.
+     */
+    static PrevoutMap ResolvePrevouts(const Block &block);
+};
+
+#endif // FIXTURE_BLOCKS_H
@@ -0,0 +1,446 @@
+#include "bench_database.h"
+#include "fixture_blocks.h"
+#include "mock_rpc_server.h"
+
+#include "async_rpc_client.h"
+#include "chain_resource.h"
+#include "chunk_arena.h"
+#include "httpclient.h"
+#include "indexing_rules.h"
+#include "local_store.h"
+#include "logger.h"
+#include "postgres_storage.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <new>
+#include <streambuf>
+#include <string>
+
+/**
+ * Heap allocations made by the benchmark binary, counted by the replaced global operator new so each
+ * benchmark can report allocations per block next to its throughput.
+ */
+namespace
+{
+    std::atomic<uint64_t> numAllocations{0};
+
+    class AllocationCounter
+    {
+    private:
+        uint64_t start;
+
+    public:
+        AllocationCounter() : start(numAllocations.load(std::memory_order_relaxed)) {}
+
+        uint64_t Count() const { return numAllocations.load(std::memory_order_relaxed) - this->start; }
+    };
+
+    std::string QuoteLiteral(const std::string &value)
+    {
+        // Matches pqxx::transaction_base::quote with standard_conforming_strings on, without a connection
+        std::string quoted;
+        quoted.reserve(value.size() + 2);
+        quoted += '\'';
+        for (char c : value)
+        {
+            if (c == '\'')
+            {
+                quoted += '\'';
+            }
+            quoted += c;
+        }
+        quoted += '\'';
+        return quoted;
+    }
+
+    class NullBuffer : public std::streambuf
+    {
+    protected:
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char *, std::streamsize count) override { return count; }
+    };
+
+    void ReportPerBlock(benchmark::State &state, const FixtureBlock &fixture, uint64_t allocations)
+    {
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * fixture.json.size()));
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+        state.counters["allocs_per_block"] = benchmark::Counter(static_cast<double>(allocations) / static_cast<double>(state.iterations()));
+        state.SetLabel(fixture.isRecorded ? "recorded" : "synthesized");
+    }
+
+    const FixtureBlock &FixtureFor(const benchmark::State &state)
+    {
+        return FixtureBlocks::Get(FixtureBlocks::Names().at(static_cast<size_t>(state.range(0))));
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size == 0 ? 1 : size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+static void BM_BlockConstruction(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureFor(state);
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        Block block(fixture.block);
+        benchmark::DoNotOptimize(block);
+    }
+
+    ReportPerBlock(state, fixture, allocations.Count());
+}
+
+static void BM_DataToOrmStorageMap(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const PrevoutMap prevouts = FixtureBlocks::ResolvePrevouts(block);
+    const IndexingRules rules;
+    ChunkArena arena;
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        {
+            OrmStorageMap orm_storage_map = block.DataToOrmStorageMap(arena, prevouts, rules);
+            benchmark::DoNotOptimize(orm_storage_map);
+        }
+        arena.Release();
+    }
+
+    ReportPerBlock(state, fixture, allocations.Count());
+}
+
+// The same rows built without the arena, every row and string a heap allocation of its own
+static void BM_DataToOrmStorageMapHeap(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const PrevoutMap prevouts = FixtureBlocks::ResolvePrevouts(block);
+    const IndexingRules rules;
+    ChunkArena arena(std::pmr::new_delete_resource());
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        {
+            OrmStorageMap orm_storage_map = block.DataToOrmStorageMap(arena, prevouts, rules);
+            benchmark::DoNotOptimize(orm_storage_map);
+        }
+        arena.Release();
+    }
+
+    ReportPerBlock(state, fixture, allocations.Count());
+}
+
+static void BM_StoreTransparentInputs(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const PrevoutMap prevouts = FixtureBlocks::ResolvePrevouts(block);
+    const PrevoutMap block_outputs;
+    ChunkArena arena;
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        {
+            OrmRows rows(arena.Resource());
+            double total_transparent_input{0.0};
+            for (const Json::Value &tx : block.GetRawJson()["tx"])
+            {
+                const char *begin{nullptr};
+                const char *end{nullptr};
+                tx["txid"].getString(&begin, &end);
+
+                block._storeTransparentInputs(std::string_view(begin, static_cast<size_t>(end - begin)), tx["vin"], total_transparent_input, &rows, arena, prevouts, block_outputs);
+            }
+            benchmark::DoNotOptimize(rows);
+        }
+        arena.Release();
+    }
+
+    ReportPerBlock(state, fixture, allocations.Count());
+}
+
+static void BM_StoreTransparentOutputs(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const IndexingRules rules;
+    ChunkArena arena;
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        {
+            OrmRows rows(arena.Resource());
+            PrevoutMap block_outputs;
+            double total_public_output{0.0};
+            for (const Json::Value &tx : block.GetRawJson()["tx"])
+            {
+                const char *begin{nullptr};
+                const char *end{nullptr};
+                tx["txid"].getString(&begin, &end);
+
+                block._storeTransparentOutputs(std::string_view(begin, static_cast<size_t>(end - begin)), tx["vout"], total_public_output, &rows, arena, block_outputs, rules);
+            }
+            benchmark::DoNotOptimize(rows);
+        }
+        arena.Release();
+    }
+
+    ReportPerBlock(state, fixture, allocations.Count());
+}
+
+static void BM_BuildInsertStatement(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const PrevoutMap prevouts = FixtureBlocks::ResolvePrevouts(block);
+    const IndexingRules rules;
+    ChunkArena arena;
+    const OrmStorageMap orm_storage_map = block.DataToOrmStorageMap(arena, prevouts, rules);
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        for (const auto &[tableName, tableData] : orm_storage_map)
+        {
+            if (!tableData.empty())
+            {
+                std::string statement = PostgresStorage::BuildInsertStatement(tableName, PostgresStorage::GetTableColumns(tableName), tableData, QuoteLiteral);
+                benchmark::DoNotOptimize(statement);
+            }
+        }
+    }
+
+    ReportPerBlock(state, fixture, allocations.Count());
+}
+
+// Resolves every outpoint the block spends with PostgresStorage's single query, against outputs stored for them
+static void BM_PostgresResolvePrevouts(benchmark::State &state)
+{
+    Database *database = BenchDatabase::Get();
+    if (database == nullptr)
+    {
+        state.SkipWithError("DATABASE_URL is not set");
+        return;
+    }
+
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const std::vector<Outpoint> outpoints = block.GetSpentOutpoints();
+    BenchDatabase::StoreOutputs(FixtureBlocks::ResolvePrevouts(block));
+
+    PostgresStorage storage(*database, false);
+
+    size_t numResolved{0};
+    for (auto _ : state)
+    {
+        PrevoutMap prevouts = storage.ResolvePrevouts(outpoints);
+        numResolved = prevouts.size();
+        benchmark::DoNotOptimize(prevouts);
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * outpoints.size()));
+    state.counters["outpoints"] = benchmark::Counter(static_cast<double>(outpoints.size()));
+    state.counters["resolved"] = benchmark::Counter(static_cast<double>(numResolved));
+    state.SetLabel(fixture.isRecorded ? "recorded" : "synthesized");
+}
+
+// Appends the block's rows to a LocalStore in a scratch directory, under a new height each iteration
+static void BM_LocalStoreWriteBlock(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const PrevoutMap prevouts = FixtureBlocks::ResolvePrevouts(block);
+    const IndexingRules rules;
+    ChunkArena arena;
+    const OrmStorageMap orm_storage_map = block.DataToOrmStorageMap(arena, prevouts, rules);
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("ingest_bench_local_store_" + std::to_string(state.range(0)));
+    std::filesystem::remove_all(directory);
+
+    {
+        LocalStore store(directory.string(), 1 << 20);
+
+        uint64_t height = block.GetHeight();
+        AllocationCounter allocations;
+        for (auto _ : state)
+        {
+            StorageBackend::WriteResult result = store.WriteBlock(height++, block.GetHash(), orm_storage_map);
+            benchmark::DoNotOptimize(result);
+        }
+
+        ReportPerBlock(state, fixture, allocations.Count());
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+// Writes the block with PostgresStorage, the outputs it spends already stored. Its rows are deleted between iterations.
+static void BM_PostgresWriteBlock(benchmark::State &state)
+{
+    Database *database = BenchDatabase::Get();
+    if (database == nullptr)
+    {
+        state.SkipWithError("DATABASE_URL is not set");
+        return;
+    }
+
+    const FixtureBlock &fixture = FixtureFor(state);
+    Block block(fixture.block);
+    const PrevoutMap prevouts = FixtureBlocks::ResolvePrevouts(block);
+    BenchDatabase::StoreOutputs(prevouts);
+
+    const IndexingRules rules;
+    ChunkArena arena;
+    const OrmStorageMap orm_storage_map = block.DataToOrmStorageMap(arena, prevouts, rules);
+
+    PostgresStorage storage(*database, false);
+    BenchDatabase::DeleteBlock(block.GetHeight(), orm_storage_map);
+
+    for (auto _ : state)
+    {
+        StorageBackend::WriteResult result = storage.WriteBlock(block.GetHeight(), block.GetHash(), orm_storage_map);
+        benchmark::DoNotOptimize(result);
+
+        state.PauseTiming();
+        BenchDatabase::DeleteBlock(block.GetHeight(), orm_storage_map);
+        state.ResumeTiming();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * fixture.json.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetLabel(fixture.isRecorded ? "recorded" : "synthesized");
+}
+
+// Arguments: requests kept in flight, the mock node's service time per getblock in microseconds, and the
+// fixture. A recorded huge block is larger than Beast's default 8 MiB body limit, which the client must lift.
+static void BM_AsyncRpcGetblock(benchmark::State &state)
+{
+    const FixtureBlock &fixture = FixtureBlocks::Get(FixtureBlocks::Names().at(static_cast<size_t>(state.range(2))));
+    const size_t maxInFlight = static_cast<size_t>(state.range(0));
+
+    MockRpcServer server(fixture.json, std::chrono::microseconds(state.range(1)), 2);
+    AsyncRpcClient client(server.GetUrl(), "bench", "bench", maxInFlight, 1);
+
+    const Json::Value height(std::to_string(fixture.block["height"].asUInt64()));
+    const Json::Value verbosity(2);
+
+    // Kept full as the syncer keeps its download window full, results are consumed in order
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::future<Json::Value>>> inFlight;
+    std::chrono::steady_clock::duration totalLatency{0};
+
+    for (auto _ : state)
+    {
+        while (inFlight.size() < maxInFlight)
+        {
+            inFlight.emplace_back(std::chrono::steady_clock::now(), client.getblock(height, verbosity));
+        }
+
+        Json::Value block;
+        try
+        {
+            block = inFlight.front().second.get();
+        }
+        catch (const std::exception &e)
+        {
+            state.SkipWithError(e.what());
+            break;
+        }
+
+        totalLatency += std::chrono::steady_clock::now() - inFlight.front().first;
+        benchmark::DoNotOptimize(block);
+        inFlight.pop_front();
+    }
+
+    for (auto &request : inFlight)
+    {
+        request.second.wait();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * fixture.json.size()));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.counters["latency_us"] = benchmark::Counter(std::chrono::duration<double, std::micro>(totalLatency).count() / static_cast<double>(state.iterations()));
+    state.counters["response_mib"] = benchmark::Counter(static_cast<double>(fixture.json.size()) / (1024.0 * 1024.0));
+    state.SetLabel(fixture.isRecorded ? "recorded" : "synthesized");
+}
+
+static void BM_Base64Encode(benchmark::State &state)
+{
+    const std::string credentials(static_cast<size_t>(state.range(0)), 'u');
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        std::string encoded = CustomClient::base64Encode(credentials);
+        benchmark::DoNotOptimize(encoded);
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * credentials.size()));
+    state.counters["allocs_per_call"] = benchmark::Counter(static_cast<double>(allocations.Count()) / static_cast<double>(state.iterations()));
+}
+
+static void BM_Logger(benchmark::State &state)
+{
+    // The cost measured is formatting and stream handling, not the terminal, so output is discarded
+    NullBuffer nullBuffer;
+    std::streambuf *stdoutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    const std::string message = "Block at height " + std::to_string(1820000) + " is already stored";
+
+    AllocationCounter allocations;
+    for (auto _ : state)
+    {
+        __DEBUG__(message.c_str());
+    }
+
+    std::cout.rdbuf(stdoutBuffer);
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * message.size()));
+    state.counters["allocs_per_call"] = benchmark::Counter(static_cast<double>(allocations.Count()) / static_cast<double>(state.iterations()));
+}
+
+// Arguments index FixtureBlocks::Names(): small, median, huge, input heavy
+BENCHMARK(BM_BlockConstruction)->DenseRange(0, 3);
+BENCHMARK(BM_DataToOrmStorageMap)->DenseRange(0, 3);
+BENCHMARK(BM_DataToOrmStorageMapHeap)->DenseRange(0, 3);
+BENCHMARK(BM_StoreTransparentInputs)->DenseRange(0, 3);
+BENCHMARK(BM_StoreTransparentOutputs)->DenseRange(0, 3);
+BENCHMARK(BM_BuildInsertStatement)->DenseRange(0, 3);
+BENCHMARK(BM_PostgresResolvePrevouts)->DenseRange(0, 3)->UseRealTime();
+BENCHMARK(BM_LocalStoreWriteBlock)->DenseRange(0, 3)->UseRealTime();
+BENCHMARK(BM_PostgresWriteBlock)->DenseRange(0, 3)->UseRealTime();
+BENCHMARK(BM_AsyncRpcGetblock)->ArgsProduct({{1, 4, 16, 64}, {0, 2000}, {1, 2}})->UseRealTime();
+BENCHMARK(BM_Base64Encode)->Arg(16)->Arg(64);
+BENCHMARK(BM_Logger);
+
+BENCHMARK_MAIN();
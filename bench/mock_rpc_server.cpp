@@ -0,0 +1,120 @@
+#include "mock_rpc_server.h"
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <algorithm>
+#include <memory>
+
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+
+/**
+ * One client connection, answering its requests in order.
+ */
+class MockRpcServer::Session : public std::enable_shared_from_this<MockRpcServer::Session>
+{
+private:
+    MockRpcServer &server;
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    boost::asio::steady_timer serviceTimer;
+    http::request<http::string_body> request;
+    http::response<http::string_body> response;
+
+    void Read()
+    {
+        this->request = {};
+        http::async_read(this->stream, this->buffer, this->request, [self = shared_from_this()](beast::error_code ec, size_t)
+                         {
+                             if (ec)
+                             {
+                                 return;
+                             }
+
+                             self->serviceTimer.expires_after(self->server.serviceTime);
+                             self->serviceTimer.async_wait([self](beast::error_code)
+                                                           { self->Respond(); }); });
+    }
+
+    void Respond()
+    {
+        this->response = {};
+        this->response.version(this->request.version());
+        this->response.result(http::status::ok);
+        this->response.set(http::field::content_type, "application/json");
+        this->response.keep_alive(this->request.keep_alive());
+        this->response.body() = this->server.responseBody;
+        this->response.prepare_payload();
+
+        http::async_write(this->stream, this->response, [self = shared_from_this()](beast::error_code ec, size_t)
+                          {
+                              if (!ec && self->response.keep_alive())
+                              {
+                                  self->Read();
+                              } });
+    }
+
+public:
+    Session(MockRpcServer &serverIn, boost::asio::ip::tcp::socket socket)
+        : server(serverIn), stream(std::move(socket)), serviceTimer(stream.get_executor()) {}
+
+    void Start()
+    {
+        this->Read();
+    }
+};
+
+MockRpcServer::MockRpcServer(const std::string &resultJson, std::chrono::microseconds serviceTimeIn, size_t numIoThreads)
+    : responseBody("{\"result\":" + resultJson + ",\"error\":null,\"id\":0}"), serviceTime(serviceTimeIn),
+      work(boost::asio::make_work_guard(io_context)), acceptor(io_context)
+{
+    const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), 0);
+    this->acceptor.open(endpoint.protocol());
+    this->acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+    this->acceptor.bind(endpoint);
+    this->acceptor.listen();
+
+    this->Accept();
+
+    for (size_t i = 0; i < std::max<size_t>(numIoThreads, 1); ++i)
+    {
+        this->io_threads.emplace_back([this]()
+                                      { this->io_context.run(); });
+    }
+}
+
+MockRpcServer::~MockRpcServer() noexcept
+{
+    this->work.reset();
+    this->io_context.stop();
+
+    for (std::thread &thread : this->io_threads)
+    {
+        thread.join();
+    }
+}
+
+std::string MockRpcServer::GetUrl() const
+{
+    return "127.0.0.1:" + std::to_string(this->acceptor.local_endpoint().port());
+}
+
+void MockRpcServer::Accept()
+{
+    this->acceptor.async_accept(boost::asio::make_strand(this->io_context), [this](beast::error_code ec, boost::asio::ip::tcp::socket socket)
+                                {
+                                    if (ec == boost::asio::error::operation_aborted)
+                                    {
+                                        return;
+                                    }
+
+                                    if (!ec)
+                                    {
+                                        std::make_shared<Session>(*this, std::move(socket))->Start();
+                                    }
+
+                                    this->Accept(); });
+}
@@ -0,0 +1,54 @@
+#ifndef MOCK_RPC_SERVER_H
+#define MOCK_RPC_SERVER_H
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * MockRpcServer
+ * In-process stand-in for zcashd serving keep-alive HTTP on a loopback port. Every request is answered
+ * with the same JSON-RPC result after serviceTime, which stands in for the node reading the block. The
+ * delay is a timer, so requests in flight on different connections are served concurrently as a node
+ * serves them.
+ */
+class MockRpcServer
+{
+private:
+    class Session;
+
+    std::string responseBody;
+    std::chrono::microseconds serviceTime;
+
+    boost::asio::io_context io_context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    boost::asio::ip::tcp::acceptor acceptor;
+    std::vector<std::thread> io_threads;
+
+    void Accept();
+
+public:
+    /**
+     * @param resultJson The serialized result every call returns.
+     * @param serviceTime Time between reading a request and answering it.
+     * @param numIoThreads Threads serving connections.
+     */
+    MockRpcServer(const std::string &resultJson, std::chrono::microseconds serviceTime, size_t numIoThreads);
+
+    MockRpcServer(const MockRpcServer &rhs) = delete;
+    MockRpcServer &operator=(const MockRpcServer &rhs) = delete;
+
+    ~MockRpcServer() noexcept;
+
+    /**
+     * @brief The endpoint as host:port, as RPC_URL is set.
+     */
+    std::string GetUrl() const;
+};
+
+#endif // MOCK_RPC_SERVER_H
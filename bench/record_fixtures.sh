@@ -0,0 +1,36 @@
+#!/bin/bash
+# Records the benchmark fixture blocks from a mainnet zcashd node as getblock (verbosity 2) results.
+#
+#   RPC_URL=http://127.0.0.1:8232 RPC_USER=user RPC_PASSWORD=password bench/record_fixtures.sh
+#
+# Heights can be overridden with SMALL_HEIGHT, MEDIAN_HEIGHT and HUGE_HEIGHT. The input heavy block is
+# recorded only when INPUT_HEAVY_HEIGHT names one, and is synthesized otherwise.
+
+set -euo pipefail
+
+: "${RPC_URL:?RPC_URL is required}"
+: "${RPC_USER:?RPC_USER is required}"
+: "${RPC_PASSWORD:?RPC_PASSWORD is required}"
+
+declare -A HEIGHTS=(
+    [small]="${SMALL_HEIGHT:-419200}"
+    [median]="${MEDIAN_HEIGHT:-1700000}"
+    [huge]="${HUGE_HEIGHT:-1820000}"
+)
+
+NAMES=(small median huge)
+if [ -n "${INPUT_HEAVY_HEIGHT:-}" ]; then
+    HEIGHTS[input_heavy]="$INPUT_HEAVY_HEIGHT"
+    NAMES+=(input_heavy)
+fi
+
+cd "$(dirname "$0")/fixtures"
+
+for name in "${NAMES[@]}"; do
+    height="${HEIGHTS[$name]}"
+    echo "Recording $name block at height $height"
+    curl --silent --fail --user "$RPC_USER:$RPC_PASSWORD" \
+        --data-binary "{\"jsonrpc\":\"1.0\",\"id\":\"bench\",\"method\":\"getblock\",\"params\":[\"$height\",2]}" \
+        -H 'content-type: text/plain;' "$RPC_URL" > "$name.json.tmp"
+    mv "$name.json.tmp" "$name.json"
+done
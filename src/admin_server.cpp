@@ -0,0 +1,353 @@
+#include "admin_server.h"
+#include "logger.h"
+#include "tracer.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sstream>
+
+namespace
+{
+    // Commands are a few words, a longer line is not a command
+    constexpr size_t MAX_COMMAND_BYTES = 4096;
+    constexpr std::chrono::seconds THROUGHPUT_SAMPLE_INTERVAL{1};
+
+    std::string ToJsonString(const Json::Value &value)
+    {
+        Json::StreamWriterBuilder writerBuilder;
+        writerBuilder["indentation"] = "";
+        return Json::writeString(writerBuilder, value);
+    }
+
+    Json::Value ErrorAnswer(const std::string &message)
+    {
+        Json::Value answer(Json::objectValue);
+        answer["error"] = message;
+        return answer;
+    }
+}
+
+/**
+ * One client connection, answering its commands in order.
+ */
+class AdminServer::Session : public std::enable_shared_from_this<AdminServer::Session>
+{
+private:
+    AdminServer &server;
+    boost::asio::local::stream_protocol::socket socket;
+    boost::asio::streambuf buffer{MAX_COMMAND_BYTES};
+    std::string answer;
+
+    void Read()
+    {
+        boost::asio::async_read_until(this->socket, this->buffer, '\n', [self = shared_from_this()](boost::system::error_code ec, size_t)
+                                      {
+                                          if (ec)
+                                          {
+                                              return;
+                                          }
+
+                                          std::istream stream(&self->buffer);
+                                          std::string line;
+                                          std::getline(stream, line);
+                                          if (!line.empty() && line.back() == '\r')
+                                          {
+                                              line.pop_back();
+                                          }
+
+                                          self->answer = ToJsonString(self->server.HandleCommand(line)) + "\n";
+                                          self->Write(); });
+    }
+
+    void Write()
+    {
+        boost::asio::async_write(this->socket, boost::asio::buffer(this->answer), [self = shared_from_this()](boost::system::error_code ec, size_t)
+                                 {
+                                     if (!ec)
+                                     {
+                                         self->Read();
+                                     } });
+    }
+
+public:
+    Session(AdminServer &serverIn, boost::asio::local::stream_protocol::socket socketIn) : server(serverIn), socket(std::move(socketIn)) {}
+
+    void Start()
+    {
+        this->Read();
+    }
+};
+
+AdminServer::AdminServer(const std::string &pathIn)
+    : path(pathIn), work(boost::asio::make_work_guard(io_context)), acceptor(io_context), sampleTimer(io_context)
+{
+}
+
+AdminServer::~AdminServer() noexcept
+{
+    this->Stop();
+}
+
+void AdminServer::AddTunable(const std::string &name, const std::string &description, std::function<uint64_t()> get, std::function<void(uint64_t)> set)
+{
+    this->tunables[name] = Tunable{description, std::move(get), std::move(set)};
+}
+
+void AdminServer::AddStatus(const std::string &name, std::function<Json::Value()> status)
+{
+    this->statuses[name] = std::move(status);
+}
+
+void AdminServer::Start()
+{
+    try
+    {
+        ::unlink(this->path.c_str());
+
+        boost::asio::local::stream_protocol::endpoint endpoint(this->path);
+        this->acceptor.open(endpoint.protocol());
+        this->acceptor.bind(endpoint);
+
+        // Anyone who can connect can resize pools, so only the owner may
+        if (::chmod(this->path.c_str(), S_IRUSR | S_IWUSR) != 0)
+        {
+            throw std::runtime_error("Unable to restrict access to admin socket " + this->path);
+        }
+
+        this->acceptor.listen();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+
+    this->Accept();
+    this->SampleThroughput();
+
+    this->io_thread = std::thread([this]()
+                                  { this->io_context.run(); });
+
+    __INFO__(("Admin socket listening on " + this->path).c_str());
+}
+
+void AdminServer::Stop()
+{
+    if (!this->io_thread.joinable())
+    {
+        return;
+    }
+
+    boost::asio::post(this->io_context, [this]()
+                      {
+                          boost::system::error_code ignored;
+                          this->acceptor.close(ignored);
+                          this->sampleTimer.cancel(); });
+
+    this->work.reset();
+    this->io_context.stop();
+    this->io_thread.join();
+
+    ::unlink(this->path.c_str());
+}
+
+void AdminServer::Accept()
+{
+    this->acceptor.async_accept([this](boost::system::error_code ec, boost::asio::local::stream_protocol::socket socket)
+                                {
+                                    if (ec == boost::asio::error::operation_aborted)
+                                    {
+                                        return;
+                                    }
+
+                                    if (!ec)
+                                    {
+                                        std::make_shared<Session>(*this, std::move(socket))->Start();
+                                    }
+
+                                    this->Accept(); });
+}
+
+void AdminServer::SampleThroughput()
+{
+    this->samples.push_back(ThroughputSample{std::chrono::steady_clock::now(), this->committedBlocks, this->committedTransactions});
+    if (this->samples.size() > MAX_THROUGHPUT_SAMPLES)
+    {
+        this->samples.pop_front();
+    }
+
+    this->sampleTimer.expires_after(THROUGHPUT_SAMPLE_INTERVAL);
+    this->sampleTimer.async_wait([this](boost::system::error_code ec)
+                                 {
+                                     if (!ec)
+                                     {
+                                         this->SampleThroughput();
+                                     } });
+}
+
+Json::Value AdminServer::HandleCommand(const std::string &line)
+{
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+
+    if (command == "get")
+    {
+        return this->GetTunableValues();
+    }
+
+    if (command == "set")
+    {
+        std::string name;
+        std::string value;
+        words >> name >> value;
+
+        auto tunable = this->tunables.find(name);
+        if (tunable == this->tunables.end())
+        {
+            return ErrorAnswer("Unknown tunable " + name);
+        }
+
+        uint64_t parsedValue{0};
+        try
+        {
+            size_t parsedLength{0};
+            parsedValue = std::stoull(value, &parsedLength);
+            if (parsedLength != value.size() || parsedValue < 1)
+            {
+                throw std::invalid_argument(value);
+            }
+        }
+        catch (const std::exception &)
+        {
+            return ErrorAnswer("Value of " + name + " must be a positive integer");
+        }
+
+        try
+        {
+            tunable->second.set(parsedValue);
+        }
+        catch (const std::exception &e)
+        {
+            __ERROR__(("Unable to set " + name + ": " + e.what()).c_str());
+            return ErrorAnswer(e.what());
+        }
+
+        __INFO__(("Admin socket set " + name + " to " + std::to_string(parsedValue) + ".").c_str());
+        return this->GetTunableValues();
+    }
+
+    if (command == "stats")
+    {
+        return this->GetStats();
+    }
+
+    if (command == "trace")
+    {
+        if (!Tracer::IsEnabled())
+        {
+            return ErrorAnswer("Tracing is not enabled, set ENABLE_TRACING");
+        }
+
+        try
+        {
+            Tracer::Dump(Config::getTracePath());
+        }
+        catch (const std::exception &e)
+        {
+            return ErrorAnswer(e.what());
+        }
+
+        Json::Value answer(Json::objectValue);
+        answer["path"] = Config::getTracePath();
+        return answer;
+    }
+
+    return ErrorAnswer("Unknown command, expected get, set <name> <value>, stats or trace");
+}
+
+Json::Value AdminServer::GetTunableValues() const
+{
+    Json::Value values(Json::objectValue);
+    for (const auto &[name, tunable] : this->tunables)
+    {
+        Json::Value &entry = values[name];
+        entry["description"] = tunable.description;
+
+        try
+        {
+            entry["value"] = Json::Value::UInt64(tunable.get());
+        }
+        catch (const std::exception &e)
+        {
+            entry["error"] = e.what();
+        }
+    }
+
+    return values;
+}
+
+Json::Value AdminServer::GetStats() const
+{
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t blocks = this->committedBlocks;
+    const uint64_t transactions = this->committedTransactions;
+
+    Json::Value stats(Json::objectValue);
+    stats["committed_blocks"] = Json::Value::UInt64(blocks);
+    stats["committed_transactions"] = Json::Value::UInt64(transactions);
+    stats["uptime_seconds"] = std::chrono::duration<double>(now - this->startedAt).count();
+
+    for (const auto &[window, windowName] : {std::make_pair(std::chrono::seconds(10), "10s"), std::make_pair(std::chrono::seconds(60), "60s")})
+    {
+        // The oldest sample inside the window, samples are a second apart
+        auto since = this->samples.begin();
+        while (since != this->samples.end() && now - since->time > window)
+        {
+            ++since;
+        }
+
+        Json::Value &rate = stats["throughput"][windowName];
+        if (since == this->samples.end() || now <= since->time)
+        {
+            rate["blocks_per_second"] = 0.0;
+            rate["transactions_per_second"] = 0.0;
+            continue;
+        }
+
+        const double seconds = std::chrono::duration<double>(now - since->time).count();
+        rate["blocks_per_second"] = static_cast<double>(blocks - since->blocks) / seconds;
+        rate["transactions_per_second"] = static_cast<double>(transactions - since->transactions) / seconds;
+    }
+
+    for (const auto &[name, status] : this->statuses)
+    {
+        try
+        {
+            stats[name] = status();
+        }
+        catch (const std::exception &e)
+        {
+            stats[name] = ErrorAnswer(e.what());
+        }
+    }
+
+    return stats;
+}
+
+void AdminServer::OnBlockCommitted(const Block & /* block */, const OrmStorageMap &orm_storage_map)
+{
+    ++this->committedBlocks;
+
+    auto transactions = orm_storage_map.find("transactions");
+    if (transactions != orm_storage_map.end())
+    {
+        this->committedTransactions += transactions->second.size();
+    }
+}
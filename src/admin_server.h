@@ -0,0 +1,123 @@
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+
+#include "database.h"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <jsonrpccpp/common/jsonparser.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * AdminServer
+ * Local admin socket for tuning a running indexer. Listens on a Unix domain socket only the owner can
+ * connect to and answers one command per line with one line of JSON:
+ *
+ *   get                  every tunable and its current value
+ *   set <name> <value>   changes a tunable, then answers as get
+ *   stats                committed blocks and transactions per second, plus the registered status
+ *   trace                writes the trace recorded so far to TRACE_PATH
+ *
+ * What can be tuned is registered by the owner of each setting with AddTunable(), so the server needs
+ * no access to the components it tunes. As a BlockCommitObserver it counts committed blocks and samples
+ * the counts once a second to report throughput over the last 10 and 60 seconds.
+ */
+class AdminServer : public BlockCommitObserver
+{
+private:
+    class Session;
+
+    struct Tunable
+    {
+        std::string description;
+        std::function<uint64_t()> get;
+        std::function<void(uint64_t)> set;
+    };
+
+    struct ThroughputSample
+    {
+        std::chrono::steady_clock::time_point time;
+        uint64_t blocks;
+        uint64_t transactions;
+    };
+
+    static constexpr size_t MAX_THROUGHPUT_SAMPLES = 61;
+
+    std::string path;
+
+    boost::asio::io_context io_context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    boost::asio::local::stream_protocol::acceptor acceptor;
+    boost::asio::steady_timer sampleTimer;
+    std::thread io_thread;
+
+    // Registered before Start() and only read afterwards
+    std::map<std::string, Tunable> tunables;
+    std::map<std::string, std::function<Json::Value()>> statuses;
+
+    std::atomic<uint64_t> committedBlocks{0};
+    std::atomic<uint64_t> committedTransactions{0};
+    const std::chrono::steady_clock::time_point startedAt{std::chrono::steady_clock::now()};
+
+    // Only touched on the io thread
+    std::deque<ThroughputSample> samples;
+
+    void Accept();
+    void SampleThroughput();
+
+    /**
+     * @brief Runs one command line.
+     *
+     * @return The JSON answer, an object with an "error" member if the command failed.
+     */
+    Json::Value HandleCommand(const std::string &line);
+
+    Json::Value GetTunableValues() const;
+    Json::Value GetStats() const;
+
+public:
+    /**
+     * @param path Path of the socket. A stale socket left at the path by an earlier run is replaced.
+     */
+    explicit AdminServer(const std::string &path);
+
+    AdminServer(const AdminServer &rhs) = delete;
+    AdminServer &operator=(const AdminServer &rhs) = delete;
+
+    ~AdminServer() noexcept;
+
+    /**
+     * @brief Makes a setting readable with get and changeable with set. Values below 1 are rejected.
+     */
+    void AddTunable(const std::string &name, const std::string &description, std::function<uint64_t()> get, std::function<void(uint64_t)> set);
+
+    /**
+     * @brief Adds a member to the stats answer, computed when stats is asked for.
+     */
+    void AddStatus(const std::string &name, std::function<Json::Value()> status);
+
+    /**
+     * @brief Starts listening. Call once every tunable is registered.
+     */
+    void Start();
+
+    /**
+     * @brief Stops listening, joins the io thread and removes the socket.
+     */
+    void Stop();
+
+    void OnBlockCommitted(const Block &block, const OrmStorageMap &orm_storage_map) override;
+};
+
+#endif // ADMIN_SERVER_H
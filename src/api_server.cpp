@@ -0,0 +1,1065 @@
+#include "api_server.h"
+#include "logger.h"
+#include "raw_transaction_codec.h"
+
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <set>
+
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+
+namespace
+{
+    constexpr std::chrono::seconds API_SESSION_TIMEOUT{30};
+
+    // A subscriber that cannot take a batch of events within this time is disconnected
+    constexpr std::chrono::seconds EVENT_WRITE_TIMEOUT{10};
+    constexpr std::chrono::seconds EVENT_KEEPALIVE_INTERVAL{15};
+    constexpr size_t MAX_EVENTS_PER_WRITE = 512;
+
+    int64_t SteadyNowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Postgres type oids of the columns served as JSON numbers, booleans and arrays
+    constexpr pqxx::oid BOOL_OID = 16;
+    constexpr pqxx::oid INT8_OID = 20;
+    constexpr pqxx::oid INT2_OID = 21;
+    constexpr pqxx::oid INT4_OID = 23;
+    constexpr pqxx::oid FLOAT4_OID = 700;
+    constexpr pqxx::oid FLOAT8_OID = 701;
+    constexpr pqxx::oid TEXT_ARRAY_OID = 1009;
+
+    // Splits a one dimensional text array literal such as {a,"b c"} into its elements
+    Json::Value ParseTextArray(std::string_view literal)
+    {
+        Json::Value elements(Json::arrayValue);
+        if (literal.size() < 2 || literal.front() != '{' || literal.back() != '}')
+        {
+            return elements;
+        }
+
+        std::string current;
+        bool isQuoted{false};
+        bool hasElement{false};
+
+        for (size_t i = 1; i + 1 < literal.size(); ++i)
+        {
+            const char c = literal[i];
+            if (isQuoted)
+            {
+                if (c == '\\' && i + 2 < literal.size())
+                {
+                    current += literal[++i];
+                }
+                else if (c == '"')
+                {
+                    isQuoted = false;
+                }
+                else
+                {
+                    current += c;
+                }
+            }
+            else if (c == '"')
+            {
+                isQuoted = true;
+                hasElement = true;
+            }
+            else if (c == ',')
+            {
+                elements.append(current);
+                current.clear();
+                hasElement = false;
+            }
+            else
+            {
+                current += c;
+                hasElement = true;
+            }
+        }
+
+        if (hasElement || !elements.empty())
+        {
+            elements.append(current);
+        }
+
+        return elements;
+    }
+
+    Json::Value RowToJson(const pqxx::row &row)
+    {
+        Json::Value object(Json::objectValue);
+
+        for (int i = 0; i < static_cast<int>(row.size()); ++i)
+        {
+            const pqxx::field field = row[i];
+            Json::Value &value = object[field.name()];
+
+            if (field.is_null())
+            {
+                value = Json::nullValue;
+                continue;
+            }
+
+            switch (field.type())
+            {
+            case BOOL_OID:
+                value = field.as<bool>();
+                break;
+            case INT2_OID:
+            case INT4_OID:
+            case INT8_OID:
+                value = Json::Value::Int64(field.as<int64_t>());
+                break;
+            case FLOAT4_OID:
+            case FLOAT8_OID:
+                value = field.as<double>();
+                break;
+            case TEXT_ARRAY_OID:
+                value = ParseTextArray(field.c_str());
+                break;
+            default:
+                value = field.c_str();
+            }
+        }
+
+        return object;
+    }
+
+    std::string ToJsonString(const Json::Value &value)
+    {
+        Json::StreamWriterBuilder writerBuilder;
+        writerBuilder["indentation"] = "";
+        return Json::writeString(writerBuilder, value);
+    }
+
+    std::string ErrorBody(const std::string &message)
+    {
+        Json::Value error(Json::objectValue);
+        error["error"] = message;
+        return ToJsonString(error);
+    }
+
+    // Calls fn for each address in a text array literal built by Block::DataToOrmStorageMap
+    template <typename F>
+    void ForEachAddress(std::string_view literal, F &&fn)
+    {
+        for (const Json::Value &address : ParseTextArray(literal))
+        {
+            fn(address.asString());
+        }
+    }
+
+    std::string AddressKey(const std::string &address)
+    {
+        return "address:" + address;
+    }
+
+    std::string QueryParameter(const std::string &query, const std::string &name)
+    {
+        size_t start{0};
+        while (start <= query.size())
+        {
+            size_t end = query.find('&', start);
+            if (end == std::string::npos)
+            {
+                end = query.size();
+            }
+
+            if (query.compare(start, name.size() + 1, name + "=") == 0)
+            {
+                return query.substr(start + name.size() + 1, end - start - name.size() - 1);
+            }
+
+            start = end + 1;
+        }
+
+        return "";
+    }
+
+    std::string FormatEvent(const EventRing::Event &event)
+    {
+        Json::Value data(Json::objectValue);
+        data["height"] = Json::Value::UInt64(event.height);
+
+        if (event.type == EventRing::EventType::Block)
+        {
+            data["hash"] = event.id;
+            data["transactions"] = event.transactionCount;
+            return "event: block\ndata: " + ToJsonString(data) + "\n\n";
+        }
+
+        data["txid"] = event.id;
+        data["address"] = event.address;
+        return "event: transaction\ndata: " + ToJsonString(data) + "\n\n";
+    }
+}
+
+/**
+ * A server-sent event stream. The session polls the server's EventRing from its own position and
+ * writes whatever was published since, so publishing never waits on a subscriber.
+ */
+class ApiServer::EventStreamSession : public std::enable_shared_from_this<ApiServer::EventStreamSession>
+{
+private:
+    ApiServer &server;
+    beast::tcp_stream stream;
+    boost::asio::steady_timer timer;
+    std::vector<std::string> addresses;
+    uint64_t position;
+    std::string batch;
+    std::vector<int64_t> batchCommitTimes;
+    std::chrono::steady_clock::time_point lastWrite{std::chrono::steady_clock::now()};
+
+    bool IsSubscribed(const EventRing::Event &event) const
+    {
+        if (event.type == EventRing::EventType::Block)
+        {
+            return true;
+        }
+
+        return std::find(this->addresses.begin(), this->addresses.end(), event.address) != this->addresses.end();
+    }
+
+    void Write(std::string data)
+    {
+        this->batch = std::move(data);
+        this->stream.expires_after(EVENT_WRITE_TIMEOUT);
+
+        boost::asio::async_write(this->stream, boost::asio::buffer(this->batch), [self = shared_from_this()](beast::error_code ec, size_t)
+                                 {
+                                     if (ec)
+                                     {
+                                         self->Close();
+                                         return;
+                                     }
+
+                                     const int64_t now = SteadyNowNs();
+                                     for (int64_t committedAt : self->batchCommitTimes)
+                                     {
+                                         self->server.notifyLatency.Record(static_cast<uint64_t>(std::max<int64_t>(0, now - committedAt) / 1000));
+                                     }
+
+                                     self->lastWrite = std::chrono::steady_clock::now();
+                                     self->Drain(); });
+    }
+
+    // Writes the events published since the last call, or waits for more
+    void Drain()
+    {
+        std::string data;
+        this->batchCommitTimes.clear();
+
+        EventRing::Event event;
+        size_t numEvents{0};
+
+        while (numEvents < MAX_EVENTS_PER_WRITE && this->position < this->server.events.GetHead())
+        {
+            EventRing::ReadResult result = this->server.events.Read(this->position, event);
+            if (result == EventRing::ReadResult::NotReady)
+            {
+                break;
+            }
+
+            if (result == EventRing::ReadResult::Overrun)
+            {
+                ++this->server.laggedDisconnects;
+                __DEBUG__("Disconnecting event stream that fell behind the event ring");
+                this->Close();
+                return;
+            }
+
+            ++this->position;
+            ++numEvents;
+
+            if (this->IsSubscribed(event))
+            {
+                data += FormatEvent(event);
+                this->batchCommitTimes.push_back(event.committedAtNs);
+            }
+        }
+
+        if (data.empty() && std::chrono::steady_clock::now() - this->lastWrite >= EVENT_KEEPALIVE_INTERVAL)
+        {
+            data = ": keepalive\n\n";
+        }
+
+        if (!data.empty())
+        {
+            this->Write(std::move(data));
+            return;
+        }
+
+        this->timer.expires_after(this->server.eventPollInterval);
+        this->timer.async_wait([self = shared_from_this()](beast::error_code ec)
+                               {
+                                   if (!ec)
+                                   {
+                                       self->Drain();
+                                   } });
+    }
+
+    void Close()
+    {
+        beast::error_code ignored;
+        this->timer.cancel();
+        this->stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+    }
+
+public:
+    EventStreamSession(ApiServer &serverIn, beast::tcp_stream &&streamIn, const std::string &addressList)
+        : server(serverIn), stream(std::move(streamIn)), timer(stream.get_executor()), position(serverIn.events.GetHead())
+    {
+        size_t start{0};
+        while (start < addressList.size())
+        {
+            size_t end = std::min(addressList.find(',', start), addressList.size());
+            if (end > start)
+            {
+                this->addresses.push_back(addressList.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+
+        ++this->server.subscribers;
+    }
+
+    ~EventStreamSession()
+    {
+        --this->server.subscribers;
+    }
+
+    void Start()
+    {
+        std::string header = "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: text/event-stream\r\n"
+                             "Cache-Control: no-cache\r\n"
+                             "Connection: keep-alive\r\n\r\n"
+                             ": subscribed\n\n";
+        this->Write(std::move(header));
+    }
+};
+
+/**
+ * One client connection. Requests on a connection are served one after another; the handlers run
+ * on the connection's strand.
+ */
+class ApiServer::Session : public std::enable_shared_from_this<ApiServer::Session>
+{
+private:
+    ApiServer &server;
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    http::request<http::string_body> request;
+    http::response<http::string_body> response;
+
+    void Read()
+    {
+        this->request = {};
+        this->stream.expires_after(API_SESSION_TIMEOUT);
+
+        http::async_read(this->stream, this->buffer, this->request, [self = shared_from_this()](beast::error_code ec, size_t)
+                         {
+                             if (ec)
+                             {
+                                 self->Close();
+                                 return;
+                             }
+
+                             self->Respond(); });
+    }
+
+    void Respond()
+    {
+        unsigned int status;
+        std::string body;
+
+        const std::string target(this->request.target());
+
+        if (this->request.method() != http::verb::get)
+        {
+            status = 405;
+            body = ErrorBody("Only GET is supported");
+        }
+        else if (target.substr(0, target.find('?')) == "/events")
+        {
+            // The connection now belongs to the event stream
+            const std::string query = target.find('?') == std::string::npos ? "" : target.substr(target.find('?') + 1);
+            std::make_shared<EventStreamSession>(this->server, std::move(this->stream), QueryParameter(query, "addresses"))->Start();
+            return;
+        }
+        else
+        {
+            std::tie(status, body) = this->server.HandleRequest(target);
+        }
+
+        this->response = {};
+        this->response.version(this->request.version());
+        this->response.result(status);
+        this->response.set(http::field::content_type, "application/json");
+        this->response.keep_alive(this->request.keep_alive());
+        this->response.body() = std::move(body);
+        this->response.prepare_payload();
+
+        http::async_write(this->stream, this->response, [self = shared_from_this()](beast::error_code ec, size_t)
+                          {
+                              if (ec || !self->response.keep_alive())
+                              {
+                                  self->Close();
+                                  return;
+                              }
+
+                              self->Read(); });
+    }
+
+    void Close()
+    {
+        beast::error_code ignored;
+        this->stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+    }
+
+public:
+    Session(ApiServer &serverIn, boost::asio::ip::tcp::socket &&socket) : server(serverIn), stream(std::move(socket)) {}
+
+    void Start()
+    {
+        this->Read();
+    }
+};
+
+void ApiServer::NotifyLatency::Record(uint64_t microseconds)
+{
+    size_t bucket{0};
+    while (bucket + 1 < NUM_BUCKETS && (microseconds >> bucket) > 1)
+    {
+        ++bucket;
+    }
+
+    ++this->buckets[bucket];
+    ++this->count;
+
+    uint64_t currentMax = this->maxMicroseconds.load();
+    while (microseconds > currentMax && !this->maxMicroseconds.compare_exchange_weak(currentMax, microseconds))
+    {
+    }
+}
+
+uint64_t ApiServer::NotifyLatency::Percentile(double percentile) const
+{
+    const uint64_t total = this->count.load();
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t rank = static_cast<uint64_t>(percentile * static_cast<double>(total));
+    uint64_t seen{0};
+
+    for (size_t bucket = 0; bucket < NUM_BUCKETS; ++bucket)
+    {
+        seen += this->buckets[bucket].load();
+        if (seen > rank)
+        {
+            return (uint64_t{2} << bucket) - 1;
+        }
+    }
+
+    return this->maxMicroseconds.load();
+}
+
+ApiServer::ApiServer(Database &database, const std::string &address, unsigned short port, size_t numIoThreads, const std::string &connection_string, size_t poolSize,
+                     size_t cacheMaxBytes, size_t cacheShards)
+    : database(database), work(boost::asio::make_work_guard(io_context)), acceptor(io_context), cache(cacheMaxBytes, cacheShards)
+{
+    try
+    {
+        for (size_t i = 0; i < std::max<size_t>(1, poolSize); ++i)
+        {
+            auto conn = std::make_unique<pqxx::connection>(connection_string);
+            ApiServer::PrepareStatements(*conn);
+            this->connection_pool.push(std::move(conn));
+        }
+
+        boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address(address), port);
+        this->acceptor.open(endpoint.protocol());
+        this->acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+        this->acceptor.bind(endpoint);
+        this->acceptor.listen(boost::asio::socket_base::max_listen_connections);
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+
+    this->Accept();
+
+    for (size_t i = 0; i < std::max<size_t>(1, numIoThreads); ++i)
+    {
+        this->io_threads.emplace_back([this]()
+                                      { this->io_context.run(); });
+    }
+
+    __INFO__(("API server listening on " + address + ":" + std::to_string(port)).c_str());
+}
+
+ApiServer::~ApiServer() noexcept
+{
+    this->Stop();
+}
+
+void ApiServer::Stop()
+{
+    boost::asio::post(this->io_context, [this]()
+                      {
+                          beast::error_code ignored;
+                          this->acceptor.close(ignored); });
+
+    this->work.reset();
+    this->io_context.stop();
+
+    for (std::thread &thread : this->io_threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+void ApiServer::Accept()
+{
+    this->acceptor.async_accept(boost::asio::make_strand(this->io_context), [this](beast::error_code ec, boost::asio::ip::tcp::socket socket)
+                                {
+                                    if (ec == boost::asio::error::operation_aborted)
+                                    {
+                                        return;
+                                    }
+
+                                    if (!ec)
+                                    {
+                                        std::make_shared<Session>(*this, std::move(socket))->Start();
+                                    }
+
+                                    this->Accept(); });
+}
+
+void ApiServer::PrepareStatements(pqxx::connection &conn)
+{
+    conn.prepare("tip", "SELECT hash, height, timestamp FROM blocks ORDER BY height DESC LIMIT 1");
+    conn.prepare("block_by_height", "SELECT * FROM blocks WHERE height = $1");
+    conn.prepare("block_by_hash", "SELECT * FROM blocks WHERE hash = $1");
+    conn.prepare("transaction_by_id", "SELECT tx_id, size, is_overwintered, version, total_public_input, total_public_output, hash, timestamp, height, "
+                                      "num_inputs, num_outputs FROM transactions WHERE tx_id = $1");
+    conn.prepare("transaction_raw", "SELECT encode(r.raw, 'hex'), t.hex FROM transactions t LEFT JOIN transaction_raw r ON r.tx_id = t.tx_id WHERE t.tx_id = $1");
+    conn.prepare("transaction_inputs", "SELECT vin_tx_id, v_out_idx, value, senders, coinbase FROM transparent_inputs WHERE tx_id = $1 ORDER BY input_index");
+    conn.prepare("transaction_outputs", "SELECT output_index, recipients, value, spent_tx_id, spent_height FROM transparent_outputs WHERE tx_id = $1 ORDER BY output_index");
+
+    if (Config::getSchemaMode() == "dictionary")
+    {
+        // The decoded arrays of the views are not indexed, so the address is looked up once and matched by id
+        conn.prepare("address_history", "SELECT t.tx_id, t.height, t.timestamp FROM transactions t WHERE t.tx_id IN ("
+                                        "SELECT d.tx_id FROM tx_ids d WHERE d.id IN ("
+                                        "SELECT tx_ref FROM transparent_outputs_encoded WHERE recipient_refs @> ARRAY[(SELECT id FROM addresses WHERE address = $1)] "
+                                        "UNION SELECT tx_ref FROM transparent_inputs_encoded WHERE sender_refs @> ARRAY[(SELECT id FROM addresses WHERE address = $1)])) "
+                                        "ORDER BY t.height DESC LIMIT $2");
+        conn.prepare("address_utxos", "SELECT d.tx_id, o.output_index, o.value, t.height FROM transparent_outputs_encoded o "
+                                      "JOIN tx_ids d ON d.id = o.tx_ref JOIN transactions t ON t.tx_id = d.tx_id "
+                                      "WHERE o.recipient_refs @> ARRAY[(SELECT id FROM addresses WHERE address = $1)] AND o.spent_height IS NULL "
+                                      "ORDER BY t.height DESC, o.output_index LIMIT $2");
+        return;
+    }
+
+    conn.prepare("address_history", "SELECT t.tx_id, t.height, t.timestamp FROM transactions t WHERE t.tx_id IN ("
+                                    "SELECT tx_id FROM transparent_outputs WHERE recipients @> ARRAY[$1]::text[] "
+                                    "UNION SELECT tx_id FROM transparent_inputs WHERE senders @> ARRAY[$1]::text[]) "
+                                    "ORDER BY t.height DESC LIMIT $2");
+
+    // Outputs of the address come from the recipients index, and spent ones are filtered out on the heap
+    conn.prepare("address_utxos", "SELECT o.tx_id, o.output_index, o.value, t.height FROM transparent_outputs o JOIN transactions t ON t.tx_id = o.tx_id "
+                                  "WHERE o.recipients @> ARRAY[$1]::text[] AND o.spent_height IS NULL "
+                                  "ORDER BY t.height DESC, o.output_index LIMIT $2");
+}
+
+std::unique_ptr<pqxx::connection> ApiServer::GetConnection()
+{
+    std::unique_lock<std::mutex> lock(cs_connection_pool);
+    cv_connection_pool.wait(lock, [this]
+                            { return !this->connection_pool.empty(); });
+
+    std::unique_ptr<pqxx::connection> conn = std::move(this->connection_pool.front());
+    this->connection_pool.pop();
+    return conn;
+}
+
+void ApiServer::ReleaseConnection(std::unique_ptr<pqxx::connection> conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_connection_pool);
+        this->connection_pool.push(std::move(conn));
+    }
+    cv_connection_pool.notify_one();
+}
+
+std::pair<unsigned int, std::string> ApiServer::HandleRequest(const std::string &target)
+{
+    const std::string path = target.substr(0, target.find('?'));
+    const std::string query = target.find('?') == std::string::npos ? "" : target.substr(target.find('?') + 1);
+
+    auto respond = [](const ResponseCache::Response &response) -> std::pair<unsigned int, std::string>
+    {
+        if (response == nullptr)
+        {
+            return {404, ErrorBody("Not found")};
+        }
+        return {200, *response};
+    };
+
+    auto segmentAfter = [&path](const std::string &prefix) -> std::optional<std::string>
+    {
+        if (path.rfind(prefix, 0) != 0 || path.size() == prefix.size())
+        {
+            return std::nullopt;
+        }
+        return path.substr(prefix.size());
+    };
+
+    try
+    {
+        if (path == "/events/stats")
+        {
+            return {200, this->GetEventStats()};
+        }
+
+        if (path == "/tip")
+        {
+            return respond(this->cache.GetOrLoad("tip", [this]()
+                                                 { return this->LoadTip(); }));
+        }
+
+        if (std::optional<std::string> block = segmentAfter("/blocks/"); block.has_value() && block->find('/') == std::string::npos)
+        {
+            return respond(this->cache.GetOrLoad("block:" + block.value(), [this, &block]()
+                                                 { return this->LoadBlock(block.value()); }));
+        }
+
+        if (std::optional<std::string> txId = segmentAfter("/transactions/"); txId.has_value() && txId->find('/') == std::string::npos)
+        {
+            return respond(this->cache.GetOrLoad("tx:" + txId.value(), [this, &txId]()
+                                                 { return this->LoadTransaction(txId.value()); }));
+        }
+
+        const std::string rawSuffix = "/raw";
+        if (std::optional<std::string> rest = segmentAfter("/transactions/"); rest.has_value() && rest->size() > rawSuffix.size() &&
+                                                                             rest->compare(rest->size() - rawSuffix.size(), rawSuffix.size(), rawSuffix) == 0)
+        {
+            // Raw transactions never change once stored, so they are not invalidated by commits
+            const std::string txId = rest->substr(0, rest->size() - rawSuffix.size());
+            return respond(this->cache.GetOrLoad("rawtx:" + txId, [this, &txId]()
+                                                 { return this->LoadRawTransaction(txId); }));
+        }
+
+        // The address of /addresses/{address}{suffix}
+        auto addressBefore = [&segmentAfter](const std::string &suffix) -> std::optional<std::string>
+        {
+            std::optional<std::string> rest = segmentAfter("/addresses/");
+            if (!rest.has_value() || rest->size() <= suffix.size() || rest->compare(rest->size() - suffix.size(), suffix.size(), suffix) != 0)
+            {
+                return std::nullopt;
+            }
+            return rest->substr(0, rest->size() - suffix.size());
+        };
+
+        auto parseLimit = [&query]() -> size_t
+        {
+            if (query.rfind("limit=", 0) != 0)
+            {
+                return DEFAULT_ADDRESS_HISTORY_LIMIT;
+            }
+            return std::min<size_t>(MAX_ADDRESS_HISTORY_LIMIT, std::stoull(query.substr(6)));
+        };
+
+        if (std::optional<std::string> history = addressBefore("/transactions"); history.has_value())
+        {
+            const std::string &address = history.value();
+            const size_t limit = parseLimit();
+
+            // Only the default page is cached, so a commit has one key to invalidate per address
+            const bool isCacheable = limit == DEFAULT_ADDRESS_HISTORY_LIMIT;
+            const std::string key = isCacheable ? AddressKey(address) : AddressKey(address) + ":" + std::to_string(limit);
+
+            return respond(this->cache.GetOrLoad(key, [this, &address, limit]()
+                                                 { return this->LoadAddressHistory(address, limit); }, isCacheable));
+        }
+
+        if (std::optional<std::string> utxos = addressBefore("/utxos"); utxos.has_value())
+        {
+            // Not cached: with deferred valuation an input's senders are unknown at commit, so there is no key to invalidate.
+            // Concurrent requests are still coalesced on the key, which holds the limit so they share a result only if it is the same.
+            const std::string &address = utxos.value();
+            const size_t limit = parseLimit();
+            return respond(this->cache.GetOrLoad("utxos:" + address + ":" + std::to_string(limit), [this, &address, limit]()
+                                                 { return this->LoadAddressUtxos(address, limit); }, false));
+        }
+
+        if (std::optional<std::string> nullifier = segmentAfter("/nullifiers/"); nullifier.has_value() && nullifier->find('/') == std::string::npos)
+        {
+            // Not cached: most lookups are misses, which the nullifier filter answers without a query
+            return respond(this->cache.GetOrLoad("nullifier:" + nullifier.value(), [this, &nullifier]()
+                                                 { return this->LoadNullifier(nullifier.value()); }, false));
+        }
+
+        return {404, ErrorBody("Unknown path")};
+    }
+    catch (const std::invalid_argument &e)
+    {
+        return {400, ErrorBody(e.what())};
+    }
+    catch (const std::out_of_range &e)
+    {
+        return {400, ErrorBody(e.what())};
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        return {500, ErrorBody("Internal error")};
+    }
+}
+
+std::optional<std::string> ApiServer::LoadTip()
+{
+    std::unique_ptr<pqxx::connection> conn = this->GetConnection();
+    std::optional<std::string> body;
+
+    try
+    {
+        pqxx::read_transaction tx(*conn);
+        pqxx::result result = tx.exec_prepared("tip");
+
+        if (!result.empty())
+        {
+            body = ToJsonString(RowToJson(result[0]));
+        }
+    }
+    catch (...)
+    {
+        this->ReleaseConnection(std::move(conn));
+        throw;
+    }
+
+    this->ReleaseConnection(std::move(conn));
+    return body;
+}
+
+std::optional<std::string> ApiServer::LoadBlock(const std::string &heightOrHash)
+{
+    const bool isHeight = heightOrHash.find_first_not_of("0123456789") == std::string::npos;
+
+    std::unique_ptr<pqxx::connection> conn = this->GetConnection();
+    std::optional<std::string> body;
+
+    try
+    {
+        pqxx::read_transaction tx(*conn);
+        pqxx::result result = isHeight ? tx.exec_prepared("block_by_height", std::stoull(heightOrHash)) : tx.exec_prepared("block_by_hash", heightOrHash);
+
+        if (!result.empty())
+        {
+            body = ToJsonString(RowToJson(result[0]));
+        }
+    }
+    catch (...)
+    {
+        this->ReleaseConnection(std::move(conn));
+        throw;
+    }
+
+    this->ReleaseConnection(std::move(conn));
+    return body;
+}
+
+std::optional<std::string> ApiServer::LoadTransaction(const std::string &txId)
+{
+    std::unique_ptr<pqxx::connection> conn = this->GetConnection();
+    std::optional<std::string> body;
+
+    try
+    {
+        pqxx::read_transaction tx(*conn);
+        pqxx::result transaction = tx.exec_prepared("transaction_by_id", txId);
+
+        if (!transaction.empty())
+        {
+            Json::Value object = RowToJson(transaction[0]);
+            object["inputs"] = Json::Value(Json::arrayValue);
+            object["outputs"] = Json::Value(Json::arrayValue);
+
+            for (const auto &row : tx.exec_prepared("transaction_inputs", txId))
+            {
+                object["inputs"].append(RowToJson(row));
+            }
+
+            for (const auto &row : tx.exec_prepared("transaction_outputs", txId))
+            {
+                object["outputs"].append(RowToJson(row));
+            }
+
+            body = ToJsonString(object);
+        }
+    }
+    catch (...)
+    {
+        this->ReleaseConnection(std::move(conn));
+        throw;
+    }
+
+    this->ReleaseConnection(std::move(conn));
+    return body;
+}
+
+std::optional<std::string> ApiServer::LoadRawTransaction(const std::string &txId)
+{
+    std::unique_ptr<pqxx::connection> conn = this->GetConnection();
+    std::optional<std::string> body;
+
+    try
+    {
+        pqxx::read_transaction tx(*conn);
+        pqxx::result result = tx.exec_prepared("transaction_raw", txId);
+
+        if (!result.empty())
+        {
+            // Compressed transactions leave the inline hex empty
+            Json::Value object;
+            object["tx_id"] = txId;
+            object["hex"] = result[0][0].is_null() ? result[0][1].as<std::string>("") : RawTransactionCodec::DecompressHex(result[0][0].c_str());
+            body = ToJsonString(object);
+        }
+    }
+    catch (...)
+    {
+        this->ReleaseConnection(std::move(conn));
+        throw;
+    }
+
+    this->ReleaseConnection(std::move(conn));
+    return body;
+}
+
+std::optional<std::string> ApiServer::LoadAddressHistory(const std::string &address, size_t limit)
+{
+    std::unique_ptr<pqxx::connection> conn = this->GetConnection();
+    std::optional<std::string> body;
+
+    try
+    {
+        pqxx::read_transaction tx(*conn);
+        pqxx::result result = tx.exec_prepared("address_history", address, static_cast<uint64_t>(limit));
+
+        Json::Value object(Json::objectValue);
+        object["address"] = address;
+        object["transactions"] = Json::Value(Json::arrayValue);
+
+        for (const auto &row : result)
+        {
+            object["transactions"].append(RowToJson(row));
+        }
+
+        body = ToJsonString(object);
+    }
+    catch (...)
+    {
+        this->ReleaseConnection(std::move(conn));
+        throw;
+    }
+
+    this->ReleaseConnection(std::move(conn));
+    return body;
+}
+
+std::optional<std::string> ApiServer::LoadAddressUtxos(const std::string &address, size_t limit)
+{
+    std::unique_ptr<pqxx::connection> conn = this->GetConnection();
+    std::optional<std::string> body;
+
+    try
+    {
+        pqxx::read_transaction tx(*conn);
+        pqxx::result result = tx.exec_prepared("address_utxos", address, static_cast<uint64_t>(limit));
+
+        Json::Value object(Json::objectValue);
+        object["address"] = address;
+        object["utxos"] = Json::Value(Json::arrayValue);
+
+        for (const auto &row : result)
+        {
+            object["utxos"].append(RowToJson(row));
+        }
+
+        body = ToJsonString(object);
+    }
+    catch (...)
+    {
+        this->ReleaseConnection(std::move(conn));
+        throw;
+    }
+
+    this->ReleaseConnection(std::move(conn));
+    return body;
+}
+
+std::optional<std::string> ApiServer::LoadNullifier(const std::string &nullifierHex)
+{
+    if (nullifierHex.size() != 64 || nullifierHex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+    {
+        throw std::invalid_argument("A nullifier is 32 bytes of hex");
+    }
+
+    std::string normalizedHex = nullifierHex;
+    std::transform(normalizedHex.begin(), normalizedHex.end(), normalizedHex.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+
+    std::optional<Database::NullifierLocation> location = this->database.FindNullifier(normalizedHex);
+    if (!location.has_value())
+    {
+        return std::nullopt;
+    }
+
+    static const char *const POOL_NAMES[] = {"sprout", "sapling", "orchard"};
+
+    Json::Value object(Json::objectValue);
+    object["nullifier"] = normalizedHex;
+    object["pool"] = POOL_NAMES[static_cast<uint16_t>(location->pool)];
+    object["tx_id"] = location->txId;
+    object["height"] = Json::Value::UInt64(location->height);
+    return ToJsonString(object);
+}
+
+void ApiServer::PublishBlockEvents(const Block &block, const OrmStorageMap &orm_storage_map)
+{
+    const int64_t committedAt = SteadyNowNs();
+
+    EventRing::Event event{};
+    event.type = EventRing::EventType::Block;
+    event.height = block.GetHeight();
+    event.transactionCount = static_cast<uint32_t>(orm_storage_map.at("transactions").size());
+    event.committedAtNs = committedAt;
+    EventRing::CopyField(event.id, block.GetHash());
+    this->events.Publish(event);
+
+    if (!this->publishTransactionEvents)
+    {
+        return;
+    }
+
+    std::set<std::pair<std::string_view, std::string>> published;
+    auto publishTransaction = [&](std::string_view txId, const std::string &address)
+    {
+        if (!published.emplace(txId, address).second)
+        {
+            return;
+        }
+
+        EventRing::Event transactionEvent{};
+        transactionEvent.type = EventRing::EventType::Transaction;
+        transactionEvent.height = block.GetHeight();
+        transactionEvent.committedAtNs = committedAt;
+
+        if (EventRing::CopyField(transactionEvent.id, txId) && EventRing::CopyField(transactionEvent.address, address))
+        {
+            this->events.Publish(transactionEvent);
+        }
+    };
+
+    for (const auto &row : orm_storage_map.at("transparent_outputs"))
+    {
+        const std::string_view txId = std::get<std::string_view>(row[0]);
+        ForEachAddress(std::get<std::string_view>(row[2]), [&](const std::string &address)
+                       { publishTransaction(txId, address); });
+    }
+
+    for (const auto &row : orm_storage_map.at("transparent_inputs"))
+    {
+        const std::string_view txId = std::get<std::string_view>(row[0]);
+        ForEachAddress(std::get<std::string_view>(row[4]), [&](const std::string &address)
+                       { publishTransaction(txId, address); });
+    }
+}
+
+std::string ApiServer::GetEventStats() const
+{
+    Json::Value stats(Json::objectValue);
+    stats["subscribers"] = Json::Value::UInt64(this->subscribers.load());
+    stats["published"] = Json::Value::UInt64(this->events.GetHead());
+    stats["ring_capacity"] = Json::Value::UInt64(this->events.GetCapacity());
+    stats["lagged_disconnects"] = Json::Value::UInt64(this->laggedDisconnects.load());
+
+    Json::Value latency(Json::objectValue);
+    latency["delivered"] = Json::Value::UInt64(this->notifyLatency.count.load());
+    latency["p50_us"] = Json::Value::UInt64(this->notifyLatency.Percentile(0.50));
+    latency["p99_us"] = Json::Value::UInt64(this->notifyLatency.Percentile(0.99));
+    latency["max_us"] = Json::Value::UInt64(this->notifyLatency.maxMicroseconds.load());
+    stats["notify_latency"] = latency;
+
+    return ToJsonString(stats);
+}
+
+void ApiServer::OnBlockCommitted(const Block &block, const OrmStorageMap &orm_storage_map)
+{
+    this->cache.Invalidate("tip");
+
+    // Lookups that missed before the block was committed are not cached, but evict in case of a resync
+    this->cache.Invalidate("block:" + std::to_string(block.GetHeight()));
+    this->cache.Invalidate("block:" + block.GetHash());
+
+    for (const auto &row : orm_storage_map.at("transactions"))
+    {
+        this->cache.Invalidate("tx:" + std::string(std::get<std::string_view>(row[0])));
+    }
+
+    auto invalidateAddress = [this](const std::string &address)
+    {
+        this->cache.Invalidate(AddressKey(address));
+    };
+
+    for (const auto &row : orm_storage_map.at("transparent_outputs"))
+    {
+        ForEachAddress(std::get<std::string_view>(row[2]), invalidateAddress);
+    }
+
+    for (const auto &row : orm_storage_map.at("transparent_inputs"))
+    {
+        ForEachAddress(std::get<std::string_view>(row[4]), invalidateAddress);
+
+        // The spent output now names this input's transaction
+        this->cache.Invalidate("tx:" + std::string(std::get<std::string_view>(row[1])));
+    }
+
+    // After invalidating, so a subscriber that queries on notification sees the block
+    this->PublishBlockEvents(block, orm_storage_map);
+}
+
+void ApiServer::OnInputsValued(uint64_t, uint64_t)
+{
+    // Valuation rewrites input values and totals without saying which transactions it touched
+    this->cache.Clear();
+}
+
+void ApiServer::OnSpendsResolved()
+{
+    // Spends applied late do not say which transactions' outputs they marked
+    this->cache.Clear();
+}
+
+ResponseCache::Stats ApiServer::GetCacheStats() const
+{
+    return this->cache.GetStats();
+}
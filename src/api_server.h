@@ -0,0 +1,150 @@
+#ifndef API_SERVER_H
+#define API_SERVER_H
+
+#include "database.h"
+#include "event_ring.h"
+#include "response_cache.h"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <jsonrpccpp/common/jsonparser.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * ApiServer
+ * Optional embedded HTTP/JSON server answering read queries from the indexed tables:
+ *
+ *   GET /tip
+ *   GET /blocks/{height or hash}
+ *   GET /transactions/{txid}
+ *   GET /transactions/{txid}/raw   raw transaction hex, decompressed if stored compressed
+ *   GET /addresses/{address}/transactions[?limit=n]
+ *   GET /addresses/{address}/utxos[?limit=n]   unspent outputs, newest first
+ *   GET /nullifiers/{hex}          the transaction that revealed a shielded nullifier
+ *   GET /events[?addresses=a,b]    server-sent events
+ *   GET /events/stats
+ *
+ * Serialized responses are kept in a ResponseCache. As a BlockCommitObserver the server invalidates
+ * the responses a committed block changes, so cached responses never trail ingest. Queries run on a
+ * connection pool of its own with prepared statements, so API load cannot starve ingest of connections.
+ *
+ * Every committed block is published to an EventRing, along with one event per (transaction, address)
+ * when transaction events are enabled. Event streams poll the ring on the io threads, so the commit
+ * path does the same work however many clients are subscribed. A stream that falls a full ring behind,
+ * or cannot be written to in time, is disconnected.
+ */
+class ApiServer : public BlockCommitObserver
+{
+private:
+    class Session;
+    class EventStreamSession;
+
+    /**
+     * Histogram of commit to delivery latency in power of two microsecond buckets.
+     */
+    struct NotifyLatency
+    {
+        static constexpr size_t NUM_BUCKETS = 40;
+
+        std::atomic<uint64_t> buckets[NUM_BUCKETS] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> maxMicroseconds{0};
+
+        void Record(uint64_t microseconds);
+
+        // Upper bound of the bucket holding the percentile
+        uint64_t Percentile(double percentile) const;
+    };
+
+    static constexpr size_t DEFAULT_ADDRESS_HISTORY_LIMIT = 50;
+    static constexpr size_t MAX_ADDRESS_HISTORY_LIMIT = 500;
+
+    // Answers nullifier lookups through its in-memory filter
+    Database &database;
+
+    boost::asio::io_context io_context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    boost::asio::ip::tcp::acceptor acceptor;
+    std::vector<std::thread> io_threads;
+
+    std::queue<std::unique_ptr<pqxx::connection>> connection_pool;
+    std::mutex cs_connection_pool;
+    std::condition_variable cv_connection_pool;
+
+    ResponseCache cache;
+
+    EventRing events{std::stoull(Config::getEventRingCapacity())};
+    const bool publishTransactionEvents{Config::getPublishTransactionEvents() == "true"};
+    const std::chrono::milliseconds eventPollInterval{std::stoull(Config::getEventPollIntervalMs())};
+
+    std::atomic<uint64_t> subscribers{0};
+    std::atomic<uint64_t> laggedDisconnects{0};
+    NotifyLatency notifyLatency;
+
+    void PublishBlockEvents(const Block &block, const OrmStorageMap &orm_storage_map);
+    std::string GetEventStats() const;
+
+    void Accept();
+
+    /**
+     * @brief Routes a GET request to its handler.
+     *
+     * @return The HTTP status and JSON body.
+     */
+    std::pair<unsigned int, std::string> HandleRequest(const std::string &target);
+
+    std::optional<std::string> LoadTip();
+    std::optional<std::string> LoadBlock(const std::string &heightOrHash);
+    std::optional<std::string> LoadTransaction(const std::string &txId);
+    std::optional<std::string> LoadRawTransaction(const std::string &txId);
+    std::optional<std::string> LoadAddressHistory(const std::string &address, size_t limit);
+    std::optional<std::string> LoadAddressUtxos(const std::string &address, size_t limit);
+    std::optional<std::string> LoadNullifier(const std::string &nullifierHex);
+
+    std::unique_ptr<pqxx::connection> GetConnection();
+    void ReleaseConnection(std::unique_ptr<pqxx::connection> conn);
+
+    static void PrepareStatements(pqxx::connection &conn);
+
+public:
+    /**
+     * @brief Opens the query connections and starts listening.
+     *
+     * @param database The indexer's database, for lookups served from its in-memory indexes.
+     * @param connection_string Connection string for the query pool.
+     * @param poolSize Number of query connections.
+     * @param numIoThreads Threads serving requests. A request holds its thread while it queries.
+     */
+    ApiServer(Database &database, const std::string &address, unsigned short port, size_t numIoThreads, const std::string &connection_string, size_t poolSize,
+              size_t cacheMaxBytes, size_t cacheShards);
+
+    ApiServer(const ApiServer &rhs) = delete;
+    ApiServer &operator=(const ApiServer &rhs) = delete;
+
+    ~ApiServer() noexcept;
+
+    /**
+     * @brief Stops accepting requests and joins the io threads.
+     */
+    void Stop();
+
+    void OnBlockCommitted(const Block &block, const OrmStorageMap &orm_storage_map) override;
+    void OnInputsValued(uint64_t firstHeight, uint64_t lastHeight) override;
+    void OnSpendsResolved() override;
+
+    ResponseCache::Stats GetCacheStats() const;
+};
+
+#endif // API_SERVER_H
@@ -0,0 +1,371 @@
+#include "async_rpc_client.h"
+#include "httpclient.h"
+#include "logger.h"
+#include "tracer.h"
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <jsonrpccpp/client.h>
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <sstream>
+
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+
+namespace
+{
+    constexpr std::chrono::seconds RPC_REQUEST_TIMEOUT{60};
+
+    // Accepts "host:port", "http://host:port" and a bare "port" on localhost, mirroring what RPC_URL is set to
+    std::pair<std::string, std::string> SplitRpcUrl(std::string url)
+    {
+        const std::string scheme = "http://";
+        if (url.rfind(scheme, 0) == 0)
+        {
+            url = url.substr(scheme.size());
+        }
+
+        url = url.substr(0, url.find('/'));
+
+        size_t separator = url.rfind(':');
+        if (separator == std::string::npos)
+        {
+            bool isPortOnly = !url.empty() && url.find_first_not_of("0123456789") == std::string::npos;
+            return isPortOnly ? std::make_pair(std::string("127.0.0.1"), url) : std::make_pair(url, std::string("8232"));
+        }
+
+        return {url.substr(0, separator), url.substr(separator + 1)};
+    }
+}
+
+/**
+ * One keep-alive HTTP connection carrying a single request at a time. Its handlers run one after
+ * another, so the connection's state needs no locking.
+ */
+class AsyncRpcClient::Connection : public std::enable_shared_from_this<AsyncRpcClient::Connection>
+{
+private:
+    AsyncRpcClient &client;
+    beast::tcp_stream stream;
+    beast::flat_buffer buffer;
+    http::request<http::string_body> request;
+    // A parser reads one response only, so each request gets a new one
+    std::optional<http::response_parser<http::string_body>> parser;
+    std::shared_ptr<PendingRequest> current;
+    bool isConnected{false};
+    bool isRetry{false};
+
+    void Send()
+    {
+        if (this->isConnected)
+        {
+            this->Write();
+            return;
+        }
+
+        this->stream.expires_after(RPC_REQUEST_TIMEOUT);
+        this->stream.async_connect(this->client.endpoints, [self = shared_from_this()](beast::error_code ec, const boost::asio::ip::tcp::endpoint &)
+                                   {
+                                       if (ec)
+                                       {
+                                           self->Fail(ec);
+                                           return;
+                                       }
+
+                                       self->isConnected = true;
+                                       self->Write(); });
+    }
+
+    void Write()
+    {
+        this->request = {};
+        this->request.method(http::verb::post);
+        this->request.target("/");
+        this->request.version(11);
+        this->request.set(http::field::host, this->client.host);
+        this->request.set(http::field::authorization, this->client.authorizationHeader);
+        this->request.set(http::field::content_type, "application/json");
+        this->request.keep_alive(true);
+        this->request.body() = this->current->body;
+        this->request.prepare_payload();
+
+        if (this->current->traceName != nullptr && Tracer::IsEnabled())
+        {
+            this->current->writeStart = std::chrono::steady_clock::now();
+        }
+
+        this->stream.expires_after(RPC_REQUEST_TIMEOUT);
+        http::async_write(this->stream, this->request, [self = shared_from_this()](beast::error_code ec, size_t)
+                          {
+                              if (ec)
+                              {
+                                  self->Fail(ec);
+                                  return;
+                              }
+
+                              self->parser.emplace();
+                              self->parser->body_limit(self->client.maxResponseBytes);
+                              http::async_read(self->stream, self->buffer, *self->parser, [self](beast::error_code readEc, size_t)
+                                               {
+                                                   if (readEc)
+                                                   {
+                                                       self->Fail(readEc);
+                                                       return;
+                                                   }
+
+                                                   self->Complete(); }); });
+    }
+
+    void Complete()
+    {
+        const http::response<http::string_body> response = this->parser->release();
+        this->parser.reset();
+
+        if (!response.keep_alive())
+        {
+            this->Close();
+        }
+
+        std::shared_ptr<PendingRequest> finished = std::move(this->current);
+
+        // zcashd reports RPC errors with a non-200 status and a JSON body, so the body decides
+        Json::Value reply;
+        std::string parseErrors;
+        Json::CharReaderBuilder readerBuilder;
+        std::istringstream bodyStream(response.body());
+
+        if (!Json::parseFromStream(readerBuilder, bodyStream, &reply, &parseErrors) || !reply.isObject())
+        {
+            finished->promise.set_exception(std::make_exception_ptr(
+                jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, "HTTP " + std::to_string(response.result_int()) + ": " + response.body())));
+        }
+        else if (!reply["error"].isNull())
+        {
+            finished->promise.set_exception(std::make_exception_ptr(
+                jsonrpc::JsonRpcException(reply["error"]["code"].asInt(), reply["error"]["message"].asString())));
+        }
+        else
+        {
+            if (finished->traceName != nullptr && Tracer::IsEnabled())
+            {
+                Tracer::Record(finished->traceName, finished->traceHeight, finished->writeStart, std::chrono::steady_clock::now());
+            }
+
+            finished->promise.set_value(reply["result"]);
+        }
+
+        this->client.OnConnectionIdle(shared_from_this());
+    }
+
+    void Fail(beast::error_code ec)
+    {
+        this->Close();
+
+        // A keep-alive connection the server already closed fails on first use, so retry once on a fresh one
+        if (!this->isRetry)
+        {
+            this->isRetry = true;
+            this->Send();
+            return;
+        }
+
+        std::shared_ptr<PendingRequest> failed = std::move(this->current);
+        failed->promise.set_exception(std::make_exception_ptr(jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_CONNECTOR, ec.message())));
+
+        this->client.OnConnectionIdle(shared_from_this());
+    }
+
+    void Close()
+    {
+        beast::error_code ignored;
+        this->stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+        this->stream.close();
+        this->buffer.clear();
+        this->isConnected = false;
+    }
+
+public:
+    explicit Connection(AsyncRpcClient &clientIn) : client(clientIn), stream(clientIn.io_context) {}
+
+    void Start(std::shared_ptr<PendingRequest> pending)
+    {
+        this->current = std::move(pending);
+        this->isRetry = false;
+        this->Send();
+    }
+};
+
+AsyncRpcClient::AsyncRpcClient(const std::string &url, const std::string &username, const std::string &password, size_t maxInFlightIn, size_t numIoThreads,
+                               uint64_t maxResponseBytesIn)
+    : maxResponseBytes(maxResponseBytesIn), work(boost::asio::make_work_guard(io_context)), maxInFlight(std::max<size_t>(maxInFlightIn, 1))
+{
+    std::tie(this->host, this->port) = SplitRpcUrl(url);
+    this->authorizationHeader = "Basic " + CustomClient::base64Encode(username + ":" + password);
+
+    boost::asio::ip::tcp::resolver resolver(this->io_context);
+    this->endpoints = resolver.resolve(this->host, this->port);
+
+    for (size_t i = 0; i < this->maxInFlight; ++i)
+    {
+        this->idleConnections.push_back(std::make_shared<Connection>(*this));
+    }
+    this->numConnections = this->maxInFlight;
+
+    for (size_t i = 0; i < std::max<size_t>(numIoThreads, 1); ++i)
+    {
+        this->io_threads.emplace_back([this]
+                                      {
+                                          Tracer::SetThreadName("rpc io");
+                                          this->io_context.run(); });
+    }
+
+    __DEBUG__(("Initialized async RPC client for " + this->host + ":" + this->port + " with " + std::to_string(this->maxInFlight) + " connections").c_str());
+}
+
+AsyncRpcClient::~AsyncRpcClient() noexcept
+{
+    this->work.reset();
+    this->io_context.stop();
+
+    for (std::thread &io_thread : this->io_threads)
+    {
+        if (io_thread.joinable())
+        {
+            io_thread.join();
+        }
+    }
+}
+
+std::future<Json::Value> AsyncRpcClient::CallMethod(const std::string &method, const Json::Value &params)
+{
+    return this->Dispatch(method, params, nullptr, 0);
+}
+
+std::future<Json::Value> AsyncRpcClient::Dispatch(const std::string &method, const Json::Value &params, const char *traceName, uint64_t traceHeight)
+{
+    Json::Value requestJson;
+    requestJson["jsonrpc"] = "1.0";
+    requestJson["id"] = Json::Value::UInt64(this->nextRequestId++);
+    requestJson["method"] = method;
+    requestJson["params"] = params.isNull() ? Json::Value(Json::arrayValue) : params;
+
+    Json::StreamWriterBuilder writerBuilder;
+    writerBuilder["indentation"] = "";
+
+    auto pending = std::make_shared<PendingRequest>();
+    pending->body = Json::writeString(writerBuilder, requestJson);
+    pending->traceName = traceName;
+    pending->traceHeight = traceHeight;
+    std::future<Json::Value> result = pending->promise.get_future();
+
+    std::shared_ptr<Connection> connection;
+    {
+        std::lock_guard<std::mutex> lock(cs_dispatch);
+        if (this->idleConnections.empty())
+        {
+            this->queuedRequests.push_back(std::move(pending));
+            return result;
+        }
+
+        connection = std::move(this->idleConnections.back());
+        this->idleConnections.pop_back();
+    }
+
+    boost::asio::post(this->io_context, [connection, pending]() mutable
+                      { connection->Start(std::move(pending)); });
+
+    return result;
+}
+
+void AsyncRpcClient::OnConnectionIdle(const std::shared_ptr<Connection> &connection)
+{
+    std::shared_ptr<PendingRequest> next;
+    {
+        std::lock_guard<std::mutex> lock(cs_dispatch);
+        if (this->numConnections > this->maxInFlight)
+        {
+            --this->numConnections;
+            return;
+        }
+
+        if (this->queuedRequests.empty())
+        {
+            this->idleConnections.push_back(connection);
+            return;
+        }
+
+        next = std::move(this->queuedRequests.front());
+        this->queuedRequests.pop_front();
+    }
+
+    connection->Start(std::move(next));
+}
+
+std::future<Json::Value> AsyncRpcClient::getblock(const Json::Value &param01, const Json::Value &param02)
+{
+    Json::Value p;
+    p.append(param01);
+    p.append(param02);
+
+    // Blocks are requested by height or by hash, and only a height tags the span
+    uint64_t height{0};
+    if (param01.isIntegral())
+    {
+        height = param01.asUInt64();
+    }
+    else if (param01.isString() && !param01.asString().empty() && param01.asString().size() < 20 &&
+             param01.asString().find_first_not_of("0123456789") == std::string::npos)
+    {
+        height = std::stoull(param01.asString());
+    }
+
+    return this->Dispatch("getblock", p, "download", height);
+}
+
+size_t AsyncRpcClient::GetMaxInFlight() const
+{
+    return this->maxInFlight;
+}
+
+void AsyncRpcClient::SetMaxInFlight(size_t maxInFlightIn)
+{
+    std::vector<std::pair<std::shared_ptr<Connection>, std::shared_ptr<PendingRequest>>> started;
+    {
+        std::lock_guard<std::mutex> lock(cs_dispatch);
+        this->maxInFlight = std::max<size_t>(maxInFlightIn, 1);
+
+        while (this->numConnections < this->maxInFlight)
+        {
+            auto connection = std::make_shared<Connection>(*this);
+            ++this->numConnections;
+
+            if (this->queuedRequests.empty())
+            {
+                this->idleConnections.push_back(std::move(connection));
+                continue;
+            }
+
+            started.emplace_back(std::move(connection), std::move(this->queuedRequests.front()));
+            this->queuedRequests.pop_front();
+        }
+
+        while (this->numConnections > this->maxInFlight && !this->idleConnections.empty())
+        {
+            this->idleConnections.pop_back();
+            --this->numConnections;
+        }
+    }
+
+    for (auto &[connection, pending] : started)
+    {
+        boost::asio::post(this->io_context, [connection = connection, pending = pending]() mutable
+                          { connection->Start(std::move(pending)); });
+    }
+
+    __INFO__(("Async RPC client now keeps up to " + std::to_string(this->maxInFlight.load()) + " requests in flight.").c_str());
+}
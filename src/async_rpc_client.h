@@ -0,0 +1,113 @@
+#ifndef ASYNC_RPC_CLIENT_H
+#define ASYNC_RPC_CLIENT_H
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <jsonrpccpp/common/jsonparser.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * AsyncRpcClient
+ * Non-blocking JSON-RPC client for zcashd. Requests are multiplexed over a fixed set of persistent
+ * keep-alive HTTP connections driven by a Boost.Asio event loop, so a single caller can keep many
+ * requests in flight instead of blocking a thread per request as CustomClient does.
+ *
+ * The number of connections bounds the number of outstanding requests; further calls are queued
+ * and dispatched as connections free up. The bound can be changed while running. Errors are reported through the returned future as
+ * jsonrpc::JsonRpcException, matching the blocking client.
+ */
+class AsyncRpcClient
+{
+private:
+    class Connection;
+
+    struct PendingRequest
+    {
+        std::string body;
+        std::promise<Json::Value> promise;
+
+        // Traced from the time the request is written to the time its response is parsed, if set
+        const char *traceName{nullptr};
+        uint64_t traceHeight{0};
+        std::chrono::steady_clock::time_point writeStart;
+    };
+
+    std::string host;
+    std::string port;
+    std::string authorizationHeader;
+    const uint64_t maxResponseBytes;
+
+    boost::asio::io_context io_context;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    boost::asio::ip::tcp::resolver::results_type endpoints;
+    std::vector<std::thread> io_threads;
+
+    std::mutex cs_dispatch;
+    std::deque<std::shared_ptr<PendingRequest>> queuedRequests;
+    std::vector<std::shared_ptr<Connection>> idleConnections;
+    size_t numConnections{0};
+    std::atomic<size_t> maxInFlight;
+
+    std::atomic<uint64_t> nextRequestId{0};
+
+    /**
+     * @brief Hands the next queued request to a connection that finished its previous one, or parks it as idle.
+     * The connection is closed instead if there are more connections than maxInFlight.
+     */
+    void OnConnectionIdle(const std::shared_ptr<Connection> &connection);
+
+    std::future<Json::Value> Dispatch(const std::string &method, const Json::Value &params, const char *traceName, uint64_t traceHeight);
+
+public:
+    static constexpr uint64_t DEFAULT_MAX_RESPONSE_BYTES = 256 * 1024 * 1024;
+
+    /**
+     * @brief Constructs the client and starts its event loop.
+     *
+     * @param url The RPC endpoint as host:port, http://host:port or a bare port on localhost.
+     * @param username RPC username used for basic authentication.
+     * @param password RPC password used for basic authentication.
+     * @param maxInFlight Number of keep-alive connections, and so the number of outstanding requests.
+     * @param numIoThreads Threads running the event loop.
+     * @param maxResponseBytes Largest response body read. Beast's default of 8 MiB is below a verbose getblock of a full block.
+     */
+    AsyncRpcClient(const std::string &url, const std::string &username, const std::string &password, size_t maxInFlight, size_t numIoThreads,
+                   uint64_t maxResponseBytes = DEFAULT_MAX_RESPONSE_BYTES);
+
+    AsyncRpcClient(const AsyncRpcClient &rhs) = delete;
+    AsyncRpcClient &operator=(const AsyncRpcClient &rhs) = delete;
+
+    ~AsyncRpcClient() noexcept;
+
+    /**
+     * @brief Queues a JSON-RPC call.
+     *
+     * @return A future holding the call's result, or a jsonrpc::JsonRpcException on RPC or transport errors.
+     */
+    std::future<Json::Value> CallMethod(const std::string &method, const Json::Value &params);
+
+    /**
+     * @brief Queues a getblock call, traced as "download" on the event loop thread when tracing is enabled.
+     */
+    std::future<Json::Value> getblock(const Json::Value &param01, const Json::Value &param02);
+
+    size_t GetMaxInFlight() const;
+
+    /**
+     * @brief Opens or closes connections until there are maxInFlight. Busy connections are closed once their request completes.
+     */
+    void SetMaxInFlight(size_t maxInFlight);
+};
+
+#endif // ASYNC_RPC_CLIENT_H
@@ -0,0 +1,176 @@
+#include "chain_monitor.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <sstream>
+
+ChainMonitor::ChainMonitor(Database &databaseIn, const std::string &rpcUrl, const std::string &rpcUsername, const std::string &rpcPassword, const std::string &connection_string,
+                           std::chrono::milliseconds chainInfoIntervalIn, std::chrono::seconds peerInfoIntervalIn, size_t flushSamplesIn)
+    : database(databaseIn), rpcClient(rpcUrl, rpcUsername, rpcPassword), conn(connection_string),
+      chainInfoInterval(std::max(chainInfoIntervalIn, std::chrono::milliseconds(1))), peerInfoInterval(std::max(peerInfoIntervalIn, std::chrono::seconds(1))),
+      flushSamples(std::max<size_t>(1, flushSamplesIn))
+{
+    this->pendingSamples.reserve(this->flushSamples);
+}
+
+ChainMonitor::~ChainMonitor() noexcept
+{
+    this->Stop();
+}
+
+void ChainMonitor::Start()
+{
+    this->worker = std::thread{&ChainMonitor::Run, this};
+}
+
+void ChainMonitor::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_stop);
+        this->isStopping = true;
+    }
+    this->cv_stop.notify_all();
+
+    if (this->worker.joinable())
+    {
+        this->worker.join();
+    }
+}
+
+void ChainMonitor::Run()
+{
+    auto nextSample = std::chrono::steady_clock::now();
+    auto nextPeers = nextSample;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs_stop);
+            if (this->cv_stop.wait_until(lock, std::min(nextSample, nextPeers), [this]()
+                                         { return this->isStopping; }))
+            {
+                break;
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        if (now >= nextSample)
+        {
+            this->SampleChainInfo();
+            nextSample = std::max(nextSample + this->chainInfoInterval, now);
+        }
+
+        if (now >= nextPeers)
+        {
+            this->RefreshPeers();
+            nextPeers = now + this->peerInfoInterval;
+        }
+    }
+
+    this->FlushChainInfo();
+}
+
+void ChainMonitor::SampleChainInfo()
+{
+    try
+    {
+        const auto observedAt = std::chrono::system_clock::now();
+        const Json::Value chain_info = this->rpcClient.getblockchaininfo();
+        if (chain_info.isNull())
+        {
+            return;
+        }
+
+        double orchard_pool_value{0.0};
+        double total_chain_value{0.0};
+        for (const Json::Value &pool : chain_info["valuePools"])
+        {
+            if (pool["id"].asString() == "orchard")
+            {
+                orchard_pool_value = pool["chainValue"].asDouble();
+            }
+
+            total_chain_value += pool["chainValue"].asDouble();
+        }
+
+        this->pendingSamples.push_back(ChainInfoSample{observedAt, chain_info["blocks"].asUInt64(), chain_info["headers"].asUInt64(), chain_info["estimatedheight"].asUInt64(),
+                                                       this->database.GetLatestCommittedHeight(), chain_info["bestblockhash"].asString(), chain_info["size_on_disk"].asDouble(),
+                                                       orchard_pool_value, total_chain_value});
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+
+    if (this->pendingSamples.size() >= this->flushSamples)
+    {
+        this->FlushChainInfo();
+    }
+}
+
+void ChainMonitor::FlushChainInfo()
+{
+    if (this->pendingSamples.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        pqxx::work tx(this->conn);
+
+        std::stringstream query;
+        query << "INSERT INTO chain_info (observed_at, node_height, header_height, best_height, indexed_height, best_block_hash, size_on_disk, orchard_pool_value, total_chain_value) VALUES ";
+        for (size_t i = 0; i < this->pendingSamples.size(); ++i)
+        {
+            const ChainInfoSample &sample = this->pendingSamples[i];
+            const auto observedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(sample.observedAt.time_since_epoch()).count();
+
+            query << (i == 0 ? "(" : ", (")
+                  << "to_timestamp(" << observedAtMs << " / 1000.0), "
+                  << sample.nodeHeight << ", " << sample.headerHeight << ", " << sample.estimatedHeight << ", "
+                  << (sample.indexedHeight ? std::to_string(*sample.indexedHeight) : "NULL") << ", "
+                  << tx.quote(sample.bestBlockHash) << ", " << tx.quote(sample.sizeOnDisk) << ", "
+                  << tx.quote(sample.orchardPoolValue) << ", " << tx.quote(sample.totalChainValue) << ")";
+        }
+
+        tx.exec(query.str());
+        tx.commit();
+    }
+    catch (const std::exception &e)
+    {
+        // Monitoring is best effort, so samples that cannot be written are dropped rather than held
+        __ERROR__(("Unable to store " + std::to_string(this->pendingSamples.size()) + " chain info samples: " + e.what()).c_str());
+    }
+
+    this->pendingSamples.clear();
+}
+
+void ChainMonitor::RefreshPeers()
+{
+    try
+    {
+        const Json::Value peer_info = this->rpcClient.getpeerinfo();
+        if (!peer_info.isArray())
+        {
+            return;
+        }
+
+        pqxx::work tx(this->conn);
+        tx.exec("TRUNCATE TABLE peerinfo");
+
+        for (const Json::Value &peer : peer_info)
+        {
+            tx.exec_params("INSERT INTO peerinfo (addr, lastsend, lastrecv, conntime, subver, synced_blocks) VALUES ($1, $2, $3, $4, $5, $6)",
+                           peer["addr"].asString(), peer["lastsend"].asString(), peer["lastrecv"].asString(), peer["conntime"].asString(),
+                           peer["subver"].asString(), peer["synced_blocks"].asString());
+        }
+
+        tx.commit();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+}
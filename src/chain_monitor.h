@@ -0,0 +1,90 @@
+#ifndef CHAIN_MONITOR_H
+#define CHAIN_MONITOR_H
+
+#include "database.h"
+#include "httpclient.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * ChainMonitor
+ * Samples getblockchaininfo and getpeerinfo on a schedule of its own, independent of ingest. The
+ * monitor has its own RPC client and its own database connection, so a segment download holding the
+ * syncer's client, or ingest holding every pooled connection, never delays a sample.
+ *
+ * Chain info is kept as an append-only time series in chain_info, one row per sample with the node's
+ * height, its header height and the indexed height at that moment, so tip lag can be followed at the
+ * sampling resolution. Samples are buffered and written CHAIN_INFO_FLUSH_SAMPLES at a time. Peers are
+ * a snapshot, replaced in peerinfo on every refresh.
+ *
+ * Both schedules run on one thread. A slow peer refresh delays the next chain info sample, and ticks
+ * missed that way are skipped rather than sampled in a burst.
+ */
+class ChainMonitor
+{
+private:
+    struct ChainInfoSample
+    {
+        std::chrono::system_clock::time_point observedAt;
+        uint64_t nodeHeight;
+        uint64_t headerHeight;
+        uint64_t estimatedHeight;
+        std::optional<uint64_t> indexedHeight;
+        std::string bestBlockHash;
+        double sizeOnDisk;
+        double orchardPoolValue;
+        double totalChainValue;
+    };
+
+    Database &database;
+    CustomClient rpcClient;
+    pqxx::connection conn;
+
+    const std::chrono::milliseconds chainInfoInterval;
+    const std::chrono::seconds peerInfoInterval;
+    const size_t flushSamples;
+
+    std::vector<ChainInfoSample> pendingSamples;
+
+    std::thread worker;
+    std::mutex cs_stop;
+    std::condition_variable cv_stop;
+    bool isStopping{false};
+
+    void Run();
+
+    void SampleChainInfo();
+    void FlushChainInfo();
+    void RefreshPeers();
+
+public:
+    /**
+     * @param connection_string Connection string for the monitor's own connection.
+     * @param chainInfoInterval Time between chain info samples.
+     * @param peerInfoInterval Time between peer snapshots.
+     * @param flushSamples Chain info samples buffered before they are written.
+     */
+    ChainMonitor(Database &database, const std::string &rpcUrl, const std::string &rpcUsername, const std::string &rpcPassword, const std::string &connection_string,
+                 std::chrono::milliseconds chainInfoInterval, std::chrono::seconds peerInfoInterval, size_t flushSamples);
+
+    ChainMonitor(const ChainMonitor &rhs) = delete;
+    ChainMonitor &operator=(const ChainMonitor &rhs) = delete;
+
+    ~ChainMonitor() noexcept;
+
+    void Start();
+
+    /**
+     * @brief Stops sampling and writes the samples still buffered.
+     */
+    void Stop();
+};
+
+#endif // CHAIN_MONITOR_H
@@ -4,7 +4,8 @@
 // Block
 Block::Block() {}
 
-Block::Block(const Json::Value &rawBlock) : nonce(rawBlock["nonce"].asCString()),
+Block::Block(const Json::Value &rawBlock) : block(rawBlock),
+                                            nonce(rawBlock["nonce"].asCString()),
                                             version(rawBlock["version"].asUInt64()),
                                             prev_block_hash(rawBlock["previousblockhash"].asCString()),
                                             next_block_hash(rawBlock["nextblockhash"].asCString()),
@@ -23,6 +24,8 @@ Block::Block(const Json::Value &rawBlock) : nonce(rawBlock["nonce"].asCString())
     {
         throw std::invalid_argument("Invalid JSON value for Block(rawBlock)");
     }
+
+    this->estimated_memory_usage = sizeof(Block) + this->size * RESIDENT_BYTES_PER_SERIALIZED_BYTE;
 }
 
 const Json::Value &Block::GetRawJson() const
@@ -35,12 +38,172 @@ const bool Block::isValid() const
     return !this->block.isNull();
 }
 
+uint64_t Block::GetHeight() const
+{
+    return this->height;
+}
+
+uint64_t Block::GetEstimatedMemoryUsage() const
+{
+    return this->estimated_memory_usage;
+}
+
+const std::string &Block::GetHash() const
+{
+    return this->hash;
+}
+
+
+namespace
+{
+    // Borrows the characters of a JSON string without copying them
+    std::string_view JsonStringView(const Json::Value &value)
+    {
+        const char *begin{nullptr};
+        const char *end{nullptr};
+
+        if (!value.isString() || !value.getString(&begin, &end))
+        {
+            return std::string_view{};
+        }
+
+        return std::string_view(begin, static_cast<size_t>(end - begin));
+    }
+
+    void AppendRow(OrmRows &rows, std::initializer_list<BlockData> values)
+    {
+        // emplace_back hands the rows' arena to the new row instead of building it on the heap
+        rows.emplace_back(values);
+    }
+
+    // 32 byte shielded values are stored as bytea using the hex input format
+    std::string_view ToByteaLiteral(const Json::Value &hexValue, ChunkArena &arena)
+    {
+        std::string_view hex = JsonStringView(hexValue);
+        if (hex.size() != 64 || hex.find_first_not_of("0123456789abcdefABCDEF") != std::string_view::npos)
+        {
+            throw std::invalid_argument("Expected 32 byte hex value, found: " + std::string(hex));
+        }
+
+        char literal[66] = {'\\', 'x'};
+        std::copy(hex.begin(), hex.end(), literal + 2);
+
+        return arena.Intern(std::string_view(literal, sizeof(literal)));
+    }
+
+    const Prevout *FindPrevout(const Outpoint &outpoint, const PrevoutMap &prevouts, const PrevoutMap &block_outputs)
+    {
+        if (auto local = block_outputs.find(outpoint); local != block_outputs.end())
+        {
+            return &local->second;
+        }
+
+        if (auto resolved = prevouts.find(outpoint); resolved != prevouts.end())
+        {
+            return &resolved->second;
+        }
+
+        return nullptr;
+    }
+
+    // Checks each quoted element of a recipient list built by _storeTransparentOutputs
+    bool ListsWatchedAddress(std::string_view recipients, const IndexingRules &rules)
+    {
+        size_t start = recipients.find('"');
+        while (start != std::string_view::npos)
+        {
+            size_t end = recipients.find('"', start + 1);
+            if (end == std::string_view::npos)
+            {
+                break;
+            }
+
+            if (rules.IsWatchedAddress(recipients.substr(start + 1, end - start - 1)))
+            {
+                return true;
+            }
+
+            start = recipients.find('"', end + 1);
+        }
+
+        return false;
+    }
+
+    bool TouchesWatchedAddress(const Json::Value &tx, const IndexingRules &rules, const PrevoutMap &prevouts, const PrevoutMap &block_outputs)
+    {
+        for (const Json::Value &output : tx["vout"])
+        {
+            for (const Json::Value &address : output["scriptPubKey"]["addresses"])
+            {
+                if (rules.IsWatchedAddress(JsonStringView(address)))
+                {
+                    return true;
+                }
+            }
+        }
+
+        for (const Json::Value &input : tx["vin"])
+        {
+            if (input.isMember("coinbase"))
+            {
+                continue;
+            }
+
+            const Prevout *prevout = FindPrevout(Outpoint{JsonStringView(input["txid"]), input["vout"].asUInt()}, prevouts, block_outputs);
+            if (prevout != nullptr && ListsWatchedAddress(prevout->recipients, rules))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+std::vector<Outpoint> Block::GetSpentOutpoints() const
+{
+    std::vector<Outpoint> outpoints;
+    std::unordered_map<std::string_view, bool> earlierTransactions;
+
+    for (const Json::Value &tx : this->transactions)
+    {
+        for (const Json::Value &input : tx["vin"])
+        {
+            if (input.isMember("coinbase"))
+            {
+                continue;
+            }
+
+            std::string_view fundingTxId = JsonStringView(input["txid"]);
+            if (earlierTransactions.count(fundingTxId) == 0)
+            {
+                outpoints.push_back(Outpoint{fundingTxId, input["vout"].asUInt()});
+            }
+        }
+
+        earlierTransactions.emplace(JsonStringView(tx["txid"]), true);
+    }
+
+    return outpoints;
+}
 
-std::map<std::string, std::vector<std::vector<BlockData>>> Block::DataToOrmStorageMap() 
+OrmStorageMap Block::DataToOrmStorageMap(ChunkArena &arena, const PrevoutMap &prevouts, const IndexingRules &rules)
 {
-    std::map<std::string, std::vector<std::vector<BlockData>>> orm_storage_map = {
-        {"block", {}}, {"transaction", {}}, {"transparent_input", {}}, {"transparent_output", {}}
-        };
+    OrmStorageMap orm_storage_map;
+    for (const char *tableName : {"blocks", "transactions", "transparent_inputs", "transparent_outputs", "nullifiers", "note_commitments"})
+    {
+        orm_storage_map.emplace(tableName, OrmRows(arena.Resource()));
+    }
+
+    // Tables excluded by the indexing rules get no rows
+    OrmRows *transaction_values = rules.IsTableEnabled(IndexedTable::Transactions) ? &orm_storage_map.at("transactions") : nullptr;
+    OrmRows *transparent_input_values = rules.IsTableEnabled(IndexedTable::TransparentInputs) ? &orm_storage_map.at("transparent_inputs") : nullptr;
+    OrmRows *transparent_output_values = rules.IsTableEnabled(IndexedTable::TransparentOutputs) ? &orm_storage_map.at("transparent_outputs") : nullptr;
+    OrmRows *nullifier_values = rules.IsTableEnabled(IndexedTable::Nullifiers) ? &orm_storage_map.at("nullifiers") : nullptr;
+    OrmRows *note_commitment_values = rules.IsTableEnabled(IndexedTable::NoteCommitments) ? &orm_storage_map.at("note_commitments") : nullptr;
+
+    // Outputs created earlier in this block, for inputs that spend them within the same block
+    PrevoutMap block_outputs;
 
     try
     {
@@ -48,8 +211,15 @@ std::map<std::string, std::vector<std::vector<BlockData>>> Block::DataToOrmStora
 
         if (this->transactions.isArray() && transactions_size > 0)
         {
+            if (transaction_values != nullptr && rules.IsIndexingEverything())
+            {
+                transaction_values->reserve(transactions_size);
+            }
+
+            // Transactions array -> Database list representation
+            this->transaction_ids_database_representation = "{";
+
             uint64_t currentTransactionIndex{0};
-            bool isCoinbase{false};
 
             for (const Json::Value &tx : this->transactions)
             {
@@ -58,53 +228,52 @@ std::map<std::string, std::vector<std::vector<BlockData>>> Block::DataToOrmStora
                     throw std::runtime_error("Invalid transaction at block height " + std::to_string(this->height) + ".");
                 }
 
-                std::string tx_id = tx["txid"].asString();
+                std::string_view tx_id = JsonStringView(tx["txid"]);
 
-                // Transactions array -> Database list representation
-                std::string transaction_ids_database_representation = "{";
-                transaction_ids_database_representation += "\"" + tx_id + "\"";
+                this->transaction_ids_database_representation += "\"";
+                this->transaction_ids_database_representation += tx_id;
+                this->transaction_ids_database_representation += "\"";
 
                 if (currentTransactionIndex < transactions_size - 1)
                 {
-                    transaction_ids_database_representation += ",";
+                    this->transaction_ids_database_representation += ",";
                 }
 
-                transaction_ids_database_representation += "}";
-
                 // Transaction inputs / outputs
                 this->total_outputs += static_cast<uint64_t>(tx["vout"].size());
                 this->total_inputs += static_cast<uint64_t>(tx["vin"].size());
-                this->total_transparent_output += tx["vout"].asDouble();
-
-                if (tx["vin"].isArray() && tx["vin"].size() == 1 && tx["vin"][0].isMember("coinbase"))
-                {
-                    this->total_transparent_input = 0.0;
-                    isCoinbase = true;
-                }
-                else
-                {
-                    const std::optional<const pqxx::result> database_read_result = Database::ExecuteRead("SELECT * FROM transparent_outputs WHERE tx_id = $1 AND output_index = $2", tx["vin"]["txid"].asString(), static_cast<uint64_t>(tx["vin"]["vout"].asInt()));
-                    if (database_read_result.has_value() && !database_read_result.value().empty())
-                    {
-                        this->total_transparent_input += database_read_result.value()[0]["value"].as<double>();
-                    }
-                }
 
                 double current_total_block_public_input{0.0};
                 double current_total_block_public_output{0.0};
 
-                this->_storeTransparentInputs(tx_id, tx["vin"], current_total_block_public_input, orm_storage_map["transparent_input"]);
-                this->_storeTransparentOutputs(tx_id, tx["vout"], current_total_block_public_output, orm_storage_map["transparent_output"]);
+                // Transactions the rules skip only contribute to the block's totals
+                const bool isIndexed = rules.MatchesTransaction(tx) && (!rules.HasAddressFilter() || TouchesWatchedAddress(tx, rules, prevouts, block_outputs));
+
+                this->_storeTransparentInputs(tx_id, tx["vin"], current_total_block_public_input, isIndexed ? transparent_input_values : nullptr, arena, prevouts, block_outputs);
+                this->_storeTransparentOutputs(tx_id, tx["vout"], current_total_block_public_output, isIndexed ? transparent_output_values : nullptr, arena, block_outputs, rules);
+
+                if (isIndexed)
+                {
+                    this->_storeShieldedData(tx_id, tx, nullifier_values, note_commitment_values, arena);
+                }
 
                 this->total_transparent_input += current_total_block_public_input;
                 this->total_transparent_output += current_total_block_public_output;
 
-                orm_storage_map["transaction"].push_back({tx_id, std::to_string(tx.size()), tx["overwintered"].asCString(), tx["version"].asCString(), std::to_string(current_total_block_public_input), std::to_string(current_total_block_public_output), tx["hex"].asCString(), this->hash, this->timestamp, this->height, tx["vin"].size(), static_cast<uint64_t>(tx["vout"].size())});
+                if (!isIndexed || transaction_values == nullptr)
+                {
+                    ++currentTransactionIndex;
+                    continue;
+                }
+
+                AppendRow(*transaction_values, {tx_id, tx["size"].asUInt64(), std::string_view(tx["overwintered"].asBool() ? "true" : "false"), tx["version"].asUInt64(), arena.Intern(std::to_string(current_total_block_public_input)), arena.Intern(std::to_string(current_total_block_public_output)), JsonStringView(tx["hex"]), arena.Intern(this->hash), this->timestamp, this->height, static_cast<uint64_t>(tx["vin"].size()), static_cast<uint64_t>(tx["vout"].size())});
                 ++currentTransactionIndex;
             }
+
+            this->transaction_ids_database_representation += "}";
         }
 
-        orm_storage_map["block"].push_back({this->hash, this->height, this->timestamp, this->nonce, this->size, this->num_transactions, this->total_transparent_output, this->difficulty, this->chainwork, this->merkle_root, this->version, this->bits, this->transaction_ids_database_representation.c_str(), this->total_outputs, this->total_inputs, this->total_transparent_input, ""});
+        AppendRow(orm_storage_map.at("blocks"), {arena.Intern(this->hash), this->height, this->timestamp, arena.Intern(this->nonce), this->size, this->num_transactions, this->total_transparent_output, this->difficulty, arena.Intern(this->chainwork), arena.Intern(this->merkle_root), this->version, arena.Intern(this->bits), arena.Intern(this->transaction_ids_database_representation), this->total_outputs, this->total_inputs, this->total_transparent_input, std::string_view{}});
     }
     catch (const std::exception &e)
     {
@@ -115,67 +284,60 @@ std::map<std::string, std::vector<std::vector<BlockData>>> Block::DataToOrmStora
     return orm_storage_map;
 }
 
-void Block::_storeTransparentInputs(const std::string &tx_id, const Json::Value &inputs, double &total_transparent_input, std::vector<std::vector<BlockData>> &transparent_transaction_inputs_values)
+void Block::_storeTransparentInputs(std::string_view tx_id, const Json::Value &inputs, double &total_transparent_input, OrmRows *transparent_transaction_inputs_values, ChunkArena &arena, const PrevoutMap &prevouts, const PrevoutMap &block_outputs)
 {
 
     if (inputs.size() > 0)
     {
 
-        std::string vin_tx_id;
+        std::string_view vin_tx_id;
         uint32_t v_out_idx;
-        std::string coinbase{""};
-        std::string senders{"{}"};
+        std::string_view coinbase;
+        std::string_view senders{"{}"};
 
         double current_input_value{0.0};
+        uint64_t input_index{0};
 
         for (const Json::Value &input : inputs)
         {
             try
             {
+                senders = "{}";
+                current_input_value = 0.0;
+
                 if (input.isMember("coinbase"))
                 {
-                    coinbase = input["coinbase"].asString();
+                    coinbase = JsonStringView(input["coinbase"]);
                     vin_tx_id = "-1";
                     v_out_idx = 0; // Represent v_out_idx for coinbase transactions with alternative value.
-                    senders = "{}";
                 }
                 else
                 {
-                    coinbase = "";
-                    vin_tx_id = input["txid"].asString();
-                    v_out_idx = input["vout"].asInt();
+                    coinbase = std::string_view{};
+                    vin_tx_id = JsonStringView(input["txid"]);
+                    v_out_idx = input["vout"].asUInt();
 
-                    // Find the vout referenced in this vin to get the value and add to the total public input
-                    const std::optional<const pqxx::result> database_read_result = Database::ExecuteRead("SELECT * FROM transparent_outputs WHERE tx_id = $1 AND output_index = $2", input["txid"].asString(), static_cast<uint64_t>(input["vout"].asInt()));
-                    if (database_read_result.has_value())
+                    // The vout referenced in this vin gives the value and senders of the input
+                    const Prevout *prevout = FindPrevout(Outpoint{vin_tx_id, v_out_idx}, prevouts, block_outputs);
+                    if (prevout != nullptr)
                     {
-                        pqxx::result db_read_result = database_read_result.value();
-                        if (!db_read_result.empty())
+                        current_input_value = prevout->value;
+                        if (transparent_transaction_inputs_values != nullptr)
                         {
-                            pqxx::row output_specified_in_vin = db_read_result[0];
-                            current_input_value = output_specified_in_vin["value"].as<double>();
-                            senders = output_specified_in_vin["recipients"].as<std::string>();
+                            senders = arena.Intern(prevout->recipients);
                         }
                     }
-                    else
-                    {
-                        senders = "{}";
-                        current_input_value = 0.0;
-                    }
 
                     total_transparent_input += current_input_value;
                 }
 
-                senders = "{}";
-                current_input_value = 0.0;
-
+                if (transparent_transaction_inputs_values == nullptr)
+                {
+                    ++input_index;
+                    continue;
+                }
 
-                transparent_transaction_inputs_values.push_back({tx_id, vin_tx_id, v_out_idx, current_input_value, senders, coinbase});
-            }
-            catch (const pqxx::sql_error &e)
-            {
-                __ERROR__(e.what());
-                throw;
+                AppendRow(*transparent_transaction_inputs_values, {tx_id, vin_tx_id, static_cast<uint64_t>(v_out_idx), current_input_value, senders, coinbase, input_index++});
             }
             catch (const std::exception &e)
             {
@@ -186,7 +348,7 @@ void Block::_storeTransparentInputs(const std::string &tx_id, const Json::Value
     }
 }
 
-void Block::_storeTransparentOutputs(const std::string &tx_id, const Json::Value &outputs, double &total_public_output, std::vector<std::vector<BlockData>> &transparent_transaction_output_values)
+void Block::_storeTransparentOutputs(std::string_view tx_id, const Json::Value &outputs, double &total_public_output, OrmRows *transparent_transaction_output_values, ChunkArena &arena, PrevoutMap &block_outputs, const IndexingRules &rules)
 {
 
     double currentOutputValue{0.0};
@@ -195,7 +357,7 @@ void Block::_storeTransparentOutputs(const std::string &tx_id, const Json::Value
     if (outputs.size() > 0)
     {
         size_t outputIndex{0};
-        std::vector<std::string> recipients;
+        // Reused for every output so building the list never allocates once it has grown
         std::string recipientList;
         for (const Json::Value &vOutEntry : outputs)
         {
@@ -206,30 +368,31 @@ void Block::_storeTransparentOutputs(const std::string &tx_id, const Json::Value
                 total_public_output += currentOutputValue;
 
                 // Stringify recipient list for addresses in vout
-                Json::Value vOutAddresses = vOutEntry["scriptPubKey"]["addresses"];
+                const Json::Value &vOutAddresses = vOutEntry["scriptPubKey"]["addresses"];
                 recipientList = "{";
                 if (vOutAddresses.isArray() && vOutAddresses.size() > 0)
                 {
                     for (const Json::Value &vOutAddress : vOutAddresses)
                     {
-                        recipients.push_back(vOutAddress.asString());
-                    }
-
-                    if (!recipients.empty())
-                    {
-                        recipientList += "\"" + recipients[0] + "\"";
-                        for (size_t i = 1; i < recipients.size(); ++i)
+                        if (recipientList.size() > 1)
                         {
-                            recipientList += ",\"" + recipients[i] + "\"";
+                            recipientList += ",";
                         }
+
+                        recipientList += "\"";
+                        recipientList += JsonStringView(vOutAddress);
+                        recipientList += "\"";
                     }
                 }
                 recipientList += "}";
 
-                transparent_transaction_output_values.push_back({tx_id, outputIndex, recipientList, currentOutputValue});
+                if (transparent_transaction_output_values != nullptr && rules.MatchesOutput(vOutEntry))
+                {
+                    AppendRow(*transparent_transaction_output_values, {tx_id, static_cast<uint64_t>(outputIndex), arena.Intern(recipientList), currentOutputValue});
+                }
 
-                recipients.clear();
-                recipientList.clear();
+                // Kept even when the output is not stored, so later inputs of this block are still valued
+                block_outputs.emplace(Outpoint{tx_id, static_cast<uint32_t>(outputIndex)}, Prevout{currentOutputValue, recipientList});
             }
             catch (const pqxx::sql_error &e)
             {
@@ -243,4 +406,69 @@ void Block::_storeTransparentOutputs(const std::string &tx_id, const Json::Value
             }
         }
     }
-}
\ No newline at end of file
+}
+
+void Block::_storeShieldedData(std::string_view tx_id, const Json::Value &tx, OrmRows *nullifier_values, OrmRows *note_commitment_values, ChunkArena &arena)
+{
+    if (nullifier_values == nullptr && note_commitment_values == nullptr)
+    {
+        return;
+    }
+
+    const uint16_t sprout = static_cast<uint16_t>(ShieldedPool::Sprout);
+    const uint16_t sapling = static_cast<uint16_t>(ShieldedPool::Sapling);
+    const uint16_t orchard = static_cast<uint16_t>(ShieldedPool::Orchard);
+
+    // Sprout joinsplits reveal two nullifiers and create two commitments each
+    uint64_t sproutOutputIndex{0};
+    for (const Json::Value &joinSplit : tx["vjoinsplit"])
+    {
+        for (const Json::Value &nullifier : joinSplit["nullifiers"])
+        {
+            if (nullifier_values != nullptr)
+            {
+                AppendRow(*nullifier_values, {ToByteaLiteral(nullifier, arena), sprout, tx_id, this->height});
+            }
+        }
+
+        for (const Json::Value &commitment : joinSplit["commitments"])
+        {
+            if (note_commitment_values != nullptr)
+            {
+                AppendRow(*note_commitment_values, {ToByteaLiteral(commitment, arena), sprout, tx_id, sproutOutputIndex++, this->height});
+            }
+        }
+    }
+
+    for (const Json::Value &spend : tx["vShieldedSpend"])
+    {
+        if (nullifier_values != nullptr)
+        {
+            AppendRow(*nullifier_values, {ToByteaLiteral(spend["nullifier"], arena), sapling, tx_id, this->height});
+        }
+    }
+
+    uint64_t saplingOutputIndex{0};
+    for (const Json::Value &output : tx["vShieldedOutput"])
+    {
+        if (note_commitment_values != nullptr)
+        {
+            AppendRow(*note_commitment_values, {ToByteaLiteral(output["cmu"], arena), sapling, tx_id, saplingOutputIndex++, this->height});
+        }
+    }
+
+    // Every Orchard action both spends and creates a note
+    uint64_t orchardActionIndex{0};
+    for (const Json::Value &action : tx["orchard"]["actions"])
+    {
+        if (nullifier_values != nullptr)
+        {
+            AppendRow(*nullifier_values, {ToByteaLiteral(action["nullifier"], arena), orchard, tx_id, this->height});
+        }
+
+        if (note_commitment_values != nullptr)
+        {
+            AppendRow(*note_commitment_values, {ToByteaLiteral(action["cmx"], arena), orchard, tx_id, orchardActionIndex++, this->height});
+        }
+    }
+}
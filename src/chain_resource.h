@@ -4,7 +4,13 @@
 #include <pqxx/pqxx>
 #include <variant>
 #include <memory>
+#include <map>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
 #include "logger.h"
+#include "chunk_arena.h"
+#include "indexing_rules.h"
 
 #ifndef CHAIN_RESOURCE
 #define CHAIN_RESOURCE
@@ -12,17 +18,67 @@
 class Block;
 class Database;
 
-using BlockData = std::variant<std::string, uint16_t, uint64_t, double>; 
+/**
+ * A single column value. Strings are views into the block's JSON or into the ChunkArena the row was
+ * built on, so rows must be written before the block is released and the arena is reset.
+ */
+using BlockData = std::variant<std::string_view, uint16_t, uint64_t, double>;
+using OrmRow = std::pmr::vector<BlockData>;
+using OrmRows = std::pmr::vector<OrmRow>;
+using OrmStorageMap = std::map<std::string, OrmRows>;
+
+/**
+ * Shielded value pools whose nullifiers and note commitments are indexed.
+ */
+enum class ShieldedPool : uint16_t
+{
+    Sprout = 0,
+    Sapling = 1,
+    Orchard = 2
+};
+
+/**
+ * A transparent output referenced by an input. The txid is a view into the spending block's JSON.
+ */
+struct Outpoint
+{
+    std::string_view txId;
+    uint32_t vout;
+
+    bool operator==(const Outpoint &rhs) const { return this->vout == rhs.vout && this->txId == rhs.txId; }
+};
+
+struct OutpointHash
+{
+    size_t operator()(const Outpoint &outpoint) const
+    {
+        return std::hash<std::string_view>()(outpoint.txId) ^ (static_cast<size_t>(outpoint.vout) * 0x9e3779b97f4a7c15ULL);
+    }
+};
+
+/**
+ * Value and recipients of the output an input spends.
+ */
+struct Prevout
+{
+    double value{0.0};
+    std::string recipients{"{}"};
+};
+
+using PrevoutMap = std::unordered_map<Outpoint, Prevout, OutpointHash>;
 
 class Storeable
 {
 public:
-    virtual std::map<std::string, std::vector<std::vector<BlockData>>> DataToOrmStorageMap() = 0;
+    virtual OrmStorageMap DataToOrmStorageMap(ChunkArena &arena, const PrevoutMap &prevouts, const IndexingRules &rules) = 0;
 };
 
 class Block : public Storeable
 {
 private:
+    // Decoded verbose JSON (hex, scripts and node overhead) is roughly an order of magnitude larger than the raw block
+    static constexpr uint64_t RESIDENT_BYTES_PER_SERIALIZED_BYTE = 12;
+
     Json::Value block{Json::nullValue};
     std::string nonce{""};
     uint16_t version;
@@ -38,6 +94,7 @@ private:
     std::string chainwork{""};
     std::string bits{""};
     uint64_t num_transactions{0};
+    uint64_t estimated_memory_usage{0};
 
     double total_transparent_output{0.0};
     std::string transaction_ids_database_representation{""};
@@ -58,11 +115,51 @@ public:
 
     const bool isValid() const;
     const Json::Value &GetRawJson() const;
+    uint64_t GetHeight() const;
+
+    /**
+     * @brief Estimated bytes held by the decoded block, derived from its serialized size.
+     */
+    uint64_t GetEstimatedMemoryUsage() const;
+    const std::string &GetHash() const;
+
+    /**
+     * @brief Returns the outputs spent by this block that were created in earlier blocks.
+     *
+     * Outputs created and spent within the block are resolved from the block itself and are not included.
+     */
+    std::vector<Outpoint> GetSpentOutpoints() const;
+
+    /**
+     * @brief Builds the rows for every table populated from this block.
+     *
+     * All rows are allocated on the arena and may reference the block's JSON, so both the arena and
+     * the block must outlive the returned map.
+     *
+     * @param prevouts The outputs returned by GetSpentOutpoints(), resolved by the caller. Inputs whose
+     *                 output is not found are stored with no value and no senders.
+     * @param rules Decides which transactions and outputs get rows. Skipped data is never copied to the
+     *              arena, though it still counts towards the block's totals.
+     */
+    OrmStorageMap DataToOrmStorageMap(ChunkArena &arena, const PrevoutMap &prevouts, const IndexingRules &rules) override;
+
+    /**
+     * Rows are appended to the given table, or only the totals are computed if it is null.
+     */
+    void _storeTransparentInputs(std::string_view tx_id, const Json::Value &inputs, double &total_transparent_input, OrmRows *transparent_transaction_input_values, ChunkArena &arena, const PrevoutMap &prevouts, const PrevoutMap &block_outputs);
 
-    std::map<std::string, std::vector<std::vector<BlockData>>> DataToOrmStorageMap() override;
+    /**
+     * Every output is added to block_outputs. Outputs matching the rules are also stored if the table is not null.
+     */
+    void _storeTransparentOutputs(std::string_view tx_id, const Json::Value &outputs, double &total_public_output, OrmRows *transparent_transaction_output_values, ChunkArena &arena, PrevoutMap &block_outputs, const IndexingRules &rules);
 
-    void _storeTransparentInputs(const std::string &tx_id, const Json::Value &inputs, double &total_transparent_input, std::vector<std::vector<BlockData>> &transparent_transaction_input_values);
-    void _storeTransparentOutputs(const std::string &tx_id, const Json::Value &outputs, double &total_public_output, std::vector<std::vector<BlockData>> &transparent_transaction_output_values);
+    /**
+     * @brief Collects the nullifiers revealed and note commitments created by a transaction.
+     *
+     * Covers Sprout joinsplits, Sapling spends/outputs and Orchard actions. Values are stored as
+     * 32 byte bytea literals in the byte order zcashd reports them.
+     */
+    void _storeShieldedData(std::string_view tx_id, const Json::Value &tx, OrmRows *nullifier_values, OrmRows *note_commitment_values, ChunkArena &arena);
     void ProcessBlockToStoreable(pqxx::work &blockTransaction, std::unique_ptr<pqxx::connection> &conn);
 };
 
@@ -0,0 +1,124 @@
+#include "chunk_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr size_t ChunkArena::INITIAL_BUFFER_BYTES;
+constexpr size_t ChunkArena::MAX_RETAINED_BUFFER_BYTES;
+
+void *ChunkArena::CountingResource::do_allocate(size_t numBytes, size_t alignment)
+{
+    void *pointer = this->upstream->allocate(numBytes, alignment);
+    ++this->allocations;
+    this->bytes += numBytes;
+    this->outstandingBytes += numBytes;
+
+    return pointer;
+}
+
+void ChunkArena::CountingResource::do_deallocate(void *pointer, size_t numBytes, size_t alignment)
+{
+    this->upstream->deallocate(pointer, numBytes, alignment);
+    this->outstandingBytes -= std::min<uint64_t>(numBytes, this->outstandingBytes);
+}
+
+bool ChunkArena::CountingResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+ChunkArena::ChunkArena() : retainedBuffer(INITIAL_BUFFER_BYTES)
+{
+    this->ResetMonotonic();
+}
+
+ChunkArena::ChunkArena(std::pmr::memory_resource *upstream) : isPassthrough(true), heap(upstream)
+{
+    this->served.SetUpstream(&this->heap);
+}
+
+void ChunkArena::ResetMonotonic()
+{
+    this->monotonic.reset();
+    this->monotonic.emplace(this->retainedBuffer.data(), this->retainedBuffer.size(), &this->heap);
+    this->served.SetUpstream(&*this->monotonic);
+}
+
+std::pmr::memory_resource *ChunkArena::Resource()
+{
+    return &this->served;
+}
+
+std::string_view ChunkArena::Intern(std::string_view value)
+{
+    if (value.empty())
+    {
+        return std::string_view{};
+    }
+
+    char *copy = static_cast<char *>(this->served.allocate(value.size(), alignof(char)));
+    std::memcpy(copy, value.data(), value.size());
+
+    if (this->isPassthrough)
+    {
+        this->passthroughInterned.emplace_back(copy, value.size());
+    }
+
+    return std::string_view(copy, value.size());
+}
+
+void ChunkArena::Release()
+{
+    for (const std::string_view &value : this->passthroughInterned)
+    {
+        this->served.deallocate(const_cast<char *>(value.data()), value.size(), alignof(char));
+    }
+    this->passthroughInterned.clear();
+
+    this->totals.arenaAllocations += this->served.allocations;
+    this->totals.arenaBytes += this->served.bytes;
+    this->totals.heapAllocations += this->heap.allocations;
+    this->totals.heapBytes += this->heap.bytes;
+
+    // Grow the retained buffer to cover what this block needed so the next one fits without the heap
+    uint64_t overflowBytes = this->heap.outstandingBytes;
+    this->served.allocations = this->served.bytes = this->served.outstandingBytes = 0;
+    this->heap.allocations = this->heap.bytes = 0;
+
+    // Rows free their own allocations as they are destroyed, there is no buffer to keep
+    if (this->isPassthrough)
+    {
+        return;
+    }
+
+    if (overflowBytes > 0 && this->retainedBuffer.size() < MAX_RETAINED_BUFFER_BYTES)
+    {
+        size_t grownSize = std::min<uint64_t>(this->retainedBuffer.size() + overflowBytes, MAX_RETAINED_BUFFER_BYTES);
+
+        this->monotonic.reset();
+        this->retainedBuffer = std::vector<std::byte>(grownSize);
+        this->ResetMonotonic();
+    }
+    else
+    {
+        this->monotonic->release();
+    }
+
+    this->heap.outstandingBytes = 0;
+}
+
+uint64_t ChunkArena::GetReservedBytes() const
+{
+    return this->retainedBuffer.size() + this->heap.outstandingBytes;
+}
+
+ChunkArena::Stats ChunkArena::GetStats() const
+{
+    Stats stats = this->totals;
+    stats.arenaAllocations += this->served.allocations;
+    stats.arenaBytes += this->served.bytes;
+    stats.heapAllocations += this->heap.allocations;
+    stats.heapBytes += this->heap.bytes;
+
+    return stats;
+}
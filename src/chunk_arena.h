@@ -0,0 +1,113 @@
+#ifndef CHUNK_ARENA_H
+#define CHUNK_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * ChunkArena
+ * Monotonic arena backing the rows built for a block. Every row vector and every string copied into
+ * a row is carved out of the arena and the whole lot is released in one step once the block has been
+ * committed, instead of being freed object by object.
+ *
+ * After a release the arena keeps a buffer as large as the biggest block seen so far (up to a cap),
+ * so steady state ingest makes no heap allocations for row building at all.
+ */
+class ChunkArena
+{
+public:
+    struct Stats
+    {
+        // Allocations served by the arena (each would otherwise have been a heap allocation)
+        uint64_t arenaAllocations{0};
+        uint64_t arenaBytes{0};
+        // Heap allocations the arena itself made to grow
+        uint64_t heapAllocations{0};
+        uint64_t heapBytes{0};
+    };
+
+private:
+    static constexpr size_t INITIAL_BUFFER_BYTES = 64 * 1024;
+    static constexpr size_t MAX_RETAINED_BUFFER_BYTES = 64 * 1024 * 1024;
+
+    /**
+     * Forwards to another resource and counts what passes through.
+     */
+    class CountingResource : public std::pmr::memory_resource
+    {
+    private:
+        std::pmr::memory_resource *upstream;
+
+    public:
+        uint64_t allocations{0};
+        uint64_t bytes{0};
+        uint64_t outstandingBytes{0};
+
+        explicit CountingResource(std::pmr::memory_resource *upstreamIn) : upstream(upstreamIn) {}
+        void SetUpstream(std::pmr::memory_resource *upstreamIn) { this->upstream = upstreamIn; }
+
+    protected:
+        void *do_allocate(size_t numBytes, size_t alignment) override;
+        void do_deallocate(void *pointer, size_t numBytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+    };
+
+    // Set when every allocation goes straight to the upstream resource, see ChunkArena(upstream)
+    const bool isPassthrough{false};
+
+    CountingResource heap{std::pmr::new_delete_resource()};
+    std::vector<std::byte> retainedBuffer;
+    std::optional<std::pmr::monotonic_buffer_resource> monotonic;
+    CountingResource served{std::pmr::null_memory_resource()};
+
+    Stats totals;
+
+    // Strings interned by a passthrough arena, freed one by one at Release()
+    std::vector<std::string_view> passthroughInterned;
+
+    void ResetMonotonic();
+
+public:
+    ChunkArena();
+
+    /**
+     * @brief An arena that retains no buffer and forwards every allocation to upstream, so each row and
+     * string is an allocation of its own as it was before rows were built on an arena. For measuring
+     * what the arena saves.
+     */
+    explicit ChunkArena(std::pmr::memory_resource *upstream);
+
+    ChunkArena(const ChunkArena &rhs) = delete;
+    ChunkArena &operator=(const ChunkArena &rhs) = delete;
+
+    std::pmr::memory_resource *Resource();
+
+    /**
+     * @brief Copies a string into the arena. The view stays valid until the next Release().
+     */
+    std::string_view Intern(std::string_view value);
+
+    /**
+     * @brief Frees everything allocated since the last release in one step.
+     *
+     * Nothing built on the arena may be used afterwards.
+     */
+    void Release();
+
+    /**
+     * @brief Bytes the arena currently holds, including its retained buffer.
+     */
+    uint64_t GetReservedBytes() const;
+
+    /**
+     * @brief Allocation counts accumulated over every release so far.
+     */
+    Stats GetStats() const;
+};
+
+#endif // CHUNK_ARENA_H
@@ -0,0 +1,172 @@
+#include "chunk_planner.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <sstream>
+
+constexpr double ChunkPlanner::TRANSACTION_COST_IN_BYTES;
+constexpr double ChunkPlanner::MIN_SEGMENT_COST;
+constexpr double ChunkPlanner::THROUGHPUT_SMOOTHING;
+constexpr size_t ChunkPlanner::PLAN_HISTORY_SIZE;
+
+ChunkPlanner::ChunkPlanner(CostProbe probeIn, size_t maxBlocksPerSegmentIn, uint64_t initialSegmentBytes, double targetSegmentSecondsIn, uint64_t probeStrideIn)
+    : probe(std::move(probeIn)),
+      maxBlocksPerSegment(std::max<size_t>(maxBlocksPerSegmentIn, 1)),
+      targetSegmentSeconds(targetSegmentSecondsIn),
+      probeStride(std::max<uint64_t>(probeStrideIn, 1)),
+      segmentCostBudget(std::max(static_cast<double>(initialSegmentBytes), MIN_SEGMENT_COST)),
+      maxSegmentCost(std::max(static_cast<double>(initialSegmentBytes), MIN_SEGMENT_COST) * 8)
+{
+}
+
+double ChunkPlanner::CostOf(const BlockCost &cost)
+{
+    return static_cast<double>(cost.bytes) + static_cast<double>(cost.numTransactions) * TRANSACTION_COST_IN_BYTES;
+}
+
+ChunkPlanner::BlockCost ChunkPlanner::EstimateBlockCost(uint64_t height)
+{
+    // Neighbouring blocks have similar cost, so only one height per stride is probed
+    uint64_t probeHeight = height - (height % this->probeStride);
+
+    auto probed = this->probedCosts.find(probeHeight);
+    if (probed != this->probedCosts.end())
+    {
+        return probed->second;
+    }
+
+    BlockCost cost = this->probe(probeHeight);
+    this->probedCosts.emplace(probeHeight, cost);
+
+    return cost;
+}
+
+ChunkPlanner::Segment ChunkPlanner::PlanNextSegment(uint64_t startHeight, uint64_t rangeEnd)
+{
+    std::lock_guard<std::mutex> lock(cs_planner);
+
+    Segment segment;
+    segment.startHeight = startHeight;
+    segment.endHeight = startHeight;
+
+    uint64_t height = startHeight;
+    while (height <= rangeEnd && height - startHeight < this->maxBlocksPerSegment)
+    {
+        BlockCost cost = this->EstimateBlockCost(height);
+        double blockCost = CostOf(cost);
+
+        if (height > startHeight && segment.estimatedCost + blockCost > this->segmentCostBudget)
+        {
+            break;
+        }
+
+        segment.endHeight = height;
+        segment.estimatedBytes += cost.bytes;
+        segment.estimatedTransactions += cost.numTransactions;
+        segment.estimatedCost += blockCost;
+        ++height;
+    }
+
+    // Probes behind the planned segment are never needed again
+    this->probedCosts.erase(this->probedCosts.begin(), this->probedCosts.lower_bound(segment.endHeight - (segment.endHeight % this->probeStride)));
+
+    this->plan.push_back(segment);
+    if (this->plan.size() > PLAN_HISTORY_SIZE)
+    {
+        this->plan.pop_front();
+    }
+
+    __DEBUG__(("Planned " + this->DescribeSegment(segment)).c_str());
+
+    return segment;
+}
+
+ChunkPlanner::Segment ChunkPlanner::TruncateSegment(const Segment &segment, uint64_t newEndHeight)
+{
+    std::lock_guard<std::mutex> lock(cs_planner);
+
+    Segment truncated = segment;
+    double keptFraction = static_cast<double>(newEndHeight - segment.startHeight + 1) / static_cast<double>(segment.endHeight - segment.startHeight + 1);
+
+    truncated.endHeight = newEndHeight;
+    truncated.estimatedBytes = static_cast<uint64_t>(segment.estimatedBytes * keptFraction);
+    truncated.estimatedTransactions = static_cast<uint64_t>(segment.estimatedTransactions * keptFraction);
+    truncated.estimatedCost = segment.estimatedCost * keptFraction;
+
+    for (auto &planned : this->plan)
+    {
+        if (planned.startHeight == segment.startHeight && planned.endHeight == segment.endHeight)
+        {
+            planned = truncated;
+        }
+    }
+
+    return truncated;
+}
+
+void ChunkPlanner::RecordSegmentCompleted(const Segment &segment, std::chrono::duration<double> elapsed)
+{
+    std::lock_guard<std::mutex> lock(cs_planner);
+
+    double seconds = std::max(elapsed.count(), 1e-3);
+    double costPerSecond = segment.estimatedCost / seconds;
+
+    this->observedCostPerSecond = this->observedCostPerSecond == 0.0
+                                      ? costPerSecond
+                                      : THROUGHPUT_SMOOTHING * costPerSecond + (1.0 - THROUGHPUT_SMOOTHING) * this->observedCostPerSecond;
+
+    this->segmentCostBudget = std::clamp(this->observedCostPerSecond * this->targetSegmentSeconds, MIN_SEGMENT_COST, this->maxSegmentCost);
+
+    for (auto &planned : this->plan)
+    {
+        if (planned.startHeight == segment.startHeight && planned.endHeight == segment.endHeight)
+        {
+            planned.observedSeconds = seconds;
+        }
+    }
+
+    __DEBUG__(("Completed segment " + std::to_string(segment.startHeight) + "-" + std::to_string(segment.endHeight) +
+               " in " + std::to_string(seconds) + "s. Segment cost budget is now " + std::to_string(static_cast<uint64_t>(this->segmentCostBudget)))
+                  .c_str());
+}
+
+std::vector<ChunkPlanner::Segment> ChunkPlanner::GetPlan() const
+{
+    std::lock_guard<std::mutex> lock(cs_planner);
+    return std::vector<Segment>(this->plan.begin(), this->plan.end());
+}
+
+void ChunkPlanner::SetMaxBlocksPerSegment(size_t maxBlocksPerSegmentIn)
+{
+    std::lock_guard<std::mutex> lock(cs_planner);
+    this->maxBlocksPerSegment = std::max<size_t>(maxBlocksPerSegmentIn, 1);
+}
+
+double ChunkPlanner::GetSegmentCostBudget() const
+{
+    std::lock_guard<std::mutex> lock(cs_planner);
+    return this->segmentCostBudget;
+}
+
+double ChunkPlanner::GetObservedCostPerSecond() const
+{
+    std::lock_guard<std::mutex> lock(cs_planner);
+    return this->observedCostPerSecond;
+}
+
+std::string ChunkPlanner::DescribeSegment(const Segment &segment) const
+{
+    std::stringstream description;
+    description << "segment " << segment.startHeight << "-" << segment.endHeight
+                << " blocks=" << (segment.endHeight - segment.startHeight + 1)
+                << " est_bytes=" << segment.estimatedBytes
+                << " est_txs=" << segment.estimatedTransactions
+                << " est_cost=" << static_cast<uint64_t>(segment.estimatedCost);
+
+    if (segment.observedSeconds >= 0.0)
+    {
+        description << " observed_s=" << segment.observedSeconds;
+    }
+
+    return description.str();
+}
@@ -0,0 +1,114 @@
+#ifndef CHUNK_PLANNER_H
+#define CHUNK_PLANNER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * ChunkPlanner
+ * Cuts a block range into segments of roughly equal processing cost instead of equal height. Early
+ * blocks are nearly empty while recent blocks can carry thousands of transactions, so a fixed block
+ * count leaves workers badly imbalanced.
+ *
+ * Block cost is estimated from a cheap size probe (block size and transaction count without the
+ * decoded transactions). The cost budget of a segment adapts to the throughput workers actually
+ * achieve so that each segment takes roughly the target amount of worker time.
+ */
+class ChunkPlanner
+{
+public:
+    struct BlockCost
+    {
+        uint64_t bytes{0};
+        uint64_t numTransactions{0};
+    };
+
+    struct Segment
+    {
+        uint64_t startHeight{0};
+        uint64_t endHeight{0};
+        uint64_t estimatedBytes{0};
+        uint64_t estimatedTransactions{0};
+        double estimatedCost{0.0};
+        double observedSeconds{-1.0};
+    };
+
+    using CostProbe = std::function<BlockCost(uint64_t height)>;
+
+private:
+    // Fixed per transaction overhead (prevout resolution, row building) expressed in bytes
+    static constexpr double TRANSACTION_COST_IN_BYTES = 2048.0;
+    static constexpr double MIN_SEGMENT_COST = 1024.0 * 1024.0;
+    static constexpr double THROUGHPUT_SMOOTHING = 0.3;
+    static constexpr size_t PLAN_HISTORY_SIZE = 256;
+
+    CostProbe probe;
+    size_t maxBlocksPerSegment;
+    double targetSegmentSeconds;
+    uint64_t probeStride;
+
+    mutable std::mutex cs_planner;
+    double segmentCostBudget;
+    double maxSegmentCost;
+    double observedCostPerSecond{0.0};
+    std::map<uint64_t, BlockCost> probedCosts;
+    std::deque<Segment> plan;
+
+    BlockCost EstimateBlockCost(uint64_t height);
+    static double CostOf(const BlockCost &cost);
+
+public:
+    /**
+     * @brief Constructs a planner.
+     *
+     * @param probe Returns the size and transaction count of the block at a height.
+     * @param maxBlocksPerSegment Upper bound on blocks in one segment regardless of cost.
+     * @param initialSegmentBytes Cost budget of a segment before any throughput has been observed.
+     * @param targetSegmentSeconds Worker time each segment should take once throughput is known.
+     * @param probeStride Only every probeStride-th height is probed; the heights in between reuse its cost.
+     */
+    ChunkPlanner(CostProbe probe, size_t maxBlocksPerSegment, uint64_t initialSegmentBytes, double targetSegmentSeconds, uint64_t probeStride);
+
+    ChunkPlanner(const ChunkPlanner &rhs) = delete;
+    ChunkPlanner &operator=(const ChunkPlanner &rhs) = delete;
+
+    /**
+     * @brief Plans the segment starting at startHeight.
+     *
+     * The segment grows until its estimated cost reaches the current budget, the block cap is
+     * reached or rangeEnd is hit. A segment always holds at least one block.
+     */
+    Segment PlanNextSegment(uint64_t startHeight, uint64_t rangeEnd);
+
+    /**
+     * @brief Shortens a planned segment that could not be downloaded in full, scaling its estimates.
+     */
+    Segment TruncateSegment(const Segment &segment, uint64_t newEndHeight);
+
+    /**
+     * @brief Feeds the worker time a planned segment actually took back into the cost budget.
+     */
+    void RecordSegmentCompleted(const Segment &segment, std::chrono::duration<double> elapsed);
+
+    /**
+     * @brief Recently planned segments with their estimated and, once finished, observed cost.
+     */
+    std::vector<Segment> GetPlan() const;
+
+    /**
+     * @brief Changes the block cap for segments planned from now on.
+     */
+    void SetMaxBlocksPerSegment(size_t maxBlocksPerSegment);
+
+    double GetSegmentCostBudget() const;
+    double GetObservedCostPerSecond() const;
+    std::string DescribeSegment(const Segment &segment) const;
+};
+
+#endif // CHUNK_PLANNER_H
@@ -0,0 +1,427 @@
+#include "columnar_exporter.h"
+#include "logger.h"
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/exception.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+namespace
+{
+    constexpr int64_t PARQUET_ROW_GROUP_ROWS = 1 << 20;
+
+    const std::string TABLE_NAMES[] = {"blocks", "transactions", "transparent_inputs", "transparent_outputs"};
+
+    std::shared_ptr<arrow::DataType> DictionaryString()
+    {
+        return arrow::dictionary(arrow::int32(), arrow::utf8());
+    }
+
+    template <typename Builder>
+    void AppendString(Builder &builder, const pqxx::field &field)
+    {
+        PARQUET_THROW_NOT_OK(field.is_null() ? builder.AppendNull() : builder.Append(std::string_view(field.c_str(), field.size())));
+    }
+
+    void AppendInt(arrow::Int64Builder &builder, const pqxx::field &field)
+    {
+        PARQUET_THROW_NOT_OK(field.is_null() ? builder.AppendNull() : builder.Append(field.as<int64_t>()));
+    }
+
+    void AppendDouble(arrow::DoubleBuilder &builder, const pqxx::field &field)
+    {
+        PARQUET_THROW_NOT_OK(field.is_null() ? builder.AppendNull() : builder.Append(field.as<double>()));
+    }
+
+    void AppendBool(arrow::BooleanBuilder &builder, const pqxx::field &field)
+    {
+        PARQUET_THROW_NOT_OK(field.is_null() ? builder.AppendNull() : builder.Append(field.as<bool>()));
+    }
+
+    std::shared_ptr<arrow::Array> Finish(arrow::ArrayBuilder &builder)
+    {
+        std::shared_ptr<arrow::Array> array;
+        PARQUET_THROW_NOT_OK(builder.Finish(&array));
+        return array;
+    }
+}
+
+ColumnarExporter::ColumnarExporter(Database &databaseIn, const std::string &connection_string, const std::string &directoryIn, Format formatIn, uint64_t partitionHeightsIn)
+    : database(databaseIn), directory(directoryIn), format(formatIn), partitionHeights(std::max<uint64_t>(1, partitionHeightsIn)), conn(connection_string)
+{
+    for (const std::string &table : TABLE_NAMES)
+    {
+        std::filesystem::create_directories(this->directory + "/" + table);
+    }
+}
+
+ColumnarExporter::~ColumnarExporter() noexcept
+{
+    this->Stop();
+}
+
+ColumnarExporter::Format ColumnarExporter::ParseFormat(const std::string &format)
+{
+    if (format == "parquet")
+    {
+        return Format::Parquet;
+    }
+    if (format == "arrow")
+    {
+        return Format::ArrowIpc;
+    }
+
+    throw std::invalid_argument("Unknown columnar export format: " + format);
+}
+
+void ColumnarExporter::Start()
+{
+    const std::optional<uint64_t> latestCommittedHeight = this->database.GetLatestCommittedHeight();
+    if (latestCommittedHeight.has_value())
+    {
+        this->QueueCompletePartitions(0, latestCommittedHeight.value());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cs_queue);
+        __INFO__(("Columnar export to " + this->directory + " starting with " + std::to_string(this->queue.size()) + " partitions to export.").c_str());
+    }
+
+    this->worker = std::thread(&ColumnarExporter::Run, this);
+}
+
+void ColumnarExporter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_queue);
+        this->isStopping = true;
+    }
+    this->cv_queue.notify_all();
+
+    if (this->worker.joinable())
+    {
+        this->worker.join();
+    }
+}
+
+void ColumnarExporter::OnBlockCommitted(const Block &block, const OrmStorageMap & /* orm_storage_map */)
+{
+    try
+    {
+        this->QueueCompletePartitions(block.GetHeight(), block.GetHeight());
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+}
+
+void ColumnarExporter::OnInputsValued(uint64_t firstHeight, uint64_t lastHeight)
+{
+    try
+    {
+        this->QueueCompletePartitions(firstHeight, lastHeight);
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+}
+
+void ColumnarExporter::QueueCompletePartitions(uint64_t firstHeight, uint64_t lastHeight)
+{
+    bool isQueued{false};
+
+    for (uint64_t partition = firstHeight / this->partitionHeights; partition <= lastHeight / this->partitionHeights; ++partition)
+    {
+        if (!this->IsPartitionCommitted(partition))
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(cs_queue);
+        if (this->queued.count(partition) == 0 && !this->IsPartitionExported(partition))
+        {
+            this->queued.insert(partition);
+            this->queue.push_back(partition);
+            isQueued = true;
+        }
+    }
+
+    if (isQueued)
+    {
+        this->cv_queue.notify_one();
+    }
+}
+
+bool ColumnarExporter::IsPartitionCommitted(uint64_t partition) const
+{
+    const uint64_t firstHeight = partition * this->partitionHeights;
+    return this->database.GetMissingHeightRanges(firstHeight, firstHeight + this->partitionHeights - 1).empty();
+}
+
+bool ColumnarExporter::IsPartitionValued(uint64_t firstHeight, uint64_t lastHeight)
+{
+    pqxx::work tx(this->conn);
+
+    pqxx::row row = tx.exec_params1("SELECT COALESCE(max(range_end), -1) >= $2 AND count(*) FILTER (WHERE last_valued_height < LEAST(range_end, $2)) = 0 "
+                                    "FROM input_valuation_checkpoints WHERE range_start <= $2 AND range_end >= $1",
+                                    firstHeight, lastHeight);
+    tx.commit();
+
+    return row[0].as<bool>();
+}
+
+bool ColumnarExporter::IsPartitionExported(uint64_t partition) const
+{
+    return std::filesystem::exists(this->PartitionPath("blocks", partition));
+}
+
+std::string ColumnarExporter::PartitionPath(const std::string &table, uint64_t partition) const
+{
+    const uint64_t firstHeight = partition * this->partitionHeights;
+    const uint64_t lastHeight = firstHeight + this->partitionHeights - 1;
+
+    // Zero padded so partitions sort by height
+    char name[64];
+    std::snprintf(name, sizeof(name), "heights_%010llu_%010llu.%s", static_cast<unsigned long long>(firstHeight), static_cast<unsigned long long>(lastHeight),
+                  this->format == Format::Parquet ? "parquet" : "arrow");
+
+    return this->directory + "/" + table + "/" + name;
+}
+
+void ColumnarExporter::Run()
+{
+    while (true)
+    {
+        uint64_t partition{0};
+        {
+            std::unique_lock<std::mutex> lock(cs_queue);
+            this->cv_queue.wait(lock, [this]()
+                                { return this->isStopping || !this->queue.empty(); });
+
+            if (this->isStopping)
+            {
+                return;
+            }
+
+            partition = this->queue.front();
+            this->queue.pop_front();
+        }
+
+        try
+        {
+            this->ExportPartition(partition);
+        }
+        catch (const std::exception &e)
+        {
+            __ERROR__(("Columnar export of partition " + std::to_string(partition) + " failed: " + e.what()).c_str());
+        }
+
+        std::lock_guard<std::mutex> lock(cs_queue);
+        this->queued.erase(partition);
+    }
+}
+
+void ColumnarExporter::ExportPartition(uint64_t partition)
+{
+    const uint64_t firstHeight = partition * this->partitionHeights;
+    const uint64_t lastHeight = firstHeight + this->partitionHeights - 1;
+
+    if (this->IsPartitionExported(partition))
+    {
+        return;
+    }
+
+    // Exported once the valuation pass reaches it, which queues it again
+    if (this->database.IsDeferringInputValuation() && !this->IsPartitionValued(firstHeight, lastHeight))
+    {
+        __DEBUG__(("Partition " + std::to_string(partition) + " waits for input valuation before export").c_str());
+        return;
+    }
+
+    pqxx::work tx(this->conn);
+
+    const std::shared_ptr<arrow::Table> transactions = this->ReadTransactions(tx, firstHeight, lastHeight);
+    const std::shared_ptr<arrow::Table> inputs = this->ReadTransparentInputs(tx, firstHeight, lastHeight);
+    const std::shared_ptr<arrow::Table> outputs = this->ReadTransparentOutputs(tx, firstHeight, lastHeight);
+    const std::shared_ptr<arrow::Table> blocks = this->ReadBlocks(tx, firstHeight, lastHeight);
+    tx.commit();
+
+    this->WriteTable(transactions, this->PartitionPath("transactions", partition));
+    this->WriteTable(inputs, this->PartitionPath("transparent_inputs", partition));
+    this->WriteTable(outputs, this->PartitionPath("transparent_outputs", partition));
+    this->WriteTable(blocks, this->PartitionPath("blocks", partition));
+
+    __INFO__(("Exported heights " + std::to_string(firstHeight) + " to " + std::to_string(lastHeight) + ": " + std::to_string(blocks->num_rows()) + " blocks, " +
+              std::to_string(transactions->num_rows()) + " transactions, " + std::to_string(inputs->num_rows()) + " inputs, " +
+              std::to_string(outputs->num_rows()) + " outputs.")
+                 .c_str());
+}
+
+std::shared_ptr<arrow::Table> ColumnarExporter::ReadBlocks(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight)
+{
+    pqxx::result rows = tx.exec_params("SELECT hash, height, timestamp, size, num_transactions, num_inputs, num_outputs, "
+                                       "total_block_input, total_block_output, difficulty, miner "
+                                       "FROM blocks WHERE height BETWEEN $1 AND $2 ORDER BY height",
+                                       firstHeight, lastHeight);
+
+    arrow::StringBuilder hash;
+    arrow::Int64Builder height, timestamp, size, numTransactions, numInputs, numOutputs;
+    arrow::DoubleBuilder totalInput, totalOutput, difficulty;
+    arrow::StringDictionary32Builder miner;
+
+    for (const auto &row : rows)
+    {
+        AppendString(hash, row[0]);
+        AppendInt(height, row[1]);
+        AppendInt(timestamp, row[2]);
+        AppendInt(size, row[3]);
+        AppendInt(numTransactions, row[4]);
+        AppendInt(numInputs, row[5]);
+        AppendInt(numOutputs, row[6]);
+        AppendDouble(totalInput, row[7]);
+        AppendDouble(totalOutput, row[8]);
+        AppendDouble(difficulty, row[9]);
+        AppendString(miner, row[10]);
+    }
+
+    auto schema = arrow::schema({arrow::field("hash", arrow::utf8()), arrow::field("height", arrow::int64()), arrow::field("timestamp", arrow::int64()),
+                                 arrow::field("size", arrow::int64()), arrow::field("num_transactions", arrow::int64()), arrow::field("num_inputs", arrow::int64()),
+                                 arrow::field("num_outputs", arrow::int64()), arrow::field("total_block_input", arrow::float64()),
+                                 arrow::field("total_block_output", arrow::float64()), arrow::field("difficulty", arrow::float64()),
+                                 arrow::field("miner", DictionaryString())});
+
+    return arrow::Table::Make(schema, {Finish(hash), Finish(height), Finish(timestamp), Finish(size), Finish(numTransactions), Finish(numInputs),
+                                       Finish(numOutputs), Finish(totalInput), Finish(totalOutput), Finish(difficulty), Finish(miner)});
+}
+
+std::shared_ptr<arrow::Table> ColumnarExporter::ReadTransactions(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight)
+{
+    pqxx::result rows = tx.exec_params("SELECT tx_id, height, timestamp, version, size, is_overwintered = 'true', num_inputs, num_outputs, "
+                                       "NULLIF(total_public_input, '')::double precision, NULLIF(total_public_output, '')::double precision "
+                                       "FROM transactions WHERE height BETWEEN $1 AND $2 ORDER BY height",
+                                       firstHeight, lastHeight);
+
+    arrow::StringBuilder txId;
+    arrow::Int64Builder height, timestamp, version, size, numInputs, numOutputs;
+    arrow::BooleanBuilder isOverwintered;
+    arrow::DoubleBuilder totalInput, totalOutput;
+
+    for (const auto &row : rows)
+    {
+        AppendString(txId, row[0]);
+        AppendInt(height, row[1]);
+        AppendInt(timestamp, row[2]);
+        AppendInt(version, row[3]);
+        AppendInt(size, row[4]);
+        AppendBool(isOverwintered, row[5]);
+        AppendInt(numInputs, row[6]);
+        AppendInt(numOutputs, row[7]);
+        AppendDouble(totalInput, row[8]);
+        AppendDouble(totalOutput, row[9]);
+    }
+
+    auto schema = arrow::schema({arrow::field("tx_id", arrow::utf8()), arrow::field("height", arrow::int64()), arrow::field("timestamp", arrow::int64()),
+                                 arrow::field("version", arrow::int64()), arrow::field("size", arrow::int64()), arrow::field("is_overwintered", arrow::boolean()),
+                                 arrow::field("num_inputs", arrow::int64()), arrow::field("num_outputs", arrow::int64()),
+                                 arrow::field("total_public_input", arrow::float64()), arrow::field("total_public_output", arrow::float64())});
+
+    return arrow::Table::Make(schema, {Finish(txId), Finish(height), Finish(timestamp), Finish(version), Finish(size), Finish(isOverwintered),
+                                       Finish(numInputs), Finish(numOutputs), Finish(totalInput), Finish(totalOutput)});
+}
+
+std::shared_ptr<arrow::Table> ColumnarExporter::ReadTransparentInputs(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight)
+{
+    pqxx::result rows = tx.exec_params("SELECT i.tx_id, t.height, i.vin_tx_id, i.v_out_idx, i.value, i.senders[1], COALESCE(i.coinbase, '') <> '' "
+                                       "FROM transparent_inputs i JOIN transactions t ON t.tx_id = i.tx_id "
+                                       "WHERE t.height BETWEEN $1 AND $2 ORDER BY t.height",
+                                       firstHeight, lastHeight);
+
+    arrow::StringBuilder txId, vinTxId;
+    arrow::Int64Builder height, outputIndex;
+    arrow::DoubleBuilder value;
+    arrow::StringDictionary32Builder sender;
+    arrow::BooleanBuilder isCoinbase;
+
+    for (const auto &row : rows)
+    {
+        AppendString(txId, row[0]);
+        AppendInt(height, row[1]);
+        AppendString(vinTxId, row[2]);
+        AppendInt(outputIndex, row[3]);
+        AppendDouble(value, row[4]);
+        AppendString(sender, row[5]);
+        AppendBool(isCoinbase, row[6]);
+    }
+
+    auto schema = arrow::schema({arrow::field("tx_id", arrow::utf8()), arrow::field("height", arrow::int64()), arrow::field("vin_tx_id", arrow::utf8()),
+                                 arrow::field("v_out_idx", arrow::int64()), arrow::field("value", arrow::float64()), arrow::field("sender", DictionaryString()),
+                                 arrow::field("coinbase", arrow::boolean())});
+
+    return arrow::Table::Make(schema, {Finish(txId), Finish(height), Finish(vinTxId), Finish(outputIndex), Finish(value), Finish(sender), Finish(isCoinbase)});
+}
+
+std::shared_ptr<arrow::Table> ColumnarExporter::ReadTransparentOutputs(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight)
+{
+    pqxx::result rows = tx.exec_params("SELECT o.tx_id, t.height, o.output_index, NULLIF(o.value, '')::double precision, o.recipients[1], "
+                                       "COALESCE(cardinality(o.recipients), 0) "
+                                       "FROM transparent_outputs o JOIN transactions t ON t.tx_id = o.tx_id "
+                                       "WHERE t.height BETWEEN $1 AND $2 ORDER BY t.height",
+                                       firstHeight, lastHeight);
+
+    arrow::StringBuilder txId;
+    arrow::Int64Builder height, outputIndex, recipientCount;
+    arrow::DoubleBuilder value;
+    arrow::StringDictionary32Builder address;
+
+    for (const auto &row : rows)
+    {
+        AppendString(txId, row[0]);
+        AppendInt(height, row[1]);
+        AppendInt(outputIndex, row[2]);
+        AppendDouble(value, row[3]);
+        AppendString(address, row[4]);
+        AppendInt(recipientCount, row[5]);
+    }
+
+    auto schema = arrow::schema({arrow::field("tx_id", arrow::utf8()), arrow::field("height", arrow::int64()), arrow::field("output_index", arrow::int64()),
+                                 arrow::field("value", arrow::float64()), arrow::field("address", DictionaryString()),
+                                 arrow::field("recipient_count", arrow::int64())});
+
+    return arrow::Table::Make(schema, {Finish(txId), Finish(height), Finish(outputIndex), Finish(value), Finish(address), Finish(recipientCount)});
+}
+
+void ColumnarExporter::WriteTable(const std::shared_ptr<arrow::Table> &table, const std::string &path) const
+{
+    const std::string tmpPath = path + ".tmp";
+
+    PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::io::FileOutputStream> outfile, arrow::io::FileOutputStream::Open(tmpPath));
+
+    if (this->format == Format::Parquet)
+    {
+        // The stored Arrow schema keeps address columns dictionary typed when read back
+        std::shared_ptr<parquet::WriterProperties> properties = parquet::WriterProperties::Builder().compression(parquet::Compression::ZSTD)->build();
+        std::shared_ptr<parquet::ArrowWriterProperties> arrowProperties = parquet::ArrowWriterProperties::Builder().store_schema()->build();
+
+        PARQUET_THROW_NOT_OK(parquet::arrow::WriteTable(*table, arrow::default_memory_pool(), outfile, PARQUET_ROW_GROUP_ROWS, properties, arrowProperties));
+    }
+    else
+    {
+        PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::ipc::RecordBatchWriter> writer, arrow::ipc::MakeFileWriter(outfile, table->schema()));
+        PARQUET_THROW_NOT_OK(writer->WriteTable(*table));
+        PARQUET_THROW_NOT_OK(writer->Close());
+    }
+
+    PARQUET_THROW_NOT_OK(outfile->Close());
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        throw std::runtime_error("Unable to move columnar export into place at " + path);
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef COLUMNAR_EXPORTER_H
+#define COLUMNAR_EXPORTER_H
+
+#include "database.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace arrow
+{
+    class Table;
+}
+
+/**
+ * ColumnarExporter
+ * Exports blocks, transactions and transparent inputs and outputs as columnar files for analytics,
+ * one file per table and partition of COLUMNAR_EXPORT_PARTITION_HEIGHTS heights:
+ *
+ *   <directory>/<table>/heights_<first>_<last>.parquet (or .arrow for Arrow IPC)
+ *
+ * Address columns are dictionary encoded. Inputs and outputs carry their block height, so every table
+ * can be pruned by height without a join. Outputs paying several addresses (bare multisig) keep the
+ * first address alongside the recipient count; the full list stays in PostgreSQL.
+ *
+ * A partition is exported once every height in it has been committed and, with deferred input
+ * valuation, valued. As a BlockCommitObserver the exporter queues partitions as they complete during
+ * ingest, and on start it queues every complete partition not exported yet, so existing tables are
+ * exported the same way. Partitions are read back from the tables on a worker thread with a connection
+ * of its own, so exporting never holds up a commit. The blocks file of a partition is written last and
+ * marks it exported.
+ */
+class ColumnarExporter : public BlockCommitObserver
+{
+public:
+    enum class Format
+    {
+        Parquet,
+        ArrowIpc
+    };
+
+private:
+    Database &database;
+    const std::string directory;
+    const Format format;
+    const uint64_t partitionHeights;
+
+    pqxx::connection conn;
+
+    std::thread worker;
+    std::mutex cs_queue;
+    std::condition_variable cv_queue;
+    std::deque<uint64_t> queue;
+    std::set<uint64_t> queued;
+    bool isStopping{false};
+
+    void Run();
+
+    /**
+     * @brief Queues the partitions covering the heights that are complete and not exported yet.
+     */
+    void QueueCompletePartitions(uint64_t firstHeight, uint64_t lastHeight);
+
+    bool IsPartitionCommitted(uint64_t partition) const;
+    bool IsPartitionValued(uint64_t firstHeight, uint64_t lastHeight);
+    bool IsPartitionExported(uint64_t partition) const;
+
+    void ExportPartition(uint64_t partition);
+    std::shared_ptr<arrow::Table> ReadBlocks(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight);
+    std::shared_ptr<arrow::Table> ReadTransactions(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight);
+    std::shared_ptr<arrow::Table> ReadTransparentInputs(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight);
+    std::shared_ptr<arrow::Table> ReadTransparentOutputs(pqxx::work &tx, uint64_t firstHeight, uint64_t lastHeight);
+
+    std::string PartitionPath(const std::string &table, uint64_t partition) const;
+
+    /**
+     * @brief Writes the table to a temporary file and renames it into place.
+     */
+    void WriteTable(const std::shared_ptr<arrow::Table> &table, const std::string &path) const;
+
+public:
+    /**
+     * @param connection_string Connection string for the exporter's own connection.
+     * @param partitionHeights Heights per partition. Changing it starts a new set of partitions.
+     */
+    ColumnarExporter(Database &database, const std::string &connection_string, const std::string &directory, Format format, uint64_t partitionHeights);
+
+    ColumnarExporter(const ColumnarExporter &rhs) = delete;
+    ColumnarExporter &operator=(const ColumnarExporter &rhs) = delete;
+
+    ~ColumnarExporter() noexcept;
+
+    /**
+     * @brief Queues every complete partition that has not been exported and starts the worker.
+     */
+    void Start();
+
+    /**
+     * @brief Finishes the partition being written and stops. Queued partitions are picked up on the next start.
+     */
+    void Stop();
+
+    void OnBlockCommitted(const Block &block, const OrmStorageMap &orm_storage_map) override;
+    void OnInputsValued(uint64_t firstHeight, uint64_t lastHeight) override;
+
+    static Format ParseFormat(const std::string &format);
+};
+
+#endif // COLUMNAR_EXPORTER_H
@@ -51,6 +51,71 @@ public:
         return getEnv("RPC_PASSWORD", "password");
     }
 
+    static std::string getRpcMaxInFlight() {
+        return getEnv("RPC_MAX_IN_FLIGHT", "16");
+    }
+
+    static std::string getRpcIoThreads() {
+        return getEnv("RPC_IO_THREADS", "2");
+    }
+
+    // Largest RPC response read. A verbose getblock of a full block is tens of megabytes.
+    static std::string getRpcMaxResponseBytes() {
+        return getEnv("RPC_MAX_RESPONSE_BYTES", "268435456");
+    }
+
+    static std::string getSyncIntervalSeconds() {
+        return getEnv("SYNC_INTERVAL_SECONDS", "21600");
+    }
+
+    static std::string getShutdownTimeoutSeconds() {
+        return getEnv("SHUTDOWN_TIMEOUT_SECONDS", "60");
+    }
+
+    static std::string getEnableAdminSocket() {
+        return getEnv("ENABLE_ADMIN_SOCKET", "false");
+    }
+
+    static std::string getAdminSocketPath() {
+        return getEnv("ADMIN_SOCKET_PATH", "indexer-admin.sock");
+    }
+
+    static std::string getEnableTracing() {
+        return getEnv("ENABLE_TRACING", "false");
+    }
+
+    static std::string getTracePath() {
+        return getEnv("TRACE_PATH", "trace.json");
+    }
+
+    static std::string getTraceMaxEventsPerThread() {
+        return getEnv("TRACE_MAX_EVENTS_PER_THREAD", "1000000");
+    }
+
+    static std::string getMissedBlockRetryIntervalSeconds() {
+        return getEnv("MISSED_BLOCK_RETRY_INTERVAL_SECONDS", "30");
+    }
+
+    static std::string getMissedBlockRetryBaseSeconds() {
+        return getEnv("MISSED_BLOCK_RETRY_BASE_SECONDS", "5");
+    }
+
+    static std::string getMissedBlockRetryMaxSeconds() {
+        return getEnv("MISSED_BLOCK_RETRY_MAX_SECONDS", "3600");
+    }
+
+    static std::string getMissedBlockRetryBatchSize() {
+        return getEnv("MISSED_BLOCK_RETRY_BATCH_SIZE", "100");
+    }
+
+    static std::string getDeferInputValuation() {
+        return getEnv("DEFER_INPUT_VALUATION", "false");
+    }
+
+    static std::string getInputValuationPartitionHeights() {
+        return getEnv("INPUT_VALUATION_PARTITION_HEIGHTS", "10000");
+    }
+
     static std::string getBlockChunkProcessingSize() {
         return getEnv("BLOCK_CHUNK_PROCESSING_SIZE", "500");
     }
@@ -59,6 +124,150 @@ public:
         return getEnv("ALLOW_MULTIPLE_THREADS", "false");
     }
 
+    static std::string getIngestMode() {
+        return getEnv("INGEST_MODE", "pool");
+    }
+
+    static std::string getPinnedWorkers() {
+        return getEnv("PINNED_WORKERS", "0");
+    }
+
+    static std::string getSegmentTargetBytes() {
+        return getEnv("SEGMENT_TARGET_BYTES", "67108864");
+    }
+
+    static std::string getSegmentTargetSeconds() {
+        return getEnv("SEGMENT_TARGET_SECONDS", "30");
+    }
+
+    static std::string getSegmentProbeStride() {
+        return getEnv("SEGMENT_PROBE_STRIDE", "10");
+    }
+
+    static std::string getMemoryBudgetBytes() {
+        return getEnv("MEMORY_BUDGET_BYTES", "2147483648");
+    }
+
+    static std::string getNullifierFilterSnapshotPath() {
+        return getEnv("NULLIFIER_FILTER_SNAPSHOT_PATH", "nullifier_filter.snapshot");
+    }
+
+    static std::string getIndexingRulesPath() {
+        return getEnv("INDEXING_RULES_PATH", "indexing_rules.json");
+    }
+
+    static std::string getEnableOutpointIndex() {
+        return getEnv("ENABLE_OUTPOINT_INDEX", "true");
+    }
+
+    static std::string getOutpointIndexPath() {
+        return getEnv("OUTPOINT_INDEX_PATH", "outpoint_index");
+    }
+
+    static std::string getOutpointIndexInitialCapacity() {
+        return getEnv("OUTPOINT_INDEX_INITIAL_CAPACITY", "4194304");
+    }
+
+    static std::string getRawTransactionStorage() {
+        return getEnv("RAW_TRANSACTION_STORAGE", "inline");
+    }
+
+    static std::string getRawTransactionCompressionLevel() {
+        return getEnv("RAW_TRANSACTION_COMPRESSION_LEVEL", "3");
+    }
+
+    static std::string getStorageBackend() {
+        return getEnv("STORAGE_BACKEND", "postgres");
+    }
+
+    static std::string getSchemaMode() {
+        return getEnv("SCHEMA_MODE", "text");
+    }
+
+    static std::string getLocalStorePath() {
+        return getEnv("LOCAL_STORE_PATH", "local_store");
+    }
+
+    static std::string getEnableColumnarExport() {
+        return getEnv("ENABLE_COLUMNAR_EXPORT", "false");
+    }
+
+    static std::string getColumnarExportPath() {
+        return getEnv("COLUMNAR_EXPORT_PATH", "columnar_export");
+    }
+
+    static std::string getColumnarExportFormat() {
+        return getEnv("COLUMNAR_EXPORT_FORMAT", "parquet");
+    }
+
+    static std::string getColumnarExportPartitionHeights() {
+        return getEnv("COLUMNAR_EXPORT_PARTITION_HEIGHTS", "10000");
+    }
+
+    static std::string getEnableChainMonitor() {
+        return getEnv("ENABLE_CHAIN_MONITOR", "false");
+    }
+
+    static std::string getChainInfoIntervalMs() {
+        return getEnv("CHAIN_INFO_INTERVAL_MS", "1000");
+    }
+
+    static std::string getChainInfoFlushSamples() {
+        return getEnv("CHAIN_INFO_FLUSH_SAMPLES", "10");
+    }
+
+    static std::string getPeerInfoIntervalSeconds() {
+        return getEnv("PEER_INFO_INTERVAL_SECONDS", "60");
+    }
+
+    static std::string getEnableApiServer() {
+        return getEnv("ENABLE_API_SERVER", "false");
+    }
+
+    static std::string getApiServerAddress() {
+        return getEnv("API_SERVER_ADDRESS", "0.0.0.0");
+    }
+
+    static std::string getApiServerPort() {
+        return getEnv("API_SERVER_PORT", "8080");
+    }
+
+    static std::string getApiServerThreads() {
+        return getEnv("API_SERVER_THREADS", "4");
+    }
+
+    static std::string getApiDatabasePoolSize() {
+        return getEnv("API_DB_POOL_SIZE", "4");
+    }
+
+    static std::string getApiCacheMaxBytes() {
+        return getEnv("API_CACHE_MAX_BYTES", "67108864");
+    }
+
+    static std::string getApiCacheShards() {
+        return getEnv("API_CACHE_SHARDS", "16");
+    }
+
+    static std::string getEventRingCapacity() {
+        return getEnv("EVENT_RING_CAPACITY", "65536");
+    }
+
+    static std::string getPublishTransactionEvents() {
+        return getEnv("PUBLISH_TRANSACTION_EVENTS", "false");
+    }
+
+    static std::string getEventPollIntervalMs() {
+        return getEnv("EVENT_POLL_INTERVAL_MS", "50");
+    }
+
+    static std::string getNullifierFilterCapacity() {
+        return getEnv("NULLIFIER_FILTER_CAPACITY", "33554432");
+    }
+
+    static std::string getNullifierFilterBitsPerEntry() {
+        return getEnv("NULLIFIER_FILTER_BITS_PER_ENTRY", "12");
+    }
+
 };
 
 #endif // CONFIG_H
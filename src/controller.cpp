@@ -1,5 +1,12 @@
 #include "controller.h"
+#include "admin_server.h"
+#include "api_server.h"
+#include "chain_monitor.h"
+#ifdef WITH_COLUMNAR_EXPORT
+#include "columnar_exporter.h"
+#endif
 #include "logger.h"
+#include "tracer.h"
 
 #include <vector>
 #include <string>
@@ -8,12 +15,16 @@
 #include <thread>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <csignal>
+#include <pthread.h>
 #include "config.h"
 
-Controller::Controller(std::unique_ptr<CustomClient> rpcClientIn, std::unique_ptr<Syncer> syncerIn,  std::unique_ptr<Database> databaseIn) : 
-rpcClient(std::move(rpcClientIn)), syncer(std::move(syncerIn)), database(std::move(databaseIn))
+Controller::Controller(std::unique_ptr<CustomClient> rpcClientIn, std::unique_ptr<AsyncRpcClient> asyncRpcClientIn, std::unique_ptr<Syncer> syncerIn,  std::unique_ptr<Database> databaseIn) : 
+rpcClient(std::move(rpcClientIn)), asyncRpcClient(std::move(asyncRpcClientIn)), syncer(std::move(syncerIn)), database(std::move(databaseIn))
 {
-    const std::string connection_string =
+    this->connection_string =
         "dbname=" + Config::getDatabaseName() +
         " user=" + Config::getDatabaseUser() +
         " password=" + Config::getDatabasePassword() +
@@ -38,7 +49,12 @@ void Controller::InitAndSetup()
 {
     try
     {
+        this->database->LoadIndexingRules();
         this->database->CreateTables();
+        this->database->OpenStorageBackend();
+        this->database->LoadSyncState();
+        this->database->LoadOutpointIndex();
+        this->database->LoadNullifierFilter();
     }
     catch (const std::exception &e)
     {
@@ -49,7 +65,16 @@ void Controller::InitAndSetup()
 void Controller::StartSyncLoop()
 {
     __INFO__("Starting sync thread.");
-    syncing_thread = std::thread{&Syncer::StartSyncLoop, this->syncer.get()};
+
+    // Segments stored side by side would commit out of order and defer each other's blocks
+    if (this->database->IsCommittingInHeightOrder())
+    {
+        __INFO__("Address filter set, storing one segment at a time in height order.");
+        this->syncer->worker_pool.SetMaxActiveTasks(1);
+    }
+
+    this->scheduler->SchedulePeriodic("sync", std::chrono::seconds(std::stoull(Config::getSyncIntervalSeconds())), [this]()
+                                      { this->syncer->SyncIfBehind(); });
 }
 
 void Controller::StartSync()
@@ -57,53 +82,278 @@ void Controller::StartSync()
     this->syncer->Sync();
 }
 
-void Controller::StartMonitoringPeers()
+void Controller::StartChainMonitor()
 {
-    __INFO__("Starting peer monitoring thread.");
-    peer_monitoring_thread = std::thread{&Syncer::InvokePeersListRefreshLoop, this->syncer.get()};
+    if (Config::getEnableChainMonitor() != "true")
+    {
+        return;
+    }
+
+    __INFO__("Starting chain monitor.");
+    this->chainMonitor = std::make_unique<ChainMonitor>(*this->database, Config::getRpcUrl(), Config::getRpcUsername(), Config::getRpcPassword(), this->connection_string,
+                                                        std::chrono::milliseconds(std::stoull(Config::getChainInfoIntervalMs())),
+                                                        std::chrono::seconds(std::stoull(Config::getPeerInfoIntervalSeconds())),
+                                                        std::stoull(Config::getChainInfoFlushSamples()));
+    this->chainMonitor->Start();
 }
 
-void Controller::StartMonitoringChainInfo()
+void Controller::StartMissedBlockRetry()
 {
-    __INFO__("Starting chain info thread..");
-    chain_info_monitoring_thread = std::thread{&Syncer::InvokeChainInfoRefreshLoop, this->syncer.get()};
+    __INFO__("Starting missed block retry thread.");
+    this->scheduler->SchedulePeriodic("missed block retry", std::chrono::seconds(std::stoull(Config::getMissedBlockRetryIntervalSeconds())), [this]()
+                                      { this->syncer->RetryMissedBlocks(); });
 }
 
-void Controller::Shutdown()
+void Controller::StartApiServer()
 {
-    this->syncer->Stop();
+    if (Config::getEnableApiServer() != "true")
+    {
+        return;
+    }
+
+    __INFO__("Starting API server.");
+    this->apiServer = std::make_unique<ApiServer>(*this->database, Config::getApiServerAddress(), static_cast<unsigned short>(std::stoul(Config::getApiServerPort())),
+                                                  std::stoull(Config::getApiServerThreads()), this->connection_string, std::stoull(Config::getApiDatabasePoolSize()),
+                                                  std::stoull(Config::getApiCacheMaxBytes()), std::stoull(Config::getApiCacheShards()));
+    this->database->AddBlockCommitObserver(this->apiServer.get());
+}
+
+void Controller::StartColumnarExport()
+{
+    if (Config::getEnableColumnarExport() != "true")
+    {
+        return;
+    }
+
+#ifndef WITH_COLUMNAR_EXPORT
+    // Apache Arrow is an optional build dependency, see COLUMNAR_EXPORT in the Makefile
+    const std::runtime_error error("ENABLE_COLUMNAR_EXPORT is set, but the indexer was built without columnar export. Rebuild with make COLUMNAR_EXPORT=1.");
+    __ERROR__(error.what());
+    throw error;
+#else
+    __INFO__("Starting columnar export.");
+    this->columnarExporter = std::make_unique<ColumnarExporter>(*this->database, this->connection_string, Config::getColumnarExportPath(),
+                                                                ColumnarExporter::ParseFormat(Config::getColumnarExportFormat()),
+                                                                std::stoull(Config::getColumnarExportPartitionHeights()));
+    this->database->AddBlockCommitObserver(this->columnarExporter.get());
+    this->columnarExporter->Start();
+#endif
+}
+
+void Controller::StartAdminServer()
+{
+    if (Config::getEnableAdminSocket() != "true")
+    {
+        return;
+    }
+
+    __INFO__("Starting admin socket.");
+    this->adminServer = std::make_unique<AdminServer>(Config::getAdminSocketPath());
+
+    Syncer &syncer = *this->syncer;
+    Database &database = *this->database;
+    AsyncRpcClient &asyncRpcClient = *this->asyncRpcClient;
+    Scheduler &scheduler = *this->scheduler;
+
+    this->adminServer->AddTunable("chunk_size", "Most blocks in one segment, from the next segment planned",
+                                  []()
+                                  { return Syncer::CHUNK_SIZE.load(); },
+                                  [&syncer](uint64_t value)
+                                  { syncer.SetChunkSize(value); });
+    this->adminServer->AddTunable("workers", "Segments and valuation partitions stored at once in the pool ingest mode",
+                                  [&syncer]()
+                                  { return syncer.worker_pool.GetMaxActiveTasks(); },
+                                  [&syncer](uint64_t value)
+                                  { syncer.worker_pool.SetMaxActiveTasks(value); });
+    this->adminServer->AddTunable("rpc_max_in_flight", "Outstanding getblock requests, one keep-alive connection each",
+                                  [&asyncRpcClient]()
+                                  { return asyncRpcClient.GetMaxInFlight(); },
+                                  [&asyncRpcClient](uint64_t value)
+                                  { asyncRpcClient.SetMaxInFlight(value); });
+    this->adminServer->AddTunable("db_pool_size", "Connections in the ingest database pool",
+                                  [&database]()
+                                  { return database.GetPoolSize(); },
+                                  [&database](uint64_t value)
+                                  { database.SetPoolSize(value); });
+
+    for (const auto &[tunableName, taskName] : {std::make_pair("sync_interval_seconds", "sync"), std::make_pair("missed_block_retry_interval_seconds", "missed block retry")})
+    {
+        const std::string task = taskName;
+        this->adminServer->AddTunable(tunableName, "Seconds between runs of the " + task + " task",
+                                      [&scheduler, task]()
+                                      {
+                                          auto interval = scheduler.GetInterval(task);
+                                          if (!interval)
+                                          {
+                                              throw std::runtime_error("The " + task + " task is not scheduled");
+                                          }
+                                          return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(*interval).count());
+                                      },
+                                      [&scheduler, task](uint64_t value)
+                                      {
+                                          if (!scheduler.SetInterval(task, std::chrono::seconds(value)))
+                                          {
+                                              throw std::runtime_error("The " + task + " task is not scheduled");
+                                          }
+                                      });
+    }
+
+    this->adminServer->AddStatus("memory_budget", [&syncer]()
+                                 {
+                                     const MemoryBudget &budget = syncer.GetMemoryBudget();
+                                     Json::Value status(Json::objectValue);
+                                     status["used_bytes"] = Json::Value::UInt64(budget.GetUsedBytes());
+                                     status["peak_bytes"] = Json::Value::UInt64(budget.GetPeakBytes());
+                                     status["limit_bytes"] = Json::Value::UInt64(budget.GetLimitBytes());
+                                     return status; });
+    this->adminServer->AddStatus("missed_blocks", [&syncer]()
+                                 {
+                                     const Database::MissedBlockStats missed = syncer.GetMissedBlockStats();
+                                     Json::Value status(Json::objectValue);
+                                     status["count"] = Json::Value::UInt64(missed.count);
+                                     status["due"] = Json::Value::UInt64(missed.dueCount);
+                                     status["oldest_age_seconds"] = missed.oldestAgeSeconds;
+                                     return status; });
+    this->adminServer->AddStatus("pinned_workers", [&syncer]()
+                                 {
+                                     Json::Value status(Json::arrayValue);
+                                     for (const PinnedWorkerPool::WorkerStats &worker : syncer.GetWorkerStats())
+                                     {
+                                         Json::Value entry(Json::objectValue);
+                                         entry["core"] = worker.core;
+                                         entry["blocks"] = Json::Value::UInt64(worker.blocks);
+                                         entry["blocks_per_busy_second"] = worker.busySeconds > 0.0 ? static_cast<double>(worker.blocks) / worker.busySeconds : 0.0;
+                                         status.append(entry);
+                                     }
+                                     return status; });
+
+    this->database->AddBlockCommitObserver(this->adminServer.get());
+    this->adminServer->Start();
 }
 
-void Controller::JoinJoinableSyncingOperations()
+void Controller::Shutdown()
 {
-    if (syncing_thread.joinable())
+    if (this->isShutDown)
     {
-        syncing_thread.join();
+        return;
     }
+    this->isShutDown = true;
 
-    if (peer_monitoring_thread.joinable())
+    const std::chrono::seconds timeout(std::stoull(Config::getShutdownTimeoutSeconds()));
+    std::mutex cs_shutdown;
+    std::condition_variable cv_shutdown;
+    bool isDrained{false};
+
+    // Bounds the drain below, a worker stuck on a lost connection must not hold up a deploy
+    std::thread watchdog([&]()
+                         {
+                            std::unique_lock<std::mutex> lock(cs_shutdown);
+                            if (!cv_shutdown.wait_for(lock, timeout, [&isDrained]() { return isDrained; }))
+                            {
+                                __ERROR__(("Shutdown did not finish within " + std::to_string(timeout.count()) + "s, exiting.").c_str());
+                                std::_Exit(EXIT_FAILURE);
+                            } });
+
+    __INFO__("Shutting down.");
+
+    // Stop fetching first, so no new segment is started while the rest shuts down
+    this->syncer->Stop();
+
+    if (this->chainMonitor)
+    {
+        this->chainMonitor->Stop();
+    }
+
+    if (this->adminServer)
+    {
+        this->adminServer->Stop();
+    }
+
+    if (this->apiServer)
+    {
+        this->apiServer->Stop();
+    }
+
+#ifdef WITH_COLUMNAR_EXPORT
+    if (this->columnarExporter)
+    {
+        this->columnarExporter->Stop();
+    }
+#endif
+
+    // A sync pass in progress commits the segments it has downloaded before the scheduler is joined
+    this->scheduler->Stop();
+    this->syncer->DrainWorkers();
+
+    this->database->SaveSyncState(true);
+    this->database->SaveNullifierFilter();
+
+    try
     {
-        peer_monitoring_thread.join();
+        Tracer::Dump(Config::getTracePath());
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
     }
 
-    if (chain_info_monitoring_thread.joinable())
     {
-        chain_info_monitoring_thread.join();
+        std::lock_guard<std::mutex> lock(cs_shutdown);
+        isDrained = true;
     }
+    cv_shutdown.notify_all();
+    watchdog.join();
+
+    __INFO__("Shutdown complete.");
 }
 
 int main()
 {
+    // Termination signals are only ever taken by sigwait below, every thread started from here inherits the mask
+    sigset_t shutdownSignals;
+    sigemptyset(&shutdownSignals);
+    sigaddset(&shutdownSignals, SIGINT);
+    sigaddset(&shutdownSignals, SIGTERM);
+    sigaddset(&shutdownSignals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &shutdownSignals, nullptr);
+
+    // Enabled before any worker starts, so every thread's spans are kept
+    if (Config::getEnableTracing() == "true")
+    {
+        Tracer::Enable(std::stoull(Config::getTraceMaxEventsPerThread()));
+    }
+
     auto database = std::make_unique<Database>();
     auto rpcClient = std::make_unique<CustomClient>(Config::getRpcUrl(), Config::getRpcUsername(), Config::getRpcPassword());
-    auto syncer = std::make_unique<Syncer>(*rpcClient, *database);
+    auto asyncRpcClient = std::make_unique<AsyncRpcClient>(Config::getRpcUrl(), Config::getRpcUsername(), Config::getRpcPassword(),
+                                                           std::stoull(Config::getRpcMaxInFlight()), std::stoull(Config::getRpcIoThreads()),
+                                                           std::stoull(Config::getRpcMaxResponseBytes()));
+    auto syncer = std::make_unique<Syncer>(*rpcClient, *asyncRpcClient, *database);
     
-    Controller controller(std::move(rpcClient), std::move(syncer), std::move(database));
+    Controller controller(std::move(rpcClient), std::move(asyncRpcClient), std::move(syncer), std::move(database));
     controller.InitAndSetup();
+    controller.StartApiServer();
+    controller.StartColumnarExport();
     controller.StartSyncLoop();
-   // controller.StartMonitoringPeers();
-   // controller.StartMonitoringChainInfo();
-    controller.JoinJoinableSyncingOperations();
+    controller.StartMissedBlockRetry();
+    controller.StartChainMonitor();
+    controller.StartAdminServer();
+
+    // SIGUSR1 writes the trace recorded so far without stopping
+    int signal{0};
+    while (sigwait(&shutdownSignals, &signal) == 0 && signal == SIGUSR1)
+    {
+        try
+        {
+            Tracer::Dump(Config::getTracePath());
+        }
+        catch (const std::exception &e)
+        {
+            __ERROR__(e.what());
+        }
+    }
+    __INFO__(("Received signal " + std::to_string(signal) + ".").c_str());
+
     controller.Shutdown();
 
     return 0;
@@ -4,6 +4,8 @@
 #include "database.h"
 #include "syncer.h"
 #include "httpclient.h"
+#include "async_rpc_client.h"
+#include "scheduler.h"
 
 
 #include <memory>
@@ -11,17 +13,31 @@
 #include <string>
 #include <vector>
 
+// database.h includes this header, so these are only declared here
+class ApiServer;
+class ColumnarExporter;
+class ChainMonitor;
+class AdminServer;
+
 class Controller
 {
     
 private:
     std::unique_ptr<CustomClient> rpcClient{nullptr};
+    std::unique_ptr<AsyncRpcClient> asyncRpcClient{nullptr};
     std::unique_ptr<Syncer> syncer{nullptr};
     std::shared_ptr<Database> database{nullptr};
+    std::unique_ptr<ApiServer> apiServer{nullptr};
+#ifdef WITH_COLUMNAR_EXPORT
+    std::unique_ptr<ColumnarExporter> columnarExporter{nullptr};
+#endif
+    std::unique_ptr<ChainMonitor> chainMonitor{nullptr};
+    std::unique_ptr<AdminServer> adminServer{nullptr};
+
+    std::string connection_string;
 
-    std::thread syncing_thread;
-    std::thread peer_monitoring_thread;
-    std::thread chain_info_monitoring_thread;
+    std::unique_ptr<Scheduler> scheduler{std::make_unique<Scheduler>()};
+    bool isShutDown{false};
 
 
 public:
@@ -31,15 +47,43 @@ public:
     Controller(Controller&&) noexcept = default;
     Controller& operator=(Controller&&) noexcept = default;
 
-    Controller(std::unique_ptr<CustomClient>, std::unique_ptr<Syncer>, std::unique_ptr<Database>);
+    Controller(std::unique_ptr<CustomClient>, std::unique_ptr<AsyncRpcClient>, std::unique_ptr<Syncer>, std::unique_ptr<Database>);
     ~Controller() noexcept;
     void InitAndSetup();
+
+    /**
+     * Stops fetching blocks, lets the workers commit every block already downloaded and persists the
+     * sync state. If that takes longer than SHUTDOWN_TIMEOUT_SECONDS the process exits anyway; every
+     * block is committed whole and writes are idempotent, so the next start resumes from what was stored.
+     */
     void Shutdown();
     void StartSyncLoop();
     void StartSync();
-    void StartMonitoringPeers();
-    void StartMonitoringChainInfo();
-    void JoinJoinableSyncingOperations();
+
+    /**
+     * Starts sampling chain info and peers on the monitor's own RPC client if ENABLE_CHAIN_MONITOR is set.
+     */
+    void StartChainMonitor();
+    void StartMissedBlockRetry();
+
+    /**
+     * Starts the read API server if ENABLE_API_SERVER is set. Call before syncing starts so the
+     * server sees every committed block.
+     */
+    void StartApiServer();
+
+    /**
+     * Starts exporting complete height partitions as columnar files if ENABLE_COLUMNAR_EXPORT is set.
+     * Call before syncing starts so partitions completed during ingest are exported as they complete.
+     * Throws if it is set but the indexer was built without COLUMNAR_EXPORT=1.
+     */
+    void StartColumnarExport();
+
+    /**
+     * Starts the admin socket if ENABLE_ADMIN_SOCKET is set. Call after the sync loop and missed block
+     * retry are scheduled, their intervals are only tunable once they are.
+     */
+    void StartAdminServer();
 };
 
 #endif // CONTROLLER_H
\ No newline at end of file
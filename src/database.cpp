@@ -1,16 +1,85 @@
 #include "database.h"
+#include "local_store.h"
+#include "postgres_storage.h"
+#include "raw_transaction_codec.h"
+#include "tracer.h"
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 
 template std::optional<const pqxx::result> Database::ExecuteRead<std::string, uint64_t>(std::string sql, std::string, uint64_t);
 
 const uint64_t Database::InvalidHeight;
+constexpr size_t Database::NULLIFIER_FILTER_REBUILD_BATCH_SIZE;
+constexpr std::chrono::seconds Database::SYNC_STATE_SAVE_INTERVAL;
+constexpr uint64_t Database::OUTPOINT_INDEX_REPLAY_BATCH_HEIGHTS;
+constexpr uint64_t Database::INPUT_VALUATION_STEP_HEIGHTS;
+constexpr size_t Database::TRANSACTION_HEX_COLUMN;
 bool Database::is_connected = false;
 bool Database::is_database_setup = false;
+std::string Database::pool_connection_string;
+thread_local std::unique_ptr<pqxx::connection> Database::pinned_connection;
+thread_local const pqxx::connection *Database::pinned_connection_address{nullptr};
 
 std::queue<std::unique_ptr<pqxx::connection>> Database::connection_pool;
 std::mutex Database::cs_connection_pool;
 std::condition_variable Database::cv_connection_pool;
+size_t Database::pool_size{0};
+size_t Database::pool_target_size{0};
+
+namespace
+{
+    std::string ToByteaHex(const std::string &bytes)
+    {
+        static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+        std::string hex{"\\x"};
+        hex.reserve(2 + bytes.size() * 2);
+
+        for (unsigned char byte : bytes)
+        {
+            hex.push_back(HEX_DIGITS[byte >> 4]);
+            hex.push_back(HEX_DIGITS[byte & 0x0f]);
+        }
+
+        return hex;
+    }
+
+    std::optional<std::string> FromHex(std::string_view hex)
+    {
+        auto digitValue = [](char c) -> int
+        {
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
+        };
+
+        if (hex.size() % 2 != 0)
+        {
+            return std::nullopt;
+        }
+
+        std::string bytes;
+        bytes.reserve(hex.size() / 2);
+
+        for (size_t i = 0; i < hex.size(); i += 2)
+        {
+            int high = digitValue(hex[i]);
+            int low = digitValue(hex[i + 1]);
+            if (high < 0 || low < 0)
+            {
+                return std::nullopt;
+            }
+
+            bytes.push_back(static_cast<char>(high << 4 | low));
+        }
+
+        return bytes;
+    }
+}
 
 Database::~Database()
 {
@@ -39,6 +108,13 @@ void Database::Connect(size_t poolSize, const std::string &conn_str)
             __DEBUG__(("Completed connections " + std::to_string((i + 1)) + "/" + std::to_string(poolSize)).c_str());
         }
 
+        {
+            std::lock_guard<std::mutex> lock(cs_connection_pool);
+            pool_size = poolSize;
+            pool_target_size = poolSize;
+        }
+
+        pool_connection_string = conn_str;
         is_connected = true;
     }
     catch (std::exception &e)
@@ -55,6 +131,12 @@ void Database::Connect(size_t poolSize, const std::string &conn_str)
 std::unique_ptr<pqxx::connection> Database::GetConnection()
 {
     __INFO__("GetConnection()");
+
+    if (pinned_connection != nullptr && pinned_connection->is_open())
+    {
+        return std::move(pinned_connection);
+    }
+
     try
     {
         std::unique_lock<std::mutex> lock(cs_connection_pool);
@@ -90,7 +172,20 @@ void Database::ReleaseConnection(std::unique_ptr<pqxx::connection> conn)
             return;
         }
 
+        if (conn.get() == pinned_connection_address)
+        {
+            pinned_connection = std::move(conn);
+            return;
+        }
+
         std::lock_guard<std::mutex> lock(cs_connection_pool);
+        if (pool_size > pool_target_size)
+        {
+            // The pool was shrunk while this connection was taken
+            --pool_size;
+            return;
+        }
+
         connection_pool.push(std::move(conn));
         cv_connection_pool.notify_one();
     }
@@ -102,6 +197,66 @@ void Database::ReleaseConnection(std::unique_ptr<pqxx::connection> conn)
     }
 }
 
+void Database::SetPoolSize(size_t poolSize)
+{
+    poolSize = std::max<size_t>(poolSize, 1);
+
+    size_t numToOpen{0};
+    {
+        std::lock_guard<std::mutex> lock(cs_connection_pool);
+        pool_target_size = poolSize;
+        numToOpen = poolSize > pool_size ? poolSize - pool_size : 0;
+
+        while (pool_size > pool_target_size && !connection_pool.empty())
+        {
+            connection_pool.pop();
+            --pool_size;
+        }
+    }
+
+    // Opened outside the lock, connecting takes a round trip each
+    std::vector<std::unique_ptr<pqxx::connection>> opened;
+    for (size_t i = 0; i < numToOpen; ++i)
+    {
+        auto conn = std::make_unique<pqxx::connection>(pool_connection_string);
+        conn->set_verbosity(pqxx::error_verbosity::verbose);
+        opened.push_back(std::move(conn));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cs_connection_pool);
+        for (auto &conn : opened)
+        {
+            connection_pool.push(std::move(conn));
+            ++pool_size;
+        }
+    }
+    cv_connection_pool.notify_all();
+
+    __INFO__(("Database connection pool resized to " + std::to_string(poolSize) + " connections.").c_str());
+}
+
+size_t Database::GetPoolSize() const
+{
+    std::lock_guard<std::mutex> lock(cs_connection_pool);
+    return pool_target_size;
+}
+
+void Database::PinConnectionToThread()
+{
+    auto conn = std::make_unique<pqxx::connection>(pool_connection_string);
+    conn->set_verbosity(pqxx::error_verbosity::verbose);
+
+    pinned_connection_address = conn.get();
+    pinned_connection = std::move(conn);
+}
+
+void Database::UnpinConnectionFromThread()
+{
+    pinned_connection.reset();
+    pinned_connection_address = nullptr;
+}
+
 void Database::ShutdownConnections()
 {
     std::lock_guard<std::mutex> lock(cs_connection_pool);
@@ -124,9 +279,15 @@ void Database::CreateTables()
         return;
     }
 
+    const std::string schemaMode = Config::getSchemaMode();
+    if (schemaMode != "text" && schemaMode != "dictionary")
+    {
+        throw std::invalid_argument("Unknown schema mode: " + schemaMode);
+    }
+
     ManagedConnection conn(*this);
 
-    std::string_view createTableStatements[7]{"CREATE TABLE blocks ("
+    std::string_view createTableStatements[16]{"CREATE TABLE IF NOT EXISTS blocks ("
                                               "hash TEXT PRIMARY KEY, "
                                               "height INTEGER, "
                                               "timestamp INTEGER, "
@@ -145,7 +306,7 @@ void Database::CreateTables()
                                               "total_block_input DOUBLE PRECISION, "
                                               "miner TEXT"
                                               ")",
-                                              "CREATE TABLE transactions ("
+                                              "CREATE TABLE IF NOT EXISTS transactions ("
                                               "tx_id TEXT PRIMARY KEY, "
                                               "size INTEGER, "
                                               "is_overwintered TEXT, "
@@ -159,31 +320,182 @@ void Database::CreateTables()
                                               "num_inputs INTEGER, "
                                               "num_outputs INTEGER"
                                               ")",
-                                              "CREATE TABLE checkpoints ("
+                                              "CREATE TABLE IF NOT EXISTS checkpoints ("
                                               "chunk_start_height INTEGER PRIMARY KEY,"
                                               "chunk_end_height INTEGER,"
                                               "last_checkpoint INTEGER"
                                               ")",
-                                              "CREATE TABLE transparent_inputs ("
-                                              "tx_id TEXT PRIMARY KEY, "
-                                              "vin_tx_id TEXT, "
-                                              "v_out_idx INTEGER, "
-                                              "value DOUBLE PRECISION, "
-                                              "senders TEXT[], "
-                                              "coinbase TEXT)",
-                                              "CREATE TABLE transparent_outputs ("
+                                              "CREATE INDEX IF NOT EXISTS transactions_height_idx ON transactions (height)",
+                                              "CREATE INDEX IF NOT EXISTS blocks_height_idx ON blocks (height)",
+                                              "CREATE TABLE IF NOT EXISTS peerinfo (addr TEXT, lastsend TEXT, lastrecv TEXT, conntime TEXT, subver TEXT, synced_blocks TEXT)",
+                                              "CREATE TABLE IF NOT EXISTS chain_info (orchard_pool_value DOUBLE PRECISION, best_block_hash TEXT, size_on_disk DOUBLE PRECISION, best_height INT, total_chain_value DOUBLE PRECISION)",
+                                              // chain_info is a time series of ChainMonitor samples; tip lag is node_height - indexed_height
+                                              "ALTER TABLE chain_info "
+                                              "ADD COLUMN IF NOT EXISTS observed_at TIMESTAMPTZ NOT NULL DEFAULT now(), "
+                                              "ADD COLUMN IF NOT EXISTS node_height INTEGER, "
+                                              "ADD COLUMN IF NOT EXISTS header_height INTEGER, "
+                                              "ADD COLUMN IF NOT EXISTS indexed_height INTEGER",
+                                              "CREATE INDEX IF NOT EXISTS chain_info_observed_at_idx ON chain_info USING BRIN (observed_at)",
+                                              "CREATE TABLE IF NOT EXISTS nullifiers ("
+                                              "nullifier BYTEA PRIMARY KEY, "
+                                              "pool SMALLINT, "
+                                              "tx_id TEXT, "
+                                              "height INTEGER)",
+                                              "CREATE TABLE IF NOT EXISTS note_commitments ("
+                                              "commitment BYTEA PRIMARY KEY, "
+                                              "pool SMALLINT, "
                                               "tx_id TEXT, "
                                               "output_index INTEGER, "
-                                              "recipients TEXT[], "
-                                              "value TEXT)",
-                                              "CREATE TABLE peerinfo (addr TEXT, lastsend TEXT, lastrecv TEXT, conntime TEXT, subver TEXT, synced_blocks TEXT)",
-                                              "CREATE TABLE chain_info (orchard_pool_value DOUBLE PRECISION, best_block_hash TEXT, size_on_disk DOUBLE PRECISION, best_height INT, total_chain_value DOUBLE PRECISION)"};
+                                              "height INTEGER)",
+                                              "CREATE TABLE IF NOT EXISTS missed_blocks ("
+                                              "height INTEGER PRIMARY KEY, "
+                                              "attempts INTEGER NOT NULL DEFAULT 0, "
+                                              "first_missed_at TIMESTAMPTZ NOT NULL DEFAULT now(), "
+                                              "next_attempt_at TIMESTAMPTZ NOT NULL DEFAULT now(), "
+                                              "last_error TEXT)",
+                                              "CREATE TABLE IF NOT EXISTS sync_state ("
+                                              "id SMALLINT PRIMARY KEY, "
+                                              "committed_heights BYTEA NOT NULL, "
+                                              "updated_at TIMESTAMPTZ NOT NULL DEFAULT now())",
+                                              "CREATE TABLE IF NOT EXISTS transaction_raw ("
+                                              "tx_id TEXT PRIMARY KEY, "
+                                              "height INTEGER, "
+                                              "raw BYTEA NOT NULL)",
+                                              // Values are already zstd compressed, so TOAST stores them out of line as they are
+                                              "ALTER TABLE transaction_raw ALTER COLUMN raw SET STORAGE EXTERNAL",
+                                              "CREATE TABLE IF NOT EXISTS input_valuation_checkpoints ("
+                                              "range_start INTEGER PRIMARY KEY, "
+                                              "range_end INTEGER NOT NULL, "
+                                              "last_valued_height INTEGER NOT NULL)"};
+
+    // Inputs and outputs keyed by their txid and addresses as text
+    std::string_view textSchemaStatements[10]{"CREATE TABLE IF NOT EXISTS transparent_inputs ("
+                                             "tx_id TEXT, "
+                                             "vin_tx_id TEXT, "
+                                             "v_out_idx INTEGER, "
+                                             "value DOUBLE PRECISION, "
+                                             "senders TEXT[], "
+                                             "coinbase TEXT, "
+                                             "input_index INTEGER NOT NULL DEFAULT 0, "
+                                             "PRIMARY KEY (tx_id, input_index))",
+                                             // Inputs used to be keyed by tx_id alone, so every stored row is the only input of its transaction
+                                             "ALTER TABLE transparent_inputs ADD COLUMN IF NOT EXISTS input_index INTEGER NOT NULL DEFAULT 0",
+                                             "DO $$ BEGIN "
+                                             "IF (SELECT array_length(conkey, 1) FROM pg_constraint WHERE conrelid = 'transparent_inputs'::regclass AND contype = 'p') IS DISTINCT FROM 2 THEN "
+                                             "ALTER TABLE transparent_inputs DROP CONSTRAINT IF EXISTS transparent_inputs_pkey; "
+                                             "ALTER TABLE transparent_inputs ADD PRIMARY KEY (tx_id, input_index); "
+                                             "END IF; END $$",
+                                             "CREATE TABLE IF NOT EXISTS transparent_outputs ("
+                                             "tx_id TEXT, "
+                                             "output_index INTEGER, "
+                                             "recipients TEXT[], "
+                                             "value TEXT)",
+                                             // Unique so a replayed block's outputs are skipped rather than duplicated
+                                             "CREATE UNIQUE INDEX IF NOT EXISTS transparent_outputs_outpoint_key ON transparent_outputs (tx_id, output_index)",
+                                             "DROP INDEX IF EXISTS transparent_outputs_outpoint_idx",
+                                             // Spends whose output is not stored yet, applied when it is (see PostgresStorage)
+                                             "CREATE TABLE IF NOT EXISTS pending_spends ("
+                                             "tx_id TEXT, "
+                                             "output_index INTEGER, "
+                                             "spent_tx_id TEXT NOT NULL, "
+                                             "spent_height INTEGER NOT NULL, "
+                                             "PRIMARY KEY (tx_id, output_index))",
+                                             // Outputs stored before spends were tracked are marked from the stored inputs, once
+                                             "DO $$ BEGIN "
+                                             "IF NOT EXISTS (SELECT 1 FROM pg_attribute WHERE attrelid = 'transparent_outputs'::regclass AND attname = 'spent_height' AND NOT attisdropped) THEN "
+                                             "ALTER TABLE transparent_outputs ADD COLUMN spent_tx_id TEXT, ADD COLUMN spent_height INTEGER; "
+                                             "UPDATE transparent_outputs o SET spent_tx_id = i.tx_id, spent_height = t.height "
+                                             "FROM transparent_inputs i JOIN transactions t ON t.tx_id = i.tx_id "
+                                             "WHERE o.tx_id = i.vin_tx_id AND o.output_index = i.v_out_idx; "
+                                             "END IF; END $$",
+                                             // Unspent outputs of an address are found through the recipients index, so it is built whenever spends are
+                                             // tracked. A partial index on spent_height duplicated it and kept spend updates from being HOT.
+                                             "CREATE INDEX IF NOT EXISTS transparent_outputs_recipients_idx ON transparent_outputs USING GIN (recipients)",
+                                             "DROP INDEX IF EXISTS transparent_outputs_unspent_recipients_idx"};
+
+    // Inputs and outputs reference txids and addresses by id (see KeyDictionary). Views of the same
+    // names decode them, so queries written against the text schema read either.
+    std::string_view dictionarySchemaStatements[10]{"CREATE TABLE IF NOT EXISTS tx_ids (id BIGINT PRIMARY KEY, tx_id TEXT NOT NULL UNIQUE)",
+                                                   "CREATE TABLE IF NOT EXISTS addresses (id BIGINT PRIMARY KEY, address TEXT NOT NULL UNIQUE)",
+                                                   "CREATE TABLE IF NOT EXISTS transparent_inputs_encoded ("
+                                                   "tx_ref BIGINT, "
+                                                   // 0 for coinbase inputs, which spend no output
+                                                   "vin_tx_ref BIGINT, "
+                                                   "v_out_idx INTEGER, "
+                                                   "value DOUBLE PRECISION, "
+                                                   "sender_refs BIGINT[], "
+                                                   "coinbase TEXT, "
+                                                   "input_index INTEGER NOT NULL, "
+                                                   "PRIMARY KEY (tx_ref, input_index))",
+                                                   "CREATE TABLE IF NOT EXISTS transparent_outputs_encoded ("
+                                                   "tx_ref BIGINT, "
+                                                   "output_index INTEGER, "
+                                                   "recipient_refs BIGINT[], "
+                                                   "value TEXT, "
+                                                   "PRIMARY KEY (tx_ref, output_index))",
+                                                   "CREATE TABLE IF NOT EXISTS pending_spends_encoded ("
+                                                   "tx_ref BIGINT, "
+                                                   "output_index INTEGER, "
+                                                   "spent_tx_ref BIGINT NOT NULL, "
+                                                   "spent_height INTEGER NOT NULL, "
+                                                   "PRIMARY KEY (tx_ref, output_index))",
+                                                   "DO $$ BEGIN "
+                                                   "IF NOT EXISTS (SELECT 1 FROM pg_attribute WHERE attrelid = 'transparent_outputs_encoded'::regclass AND attname = 'spent_height' AND NOT attisdropped) THEN "
+                                                   "ALTER TABLE transparent_outputs_encoded ADD COLUMN spent_tx_ref BIGINT, ADD COLUMN spent_height INTEGER; "
+                                                   "UPDATE transparent_outputs_encoded o SET spent_tx_ref = i.tx_ref, spent_height = t.height "
+                                                   "FROM transparent_inputs_encoded i JOIN tx_ids d ON d.id = i.tx_ref JOIN transactions t ON t.tx_id = d.tx_id "
+                                                   "WHERE o.tx_ref = i.vin_tx_ref AND o.output_index = i.v_out_idx; "
+                                                   "END IF; END $$",
+                                                   "CREATE INDEX IF NOT EXISTS transparent_outputs_encoded_recipients_idx ON transparent_outputs_encoded USING GIN (recipient_refs)",
+                                                   "DROP INDEX IF EXISTS transparent_outputs_encoded_unspent_recipients_idx",
+                                                   "CREATE OR REPLACE VIEW transparent_inputs AS "
+                                                   "SELECT d.tx_id, COALESCE(v.tx_id, '-1') AS vin_tx_id, i.v_out_idx, i.value, "
+                                                   "ARRAY(SELECT a.address FROM unnest(i.sender_refs) WITH ORDINALITY AS s(id, position) JOIN addresses a ON a.id = s.id ORDER BY s.position) AS senders, "
+                                                   "i.coinbase, i.input_index "
+                                                   "FROM transparent_inputs_encoded i JOIN tx_ids d ON d.id = i.tx_ref LEFT JOIN tx_ids v ON v.id = i.vin_tx_ref",
+                                                   "CREATE OR REPLACE VIEW transparent_outputs AS "
+                                                   "SELECT d.tx_id, o.output_index, "
+                                                   "ARRAY(SELECT a.address FROM unnest(o.recipient_refs) WITH ORDINALITY AS r(id, position) JOIN addresses a ON a.id = r.id ORDER BY r.position) AS recipients, "
+                                                   "o.value, s.tx_id AS spent_tx_id, o.spent_height "
+                                                   "FROM transparent_outputs_encoded o JOIN tx_ids d ON d.id = o.tx_ref LEFT JOIN tx_ids s ON s.id = o.spent_tx_ref"};
+
+    // Sender lookups of the API server. Every input written maintains them, so they are only built when it is enabled.
+    std::string_view textApiIndexStatements[1]{"CREATE INDEX IF NOT EXISTS transparent_inputs_senders_idx ON transparent_inputs USING GIN (senders)"};
+
+    std::string_view dictionaryApiIndexStatements[1]{"CREATE INDEX IF NOT EXISTS transparent_inputs_encoded_senders_idx ON transparent_inputs_encoded USING GIN (sender_refs)"};
+
+    const bool isApiServerEnabled = Config::getEnableApiServer() == "true";
+
+    std::vector<std::string_view> statements(std::begin(createTableStatements), std::end(createTableStatements));
+    if (this->dictionary_encoded_schema)
+    {
+        statements.insert(statements.end(), std::begin(dictionarySchemaStatements), std::end(dictionarySchemaStatements));
+        if (isApiServerEnabled)
+        {
+            statements.insert(statements.end(), std::begin(dictionaryApiIndexStatements), std::end(dictionaryApiIndexStatements));
+        }
+    }
+    else
+    {
+        statements.insert(statements.end(), std::begin(textSchemaStatements), std::end(textSchemaStatements));
+        if (isApiServerEnabled)
+        {
+            statements.insert(statements.end(), std::begin(textApiIndexStatements), std::end(textApiIndexStatements));
+        }
+    }
 
     try
     {
         pqxx::work tx(*conn);
 
-        for (const std::string_view &query : createTableStatements)
+        // The schema mode is fixed when the tables are first created. The scalar subquery gives one NULL row on a fresh database.
+        pqxx::row existing = tx.exec1("SELECT (SELECT relkind FROM pg_class WHERE oid = to_regclass('transparent_outputs'))");
+        if (!existing[0].is_null() && (existing[0].as<std::string>() == "v") != this->dictionary_encoded_schema)
+        {
+            throw std::runtime_error("SCHEMA_MODE is " + Config::getSchemaMode() + " but the database was created with the other schema mode");
+        }
+
+        for (const std::string_view &query : statements)
         {
             try
             {
@@ -223,233 +535,272 @@ void Database::CreateTables()
     }
 }
 
-void Database::BatchInsertStatements(pqxx::work &batch_insert_txn, const std::string &table_name, const std::vector<std::string> &columns, const std::vector<std::vector<BlockData>> &orm_values) const
+void Database::UpdateChunkCheckpoint(size_t chunkStartHeight, size_t currentProcessingChunkHeight)
 {
-    try
+    this->storage_backend->UpdateChunkCheckpoint(chunkStartHeight, currentProcessingChunkHeight);
+}
+
+std::optional<Database::Checkpoint> Database::GetCheckpoint(signed int chunkStartHeight)
+{
+    if (chunkStartHeight == Database::InvalidHeight)
     {
-        std::stringstream query;
-        query << "INSERT INTO ";
+        return std::nullopt;
+    }
 
-        query << table_name << " (";
-        for (size_t j = 0; j < columns.size(); ++j)
-        {
-            query << columns[j];
+    return this->storage_backend->GetCheckpoint(chunkStartHeight);
+}
 
-            if (j != columns.size() - 1)
-            {
-                query << ", ";
-            }
-            else
-            {
-                query << ") VALUES ";
-            }
-        }
+void Database::CreateCheckpointIfNonExistent(size_t chunkStartHeight, size_t chunkEndHeight)
+{
+    this->storage_backend->CreateCheckpointIfNonExistent(chunkStartHeight, chunkEndHeight);
+}
 
-        for (size_t i = 0; i < orm_values.size(); ++i)
-        {
-            const auto &row = orm_values[i];
-            query << "(";
+void Database::SplitCheckpoint(size_t chunkStartHeight, size_t newChunkEndHeight)
+{
+    this->storage_backend->SplitCheckpoint(chunkStartHeight, newChunkEndHeight);
+}
 
-            for (size_t j = 0; j < row.size(); ++j)
-            {
-                // std::visit is used to obtain the string representation of the variant
-                std::string value = std::visit([](auto &&arg) -> std::string
-                                               {
-                                                   using T = std::decay_t<decltype(arg)>;
-                                                   if constexpr (std::is_same_v<T, std::string>)
-                                                       return arg; // If it's a string, use it directly
-                                                   else
-                                                       return std::to_string(arg); // Convert numbers to string
-                                                   // Handle other types as needed
-                                               },
-                                               row[j]);
-
-                query << batch_insert_txn.quote(value); // Use the obtained string value
-                if (j < row.size() - 1)
-                {
-                    query << ", ";
-                }
-            }
-            query << ")";
+std::stack<Database::Checkpoint> Database::GetUnfinishedCheckpoints()
+{
+    return this->storage_backend->GetUnfinishedCheckpoints();
+}
 
-            if (i < orm_values.size() - 1)
-            {
-                query << ", ";
-            }
-        }
+void Database::AddMissedBlock(size_t blockHeight, const std::string &reason)
+{
+    __DEBUG__(("Missed block at height " + std::to_string(blockHeight)).c_str());
+
+    try
+    {
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
+
+        // A height missed again before its retry keeps its age and attempt count
+        tx.exec_params("INSERT INTO missed_blocks (height, attempts, first_missed_at, next_attempt_at, last_error) "
+                       "VALUES ($1, 0, now(), now(), $2) "
+                       "ON CONFLICT (height) DO UPDATE SET last_error = EXCLUDED.last_error",
+                       blockHeight, reason);
+        tx.commit();
 
-        query << ";";
-        batch_insert_txn.exec(query.str());
+        std::lock_guard<std::mutex> lock(cs_missed_heights);
+        this->missed_heights.insert(blockHeight);
     }
     catch (const std::exception &e)
     {
-        throw;
+        __ERROR__(("Failed to record missed block at height " + std::to_string(blockHeight) + ": " + e.what()).c_str());
     }
 }
 
-void Database::UpdateChunkCheckpoint(size_t chunkStartHeight, size_t currentProcessingChunkHeight)
+void Database::RemoveMissedBlock(size_t blockHeight)
 {
-
-    ManagedConnection conn(*this);
-
     try
     {
-        pqxx::work transaction(*conn);
-
-        conn->prepare(
-            "update_checkpoint",
-            "UPDATE checkpoints "
-            "SET last_checkpoint = $2 "
-            "WHERE chunk_start_height = $1;");
-
-        transaction.exec_prepared("update_checkpoint", chunkStartHeight, currentProcessingChunkHeight);
-        transaction.commit();
-
-        std::string message = "Updating checkpoint from start value " + std::to_string(chunkStartHeight) + " to " + std::to_string(currentProcessingChunkHeight);
-        __DEBUG__(message.c_str());
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
+        tx.exec_params("DELETE FROM missed_blocks WHERE height = $1", blockHeight);
+        tx.commit();
 
-        conn->unprepare("update_checkpoint");
+        std::lock_guard<std::mutex> lock(cs_missed_heights);
+        this->missed_heights.erase(blockHeight);
     }
-    catch (std::exception &e)
+    catch (const std::exception &e)
     {
         __ERROR__(e.what());
-        throw;
     }
 }
 
-std::optional<Database::Checkpoint> Database::GetCheckpoint(signed int chunkStartHeight)
+bool Database::IsMissedBlock(uint64_t blockHeight)
 {
-    if (chunkStartHeight == Database::InvalidHeight)
-    {
-        return std::nullopt;
-    }
-    ManagedConnection conn(*this);
+    std::lock_guard<std::mutex> lock(cs_missed_heights);
+    return this->missed_heights.count(blockHeight) > 0;
+}
+
+std::vector<Database::MissedBlock> Database::GetDueMissedBlocks(size_t limit)
+{
+    std::vector<MissedBlock> dueBlocks;
+
     try
     {
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
 
-        pqxx::work transaction(*conn);
-
-        pqxx::result result = transaction.exec(
-            "SELECT chunk_start_height, chunk_end_height, last_checkpoint "
-            "FROM checkpoints WHERE chunk_start_height = " +
-            transaction.quote(chunkStartHeight));
+        pqxx::result result = tx.exec_params("SELECT height, attempts FROM missed_blocks WHERE next_attempt_at <= now() ORDER BY height LIMIT $1", limit);
+        dueBlocks.reserve(result.size());
 
-        if (result.empty())
+        for (const auto &row : result)
         {
-            return std::nullopt;
+            dueBlocks.push_back(MissedBlock{row["height"].as<uint64_t>(), row["attempts"].as<uint32_t>()});
         }
-        else
-        {
-            pqxx::row row = result[0];
-
-            Checkpoint checkpoint;
-
-            checkpoint.chunkStartHeight = row["chunk_start_height"].as<size_t>();
-            checkpoint.chunkEndHeight = row["chunk_end_height"].as<size_t>();
-            checkpoint.lastCheckpoint = row["last_checkpoint"].as<size_t>();
 
-            return checkpoint;
-        }
+        tx.commit();
     }
-    catch (const pqxx::sql_error &e)
+    catch (const std::exception &e)
     {
         __ERROR__(e.what());
-        throw;
+    }
+
+    return dueBlocks;
+}
+
+void Database::RescheduleMissedBlock(const MissedBlock &missedBlock, double delaySeconds, const std::string &reason)
+{
+    try
+    {
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
+        tx.exec_params("UPDATE missed_blocks SET attempts = $2, next_attempt_at = now() + make_interval(secs => $3), last_error = $4 WHERE height = $1",
+                       missedBlock.height, missedBlock.attempts + 1, delaySeconds, reason);
+        tx.commit();
     }
     catch (const std::exception &e)
     {
         __ERROR__(e.what());
-        throw;
     }
 }
 
-void Database::CreateCheckpointIfNonExistent(size_t chunkStartHeight, size_t chunkEndHeight)
+Database::MissedBlockStats Database::GetMissedBlockStats()
 {
-    ManagedConnection conn(*this);
+    MissedBlockStats stats;
 
     try
     {
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
 
-        std::string insertCheckpointStatement = R"(
-    INSERT INTO checkpoints (
-        chunk_start_height, 
-        chunk_end_height, 
-        last_checkpoint
-    ) VALUES ($1, $2, $3);
-)";
-
-        conn->prepare("insert_checkpoint", insertCheckpointStatement);
-        pqxx::work transaction(*conn);
-
-        transaction.exec_prepared("insert_checkpoint", chunkStartHeight, chunkEndHeight, chunkStartHeight);
-        transaction.commit();
+        pqxx::row row = tx.exec1("SELECT count(*), "
+                                 "COALESCE(EXTRACT(EPOCH FROM now() - min(first_missed_at)), 0), "
+                                 "COALESCE(max(attempts), 0), "
+                                 "count(*) FILTER (WHERE next_attempt_at <= now()) "
+                                 "FROM missed_blocks");
 
-        __DEBUG__(("Checkpoint created at height " + std::to_string(chunkStartHeight) + " to " + std::to_string(chunkEndHeight)).c_str());
+        stats.count = row[0].as<uint64_t>();
+        stats.oldestAgeSeconds = row[1].as<double>();
+        stats.maxAttempts = row[2].as<uint64_t>();
+        stats.dueCount = row[3].as<uint64_t>();
 
-        conn->unprepare("insert_checkpoint");
+        tx.commit();
     }
-    catch (std::exception &e)
+    catch (const std::exception &e)
     {
         __ERROR__(e.what());
     }
+
+    return stats;
 }
 
-std::stack<Database::Checkpoint> Database::GetUnfinishedCheckpoints()
+bool Database::StoreBlock(Block &block, ChunkArena &arena, MemoryBudget *memoryBudget)
 {
-    ManagedConnection conn(*this);
+    const uint64_t blockMemoryUsage = block.GetEstimatedMemoryUsage();
+    const uint64_t blockHeight = block.GetHeight();
+    bool isBlockStored{false};
 
+    // Obtain orm storage map and write the entire block at once
     try
     {
+        if (this->committed_heights.Contains(blockHeight))
+        {
+            __DEBUG__(("Block at height " + std::to_string(blockHeight) + " is already committed").c_str());
+            isBlockStored = true;
+        }
+        else if (this->IsWaitingForLowerHeights(blockHeight))
+        {
+            __DEBUG__(("Deferring block at height " + std::to_string(blockHeight) + " until every height below it is committed").c_str());
+        }
+        else
+        {
+            // Deferred inputs keep only their (txid, vout) reference until ValueInputPartition() runs
+            PrevoutMap prevouts;
+            if (!this->defer_input_valuation)
+            {
+                TraceSpan span("resolve prevouts", blockHeight);
+                prevouts = this->ResolvePrevouts(block.GetSpentOutpoints());
+            }
 
-        pqxx::work transaction(*conn);
-
-        std::string query = R"(
-            SELECT chunk_start_height, chunk_end_height, last_checkpoint
-            FROM checkpoints
-            WHERE chunk_end_height != last_checkpoint
-        )";
+            std::optional<TraceSpan> buildRowsSpan(std::in_place, "build rows", blockHeight);
+            OrmStorageMap orm_storage_map = block.DataToOrmStorageMap(arena, prevouts, this->indexing_rules);
+            if (this->compress_raw_transactions)
+            {
+                this->MoveRawTransactionsOutOfRow(orm_storage_map, arena, blockHeight);
+            }
+            buildRowsSpan.reset();
+            ScopedMemoryReservation rowBatchReservation(memoryBudget, arena.GetReservedBytes());
 
-        // Execute query
-        pqxx::result result = transaction.exec(query);
+            StorageBackend::WriteResult writeResult;
+            {
+                TraceSpan span("write", blockHeight);
+                writeResult = this->storage_backend->WriteBlock(blockHeight, block.GetHash(), orm_storage_map);
+            }
+            if (writeResult == StorageBackend::WriteResult::AlreadyStored)
+            {
+                // The block was stored before the bitmap was last persisted, so it only needs to be marked
+                __DEBUG__(("Block at height " + std::to_string(blockHeight) + " was already stored").c_str());
+            }
+            else
+            {
+                // Only committed nullifiers may enter the filter
+                for (const auto &nullifierRow : orm_storage_map.at("nullifiers"))
+                {
+                    this->nullifier_filter.InsertHex(std::get<std::string_view>(nullifierRow[0]));
+                }
 
-        // Process the sql rows for each checkpoint
-        std::stack<Checkpoint> checkpoints;
-        Checkpoint currentCheckpoint;
+                this->ApplyToOutpointIndex(orm_storage_map, blockHeight);
+            }
 
-        pqxx::result::const_iterator row_iterator = result.cbegin();
-        while (row_iterator != result.cend())
-        {
-            currentCheckpoint.chunkStartHeight = row_iterator["chunk_start_height"].as<size_t>();
-            currentCheckpoint.chunkEndHeight = row_iterator["chunk_end_height"].as<size_t>();
-            currentCheckpoint.lastCheckpoint = row_iterator["last_checkpoint"].as<size_t>();
-            checkpoints.push(currentCheckpoint);
+            this->committed_heights.Add(blockHeight);
+            isBlockStored = true;
 
-            ++row_iterator;
+            if (writeResult == StorageBackend::WriteResult::Written)
+            {
+                for (BlockCommitObserver *observer : this->block_commit_observers)
+                {
+                    observer->OnBlockCommitted(block, orm_storage_map);
+                }
+            }
         }
-        return checkpoints;
-    }
-    catch (const pqxx::sql_error &e)
-    {
-        __ERROR__(e.what());
 
-        std::stack<Database::Checkpoint> empty_stack;
-        return empty_stack;
+        // A block stored on resync or retry is no longer missing
+        if (isBlockStored && this->IsMissedBlock(blockHeight))
+        {
+            this->RemoveMissedBlock(blockHeight);
+        }
     }
     catch (const std::exception &e)
     {
         __ERROR__(e.what());
+    }
 
-        std::stack<Database::Checkpoint> empty_stack;
-        return empty_stack;
+    // The rows reference the block's JSON, so both go together once the block has been written
+    arena.Release();
+    block = Block();
+    if (memoryBudget != nullptr)
+    {
+        memoryBudget->Release(blockMemoryUsage);
     }
+
+    return isBlockStored;
 }
 
-void Database::AddMissedBlock(size_t blockHeight)
+void Database::MoveRawTransactionsOutOfRow(OrmStorageMap &orm_storage_map, ChunkArena &arena, uint64_t blockHeight)
 {
-    __DEBUG__(("Missed block at height " + std::to_string(blockHeight)).c_str());
+    static const int compressionLevel = std::stoi(Config::getRawTransactionCompressionLevel());
+
+    OrmRows &rawTransactions = orm_storage_map.emplace("transaction_raw", OrmRows(arena.Resource())).first->second;
+    OrmRows &transactions = orm_storage_map.at("transactions");
+    rawTransactions.reserve(transactions.size());
+
+    for (OrmRow &row : transactions)
+    {
+        const std::string_view hex = std::get<std::string_view>(row[TRANSACTION_HEX_COLUMN]);
+        if (hex.empty())
+        {
+            continue;
+        }
+
+        rawTransactions.emplace_back(std::initializer_list<BlockData>{row[0], blockHeight, arena.Intern(RawTransactionCodec::CompressHex(hex, compressionLevel))});
+        row[TRANSACTION_HEX_COLUMN] = std::string_view{};
+    }
 }
 
-void Database::BatchStoreBlocks(std::vector<Block> &chunk, uint64_t chunkStartHeight, uint64_t chunkEndHeight, uint64_t trueRangeStartHeight)
+void Database::BatchStoreBlocks(std::vector<Block> &chunk, uint64_t chunkStartHeight, uint64_t chunkEndHeight, uint64_t trueRangeStartHeight, MemoryBudget *memoryBudget, ChunkArena *scratchArena)
 {
     __INFO__("Syncing path: BatchStoreBlocks()");
 
@@ -461,61 +812,27 @@ void Database::BatchStoreBlocks(std::vector<Block> &chunk, uint64_t chunkStartHe
     auto elapsedTimeSinceLastCheckpoint{now - timeSinceLastCheckpoint};
     size_t chunkCurrentProcessingIndex{static_cast<size_t>(chunkStartHeight)};
 
-    ManagedConnection conn(*this);
-    pqxx::work batch_insert_txn(*conn);
+    // Rows of each block are built on the arena and dropped in one step after the block is written
+    std::optional<ChunkArena> chunkArena;
+    ChunkArena &arena = scratchArena != nullptr ? *scratchArena : chunkArena.emplace();
 
     // Process the chunk. Commit all transactions by the block (i.e. batch insert transaction is atomic)
     for (auto &item : chunk)
     {
+        // Blocks that failed to download or store are queued in missed_blocks and retried in the
+        // background, so the rest of the chunk and its checkpoint keep moving
         if (!item.isValid())
         {
-            throw std::invalid_argument("Expected Json::Value for block, but found Json::nullValue");
+            __DEBUG__(("Skipping missed block at height " + std::to_string(chunkCurrentProcessingIndex)).c_str());
         }
-
-        // Obtain orm storage map and batch inserts for the entire block
-        try
+        else
         {
-            std::map<std::string, std::vector<std::vector<BlockData>>> orm_storage_map = item.DataToOrmStorageMap();
-
-            for (auto iter = orm_storage_map.cbegin(); iter != orm_storage_map.cend(); ++iter)
+            // A block deferred behind a missing height is synced again with the next missing range
+            const uint64_t blockHeight = item.GetHeight();
+            if (!this->StoreBlock(item, arena, memoryBudget) && !this->IsWaitingForLowerHeights(blockHeight))
             {
-                for (auto stmt_iter = orm_storage_map[iter->first].cbegin(); stmt_iter != orm_storage_map[iter->first].cend(); ++stmt_iter)
-                {
-                    const auto &tableName = iter->first;
-                    const auto &tableData = iter->second;
-
-                    if (tableName == "blocks")
-                    {
-                        this->BatchInsertStatements(batch_insert_txn, tableName,
-                                                    {"hash", "height", "timestamp", "nonce", "size", "num_transactions", "total_block_output",
-                                                     "difficulty", "chainwork", "merkle_root", "version", "bits", "transaction_ids", "num_outputs",
-                                                     "num_inputs", "total_block_input", "miner"},
-                                                    tableData);
-                    }
-                    else if (tableName == "transactions")
-                    {
-                        this->BatchInsertStatements(batch_insert_txn, tableName, {"tx_id", "size", "is_overwintered", "version", "total_public_input", "total_public_output", "hex", "hash", "timestamp", "height", "num_inputs", "num_outputs"}, tableData);
-                    }
-                    else if (tableName == "transparent_inputs")
-                    {
-                        this->BatchInsertStatements(batch_insert_txn, tableName, {"tx_id", "vin_tx_id", "v_out_idx", "value", "senders", "coinbase"}, tableData);
-                    }
-                    else if (tableName == "transparent_outputs")
-                    {
-                        this->BatchInsertStatements(batch_insert_txn, tableName, {"tx_id", "output_index", "recipients", "value"}, tableData);
-                    }
-                }
+                this->AddMissedBlock(blockHeight, "Failed to store block");
             }
-
-            batch_insert_txn.commit();
-        }
-        catch (const std::exception &e)
-        {
-            // Missed block
-            __ERROR__(e.what());
-
-            ++chunkCurrentProcessingIndex;
-            continue;
         }
 
         // Check elapsed time since last chckpoint and attempt an update
@@ -531,13 +848,22 @@ void Database::BatchStoreBlocks(std::vector<Block> &chunk, uint64_t chunkStartHe
             // Update checkpoint if 10 seconds has elapsed since the last or the end of the chunk has been reached
             if (elapsedTimeSinceLastCheckpoint >= std::chrono::seconds(10) || reachedEndOfChunk)
             {
+                TraceSpan span("checkpoint", chunkCurrentProcessingIndex);
                 this->UpdateChunkCheckpoint(checkpointExist ? checkpoint.chunkStartHeight : chunkStartHeight, chunkCurrentProcessingIndex);
+                this->SaveSyncState();
                 timeSinceLastCheckpoint = std::chrono::steady_clock::now();
             }
         }
 
         ++chunkCurrentProcessingIndex;
     }
+
+    this->SaveSyncState();
+
+    ChunkArena::Stats arenaStats = arena.GetStats();
+    __DEBUG__(("Row building made " + std::to_string(arenaStats.arenaAllocations) + " arena allocations (" + std::to_string(arenaStats.arenaBytes) +
+               " bytes) backed by " + std::to_string(arenaStats.heapAllocations) + " heap allocations")
+                  .c_str());
 }
 
 std::optional<pqxx::row> Database::GetOutputByTransactionIdAndIndex(const std::string &txid, uint64_t v_out_index)
@@ -555,103 +881,578 @@ std::optional<pqxx::row> Database::GetOutputByTransactionIdAndIndex(const std::s
     return std::nullopt;
 }
 
-uint64_t Database::GetSyncedBlockCountFromDB()
+PrevoutMap Database::ResolvePrevouts(const std::vector<Outpoint> &outpoints)
 {
-    try
+    if (!this->outpoint_index)
     {
-        ManagedConnection conn(*this);
-        pqxx::work tx(*conn);
-        std::optional<pqxx::row> row = tx.exec1("SELECT height FROM blocks ORDER BY height DESC LIMIT 1;");
-        size_t syncedBlockCount{0};
-        if (row.has_value())
+        return this->storage_backend->ResolvePrevouts(outpoints);
+    }
+
+    PrevoutMap prevouts;
+    prevouts.reserve(outpoints.size());
+
+    std::vector<Outpoint> unresolved;
+    for (const Outpoint &outpoint : outpoints)
+    {
+        std::optional<OutpointIndex::Entry> entry = this->outpoint_index->Find(outpoint.txId, outpoint.vout);
+        if (entry.has_value())
         {
-            syncedBlockCount = row.value()[0].as<int>();
+            prevouts.emplace(outpoint, Prevout{entry->value, std::move(entry->recipients)});
         }
         else
         {
-            syncedBlockCount = 0;
+            unresolved.push_back(outpoint);
         }
+    }
 
-        __DEBUG__(("New synced block count " + std::to_string(syncedBlockCount)).c_str());
+    // Outputs of blocks committed out of order by another chunk are not in the index yet
+    if (!unresolved.empty())
+    {
+        prevouts.merge(this->storage_backend->ResolvePrevouts(unresolved));
+    }
 
-        return syncedBlockCount;
+    return prevouts;
+}
+
+void Database::ApplyToOutpointIndex(const OrmStorageMap &orm_storage_map, uint64_t blockHeight)
+{
+    if (!this->outpoint_index)
+    {
+        return;
     }
-    catch (std::exception &e)
+
+    // Outputs before spends, so outputs created and spent within the block end up spent
+    for (const auto &outputRow : orm_storage_map.at("transparent_outputs"))
+    {
+        this->outpoint_index->Insert(std::get<std::string_view>(outputRow[0]), static_cast<uint32_t>(std::get<uint64_t>(outputRow[1])), std::get<double>(outputRow[3]), std::get<std::string_view>(outputRow[2]), blockHeight);
+    }
+
+    for (const auto &inputRow : orm_storage_map.at("transparent_inputs"))
+    {
+        // Coinbase inputs carry no funding txid and are ignored by the index
+        this->outpoint_index->MarkSpent(std::get<std::string_view>(inputRow[1]), static_cast<uint32_t>(std::get<uint64_t>(inputRow[2])), blockHeight);
+    }
+
+    this->outpoint_index->MarkHeightApplied(blockHeight);
+}
+
+std::vector<Database::InputValuationPartition> Database::GetUnvaluedInputPartitions()
+{
+    std::vector<InputValuationPartition> partitions;
+
+    // Inputs only spend earlier outputs, so every input below the watermark can be valued
+    const uint64_t watermark = this->GetCommittedHeightWatermark();
+    if (watermark == 0)
+    {
+        return partitions;
+    }
+
+    const uint64_t partitionHeights = std::max<uint64_t>(1, std::stoull(Config::getInputValuationPartitionHeights()));
+
+    try
+    {
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
+
+        // Partitions are aligned to partitionHeights, so a partial last partition is extended on the next pass
+        tx.exec_params("INSERT INTO input_valuation_checkpoints (range_start, range_end, last_valued_height) "
+                       "SELECT s, LEAST(s + $1::integer - 1, $2::integer), s - 1 FROM generate_series(0, $2::integer, $1::integer) AS s "
+                       "ON CONFLICT (range_start) DO UPDATE SET range_end = EXCLUDED.range_end WHERE input_valuation_checkpoints.range_end < EXCLUDED.range_end",
+                       partitionHeights, watermark - 1);
+
+        pqxx::result result = tx.exec("SELECT range_start, range_end, last_valued_height FROM input_valuation_checkpoints "
+                                      "WHERE last_valued_height < range_end ORDER BY range_start");
+        tx.commit();
+
+        for (const auto &row : result)
+        {
+            partitions.push_back(InputValuationPartition{row[0].as<uint64_t>(), row[1].as<uint64_t>(), static_cast<uint64_t>(row[2].as<int64_t>() + 1)});
+        }
+    }
+    catch (const std::exception &e)
     {
         __ERROR__(e.what());
-        return 0;
+        throw;
     }
-    catch (pqxx::unexpected_rows &e)
+
+    return partitions;
+}
+
+void Database::ValueInputPartition(const InputValuationPartition &partition)
+{
+    try
+    {
+        ManagedConnection conn(*this);
+
+        for (uint64_t stepStart = partition.nextHeight; stepStart <= partition.rangeEnd; stepStart += INPUT_VALUATION_STEP_HEIGHTS)
+        {
+            const uint64_t stepEnd = std::min(partition.rangeEnd, stepStart + INPUT_VALUATION_STEP_HEIGHTS - 1);
+            pqxx::work tx(*conn);
+
+            if (this->dictionary_encoded_schema)
+            {
+                // The views cannot be updated, so the encoded tables are, joined on ids
+                tx.exec_params("UPDATE transparent_inputs_encoded i SET value = o.value::double precision, sender_refs = o.recipient_refs "
+                               "FROM tx_ids d, transactions t, transparent_outputs_encoded o "
+                               "WHERE d.id = i.tx_ref AND t.tx_id = d.tx_id AND t.height BETWEEN $1 AND $2 AND o.tx_ref = i.vin_tx_ref AND o.output_index = i.v_out_idx",
+                               stepStart, stepEnd);
+
+                tx.exec_params("UPDATE transactions t SET total_public_input = round(s.total::numeric, 6)::text "
+                               "FROM (SELECT d.tx_id, sum(i.value) AS total FROM transparent_inputs_encoded i JOIN tx_ids d ON d.id = i.tx_ref "
+                               "JOIN transactions ti ON ti.tx_id = d.tx_id WHERE ti.height BETWEEN $1 AND $2 GROUP BY d.tx_id) s "
+                               "WHERE t.tx_id = s.tx_id",
+                               stepStart, stepEnd);
+            }
+            else
+            {
+                tx.exec_params("UPDATE transparent_inputs i SET value = o.value::double precision, senders = o.recipients "
+                               "FROM transactions t, transparent_outputs o "
+                               "WHERE t.tx_id = i.tx_id AND t.height BETWEEN $1 AND $2 AND o.tx_id = i.vin_tx_id AND o.output_index = i.v_out_idx",
+                               stepStart, stepEnd);
+
+                tx.exec_params("UPDATE transactions t SET total_public_input = round(s.total::numeric, 6)::text "
+                               "FROM (SELECT i.tx_id, sum(i.value) AS total FROM transparent_inputs i JOIN transactions ti ON ti.tx_id = i.tx_id "
+                               "WHERE ti.height BETWEEN $1 AND $2 GROUP BY i.tx_id) s "
+                               "WHERE t.tx_id = s.tx_id",
+                               stepStart, stepEnd);
+            }
+
+            tx.exec_params("UPDATE blocks b SET total_block_input = s.total "
+                           "FROM (SELECT height, sum(total_public_input::double precision) AS total FROM transactions "
+                           "WHERE height BETWEEN $1 AND $2 GROUP BY height) s "
+                           "WHERE b.height = s.height",
+                           stepStart, stepEnd);
+
+            // The checkpoint moves with the values it covers, so an interrupted pass resumes after the last step
+            tx.exec_params("UPDATE input_valuation_checkpoints SET last_valued_height = $1 WHERE range_start = $2", stepEnd, partition.rangeStart);
+            tx.commit();
+
+            for (BlockCommitObserver *observer : this->block_commit_observers)
+            {
+                observer->OnInputsValued(stepStart, stepEnd);
+            }
+        }
+
+        __DEBUG__(("Valued inputs at heights " + std::to_string(partition.nextHeight) + " to " + std::to_string(partition.rangeEnd)).c_str());
+    }
+    catch (const std::exception &e)
     {
         __ERROR__(e.what());
-        return 0;
+        throw;
     }
 }
 
-void Database::StorePeers(const Json::Value &peer_info)
+void Database::AddBlockCommitObserver(BlockCommitObserver *observer)
+{
+    this->block_commit_observers.push_back(observer);
+}
+
+bool Database::IsDeferringInputValuation() const
+{
+    return this->defer_input_valuation;
+}
+
+bool Database::IsCommittingInHeightOrder() const
+{
+    // Deferred inputs are never matched against the filter, so they need no ordering
+    return this->indexing_rules.HasAddressFilter() && !this->defer_input_valuation;
+}
+
+bool Database::IsWaitingForLowerHeights(uint64_t height) const
+{
+    return this->IsCommittingInHeightOrder() && height > this->committed_heights.NextMissing(0);
+}
+
+std::optional<uint64_t> Database::GetLatestCommittedHeight() const
 {
+    return this->committed_heights.Maximum();
+}
+
+uint64_t Database::GetCommittedHeightWatermark() const
+{
+    return this->committed_heights.NextMissing(0);
+}
+
+std::vector<HeightBitmap::HeightRange> Database::GetMissingHeightRanges(uint64_t fromHeight, uint64_t toHeight) const
+{
+    return this->committed_heights.MissingRanges(fromHeight, toHeight);
+}
 
-    if (!peer_info.isNull())
+void Database::LoadSyncState()
+{
+    try
     {
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
 
-        try
         {
-            ManagedConnection connection(*this);
-            pqxx::work tx{*connection};
+            std::lock_guard<std::mutex> lock(cs_missed_heights);
+            for (const auto &row : tx.exec("SELECT height FROM missed_blocks"))
+            {
+                this->missed_heights.insert(row[0].as<uint64_t>());
+            }
+        }
 
-            tx.exec("TRUNCATE TABLE peerinfo;");
+        pqxx::result result = tx.exec("SELECT encode(committed_heights, 'hex') FROM sync_state WHERE id = 1");
 
-            connection->prepare("insert_peer_info", "INSERT INTO peerinfo (addr, lastsend, lastrecv, conntime, subver, synced_blocks) VALUES ($1, $2, $3, $4, $5, $6)");
+        if (!result.empty())
+        {
+            std::optional<std::string> bytes = FromHex(result[0][0].c_str());
+            if (bytes.has_value() && this->committed_heights.Deserialize(bytes.value()))
+            {
+                tx.commit();
+                this->persisted_sync_state_version = this->committed_heights.GetVersion();
+
+                __INFO__(("Loaded sync state with " + std::to_string(this->committed_heights.Cardinality()) + " committed heights, contiguous to " +
+                          std::to_string(this->committed_heights.NextMissing(0)))
+                             .c_str());
+                return;
+            }
 
-            if (peer_info.isArray() && peer_info.size() > 0)
+            __ERROR__("Stored sync state is corrupt, rebuilding it from the stored blocks.");
+        }
+
+        tx.commit();
+
+        // One time migration for databases written before sync_state existed
+        this->committed_heights.Clear();
+        this->storage_backend->LoadStoredHeights(this->committed_heights);
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+
+    __INFO__(("Rebuilt sync state from " + this->storage_backend->GetName() + " storage with " + std::to_string(this->committed_heights.Cardinality()) + " committed heights.").c_str());
+    this->SaveSyncState(true);
+}
+
+void Database::SaveSyncState(bool force)
+{
+    std::lock_guard<std::mutex> lock(cs_sync_state);
+
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t version = this->committed_heights.GetVersion();
+
+    if (version == this->persisted_sync_state_version || (!force && now - this->last_sync_state_save < SYNC_STATE_SAVE_INTERVAL))
+    {
+        return;
+    }
+
+    try
+    {
+        // Heights are only persisted once the blocks behind them are durable, so the heights are taken
+        // before the flush. A block committed during the flush is saved by the next call.
+        const std::string committedHeights = this->committed_heights.Serialize();
+        this->storage_backend->Flush();
+
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
+
+        tx.exec_params("INSERT INTO sync_state (id, committed_heights, updated_at) VALUES (1, $1::bytea, now()) "
+                       "ON CONFLICT (id) DO UPDATE SET committed_heights = EXCLUDED.committed_heights, updated_at = EXCLUDED.updated_at",
+                       ToByteaHex(committedHeights));
+        tx.commit();
+
+        this->persisted_sync_state_version = version;
+        this->last_sync_state_save = now;
+
+        if (this->outpoint_index)
+        {
+            this->outpoint_index->Flush();
+        }
+
+        // Spends that raced their output's block stay pending until swept here, once per save
+        if (this->storage_backend->ResolvePendingSpends(this->committed_heights.NextMissing(0)) > 0)
+        {
+            for (BlockCommitObserver *observer : this->block_commit_observers)
             {
-                for (const Json::Value &peer : peer_info)
-                {
-                    tx.exec_prepared("insert_peer_info", peer["addr"].asString(), peer["lastsend"].asString(), peer["lastrecv"].asString(), peer["conntime"].asString(), peer["subver"].asString(), peer["synced_blocks"].asString());
-                }
+                observer->OnSpendsResolved();
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        // Heights committed since the last save are recognised as already stored when they are seen again
+        __ERROR__(e.what());
+    }
+}
 
-                tx.commit();
+void Database::UnmarkSpendsAbove(uint64_t height)
+{
+    try
+    {
+        if (this->storage_backend->UnmarkSpendsAbove(height) > 0)
+        {
+            for (BlockCommitObserver *observer : this->block_commit_observers)
+            {
+                observer->OnSpendsResolved();
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+void Database::OpenStorageBackend()
+{
+    const std::string backend = Config::getStorageBackend();
+
+    try
+    {
+        if (backend == "postgres")
+        {
+            this->storage_backend = std::make_unique<PostgresStorage>(*this, this->dictionary_encoded_schema);
+        }
+        else if (backend == "local")
+        {
+            // These read rows back from the PostgreSQL tables, which the local store leaves empty
+            if (this->defer_input_valuation || Config::getEnableApiServer() == "true" || Config::getEnableColumnarExport() == "true")
+            {
+                throw std::invalid_argument("Deferred input valuation, the API server and columnar export require the postgres storage backend");
             }
+
+            if (this->dictionary_encoded_schema)
+            {
+                throw std::invalid_argument("The dictionary schema mode requires the postgres storage backend");
+            }
+
+            this->storage_backend = std::make_unique<LocalStore>(Config::getLocalStorePath(), std::stoull(Config::getOutpointIndexInitialCapacity()));
         }
-        catch (const std::exception &e)
+        else
         {
-            __ERROR__(e.what());
+            throw std::invalid_argument("Unknown storage backend: " + backend);
         }
     }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+
+    __INFO__(("Storing blocks with " + this->storage_backend->GetName() + " storage.").c_str());
 }
 
-void Database::StoreChainInfo(const Json::Value &chain_info)
+void Database::LoadIndexingRules()
 {
+    try
+    {
+        this->indexing_rules = IndexingRules::LoadFromFile(Config::getIndexingRulesPath());
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
 
-    if (!chain_info.isNull())
+    __INFO__(("Indexing rules: " + this->indexing_rules.Describe()).c_str());
+}
+
+void Database::LoadOutpointIndex()
+{
+    if (Config::getEnableOutpointIndex() != "true")
     {
-        std::string insert_chain_info_query{"INSERT INTO chain_info (orchard_pool_value, best_block_hash, size_on_disk, best_height, total_chain_value) VALUES ($1, $2, $3, $4, $5)"};
+        __INFO__("Outpoint index disabled, prevouts are resolved from the database.");
+        return;
+    }
 
-        double orchard_pool_value{0.0};
-        Json::Value value_pools = chain_info["valuePools"];
+    // Replay reads the PostgreSQL tables; the local store keeps an outpoint index of its own
+    if (this->storage_backend->GetName() != "postgres")
+    {
+        __INFO__(("Prevouts are resolved by " + this->storage_backend->GetName() + " storage.").c_str());
+        return;
+    }
+
+    try
+    {
+        this->outpoint_index = std::make_unique<OutpointIndex>(Config::getOutpointIndexPath(), std::stoull(Config::getOutpointIndexInitialCapacity()));
+
+        const std::optional<uint64_t> latestCommittedHeight = this->committed_heights.Maximum();
+        if (!latestCommittedHeight.has_value())
+        {
+            return;
+        }
+
+        // Heights committed to the database but not applied to the index, i.e. committed and not missing
+        const HeightBitmap &appliedHeights = this->outpoint_index->GetAppliedHeights();
+        std::vector<HeightBitmap::HeightRange> replayRanges;
+        uint64_t nextHeight{0};
 
-        if (value_pools.isNull())
+        auto addCommittedRange = [&](uint64_t first, uint64_t last)
         {
-            uint64_t total_chain_value = std::accumulate(value_pools.begin(), value_pools.end(), 0.0, [&orchard_pool_value](uint64_t accumulator, const Json::Value& pool)
-                                                                   {
-            if (pool["id"].asString() == "orchard")
+            for (const auto &range : appliedHeights.MissingRanges(first, last))
             {
-                orchard_pool_value = pool["chainValue"].asDouble();
+                replayRanges.push_back(range);
             }
+        };
 
-            return accumulator += pool["chainValue"].asDouble(); });
+        for (const auto &[missingFirst, missingLast] : this->committed_heights.MissingRanges(0, latestCommittedHeight.value()))
+        {
+            if (missingFirst > nextHeight)
+            {
+                addCommittedRange(nextHeight, missingFirst - 1);
+            }
+            nextHeight = missingLast + 1;
+        }
 
-            try
+        if (nextHeight <= latestCommittedHeight.value())
+        {
+            addCommittedRange(nextHeight, latestCommittedHeight.value());
+        }
+
+        if (replayRanges.empty())
+        {
+            __INFO__(("Loaded outpoint index with " + std::to_string(this->outpoint_index->GetUnspentCount()) + " unspent outputs.").c_str());
+            return;
+        }
+
+        ManagedConnection conn(*this);
+        uint64_t replayedHeights{0};
+
+        for (const auto &[rangeFirst, rangeLast] : replayRanges)
+        {
+            for (uint64_t batchFirst = rangeFirst; batchFirst <= rangeLast; batchFirst += OUTPOINT_INDEX_REPLAY_BATCH_HEIGHTS)
             {
-                ManagedConnection conn(*this);
-                pqxx::work tx{*conn};
-                tx.exec_params(insert_chain_info_query, orchard_pool_value, chain_info["bestblockhash"].asString(), chain_info["size_on_disk"].asDouble(), chain_info["estimatedheight"].asInt(), total_chain_value);
+                const uint64_t batchLast = std::min(rangeLast, batchFirst + OUTPOINT_INDEX_REPLAY_BATCH_HEIGHTS - 1);
+                pqxx::work tx(*conn);
+
+                pqxx::result outputs = tx.exec_params("SELECT o.tx_id, o.output_index, o.value, o.recipients, t.height FROM transparent_outputs o "
+                                                      "JOIN transactions t ON t.tx_id = o.tx_id WHERE t.height BETWEEN $1 AND $2",
+                                                      batchFirst, batchLast);
+                for (const auto &row : outputs)
+                {
+                    this->outpoint_index->Insert(row[0].c_str(), row[1].as<uint32_t>(), row[2].as<double>(), row[3].c_str(), row[4].as<uint64_t>());
+                }
+
+                pqxx::result spends = tx.exec_params("SELECT i.vin_tx_id, i.v_out_idx, t.height FROM transparent_inputs i "
+                                                     "JOIN transactions t ON t.tx_id = i.tx_id WHERE t.height BETWEEN $1 AND $2 AND i.vin_tx_id <> '-1'",
+                                                     batchFirst, batchLast);
+                for (const auto &row : spends)
+                {
+                    this->outpoint_index->MarkSpent(row[0].c_str(), row[1].as<uint32_t>(), row[2].as<uint64_t>());
+                }
+
                 tx.commit();
+
+                for (uint64_t height = batchFirst; height <= batchLast; ++height)
+                {
+                    this->outpoint_index->MarkHeightApplied(height);
+                }
+                replayedHeights += batchLast - batchFirst + 1;
             }
-            catch (const std::exception &e)
+        }
+
+        this->outpoint_index->Flush();
+        __INFO__(("Replayed " + std::to_string(replayedHeights) + " heights into the outpoint index, " + std::to_string(this->outpoint_index->GetUnspentCount()) + " unspent outputs.").c_str());
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+void Database::LoadNullifierFilter()
+{
+    // Nullifiers are only queryable from the postgres tables, which the local store leaves empty
+    if (this->storage_backend->GetName() != "postgres")
+    {
+        __INFO__("Nullifier lookups need the postgres storage backend, the nullifier filter is not loaded.");
+        return;
+    }
+
+    const std::string snapshotPath = Config::getNullifierFilterSnapshotPath();
+    if (this->nullifier_filter.LoadSnapshot(snapshotPath))
+    {
+        __INFO__(("Loaded nullifier filter snapshot with " + std::to_string(this->nullifier_filter.Size()) + " nullifiers.").c_str());
+        return;
+    }
+
+    this->nullifier_filter.Clear();
+
+    try
+    {
+        ManagedConnection conn(*this);
+        pqxx::work tx(*conn);
+
+        // Keyset pagination over the primary key keeps each round trip bounded
+        std::string lastNullifier{"\\x"};
+        while (true)
+        {
+            pqxx::result result = tx.exec_params("SELECT nullifier FROM nullifiers WHERE nullifier > $1::bytea ORDER BY nullifier LIMIT $2", lastNullifier, NULLIFIER_FILTER_REBUILD_BATCH_SIZE);
+
+            for (const auto &row : result)
+            {
+                this->nullifier_filter.InsertHex(row[0].c_str());
+            }
+
+            if (result.size() < NULLIFIER_FILTER_REBUILD_BATCH_SIZE)
             {
-                __ERROR__(e.what());
+                break;
             }
+
+            lastNullifier = result[result.size() - 1][0].as<std::string>();
         }
+
+        tx.commit();
     }
-}
\ No newline at end of file
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+
+    __INFO__(("Rebuilt nullifier filter from database with " + std::to_string(this->nullifier_filter.Size()) + " nullifiers.").c_str());
+}
+
+void Database::SaveNullifierFilter()
+{
+    if (this->storage_backend->GetName() != "postgres")
+    {
+        return;
+    }
+
+    try
+    {
+        this->nullifier_filter.SaveSnapshot(Config::getNullifierFilterSnapshotPath());
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+}
+
+std::optional<Database::NullifierLocation> Database::FindNullifier(const std::string &nullifierHex)
+{
+    if (this->storage_backend->GetName() != "postgres")
+    {
+        throw std::logic_error("Nullifier lookups require the postgres storage backend");
+    }
+
+    if (!this->nullifier_filter.MayContainHex(nullifierHex))
+    {
+        return std::nullopt;
+    }
+
+    ManagedConnection conn(*this);
+    pqxx::work tx(*conn);
+
+    const std::string byteaLiteral = nullifierHex.rfind("\\x", 0) == 0 ? nullifierHex : "\\x" + nullifierHex;
+    pqxx::result result = tx.exec_params("SELECT pool, tx_id, height FROM nullifiers WHERE nullifier = $1::bytea", byteaLiteral);
+
+    if (result.empty())
+    {
+        return std::nullopt;
+    }
+
+    NullifierLocation location;
+    location.pool = static_cast<ShieldedPool>(result[0]["pool"].as<uint16_t>());
+    location.txId = result[0]["tx_id"].as<std::string>();
+    location.height = result[0]["height"].as<uint64_t>();
+
+    return location;
+}
@@ -16,33 +16,121 @@
 #include <iostream>
 #include <variant>
 #include <limits>
+#include <set>
+#include <unordered_set>
 #include <jsonrpccpp/common/jsonparser.h>
 
 #include "httpclient.h"
 #include "logger.h"
 #include "controller.h"
 #include "chain_resource.h"
+#include "nullifier_filter.h"
+#include "height_bitmap.h"
+#include "outpoint_index.h"
+#include "storage_backend.h"
+#include "memory_budget.h"
+#include "config.h"
 
 #ifndef DATABASE_H
 #define DATABASE_H
 
 class ManagedConnection;
 
+/**
+ * Notified by Database as blocks are committed. Callbacks run on the committing thread after the
+ * block's transaction, so they must be quick and must not throw.
+ */
+class BlockCommitObserver
+{
+public:
+    virtual ~BlockCommitObserver() = default;
+
+    /**
+     * @brief A block and the rows written for it were committed.
+     */
+    virtual void OnBlockCommitted(const Block &block, const OrmStorageMap &orm_storage_map) = 0;
+
+    /**
+     * @brief Deferred input values and totals were written for the heights.
+     */
+    virtual void OnInputsValued(uint64_t /* firstHeight */, uint64_t /* lastHeight */) {}
+
+    /**
+     * @brief Spent marks of committed blocks changed after their blocks were reported, set by ResolvePendingSpends() or cleared by UnmarkSpendsAbove().
+     */
+    virtual void OnSpendsResolved() {}
+};
+
 class Database
 {
 
     friend class Controller;
     friend class Syncer;
+    // Opens the database the storage benchmarks run against
+    friend class BenchDatabase;
 
 private:
     static std::queue<std::unique_ptr<pqxx::connection>> connection_pool;
     static std::mutex cs_connection_pool;
     static std::condition_variable cv_connection_pool;
+    // Connections the pool owns, idle or taken, and how many it should own. Guarded by cs_connection_pool.
+    static size_t pool_size;
+    static size_t pool_target_size;
 
     static bool is_connected;
     static bool is_database_setup;
+    static std::string pool_connection_string;
+
+    // A connection owned by the current thread, handed out ahead of the pool (see PinConnectionToThread)
+    static thread_local std::unique_ptr<pqxx::connection> pinned_connection;
+    static thread_local const pqxx::connection *pinned_connection_address;
+
+    static constexpr size_t NULLIFIER_FILTER_REBUILD_BATCH_SIZE = 100000;
+    static constexpr std::chrono::seconds SYNC_STATE_SAVE_INTERVAL{10};
+    static constexpr uint64_t OUTPOINT_INDEX_REPLAY_BATCH_HEIGHTS = 1000;
+    static constexpr uint64_t INPUT_VALUATION_STEP_HEIGHTS = 1000;
+
+    // Position of hex in the transactions rows built by Block::DataToOrmStorageMap()
+    static constexpr size_t TRANSACTION_HEX_COLUMN = 6;
 
-    void BatchInsertStatements(pqxx::work &batch_insert_txn, const std::string& table_name, const std::vector<std::string> &columns, const std::vector<std::vector<BlockData>>&) const;
+    struct MissedBlock
+    {
+        uint64_t height;
+        uint32_t attempts;
+    };
+
+    // Heights of every committed block, persisted to sync_state at checkpoint cadence
+    HeightBitmap committed_heights;
+    std::mutex cs_sync_state;
+    uint64_t persisted_sync_state_version{0};
+    std::chrono::steady_clock::time_point last_sync_state_save{};
+
+    // Inputs are stored without value or senders and valued in bulk once their heights are contiguous
+    const bool defer_input_valuation{Config::getDeferInputValuation() == "true"};
+
+    // Raw transactions are written zstd compressed to transaction_raw instead of inline as hex
+    const bool compress_raw_transactions{Config::getRawTransactionStorage() == "compressed"};
+
+    // Inputs and outputs reference txids and addresses by integer id instead of repeating them as text
+    const bool dictionary_encoded_schema{Config::getSchemaMode() == "dictionary"};
+
+    // Registered before syncing starts and never removed, so they are read without locking
+    std::vector<BlockCommitObserver *> block_commit_observers;
+
+    // Which transactions and tables are indexed, loaded once at startup
+    IndexingRules indexing_rules;
+
+    // Unspent transparent outputs, flushed with the sync state. Null when disabled.
+    std::unique_ptr<OutpointIndex> outpoint_index;
+
+    // Where block rows and chunk checkpoints are written, chosen by STORAGE_BACKEND
+    std::unique_ptr<StorageBackend> storage_backend;
+
+    // Heights in missed_blocks, so storing a block only touches the table when it was missed
+    std::set<uint64_t> missed_heights;
+    std::mutex cs_missed_heights;
+
+    NullifierFilter nullifier_filter{std::stoull(Config::getNullifierFilterCapacity()), std::stoull(Config::getNullifierFilterBitsPerEntry())};
 
     /**
      * Shuts down all connections in the connection pool.
@@ -59,19 +147,68 @@ private:
     void UpdateChunkCheckpoint(size_t chunkStartHeight, size_t checkpointUpdateValue);
 
     /**
-     * Adds a block height to a list or set of missed blocks.
+     * Records a block height in the missed_blocks table so the retry worker picks it up.
+     * Failures to record are logged and not thrown, as callers are mid-download.
      *
      * @param blockHeight The height of the block that was missed.
+     * @param reason Why the block was missed, kept for inspection.
      */
-    void AddMissedBlock(size_t blockHeight);
+    void AddMissedBlock(size_t blockHeight, const std::string &reason = "");
 
     /**
-     * Removes a block height from the list or set of missed blocks.
+     * Removes a block height from the missed_blocks table.
      *
      * @param blockHeight The height of the block to remove from missed blocks.
      */
     void RemoveMissedBlock(size_t blockHeight);
 
+    bool IsMissedBlock(uint64_t blockHeight);
+
+    /**
+     * Returns missed blocks whose next retry is due, lowest height first.
+     *
+     * @param limit The maximum number of missed blocks to return.
+     */
+    std::vector<MissedBlock> GetDueMissedBlocks(size_t limit);
+
+    /**
+     * Counts a failed retry of a missed block and schedules the next one.
+     *
+     * @param missedBlock The missed block that failed again.
+     * @param delaySeconds Seconds until the next retry.
+     * @param reason Why the retry failed.
+     */
+    void RescheduleMissedBlock(const MissedBlock &missedBlock, double delaySeconds, const std::string &reason);
+
+    /**
+     * Writes a single block atomically through the storage backend, then releases the block, its rows on
+     * the arena and its charge against the memory budget. Storing a block removes it from missed_blocks.
+     *
+     * @return True if the block was committed.
+     */
+    bool StoreBlock(Block &block, ChunkArena &arena, MemoryBudget *memoryBudget);
+
+    /**
+     * Finds the value and recipients of each outpoint, from the outpoint index where possible and
+     * from the storage backend otherwise. Outpoints that are not found are left out.
+     */
+    PrevoutMap ResolvePrevouts(const std::vector<Outpoint> &outpoints);
+
+    /**
+     * Compresses the hex of each transaction row into a transaction_raw row and leaves the hex column empty.
+     */
+    void MoveRawTransactionsOutOfRow(OrmStorageMap &orm_storage_map, ChunkArena &arena, uint64_t blockHeight);
+
+    /**
+     * Adds a committed block's outputs to the outpoint index and marks the outputs it spends.
+     */
+    void ApplyToOutpointIndex(const OrmStorageMap &orm_storage_map, uint64_t blockHeight);
+
+    /**
+     * Whether the block must wait for a lower height to be committed, see IsCommittingInHeightOrder().
+     */
+    bool IsWaitingForLowerHeights(uint64_t height) const;
+
     /**
      * Establishes connections to the database.
      *
@@ -80,6 +217,24 @@ private:
      */
     void Connect(size_t poolSize, const std::string &connection_string);
 
+    /**
+     * Grows or shrinks the connection pool. New connections are opened right away, idle ones beyond
+     * the new size are closed right away and taken ones are closed as they are released.
+     */
+    void SetPoolSize(size_t poolSize);
+    size_t GetPoolSize() const;
+
+    /**
+     * Opens a connection owned by the calling thread. Connections taken on this thread come from it
+     * instead of the pool, and only fall back to the pool while it is already in use on the thread.
+     */
+    void PinConnectionToThread();
+
+    /**
+     * Closes the calling thread's own connection.
+     */
+    void UnpinConnectionFromThread();
+
     /**
      * Creates necessary tables in the database.
      *
@@ -108,26 +263,98 @@ private:
      * @param chunkStartHeight The starting height of the chunk.
      * @param chunkEndHeight The ending height of the chunk.
      * @param trueRangeStartHeight The true starting height of the range. Defaults to 0 if not provided.
+     * @param memoryBudget Optional budget the chunk's blocks were charged to. Each block is released
+     *                     (and credited back) once processed, and row batches are charged while pending.
+     * @param scratchArena Optional arena owned by the caller to build rows on. A chunk-local arena is used otherwise.
      */
-    void BatchStoreBlocks(std::vector<Block> &chunk, uint64_t chunkStartHeight, uint64_t chunkEndHeight, uint64_t trueRangeStartHeight = Database::InvalidHeight);
-    
+    void BatchStoreBlocks(std::vector<Block> &chunk, uint64_t chunkStartHeight, uint64_t chunkEndHeight, uint64_t trueRangeStartHeight = Database::InvalidHeight, MemoryBudget *memoryBudget = nullptr,
+                          ChunkArena *scratchArena = nullptr);
+
     /**
-     * Stores connected peers to the peersinfo table.
+     * Shrinks a checkpoint to end at newChunkEndHeight and creates a checkpoint for the remainder,
+     * so each part can be stored by a separate task.
      *
-     * @param peer_info JSON array containing information about connected peers.
-    */
-    void StorePeers(const Json::Value& peer_info);
+     * @param chunkStartHeight The starting height of the checkpoint to split.
+     * @param newChunkEndHeight The last height kept by the existing checkpoint.
+     */
+    void SplitCheckpoint(size_t chunkStartHeight, size_t newChunkEndHeight);
+
+
+    /**
+     * Loads the nullifier membership filter from its snapshot, or rebuilds it from the
+     * nullifiers table if no clean snapshot is available. Skipped with the local storage backend,
+     * whose nullifiers cannot be looked up. Call after OpenStorageBackend().
+     */
+    void LoadNullifierFilter();
+
+    /**
+     * Writes a clean snapshot of the nullifier membership filter. Only call once ingest has stopped.
+     */
+    void SaveNullifierFilter();
+
+    /**
+     * Opens the storage backend named by STORAGE_BACKEND. Call after CreateTables().
+     */
+    void OpenStorageBackend();
+
+    /**
+     * Loads the committed height bitmap from sync_state. Databases created before sync_state existed
+     * are migrated with a single pass over the stored blocks.
+     */
+    void LoadSyncState();
+
+    /**
+     * Compiles the indexing rules in INDEXING_RULES_PATH. Without a rules file every transaction is indexed.
+     */
+    void LoadIndexingRules();
+
+    /**
+     * Opens the outpoint index and replays committed heights it has not applied. Call after LoadSyncState().
+     */
+    void LoadOutpointIndex();
+
+    /**
+     * Flushes the storage backend, then persists the committed height bitmap if it changed and flushes
+     * the outpoint index with it.
+     *
+     * @param force Saves even if the last save was less than SYNC_STATE_SAVE_INTERVAL ago.
+     */
+    void SaveSyncState(bool force = false);
 
-    void StoreChainInfo(const Json::Value& chain_info);
+    /**
+     * Clears the spent marks left by blocks above height, for rolling those blocks back, and tells the
+     * observers, as outputs they reported spent are unspent again.
+     */
+    void UnmarkSpendsAbove(uint64_t height);
     
 public:
     static const uint64_t InvalidHeight{std::numeric_limits<uint64_t>::max()};
 
-    struct Checkpoint
+    using Checkpoint = StorageBackend::Checkpoint;
+
+    struct MissedBlockStats
+    {
+        uint64_t count{0};
+        uint64_t dueCount{0};
+        uint64_t maxAttempts{0};
+        double oldestAgeSeconds{0.0};
+    };
+
+    /**
+     * A range of heights whose inputs are valued together. Heights below nextHeight are done.
+     */
+    struct InputValuationPartition
+    {
+        uint64_t rangeStart;
+        uint64_t rangeEnd;
+        uint64_t nextHeight;
+    };
+
+    struct NullifierLocation
     {
-        size_t chunkStartHeight;
-        size_t chunkEndHeight;
-        size_t lastCheckpoint;
+        ShieldedPool pool;
+        std::string txId;
+        uint64_t height;
     };
 
     /**
@@ -188,11 +415,66 @@ static std::optional<const pqxx::result> ExecuteRead(std::string sql, Args... ar
     }
 }
 
+    /**
+     * Registers an observer of committed blocks. Call before syncing starts.
+     */
+    void AddBlockCommitObserver(BlockCommitObserver *observer);
+
+    /**
+     * Whether inputs are stored as bare (txid, vout) references and valued by ValueInputPartition().
+     */
+    bool IsDeferringInputValuation() const;
+
+    /**
+     * Whether a block is only committed once every height below it is. Inputs are matched against an
+     * address filter through the outputs they spend, which must be committed first.
+     */
+    bool IsCommittingInHeightOrder() const;
+
+    /**
+     * Extends the input valuation checkpoints up to the committed height watermark and returns the
+     * partitions that still have heights to value. Partitions are independent and may be valued in parallel.
+     */
+    std::vector<InputValuationPartition> GetUnvaluedInputPartitions();
+
+    /**
+     * Fills the value and senders of every input in the partition from transparent_outputs, then the
+     * input totals of their transactions and blocks. Work is committed in steps along with the
+     * partition's checkpoint.
+     */
+    void ValueInputPartition(const InputValuationPartition &partition);
+
     // Functions related to the indexing process
-    uint64_t GetSyncedBlockCountFromDB();
+    std::optional<uint64_t> GetLatestCommittedHeight() const;
+
+    /**
+     * Returns the lowest height that has not been committed. Every height below it is stored.
+     */
+    uint64_t GetCommittedHeightWatermark() const;
+
+    /**
+     * Returns the ranges of heights within [fromHeight, toHeight] that have not been committed.
+     */
+    std::vector<HeightBitmap::HeightRange> GetMissingHeightRanges(uint64_t fromHeight, uint64_t toHeight) const;
     std::optional<pqxx::row> GetOutputByTransactionIdAndIndex(const std::string &txid, uint64_t v_out_index);
     std::stack<Database::Checkpoint> GetUnfinishedCheckpoints();
     std::optional<Database::Checkpoint> GetCheckpoint(signed int chunkStartHeight);
+
+    /**
+     * Returns the number of missed blocks waiting to be retried and the age of the oldest one.
+     */
+    Database::MissedBlockStats GetMissedBlockStats();
+
+    /**
+     * Finds where a shielded nullifier was revealed. Nullifiers rejected by the in-memory
+     * filter are answered without touching the database.
+     *
+     * Requires the postgres storage backend, as the local store keeps no nullifier table.
+     *
+     * @param nullifierHex The 32 byte nullifier as lowercase hex.
+     * @return The revealing transaction, or std::nullopt if the nullifier has not been indexed.
+     */
+    std::optional<Database::NullifierLocation> FindNullifier(const std::string &nullifierHex);
 };
 
 class ManagedConnection {
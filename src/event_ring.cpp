@@ -0,0 +1,76 @@
+#include "event_ring.h"
+
+#include <cstring>
+
+EventRing::EventRing(size_t capacity)
+{
+    uint64_t roundedCapacity{1};
+    while (roundedCapacity < capacity)
+    {
+        roundedCapacity <<= 1;
+    }
+
+    this->slots = std::make_unique<Slot[]>(roundedCapacity);
+    this->mask = roundedCapacity - 1;
+}
+
+void EventRing::Publish(const Event &event)
+{
+    uint64_t words[PAYLOAD_WORDS] = {};
+    std::memcpy(words, &event, sizeof(Event));
+
+    const uint64_t position = this->head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = this->slots[position & this->mask];
+
+    slot.sequence.store(2 * position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < PAYLOAD_WORDS; ++i)
+    {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    slot.sequence.store(2 * position + 2, std::memory_order_release);
+}
+
+EventRing::ReadResult EventRing::Read(uint64_t position, Event &event) const
+{
+    const Slot &slot = this->slots[position & this->mask];
+    const uint64_t expected = 2 * position + 2;
+
+    const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before < expected)
+    {
+        return ReadResult::NotReady;
+    }
+    if (before > expected)
+    {
+        return ReadResult::Overrun;
+    }
+
+    uint64_t words[PAYLOAD_WORDS];
+    for (size_t i = 0; i < PAYLOAD_WORDS; ++i)
+    {
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+
+    // A publisher that lapped the reader during the copy has moved the sequence on
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before)
+    {
+        return ReadResult::Overrun;
+    }
+
+    std::memcpy(&event, words, sizeof(Event));
+    return ReadResult::Ok;
+}
+
+uint64_t EventRing::GetHead() const
+{
+    return this->head.load(std::memory_order_acquire);
+}
+
+uint64_t EventRing::GetCapacity() const
+{
+    return this->mask + 1;
+}
@@ -0,0 +1,106 @@
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * EventRing
+ * Lock-free broadcast ring of fixed size notification events. Any number of threads publish and any
+ * number of readers consume; each reader keeps its own position, so publishing costs the same however
+ * many readers there are and never waits for them.
+ *
+ * Each slot is guarded by a sequence number derived from the position written to it. A reader that
+ * falls a full ring behind finds its position overwritten and is told so instead of reading a torn
+ * or newer event.
+ */
+class EventRing
+{
+public:
+    static constexpr size_t ID_SIZE = 65;
+    static constexpr size_t ADDRESS_SIZE = 96;
+
+    enum class EventType : uint8_t
+    {
+        Block = 1,
+        Transaction = 2
+    };
+
+    struct Event
+    {
+        EventType type;
+        uint32_t transactionCount;
+        uint64_t height;
+        int64_t committedAtNs; // steady clock time the block was committed
+        char id[ID_SIZE];      // block hash or txid
+        char address[ADDRESS_SIZE];
+    };
+
+    enum class ReadResult
+    {
+        Ok,
+        NotReady, // Not published yet
+        Overrun   // Overwritten before it was read
+    };
+
+private:
+    static_assert(std::is_trivially_copyable<Event>::value, "Events are copied word by word");
+    static constexpr size_t PAYLOAD_WORDS = (sizeof(Event) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    struct Slot
+    {
+        // 2 * position + 1 while the event at position is written, 2 * position + 2 once it is readable
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<uint64_t> words[PAYLOAD_WORDS];
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    uint64_t mask;
+    std::atomic<uint64_t> head{0};
+
+public:
+    /**
+     * @param capacity Number of events kept, rounded up to a power of two.
+     */
+    explicit EventRing(size_t capacity);
+
+    EventRing(const EventRing &rhs) = delete;
+    EventRing &operator=(const EventRing &rhs) = delete;
+
+    void Publish(const Event &event);
+
+    /**
+     * @brief Copies the event at position.
+     */
+    ReadResult Read(uint64_t position, Event &event) const;
+
+    /**
+     * @brief The position the next published event will take. New readers start here.
+     */
+    uint64_t GetHead() const;
+    uint64_t GetCapacity() const;
+
+    /**
+     * @brief Copies a string into a fixed size event field.
+     *
+     * @return False if it does not fit.
+     */
+    template <size_t N>
+    static bool CopyField(char (&field)[N], std::string_view value)
+    {
+        if (value.size() >= N)
+        {
+            return false;
+        }
+
+        value.copy(field, value.size());
+        field[value.size()] = '\0';
+        return true;
+    }
+};
+
+#endif // EVENT_RING_H
@@ -0,0 +1,463 @@
+#include "height_bitmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+constexpr uint32_t HeightBitmap::CONTAINER_BITS;
+constexpr uint32_t HeightBitmap::CONTAINER_SIZE;
+constexpr uint32_t HeightBitmap::ARRAY_MAX_CARDINALITY;
+constexpr size_t HeightBitmap::BITSET_WORDS;
+constexpr char HeightBitmap::SERIALIZED_MAGIC[8];
+
+namespace
+{
+    // Serialized integers are little endian regardless of the host
+    template <typename T>
+    void AppendLittleEndian(std::string &out, T value)
+    {
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            out.push_back(static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xff));
+        }
+    }
+
+    template <typename T>
+    bool ReadLittleEndian(const std::string &in, size_t &offset, T &value)
+    {
+        if (offset > in.size() || in.size() - offset < sizeof(T))
+        {
+            return false;
+        }
+
+        uint64_t result{0};
+        for (size_t i = 0; i < sizeof(T); ++i)
+        {
+            result |= static_cast<uint64_t>(static_cast<uint8_t>(in[offset + i])) << (8 * i);
+        }
+
+        value = static_cast<T>(result);
+        offset += sizeof(T);
+
+        return true;
+    }
+
+    void AppendRange(std::vector<HeightBitmap::HeightRange> &ranges, uint64_t start, uint64_t end)
+    {
+        if (!ranges.empty() && ranges.back().second + 1 == start)
+        {
+            ranges.back().second = end;
+            return;
+        }
+
+        ranges.emplace_back(start, end);
+    }
+}
+
+bool HeightBitmap::Container::Contains(uint16_t low) const
+{
+    switch (this->kind)
+    {
+    case ContainerKind::Full:
+        return true;
+    case ContainerKind::Bitset:
+        return (this->bitset[low >> 6] >> (low & 63)) & 1;
+    default:
+        return std::binary_search(this->array.begin(), this->array.end(), low);
+    }
+}
+
+bool HeightBitmap::Container::Add(uint16_t low)
+{
+    if (this->kind == ContainerKind::Full)
+    {
+        return false;
+    }
+
+    if (this->kind == ContainerKind::Array)
+    {
+        auto position = std::lower_bound(this->array.begin(), this->array.end(), low);
+        if (position != this->array.end() && *position == low)
+        {
+            return false;
+        }
+
+        this->array.insert(position, low);
+        ++this->cardinality;
+
+        if (this->cardinality > ARRAY_MAX_CARDINALITY)
+        {
+            this->bitset.assign(BITSET_WORDS, 0);
+            for (uint16_t value : this->array)
+            {
+                this->bitset[value >> 6] |= 1ULL << (value & 63);
+            }
+
+            this->array.clear();
+            this->array.shrink_to_fit();
+            this->kind = ContainerKind::Bitset;
+        }
+
+        return true;
+    }
+
+    uint64_t &word = this->bitset[low >> 6];
+    const uint64_t bit = 1ULL << (low & 63);
+    if (word & bit)
+    {
+        return false;
+    }
+
+    word |= bit;
+    ++this->cardinality;
+
+    if (this->cardinality == CONTAINER_SIZE)
+    {
+        this->bitset.clear();
+        this->bitset.shrink_to_fit();
+        this->kind = ContainerKind::Full;
+    }
+
+    return true;
+}
+
+uint32_t HeightBitmap::Container::NextMissing(uint32_t fromLow) const
+{
+    if (fromLow >= CONTAINER_SIZE || this->kind == ContainerKind::Full)
+    {
+        return CONTAINER_SIZE;
+    }
+
+    if (this->kind == ContainerKind::Array)
+    {
+        uint32_t candidate = fromLow;
+        for (auto it = std::lower_bound(this->array.begin(), this->array.end(), static_cast<uint16_t>(fromLow)); it != this->array.end() && *it == candidate; ++it)
+        {
+            ++candidate;
+        }
+
+        return candidate;
+    }
+
+    size_t wordIndex = fromLow >> 6;
+    uint64_t unset = ~this->bitset[wordIndex] & (~0ULL << (fromLow & 63));
+
+    while (unset == 0)
+    {
+        if (++wordIndex == BITSET_WORDS)
+        {
+            return CONTAINER_SIZE;
+        }
+
+        unset = ~this->bitset[wordIndex];
+    }
+
+    return static_cast<uint32_t>(wordIndex * 64 + __builtin_ctzll(unset));
+}
+
+uint32_t HeightBitmap::Container::NextPresent(uint32_t fromLow) const
+{
+    if (fromLow >= CONTAINER_SIZE)
+    {
+        return CONTAINER_SIZE;
+    }
+
+    if (this->kind == ContainerKind::Full)
+    {
+        return fromLow;
+    }
+
+    if (this->kind == ContainerKind::Array)
+    {
+        auto it = std::lower_bound(this->array.begin(), this->array.end(), static_cast<uint16_t>(fromLow));
+        return it == this->array.end() ? CONTAINER_SIZE : *it;
+    }
+
+    size_t wordIndex = fromLow >> 6;
+    uint64_t set = this->bitset[wordIndex] & (~0ULL << (fromLow & 63));
+
+    while (set == 0)
+    {
+        if (++wordIndex == BITSET_WORDS)
+        {
+            return CONTAINER_SIZE;
+        }
+
+        set = this->bitset[wordIndex];
+    }
+
+    return static_cast<uint32_t>(wordIndex * 64 + __builtin_ctzll(set));
+}
+
+void HeightBitmap::Container::AppendMissing(uint64_t base, uint32_t fromLow, uint32_t toLow, std::vector<HeightRange> &ranges) const
+{
+    uint32_t gapStart = this->NextMissing(fromLow);
+
+    while (gapStart <= toLow)
+    {
+        uint32_t gapEnd = std::min(this->NextPresent(gapStart) - 1, toLow);
+        AppendRange(ranges, base + gapStart, base + gapEnd);
+
+        gapStart = this->NextMissing(gapEnd + 1);
+    }
+}
+
+void HeightBitmap::Add(uint64_t height)
+{
+    std::unique_lock<std::shared_mutex> lock(cs_bitmap);
+
+    if (this->containers[height >> CONTAINER_BITS].Add(static_cast<uint16_t>(height)))
+    {
+        ++this->cardinality;
+        ++this->version;
+    }
+}
+
+bool HeightBitmap::Contains(uint64_t height) const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_bitmap);
+
+    auto container = this->containers.find(height >> CONTAINER_BITS);
+    return container != this->containers.end() && container->second.Contains(static_cast<uint16_t>(height));
+}
+
+uint64_t HeightBitmap::Cardinality() const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_bitmap);
+    return this->cardinality;
+}
+
+std::optional<uint64_t> HeightBitmap::Maximum() const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_bitmap);
+
+    for (auto it = this->containers.rbegin(); it != this->containers.rend(); ++it)
+    {
+        const Container &container = it->second;
+        if (container.cardinality == 0)
+        {
+            continue;
+        }
+
+        uint64_t base = it->first << CONTAINER_BITS;
+        if (container.kind == ContainerKind::Full)
+        {
+            return base + CONTAINER_SIZE - 1;
+        }
+
+        if (container.kind == ContainerKind::Array)
+        {
+            return base + container.array.back();
+        }
+
+        for (size_t wordIndex = BITSET_WORDS; wordIndex-- > 0;)
+        {
+            if (container.bitset[wordIndex] != 0)
+            {
+                return base + wordIndex * 64 + (63 - __builtin_clzll(container.bitset[wordIndex]));
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+uint64_t HeightBitmap::NextMissing(uint64_t fromHeight) const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_bitmap);
+
+    uint64_t key = fromHeight >> CONTAINER_BITS;
+    uint32_t low = static_cast<uint16_t>(fromHeight);
+
+    for (auto it = this->containers.lower_bound(key); it != this->containers.end() && it->first == key; ++it, ++key, low = 0)
+    {
+        uint32_t missing = it->second.NextMissing(low);
+        if (missing < CONTAINER_SIZE)
+        {
+            return (key << CONTAINER_BITS) + missing;
+        }
+    }
+
+    return (key << CONTAINER_BITS) + low;
+}
+
+std::vector<HeightBitmap::HeightRange> HeightBitmap::MissingRanges(uint64_t fromHeight, uint64_t toHeight) const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_bitmap);
+
+    std::vector<HeightRange> ranges;
+    uint64_t cursor = fromHeight;
+    auto it = this->containers.lower_bound(fromHeight >> CONTAINER_BITS);
+
+    while (cursor <= toHeight)
+    {
+        const uint64_t cursorKey = cursor >> CONTAINER_BITS;
+
+        // Heights between containers were never committed
+        if (it == this->containers.end() || it->first > cursorKey)
+        {
+            uint64_t gapEnd = it == this->containers.end() ? toHeight : std::min(toHeight, (it->first << CONTAINER_BITS) - 1);
+            AppendRange(ranges, cursor, gapEnd);
+
+            if (it == this->containers.end())
+            {
+                break;
+            }
+
+            cursor = it->first << CONTAINER_BITS;
+            continue;
+        }
+
+        const uint64_t base = it->first << CONTAINER_BITS;
+        const uint32_t toLow = static_cast<uint32_t>(std::min<uint64_t>(toHeight - base, CONTAINER_SIZE - 1));
+        it->second.AppendMissing(base, static_cast<uint32_t>(cursor - base), toLow, ranges);
+
+        cursor = base + CONTAINER_SIZE;
+        ++it;
+    }
+
+    return ranges;
+}
+
+uint64_t HeightBitmap::GetVersion() const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_bitmap);
+    return this->version;
+}
+
+void HeightBitmap::Clear()
+{
+    std::unique_lock<std::shared_mutex> lock(cs_bitmap);
+
+    this->containers.clear();
+    this->cardinality = 0;
+    ++this->version;
+}
+
+std::string HeightBitmap::Serialize() const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_bitmap);
+
+    std::string bytes(SERIALIZED_MAGIC, sizeof(SERIALIZED_MAGIC));
+    AppendLittleEndian<uint64_t>(bytes, this->containers.size());
+    AppendLittleEndian<uint64_t>(bytes, this->cardinality);
+
+    for (const auto &[key, container] : this->containers)
+    {
+        AppendLittleEndian<uint64_t>(bytes, key);
+        AppendLittleEndian<uint8_t>(bytes, static_cast<uint8_t>(container.kind));
+        AppendLittleEndian<uint32_t>(bytes, container.cardinality);
+
+        if (container.kind == ContainerKind::Array)
+        {
+            for (uint16_t value : container.array)
+            {
+                AppendLittleEndian<uint16_t>(bytes, value);
+            }
+        }
+        else if (container.kind == ContainerKind::Bitset)
+        {
+            for (uint64_t word : container.bitset)
+            {
+                AppendLittleEndian<uint64_t>(bytes, word);
+            }
+        }
+    }
+
+    return bytes;
+}
+
+bool HeightBitmap::Deserialize(const std::string &bytes)
+{
+    if (bytes.size() < sizeof(SERIALIZED_MAGIC) || std::memcmp(bytes.data(), SERIALIZED_MAGIC, sizeof(SERIALIZED_MAGIC)) != 0)
+    {
+        return false;
+    }
+
+    size_t offset = sizeof(SERIALIZED_MAGIC);
+    uint64_t numContainers{0};
+    uint64_t totalCardinality{0};
+
+    if (!ReadLittleEndian(bytes, offset, numContainers) || !ReadLittleEndian(bytes, offset, totalCardinality))
+    {
+        return false;
+    }
+
+    std::map<uint64_t, Container> loaded;
+    uint64_t loadedCardinality{0};
+
+    for (uint64_t i = 0; i < numContainers; ++i)
+    {
+        uint64_t key{0};
+        uint8_t kind{0};
+        Container container;
+
+        if (!ReadLittleEndian(bytes, offset, key) || !ReadLittleEndian(bytes, offset, kind) || !ReadLittleEndian(bytes, offset, container.cardinality))
+        {
+            return false;
+        }
+
+        container.kind = static_cast<ContainerKind>(kind);
+
+        if (container.kind == ContainerKind::Array)
+        {
+            if (container.cardinality > ARRAY_MAX_CARDINALITY)
+            {
+                return false;
+            }
+
+            container.array.resize(container.cardinality);
+            for (uint16_t &value : container.array)
+            {
+                if (!ReadLittleEndian(bytes, offset, value))
+                {
+                    return false;
+                }
+            }
+
+            if (std::adjacent_find(container.array.begin(), container.array.end(), std::greater_equal<uint16_t>()) != container.array.end())
+            {
+                return false;
+            }
+        }
+        else if (container.kind == ContainerKind::Bitset)
+        {
+            uint64_t setBits{0};
+            container.bitset.resize(BITSET_WORDS);
+            for (uint64_t &word : container.bitset)
+            {
+                if (!ReadLittleEndian(bytes, offset, word))
+                {
+                    return false;
+                }
+
+                setBits += __builtin_popcountll(word);
+            }
+
+            if (setBits != container.cardinality)
+            {
+                return false;
+            }
+        }
+        else if (container.kind != ContainerKind::Full || container.cardinality != CONTAINER_SIZE)
+        {
+            return false;
+        }
+
+        loadedCardinality += container.cardinality;
+        loaded.emplace(key, std::move(container));
+    }
+
+    if (offset != bytes.size() || loadedCardinality != totalCardinality)
+    {
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(cs_bitmap);
+    this->containers = std::move(loaded);
+    this->cardinality = loadedCardinality;
+    ++this->version;
+
+    return true;
+}
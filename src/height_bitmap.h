@@ -0,0 +1,118 @@
+#ifndef HEIGHT_BITMAP_H
+#define HEIGHT_BITMAP_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * HeightBitmap
+ * Compressed set of committed block heights, laid out like a roaring bitmap. Heights are split into
+ * containers of 65536 by their upper bits. A container holds a sorted array of its low 16 bits while
+ * sparse, switches to a 8 KiB bitset once dense, and collapses to a single marker once every height in
+ * it is set, which is the common case behind the sync frontier.
+ *
+ * Chunks commit out of order, so the set answers both the contiguous watermark and the exact gaps below
+ * the highest committed height without touching the blocks table.
+ */
+class HeightBitmap
+{
+public:
+    using HeightRange = std::pair<uint64_t, uint64_t>;
+
+private:
+    static constexpr uint32_t CONTAINER_BITS = 16;
+    static constexpr uint32_t CONTAINER_SIZE = 1U << CONTAINER_BITS;
+    static constexpr uint32_t ARRAY_MAX_CARDINALITY = 4096;
+    static constexpr size_t BITSET_WORDS = CONTAINER_SIZE / 64;
+    static constexpr char SERIALIZED_MAGIC[8] = {'Z', 'H', 'B', 'M', 'A', 'P', '0', '1'};
+
+    enum class ContainerKind : uint8_t
+    {
+        Array = 0,
+        Bitset = 1,
+        Full = 2
+    };
+
+    struct Container
+    {
+        ContainerKind kind{ContainerKind::Array};
+        uint32_t cardinality{0};
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bitset;
+
+        bool Contains(uint16_t low) const;
+        bool Add(uint16_t low);
+
+        // Appends the unset low bits in [fromLow, toLow] as ranges offset by base
+        void AppendMissing(uint64_t base, uint32_t fromLow, uint32_t toLow, std::vector<HeightRange> &ranges) const;
+
+        // First unset (or set) low bit at or above fromLow, or CONTAINER_SIZE if there is none
+        uint32_t NextMissing(uint32_t fromLow) const;
+        uint32_t NextPresent(uint32_t fromLow) const;
+    };
+
+    mutable std::shared_mutex cs_bitmap;
+    std::map<uint64_t, Container> containers;
+    uint64_t cardinality{0};
+    uint64_t version{0};
+
+public:
+    HeightBitmap() = default;
+
+    HeightBitmap(const HeightBitmap &rhs) = delete;
+    HeightBitmap &operator=(const HeightBitmap &rhs) = delete;
+
+    /**
+     * @brief Marks a height as committed.
+     */
+    void Add(uint64_t height);
+    bool Contains(uint64_t height) const;
+
+    uint64_t Cardinality() const;
+
+    /**
+     * @brief Returns the highest committed height, or std::nullopt if none is committed.
+     */
+    std::optional<uint64_t> Maximum() const;
+
+    /**
+     * @brief Returns the lowest height at or above fromHeight that is not committed.
+     *
+     * With fromHeight 0 this is the contiguous watermark: every height below it is committed.
+     */
+    uint64_t NextMissing(uint64_t fromHeight) const;
+
+    /**
+     * @brief Returns every maximal range of uncommitted heights within [fromHeight, toHeight].
+     *
+     * Full containers are skipped whole, so the cost follows the number of gaps and partially
+     * filled containers rather than the number of heights.
+     */
+    std::vector<HeightRange> MissingRanges(uint64_t fromHeight, uint64_t toHeight) const;
+
+    /**
+     * @brief Increases on every change, so callers can skip persisting an unchanged bitmap.
+     */
+    uint64_t GetVersion() const;
+
+    void Clear();
+
+    /**
+     * @brief Serializes the bitmap to a portable byte string.
+     */
+    std::string Serialize() const;
+
+    /**
+     * @brief Replaces the bitmap with one produced by Serialize.
+     *
+     * @return False if the bytes are not a valid serialized bitmap, leaving the bitmap unchanged.
+     */
+    bool Deserialize(const std::string &bytes);
+};
+
+#endif // HEIGHT_BITMAP_H
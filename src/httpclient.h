@@ -31,7 +31,7 @@ public:
     Json::Value getblockcount();
     Json::Value getblockheader(const Json::Value &param01, const Json::Value &param02);
     Json::Value getblock(const Json::Value &param01, const Json::Value &param02);
-    std::string base64Encode(const std::string &input);
+    static std::string base64Encode(const std::string &input);
     Json::Value getpeerinfo();
 };
 
@@ -0,0 +1,217 @@
+#include "indexing_rules.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    uint8_t TableBit(IndexedTable table)
+    {
+        return static_cast<uint8_t>(1u << static_cast<uint8_t>(table));
+    }
+
+    IndexedTable ParseTable(const std::string &name)
+    {
+        if (name == "transactions")
+            return IndexedTable::Transactions;
+        if (name == "transparent_inputs")
+            return IndexedTable::TransparentInputs;
+        if (name == "transparent_outputs")
+            return IndexedTable::TransparentOutputs;
+        if (name == "nullifiers")
+            return IndexedTable::Nullifiers;
+        if (name == "note_commitments")
+            return IndexedTable::NoteCommitments;
+
+        throw std::invalid_argument("Unknown table in indexing rules: " + name);
+    }
+
+    bool HasShieldedComponents(const Json::Value &tx)
+    {
+        return tx["vjoinsplit"].size() > 0 || tx["vShieldedSpend"].size() > 0 || tx["vShieldedOutput"].size() > 0 ||
+               tx["orchard"]["actions"].size() > 0;
+    }
+}
+
+void IndexingRules::AddWatchedAddress(std::string_view address)
+{
+    if (address.empty() || this->watchedAddresses.count(address) > 0)
+    {
+        return;
+    }
+
+    this->addressStorage.emplace_back(address);
+    this->watchedAddresses.insert(this->addressStorage.back());
+}
+
+IndexingRules IndexingRules::LoadFromFile(const std::string &path)
+{
+    IndexingRules rules;
+
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        return rules;
+    }
+
+    Json::Value config;
+    std::string parseErrors;
+    Json::CharReaderBuilder readerBuilder;
+    if (!Json::parseFromStream(readerBuilder, file, &config, &parseErrors) || !config.isObject())
+    {
+        throw std::invalid_argument("Invalid indexing rules in " + path + ": " + parseErrors);
+    }
+
+    rules.isIndexingEverything = false;
+
+    if (config.isMember("tables"))
+    {
+        rules.enabledTables = 0;
+        for (const Json::Value &table : config["tables"])
+        {
+            rules.enabledTables |= TableBit(ParseTable(table.asString()));
+        }
+    }
+
+    for (const Json::Value &address : config["addresses"])
+    {
+        rules.AddWatchedAddress(address.asString());
+    }
+
+    // Large watch lists are kept in plain files, one address per line
+    for (const Json::Value &addressFile : config["address_files"])
+    {
+        std::ifstream addresses(addressFile.asString());
+        if (!addresses.is_open())
+        {
+            throw std::invalid_argument("Cannot open address file " + addressFile.asString());
+        }
+
+        std::string line;
+        while (std::getline(addresses, line))
+        {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            rules.AddWatchedAddress(line);
+        }
+    }
+
+    if (config.isMember("transaction_versions"))
+    {
+        rules.allowedVersions = 0;
+        for (const Json::Value &version : config["transaction_versions"])
+        {
+            rules.allowedVersions |= uint64_t{1} << std::min<uint64_t>(version.asUInt64(), 63);
+        }
+    }
+
+    const std::string shielded = config.get("shielded", "any").asString();
+    if (shielded == "only")
+    {
+        rules.shieldedRule = ShieldedRule::Only;
+    }
+    else if (shielded == "exclude")
+    {
+        rules.shieldedRule = ShieldedRule::Exclude;
+    }
+    else if (shielded != "any")
+    {
+        throw std::invalid_argument("Unknown shielded rule: " + shielded);
+    }
+
+    rules.includeCoinbase = config.get("include_coinbase", true).asBool();
+
+    for (const Json::Value &scriptType : config["output_script_types"])
+    {
+        rules.outputScriptTypes.push_back(scriptType.asString());
+    }
+
+    rules.minOutputValue = config.get("min_output_value", 0.0).asDouble();
+
+    return rules;
+}
+
+bool IndexingRules::IsTableEnabled(IndexedTable table) const
+{
+    return (this->enabledTables & TableBit(table)) != 0;
+}
+
+bool IndexingRules::IsIndexingEverything() const
+{
+    return this->isIndexingEverything;
+}
+
+bool IndexingRules::HasAddressFilter() const
+{
+    return !this->watchedAddresses.empty();
+}
+
+bool IndexingRules::IsWatchedAddress(std::string_view address) const
+{
+    return this->watchedAddresses.count(address) > 0;
+}
+
+bool IndexingRules::MatchesTransaction(const Json::Value &tx) const
+{
+    if (this->isIndexingEverything)
+    {
+        return true;
+    }
+
+    const uint64_t version = std::min<uint64_t>(tx["version"].asUInt64(), 63);
+    if ((this->allowedVersions & (uint64_t{1} << version)) == 0)
+    {
+        return false;
+    }
+
+    if (!this->includeCoinbase && tx["vin"].size() > 0 && tx["vin"][0].isMember("coinbase"))
+    {
+        return false;
+    }
+
+    if (this->shieldedRule != ShieldedRule::Any)
+    {
+        return HasShieldedComponents(tx) == (this->shieldedRule == ShieldedRule::Only);
+    }
+
+    return true;
+}
+
+bool IndexingRules::MatchesOutput(const Json::Value &output) const
+{
+    if (this->isIndexingEverything)
+    {
+        return true;
+    }
+
+    if (output["value"].asDouble() < this->minOutputValue)
+    {
+        return false;
+    }
+
+    if (!this->outputScriptTypes.empty())
+    {
+        const std::string scriptType = output["scriptPubKey"]["type"].asString();
+        return std::find(this->outputScriptTypes.begin(), this->outputScriptTypes.end(), scriptType) != this->outputScriptTypes.end();
+    }
+
+    return true;
+}
+
+std::string IndexingRules::Describe() const
+{
+    if (this->isIndexingEverything)
+    {
+        return "indexing every transaction";
+    }
+
+    std::string description = "tables mask=" + std::to_string(this->enabledTables) +
+                              ", watched addresses=" + std::to_string(this->watchedAddresses.size()) +
+                              ", min output value=" + std::to_string(this->minOutputValue) +
+                              ", script types=" + std::to_string(this->outputScriptTypes.size()) +
+                              ", coinbase=" + (this->includeCoinbase ? "included" : "excluded");
+
+    return description;
+}
@@ -0,0 +1,119 @@
+#ifndef INDEXING_RULES_H
+#define INDEXING_RULES_H
+
+#include <jsonrpccpp/common/jsonparser.h>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Tables populated from a block besides blocks, which is always written as sync progress is read from it.
+ */
+enum class IndexedTable : uint8_t
+{
+    Transactions = 0,
+    TransparentInputs = 1,
+    TransparentOutputs = 2,
+    Nullifiers = 3,
+    NoteCommitments = 4
+};
+
+/**
+ * IndexingRules
+ * Declarative filter deciding which transactions and outputs of a block are indexed. Rules are read
+ * once from a JSON file and compiled into flags, bitmasks and a hashed address set, so checking a
+ * transaction costs a few comparisons and one hash lookup per address. An absent file indexes everything.
+ *
+ *   {
+ *     "tables": ["transactions", "transparent_inputs", "transparent_outputs", "nullifiers", "note_commitments"],
+ *     "addresses": ["t1...", "t3..."],
+ *     "address_files": ["watched_addresses.txt"],
+ *     "transaction_versions": [4, 5],
+ *     "shielded": "any" | "only" | "exclude",
+ *     "include_coinbase": true,
+ *     "output_script_types": ["pubkeyhash", "scripthash"],
+ *     "min_output_value": 0.0
+ *   }
+ *
+ * A transaction is indexed when its version and shielded components are allowed and, if addresses are
+ * watched, one of its outputs pays or one of its inputs spends from a watched address. Within an
+ * indexed transaction only outputs of an allowed script type and at least min_output_value are stored.
+ * Inputs can only match through the prevouts resolved for them, so with deferred input valuation only
+ * outputs are matched against watched addresses. Otherwise blocks are committed in height order while
+ * addresses are watched, so the output an input spends is always committed before the input is matched.
+ *
+ * Block totals count every transaction, but an input is only valued if its prevout is known. Outputs
+ * of skipped transactions are never stored, so under an address filter an input spending one from an
+ * earlier block counts as zero and total_transparent_input of blocks and transactions is partial.
+ */
+class IndexingRules
+{
+private:
+    static constexpr uint8_t ALL_TABLES = 0x1F;
+
+    enum class ShieldedRule
+    {
+        Any,
+        Only,
+        Exclude
+    };
+
+    uint8_t enabledTables{ALL_TABLES};
+
+    // Owns the watched addresses viewed by watchedAddresses
+    std::deque<std::string> addressStorage;
+    std::unordered_set<std::string_view> watchedAddresses;
+
+    // Bit n allows transaction version n; versions above 63 share the top bit
+    uint64_t allowedVersions{~uint64_t{0}};
+    ShieldedRule shieldedRule{ShieldedRule::Any};
+    bool includeCoinbase{true};
+
+    std::vector<std::string> outputScriptTypes;
+    double minOutputValue{0.0};
+
+    bool isIndexingEverything{true};
+
+    void AddWatchedAddress(std::string_view address);
+
+public:
+    /**
+     * @brief Rules that index every transaction into every table.
+     */
+    IndexingRules() = default;
+
+    // The address set views strings owned by the rules, which survive a move but not a copy
+    IndexingRules(const IndexingRules &rhs) = delete;
+    IndexingRules &operator=(const IndexingRules &rhs) = delete;
+
+    IndexingRules(IndexingRules &&rhs) noexcept = default;
+    IndexingRules &operator=(IndexingRules &&rhs) noexcept = default;
+
+    /**
+     * @brief Compiles the rules in path. A missing file indexes everything; an invalid one throws.
+     */
+    static IndexingRules LoadFromFile(const std::string &path);
+
+    bool IsTableEnabled(IndexedTable table) const;
+    bool IsIndexingEverything() const;
+    bool HasAddressFilter() const;
+    bool IsWatchedAddress(std::string_view address) const;
+
+    /**
+     * @brief Checks the transaction's version, shielded components and coinbase status.
+     */
+    bool MatchesTransaction(const Json::Value &tx) const;
+
+    /**
+     * @brief Checks an output's script type and value.
+     */
+    bool MatchesOutput(const Json::Value &output) const;
+
+    std::string Describe() const;
+};
+
+#endif // INDEXING_RULES_H
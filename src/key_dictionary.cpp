@@ -0,0 +1,100 @@
+#include "key_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+KeyDictionary::Shard &KeyDictionary::ShardFor(std::string_view key)
+{
+    return this->shards[std::hash<std::string_view>{}(key) % NUM_SHARDS];
+}
+
+const KeyDictionary::Shard &KeyDictionary::ShardFor(std::string_view key) const
+{
+    return this->shards[std::hash<std::string_view>{}(key) % NUM_SHARDS];
+}
+
+std::string_view KeyDictionary::CopyKey(Shard &shard, std::string_view key)
+{
+    // Keys are never removed, so they are packed end to end without per-key allocations
+    char *copy = static_cast<char *>(shard.keyStorage.allocate(std::max<size_t>(key.size(), 1), 1));
+    std::memcpy(copy, key.data(), key.size());
+    return std::string_view(copy, key.size());
+}
+
+void KeyDictionary::InsertStored(std::string_view key, uint64_t id)
+{
+    Shard &shard = this->ShardFor(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.cs_shard);
+        if (shard.entries.find(key) == shard.entries.end())
+        {
+            shard.entries.emplace(CopyKey(shard, key), Entry{id, true});
+        }
+    }
+
+    uint64_t next = this->nextId.load();
+    while (next <= id && !this->nextId.compare_exchange_weak(next, id + 1))
+    {
+    }
+}
+
+uint64_t KeyDictionary::GetOrAssign(std::string_view key, std::vector<NewKey> &unstored)
+{
+    Shard &shard = this->ShardFor(key);
+    std::lock_guard<std::mutex> lock(shard.cs_shard);
+
+    auto entry = shard.entries.find(key);
+    if (entry == shard.entries.end())
+    {
+        entry = shard.entries.emplace(CopyKey(shard, key), Entry{this->nextId++, false}).first;
+    }
+
+    if (!entry->second.isStored)
+    {
+        unstored.push_back(NewKey{entry->second.id, entry->first});
+    }
+
+    return entry->second.id;
+}
+
+std::optional<uint64_t> KeyDictionary::Find(std::string_view key) const
+{
+    const Shard &shard = this->ShardFor(key);
+    std::lock_guard<std::mutex> lock(shard.cs_shard);
+
+    auto entry = shard.entries.find(key);
+    if (entry == shard.entries.end())
+    {
+        return std::nullopt;
+    }
+
+    return entry->second.id;
+}
+
+void KeyDictionary::MarkStored(const std::vector<NewKey> &keys)
+{
+    for (const NewKey &newKey : keys)
+    {
+        Shard &shard = this->ShardFor(newKey.key);
+        std::lock_guard<std::mutex> lock(shard.cs_shard);
+
+        auto entry = shard.entries.find(newKey.key);
+        if (entry != shard.entries.end())
+        {
+            entry->second.isStored = true;
+        }
+    }
+}
+
+size_t KeyDictionary::Size() const
+{
+    size_t size{0};
+    for (const Shard &shard : this->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.cs_shard);
+        size += shard.entries.size();
+    }
+
+    return size;
+}
@@ -0,0 +1,87 @@
+#ifndef KEY_DICTIONARY_H
+#define KEY_DICTIONARY_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * KeyDictionary
+ * Assigns compact integer ids to string keys such as txids and addresses, for the dictionary-encoded
+ * schema. Ids are assigned in process, so encoding a block's rows takes no database round trip. The
+ * dictionary is sharded by key hash, so workers encoding different blocks rarely share a lock.
+ *
+ * An id is only usable by readers once the row mapping it to its key is committed. A key stays
+ * unstored until MarkStored() is called after such a commit, and every block referencing an unstored
+ * key writes the mapping itself, so a block that aborts never leaves the next one with a dangling id.
+ */
+class KeyDictionary
+{
+public:
+    struct NewKey
+    {
+        uint64_t id;
+        // Views the dictionary's own copy of the key, valid for the dictionary's lifetime
+        std::string_view key;
+    };
+
+private:
+    static constexpr size_t NUM_SHARDS = 64;
+
+    struct Entry
+    {
+        uint64_t id;
+        bool isStored;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex cs_shard;
+        std::pmr::monotonic_buffer_resource keyStorage;
+        std::unordered_map<std::string_view, Entry> entries;
+    };
+
+    std::array<Shard, NUM_SHARDS> shards;
+    std::atomic<uint64_t> nextId{1};
+
+    Shard &ShardFor(std::string_view key);
+    const Shard &ShardFor(std::string_view key) const;
+
+    static std::string_view CopyKey(Shard &shard, std::string_view key);
+
+public:
+    KeyDictionary() = default;
+
+    KeyDictionary(const KeyDictionary &rhs) = delete;
+    KeyDictionary &operator=(const KeyDictionary &rhs) = delete;
+
+    /**
+     * @brief Adds a key already stored with the given id, when seeding from the database. Ids assigned later start above it.
+     */
+    void InsertStored(std::string_view key, uint64_t id);
+
+    /**
+     * @brief Returns the key's id, assigning the next free one if the key is new.
+     *
+     * @param unstored Receives the key if its mapping is not known to be committed yet. Keys
+     * referenced repeatedly are appended repeatedly.
+     */
+    uint64_t GetOrAssign(std::string_view key, std::vector<NewKey> &unstored);
+
+    std::optional<uint64_t> Find(std::string_view key) const;
+
+    /**
+     * @brief Records that the mappings of the keys were committed.
+     */
+    void MarkStored(const std::vector<NewKey> &keys);
+
+    size_t Size() const;
+};
+
+#endif // KEY_DICTIONARY_H
@@ -0,0 +1,711 @@
+#include "local_store.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr uint32_t LocalStore::RECORD_MAGIC;
+constexpr uint64_t LocalStore::SEGMENT_MAX_BYTES;
+
+namespace
+{
+    // Table ids are the position in this list, so tables may only be appended
+    const std::array<std::string, 7> TABLE_NAMES{"blocks", "transactions", "transparent_inputs", "transparent_outputs", "nullifiers", "note_commitments", "transaction_raw"};
+
+    constexpr char SEGMENT_PREFIX[] = "blocks-";
+    constexpr char SEGMENT_SUFFIX[] = ".log";
+
+    std::runtime_error SystemError(const std::string &message)
+    {
+        return std::runtime_error(message + ": " + std::strerror(errno));
+    }
+
+    uint32_t Crc32(std::string_view bytes)
+    {
+        static const std::array<uint32_t, 256> table = []
+        {
+            std::array<uint32_t, 256> entries{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+                }
+                entries[i] = value;
+            }
+            return entries;
+        }();
+
+        uint32_t crc = 0xFFFFFFFFu;
+        for (unsigned char byte : bytes)
+        {
+            crc = table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+        }
+
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    template <typename T>
+    void Put(std::string &out, T value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    /**
+     * Bounds checked reader over a record payload. Reads past the end fail instead of throwing, so a
+     * malformed record is reported like a bad checksum.
+     */
+    class PayloadReader
+    {
+    private:
+        std::string_view payload;
+        size_t offset{0};
+
+    public:
+        explicit PayloadReader(std::string_view payloadIn) : payload(payloadIn) {}
+
+        template <typename T>
+        bool Get(T &value)
+        {
+            if (this->payload.size() - this->offset < sizeof(T))
+            {
+                return false;
+            }
+
+            std::memcpy(&value, this->payload.data() + this->offset, sizeof(T));
+            this->offset += sizeof(T);
+            return true;
+        }
+
+        bool GetBytes(size_t length, std::string_view &bytes)
+        {
+            if (this->payload.size() - this->offset < length)
+            {
+                return false;
+            }
+
+            bytes = this->payload.substr(this->offset, length);
+            this->offset += length;
+            return true;
+        }
+
+        bool IsAtEnd() const
+        {
+            return this->offset == this->payload.size();
+        }
+    };
+
+    bool WriteFully(int fd, const std::string &bytes)
+    {
+        size_t written{0};
+        while (written < bytes.size())
+        {
+            const ssize_t result = ::write(fd, bytes.data() + written, bytes.size() - written);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            written += static_cast<size_t>(result);
+        }
+
+        return true;
+    }
+}
+
+LocalStore::LocalStore(const std::string &directoryIn, uint64_t outpointIndexCapacity) : directory(directoryIn)
+{
+    std::filesystem::create_directories(this->directory);
+
+    this->outpoints = std::make_unique<OutpointIndex>(this->directory + "/outpoints", outpointIndexCapacity);
+    this->LoadCheckpoints();
+
+    std::vector<uint64_t> segmentNumbers;
+    for (const auto &entry : std::filesystem::directory_iterator(this->directory))
+    {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind(SEGMENT_PREFIX, 0) == 0 && name.size() > sizeof(SEGMENT_PREFIX) - 1 + sizeof(SEGMENT_SUFFIX) - 1 &&
+            name.compare(name.size() - (sizeof(SEGMENT_SUFFIX) - 1), std::string::npos, SEGMENT_SUFFIX) == 0)
+        {
+            segmentNumbers.push_back(std::stoull(name.substr(sizeof(SEGMENT_PREFIX) - 1)));
+        }
+    }
+    std::sort(segmentNumbers.begin(), segmentNumbers.end());
+
+    const uint64_t appliedBefore = this->outpoints->GetAppliedHeights().Cardinality();
+    for (size_t i = 0; i < segmentNumbers.size(); ++i)
+    {
+        this->ScanSegment(segmentNumbers[i], i + 1 == segmentNumbers.size());
+    }
+
+    if (this->outpoints->GetAppliedHeights().Cardinality() != appliedBefore)
+    {
+        this->outpoints->Flush();
+    }
+
+    this->OpenSegment(segmentNumbers.empty() ? 1 : segmentNumbers.back());
+
+    __INFO__(("Opened local store at " + this->directory + " with " + std::to_string(this->storedHeights.Cardinality()) + " blocks in " +
+              std::to_string(segmentNumbers.size()) + " segments.")
+                 .c_str());
+}
+
+LocalStore::~LocalStore() noexcept
+{
+    try
+    {
+        this->Flush();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+
+    if (this->segmentFd >= 0)
+    {
+        ::close(this->segmentFd);
+    }
+}
+
+std::string LocalStore::SegmentPath(uint64_t number) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%s%06llu%s", SEGMENT_PREFIX, static_cast<unsigned long long>(number), SEGMENT_SUFFIX);
+    return this->directory + "/" + name;
+}
+
+std::string LocalStore::CheckpointsPath() const
+{
+    return this->directory + "/checkpoints";
+}
+
+void LocalStore::ScanSegment(uint64_t number, bool isLastSegment)
+{
+    const std::string path = this->SegmentPath(number);
+    const int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        throw SystemError("Unable to open local store segment " + path);
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0)
+    {
+        ::close(fd);
+        throw SystemError("Unable to stat local store segment " + path);
+    }
+
+    const uint64_t fileSize = static_cast<uint64_t>(fileStat.st_size);
+    uint64_t offset{0};
+    std::string payload;
+
+    while (offset < fileSize)
+    {
+        RecordHeader header{};
+        bool isValid = fileSize - offset >= sizeof(RecordHeader) &&
+                       ::pread(fd, &header, sizeof(header), static_cast<off_t>(offset)) == static_cast<ssize_t>(sizeof(header)) &&
+                       header.magic == RECORD_MAGIC && fileSize - offset - sizeof(RecordHeader) >= header.length;
+
+        if (isValid)
+        {
+            payload.resize(header.length);
+            isValid = ::pread(fd, payload.data(), header.length, static_cast<off_t>(offset + sizeof(RecordHeader))) == static_cast<ssize_t>(header.length) &&
+                      Crc32(payload) == header.checksum;
+        }
+
+        uint64_t height{0};
+        OrmStorageMap orm_storage_map;
+        if (isValid)
+        {
+            isValid = DecodeRecord(payload, height, orm_storage_map);
+        }
+
+        if (!isValid)
+        {
+            if (!isLastSegment)
+            {
+                ::close(fd);
+                throw std::runtime_error("Local store segment " + path + " is corrupt at offset " + std::to_string(offset));
+            }
+
+            // Appends past the last flush may be torn by a crash. Their heights were never persisted as committed.
+            __ERROR__(("Truncating torn record at offset " + std::to_string(offset) + " of " + path).c_str());
+            if (::ftruncate(fd, static_cast<off_t>(offset)) != 0)
+            {
+                ::close(fd);
+                throw SystemError("Unable to truncate local store segment " + path);
+            }
+            break;
+        }
+
+        this->storedHeights.Add(height);
+        if (!this->outpoints->GetAppliedHeights().Contains(height))
+        {
+            this->ApplyToOutpoints(orm_storage_map, height);
+        }
+
+        offset += sizeof(RecordHeader) + header.length;
+    }
+
+    ::close(fd);
+}
+
+void LocalStore::OpenSegment(uint64_t number)
+{
+    const std::string path = this->SegmentPath(number);
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        throw SystemError("Unable to open local store segment " + path);
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0)
+    {
+        ::close(fd);
+        throw SystemError("Unable to stat local store segment " + path);
+    }
+
+    if (this->segmentFd >= 0)
+    {
+        ::close(this->segmentFd);
+    }
+
+    this->segmentFd = fd;
+    this->segmentNumber = number;
+    this->segmentBytes = static_cast<uint64_t>(fileStat.st_size);
+}
+
+void LocalStore::RollSegment()
+{
+    // A full segment is synced once, so Flush() only ever has the current segment to sync
+    if (::fdatasync(this->segmentFd) != 0)
+    {
+        throw SystemError("Unable to sync local store segment " + this->SegmentPath(this->segmentNumber));
+    }
+
+    this->OpenSegment(this->segmentNumber + 1);
+}
+
+std::string LocalStore::EncodeRecord(uint64_t height, std::string_view hash, const OrmStorageMap &orm_storage_map)
+{
+    std::string record(sizeof(RecordHeader), '\0');
+
+    Put<uint64_t>(record, height);
+    Put<uint16_t>(record, static_cast<uint16_t>(hash.size()));
+    record.append(hash);
+    Put<uint8_t>(record, static_cast<uint8_t>(orm_storage_map.size()));
+
+    for (const auto &[tableName, tableData] : orm_storage_map)
+    {
+        const auto table = std::find(TABLE_NAMES.begin(), TABLE_NAMES.end(), tableName);
+        if (table == TABLE_NAMES.end())
+        {
+            throw std::invalid_argument("Local store has no id for table " + tableName);
+        }
+
+        Put<uint8_t>(record, static_cast<uint8_t>(table - TABLE_NAMES.begin()));
+        Put<uint32_t>(record, static_cast<uint32_t>(tableData.size()));
+
+        for (const OrmRow &row : tableData)
+        {
+            Put<uint8_t>(record, static_cast<uint8_t>(row.size()));
+
+            for (const BlockData &value : row)
+            {
+                // Each value is tagged with its alternative in BlockData
+                Put<uint8_t>(record, static_cast<uint8_t>(value.index()));
+                std::visit([&record](auto &&arg)
+                           {
+                               using T = std::decay_t<decltype(arg)>;
+                               if constexpr (std::is_same_v<T, std::string_view>)
+                               {
+                                   Put<uint32_t>(record, static_cast<uint32_t>(arg.size()));
+                                   record.append(arg);
+                               }
+                               else
+                               {
+                                   Put<T>(record, arg);
+                               } },
+                           value);
+            }
+        }
+    }
+
+    const std::string_view payload = std::string_view(record).substr(sizeof(RecordHeader));
+    const RecordHeader header{RECORD_MAGIC, static_cast<uint32_t>(payload.size()), Crc32(payload), 0};
+    std::memcpy(record.data(), &header, sizeof(header));
+
+    return record;
+}
+
+bool LocalStore::DecodeRecord(std::string_view payload, uint64_t &height, OrmStorageMap &orm_storage_map)
+{
+    PayloadReader reader(payload);
+
+    uint16_t hashLength{0};
+    std::string_view hash;
+    uint8_t numTables{0};
+    if (!reader.Get(height) || !reader.Get(hashLength) || !reader.GetBytes(hashLength, hash) || !reader.Get(numTables))
+    {
+        return false;
+    }
+
+    for (uint8_t t = 0; t < numTables; ++t)
+    {
+        uint8_t tableId{0};
+        uint32_t numRows{0};
+        if (!reader.Get(tableId) || !reader.Get(numRows) || tableId >= TABLE_NAMES.size())
+        {
+            return false;
+        }
+
+        OrmRows &rows = orm_storage_map[TABLE_NAMES[tableId]];
+        for (uint32_t r = 0; r < numRows; ++r)
+        {
+            uint8_t numColumns{0};
+            if (!reader.Get(numColumns))
+            {
+                return false;
+            }
+
+            OrmRow &row = rows.emplace_back();
+            row.reserve(numColumns);
+
+            for (uint8_t c = 0; c < numColumns; ++c)
+            {
+                uint8_t kind{0};
+                if (!reader.Get(kind))
+                {
+                    return false;
+                }
+
+                bool isRead{false};
+                switch (kind)
+                {
+                case 0:
+                {
+                    uint32_t length{0};
+                    std::string_view bytes;
+                    isRead = reader.Get(length) && reader.GetBytes(length, bytes);
+                    row.emplace_back(bytes);
+                    break;
+                }
+                case 1:
+                {
+                    uint16_t value{0};
+                    isRead = reader.Get(value);
+                    row.emplace_back(value);
+                    break;
+                }
+                case 2:
+                {
+                    uint64_t value{0};
+                    isRead = reader.Get(value);
+                    row.emplace_back(value);
+                    break;
+                }
+                case 3:
+                {
+                    double value{0.0};
+                    isRead = reader.Get(value);
+                    row.emplace_back(value);
+                    break;
+                }
+                default:
+                    break;
+                }
+
+                if (!isRead)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return reader.IsAtEnd();
+}
+
+void LocalStore::ApplyToOutpoints(const OrmStorageMap &orm_storage_map, uint64_t height)
+{
+    // Outputs before spends, so outputs created and spent within the block end up spent
+    auto outputs = orm_storage_map.find("transparent_outputs");
+    if (outputs != orm_storage_map.end())
+    {
+        for (const auto &outputRow : outputs->second)
+        {
+            this->outpoints->Insert(std::get<std::string_view>(outputRow[0]), static_cast<uint32_t>(std::get<uint64_t>(outputRow[1])), std::get<double>(outputRow[3]), std::get<std::string_view>(outputRow[2]), height);
+        }
+    }
+
+    auto inputs = orm_storage_map.find("transparent_inputs");
+    if (inputs != orm_storage_map.end())
+    {
+        for (const auto &inputRow : inputs->second)
+        {
+            this->outpoints->MarkSpent(std::get<std::string_view>(inputRow[1]), static_cast<uint32_t>(std::get<uint64_t>(inputRow[2])), height);
+        }
+    }
+
+    this->outpoints->MarkHeightApplied(height);
+}
+
+std::string LocalStore::GetName() const
+{
+    return "local";
+}
+
+StorageBackend::WriteResult LocalStore::WriteBlock(uint64_t height, std::string_view hash, const OrmStorageMap &orm_storage_map)
+{
+    const std::string record = EncodeRecord(height, hash, orm_storage_map);
+
+    {
+        std::lock_guard<std::mutex> lock(cs_log);
+
+        if (this->storedHeights.Contains(height))
+        {
+            return WriteResult::AlreadyStored;
+        }
+
+        if (this->segmentBytes > 0 && this->segmentBytes + record.size() > SEGMENT_MAX_BYTES)
+        {
+            this->RollSegment();
+        }
+
+        if (!WriteFully(this->segmentFd, record))
+        {
+            const std::runtime_error error = SystemError("Unable to append block " + std::to_string(height) + " to " + this->SegmentPath(this->segmentNumber));
+
+            // Drop a partial append so the next record starts on a record boundary
+            if (::ftruncate(this->segmentFd, static_cast<off_t>(this->segmentBytes)) != 0)
+            {
+                __ERROR__(("Unable to truncate partial record in " + this->SegmentPath(this->segmentNumber)).c_str());
+            }
+            throw error;
+        }
+
+        this->segmentBytes += record.size();
+        this->storedHeights.Add(height);
+    }
+
+    this->ApplyToOutpoints(orm_storage_map, height);
+    return WriteResult::Written;
+}
+
+PrevoutMap LocalStore::ResolvePrevouts(const std::vector<Outpoint> &outpointsIn)
+{
+    PrevoutMap prevouts;
+    prevouts.reserve(outpointsIn.size());
+
+    for (const Outpoint &outpoint : outpointsIn)
+    {
+        std::optional<OutpointIndex::Entry> entry = this->outpoints->Find(outpoint.txId, outpoint.vout);
+        if (entry.has_value())
+        {
+            prevouts.emplace(outpoint, Prevout{entry->value, std::move(entry->recipients)});
+        }
+    }
+
+    return prevouts;
+}
+
+std::optional<uint64_t> LocalStore::GetTipHeight()
+{
+    return this->storedHeights.Maximum();
+}
+
+void LocalStore::LoadStoredHeights(HeightBitmap &heights)
+{
+    const std::optional<uint64_t> tip = this->storedHeights.Maximum();
+    if (!tip.has_value())
+    {
+        return;
+    }
+
+    // Stored heights are the complement of the missing ranges up to the tip
+    uint64_t nextHeight{0};
+    auto addRange = [&heights](uint64_t first, uint64_t last)
+    {
+        for (uint64_t height = first; height <= last; ++height)
+        {
+            heights.Add(height);
+        }
+    };
+
+    for (const auto &[missingFirst, missingLast] : this->storedHeights.MissingRanges(0, tip.value()))
+    {
+        if (missingFirst > nextHeight)
+        {
+            addRange(nextHeight, missingFirst - 1);
+        }
+        nextHeight = missingLast + 1;
+    }
+
+    if (nextHeight <= tip.value())
+    {
+        addRange(nextHeight, tip.value());
+    }
+}
+
+size_t LocalStore::UnmarkSpendsAbove(uint64_t height)
+{
+    const std::runtime_error error("The local store cannot undo spends above height " + std::to_string(height) + ", as its outpoint index keeps no spend heights");
+    __ERROR__(error.what());
+    throw error;
+}
+
+void LocalStore::Flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_log);
+        if (this->segmentFd >= 0 && ::fdatasync(this->segmentFd) != 0)
+        {
+            throw SystemError("Unable to sync local store segment " + this->SegmentPath(this->segmentNumber));
+        }
+    }
+
+    this->outpoints->Flush();
+}
+
+void LocalStore::LoadCheckpoints()
+{
+    std::lock_guard<std::mutex> lock(cs_checkpoints);
+
+    std::ifstream file(this->CheckpointsPath());
+    Checkpoint checkpoint{};
+    while (file >> checkpoint.chunkStartHeight >> checkpoint.chunkEndHeight >> checkpoint.lastCheckpoint)
+    {
+        this->checkpoints[checkpoint.chunkStartHeight] = checkpoint;
+    }
+}
+
+void LocalStore::SaveCheckpoints()
+{
+    const std::string path = this->CheckpointsPath();
+    const std::string tmpPath = path + ".tmp";
+
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        for (const auto &[chunkStartHeight, checkpoint] : this->checkpoints)
+        {
+            out << checkpoint.chunkStartHeight << ' ' << checkpoint.chunkEndHeight << ' ' << checkpoint.lastCheckpoint << '\n';
+        }
+
+        if (!out)
+        {
+            throw std::runtime_error("Failed writing local store checkpoints: " + tmpPath);
+        }
+    }
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        throw SystemError("Unable to replace local store checkpoints at " + path);
+    }
+}
+
+void LocalStore::CreateCheckpointIfNonExistent(size_t chunkStartHeight, size_t chunkEndHeight)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock(cs_checkpoints);
+        if (this->checkpoints.emplace(chunkStartHeight, Checkpoint{chunkStartHeight, chunkEndHeight, chunkStartHeight}).second)
+        {
+            this->SaveCheckpoints();
+            __DEBUG__(("Checkpoint created at height " + std::to_string(chunkStartHeight) + " to " + std::to_string(chunkEndHeight)).c_str());
+        }
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+}
+
+void LocalStore::UpdateChunkCheckpoint(size_t chunkStartHeight, size_t checkpointUpdateValue)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock(cs_checkpoints);
+        auto checkpoint = this->checkpoints.find(chunkStartHeight);
+        if (checkpoint == this->checkpoints.end())
+        {
+            return;
+        }
+
+        checkpoint->second.lastCheckpoint = checkpointUpdateValue;
+        this->SaveCheckpoints();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+void LocalStore::SplitCheckpoint(size_t chunkStartHeight, size_t newChunkEndHeight)
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock(cs_checkpoints);
+
+        Checkpoint &existing = this->checkpoints.at(chunkStartHeight);
+        const size_t chunkEndHeight = existing.chunkEndHeight;
+        if (newChunkEndHeight >= chunkEndHeight)
+        {
+            return;
+        }
+
+        existing.chunkEndHeight = newChunkEndHeight;
+        this->checkpoints[newChunkEndHeight + 1] = Checkpoint{newChunkEndHeight + 1, chunkEndHeight, newChunkEndHeight + 1};
+        this->SaveCheckpoints();
+
+        __DEBUG__(("Split checkpoint " + std::to_string(chunkStartHeight) + " at height " + std::to_string(newChunkEndHeight)).c_str());
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+std::optional<StorageBackend::Checkpoint> LocalStore::GetCheckpoint(size_t chunkStartHeight)
+{
+    std::lock_guard<std::mutex> lock(cs_checkpoints);
+
+    auto checkpoint = this->checkpoints.find(chunkStartHeight);
+    if (checkpoint == this->checkpoints.end())
+    {
+        return std::nullopt;
+    }
+
+    return checkpoint->second;
+}
+
+std::stack<StorageBackend::Checkpoint> LocalStore::GetUnfinishedCheckpoints()
+{
+    std::lock_guard<std::mutex> lock(cs_checkpoints);
+
+    std::stack<Checkpoint> unfinished;
+    for (const auto &[chunkStartHeight, checkpoint] : this->checkpoints)
+    {
+        if (checkpoint.chunkEndHeight != checkpoint.lastCheckpoint)
+        {
+            unfinished.push(checkpoint);
+        }
+    }
+
+    return unfinished;
+}
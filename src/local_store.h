@@ -0,0 +1,121 @@
+#ifndef LOCAL_STORE_H
+#define LOCAL_STORE_H
+
+#include "outpoint_index.h"
+#include "storage_backend.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * LocalStore
+ * Embedded storage backend that appends each block to a log of segment files in a local directory,
+ * for running the indexer without a database server. A block is one record holding every row built
+ * for it, so a block is written with a single append and is either wholly present or absent.
+ *
+ *   record  = magic (u32) | payload length (u32) | payload crc32 (u32) | reserved (u32) | payload
+ *   payload = height (u64) | hash length (u16) | hash | table count (u8) | tables
+ *   table   = table id (u8) | row count (u32) | rows, each a column count (u8) and tagged values
+ *
+ * Segments roll over at SEGMENT_MAX_BYTES. Appends reach disk at Flush(), which Database calls before
+ * persisting its committed heights, so a record torn by a crash is always past the persisted heights
+ * and is cut off when the last segment is scanned on open.
+ *
+ * Prevouts are resolved from an OutpointIndex kept in the same directory, which is the store's only
+ * index of outputs. Records the index has not applied are replayed into it on open. Chunk checkpoints
+ * are a small text file rewritten on each change.
+ */
+class LocalStore : public StorageBackend
+{
+private:
+    static constexpr uint32_t RECORD_MAGIC = 0x4B4C425A; // "ZBLK"
+    static constexpr uint64_t SEGMENT_MAX_BYTES = uint64_t{256} << 20;
+
+    struct RecordHeader
+    {
+        uint32_t magic;
+        uint32_t length;
+        uint32_t checksum;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(RecordHeader) == 16, "Local store record header layout changed");
+
+    std::string directory;
+
+    // Appends are serialised; records are encoded before the lock is taken
+    std::mutex cs_log;
+    int segmentFd{-1};
+    uint64_t segmentNumber{0};
+    uint64_t segmentBytes{0};
+
+    HeightBitmap storedHeights;
+    std::unique_ptr<OutpointIndex> outpoints;
+
+    std::mutex cs_checkpoints;
+    std::map<size_t, Checkpoint> checkpoints;
+
+    std::string SegmentPath(uint64_t number) const;
+    std::string CheckpointsPath() const;
+
+    /**
+     * @brief Reads every record of a segment, replaying the ones the outpoint index has not applied.
+     * A torn record at the end of the last segment is truncated; anywhere else it throws.
+     */
+    void ScanSegment(uint64_t number, bool isLastSegment);
+    void OpenSegment(uint64_t number);
+    void RollSegment();
+
+    void ApplyToOutpoints(const OrmStorageMap &orm_storage_map, uint64_t height);
+
+    void LoadCheckpoints();
+
+    // Call with cs_checkpoints held
+    void SaveCheckpoints();
+
+    static std::string EncodeRecord(uint64_t height, std::string_view hash, const OrmStorageMap &orm_storage_map);
+    static bool DecodeRecord(std::string_view payload, uint64_t &height, OrmStorageMap &orm_storage_map);
+
+public:
+    /**
+     * @brief Opens the store in directory, creating it if needed, and scans its segments.
+     *
+     * @param outpointIndexCapacity Initial slots of the outpoint index when it is created.
+     */
+    LocalStore(const std::string &directory, uint64_t outpointIndexCapacity);
+    ~LocalStore() noexcept;
+
+    LocalStore(const LocalStore &rhs) = delete;
+    LocalStore &operator=(const LocalStore &rhs) = delete;
+
+    std::string GetName() const override;
+
+    WriteResult WriteBlock(uint64_t height, std::string_view hash, const OrmStorageMap &orm_storage_map) override;
+    PrevoutMap ResolvePrevouts(const std::vector<Outpoint> &outpoints) override;
+    std::optional<uint64_t> GetTipHeight() override;
+    void LoadStoredHeights(HeightBitmap &heights) override;
+
+    /**
+     * @brief Syncs the current segment, then the outpoint index.
+     */
+    void Flush() override;
+
+    // Spent state lives in the outpoint index, which keeps no pending spends
+    size_t ResolvePendingSpends(uint64_t) override { return 0; }
+
+    /**
+     * @brief Throws, as the outpoint index does not record the height of a spend. Rebuild the store from its segments instead.
+     */
+    size_t UnmarkSpendsAbove(uint64_t height) override;
+
+    void CreateCheckpointIfNonExistent(size_t chunkStartHeight, size_t chunkEndHeight) override;
+    void UpdateChunkCheckpoint(size_t chunkStartHeight, size_t checkpointUpdateValue) override;
+    void SplitCheckpoint(size_t chunkStartHeight, size_t newChunkEndHeight) override;
+    std::optional<Checkpoint> GetCheckpoint(size_t chunkStartHeight) override;
+    std::stack<Checkpoint> GetUnfinishedCheckpoints() override;
+};
+
+#endif // LOCAL_STORE_H
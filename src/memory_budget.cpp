@@ -0,0 +1,91 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+
+MemoryBudget::MemoryBudget(uint64_t limitBytesIn) : limitBytes(limitBytesIn)
+{
+}
+
+void MemoryBudget::ChargeLocked(uint64_t bytes)
+{
+    this->usedBytes += bytes;
+    this->peakBytes = std::max(this->peakBytes, this->usedBytes);
+}
+
+void MemoryBudget::Acquire(uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(cs_budget);
+    cv_budget.wait(lock, [this, bytes]
+                   { return this->usedBytes == 0 || this->usedBytes + bytes <= this->limitBytes; });
+
+    this->ChargeLocked(bytes);
+}
+
+bool MemoryBudget::TryAcquire(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(cs_budget);
+    if (this->usedBytes != 0 && this->usedBytes + bytes > this->limitBytes)
+    {
+        return false;
+    }
+
+    this->ChargeLocked(bytes);
+    return true;
+}
+
+void MemoryBudget::Reserve(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(cs_budget);
+    this->ChargeLocked(bytes);
+}
+
+void MemoryBudget::Release(uint64_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_budget);
+        this->usedBytes -= std::min(bytes, this->usedBytes);
+    }
+
+    cv_budget.notify_all();
+}
+
+uint64_t MemoryBudget::GetUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(cs_budget);
+    return this->usedBytes;
+}
+
+uint64_t MemoryBudget::GetPeakBytes() const
+{
+    std::lock_guard<std::mutex> lock(cs_budget);
+    return this->peakBytes;
+}
+
+uint64_t MemoryBudget::GetLimitBytes() const
+{
+    return this->limitBytes;
+}
+
+std::string MemoryBudget::Describe() const
+{
+    std::lock_guard<std::mutex> lock(cs_budget);
+    return "Memory budget: used=" + std::to_string(this->usedBytes) +
+           " peak=" + std::to_string(this->peakBytes) +
+           " limit=" + std::to_string(this->limitBytes) + " bytes";
+}
+
+ScopedMemoryReservation::ScopedMemoryReservation(MemoryBudget *budgetIn, uint64_t bytesIn) : budget(budgetIn), bytes(bytesIn)
+{
+    if (this->budget != nullptr)
+    {
+        this->budget->Reserve(this->bytes);
+    }
+}
+
+ScopedMemoryReservation::~ScopedMemoryReservation()
+{
+    if (this->budget != nullptr)
+    {
+        this->budget->Release(this->bytes);
+    }
+}
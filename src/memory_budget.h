@@ -0,0 +1,79 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * MemoryBudget
+ * Byte accounting for block data resident in the syncer. Downloaded blocks are charged when they
+ * arrive and credited back once their rows are committed; pending row batches are charged while
+ * they wait to be written. The downloader is the only party that waits on the budget, so workers
+ * holding memory can always make progress and release it.
+ */
+class MemoryBudget
+{
+private:
+    mutable std::mutex cs_budget;
+    std::condition_variable cv_budget;
+
+    uint64_t limitBytes;
+    uint64_t usedBytes{0};
+    uint64_t peakBytes{0};
+
+    void ChargeLocked(uint64_t bytes);
+
+public:
+    explicit MemoryBudget(uint64_t limitBytes);
+
+    MemoryBudget(const MemoryBudget &rhs) = delete;
+    MemoryBudget &operator=(const MemoryBudget &rhs) = delete;
+
+    /**
+     * @brief Blocks until the bytes fit in the budget, then charges them.
+     *
+     * A request is always admitted when nothing else is charged, so a single block larger than
+     * the whole budget cannot stall the syncer forever.
+     */
+    void Acquire(uint64_t bytes);
+
+    /**
+     * @brief Charges the bytes only if they fit in the budget right now.
+     *
+     * @return True if the bytes were charged.
+     */
+    bool TryAcquire(uint64_t bytes);
+
+    /**
+     * @brief Charges the bytes without waiting. Used for short lived allocations made by workers.
+     */
+    void Reserve(uint64_t bytes);
+
+    void Release(uint64_t bytes);
+
+    uint64_t GetUsedBytes() const;
+    uint64_t GetPeakBytes() const;
+    uint64_t GetLimitBytes() const;
+    std::string Describe() const;
+};
+
+/**
+ * Reserves bytes against a MemoryBudget for the lifetime of a scope.
+ */
+class ScopedMemoryReservation
+{
+private:
+    MemoryBudget *budget;
+    uint64_t bytes;
+
+public:
+    ScopedMemoryReservation(MemoryBudget *budgetIn, uint64_t bytesIn);
+    ~ScopedMemoryReservation();
+
+    ScopedMemoryReservation(const ScopedMemoryReservation &rhs) = delete;
+    ScopedMemoryReservation &operator=(const ScopedMemoryReservation &rhs) = delete;
+};
+
+#endif // MEMORY_BUDGET_H
@@ -0,0 +1,257 @@
+#include "nullifier_filter.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char NullifierFilter::SNAPSHOT_MAGIC[8];
+
+namespace
+{
+    // Salts from the Parquet split block Bloom filter specification. Each selects one bit in one word of a block.
+    constexpr uint32_t BLOCK_SALTS[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                         0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+    int HexDigitValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+}
+
+NullifierFilter::NullifierFilter(uint64_t expectedNullifiers, uint64_t bitsPerNullifier)
+{
+    const uint64_t bitsPerBlock = WORDS_PER_BLOCK * 32;
+    uint64_t numBlocks = (expectedNullifiers * bitsPerNullifier + bitsPerBlock - 1) / bitsPerBlock;
+
+    this->blocks.assign(std::max<uint64_t>(numBlocks, 1), FilterBlock{});
+}
+
+uint64_t NullifierFilter::HashNullifier(const uint8_t *nullifier)
+{
+    // Nullifiers are already uniformly distributed, so folding the four words and finalizing is enough.
+    uint64_t words[4];
+    std::memcpy(words, nullifier, sizeof(words));
+
+    uint64_t hash = words[0] ^ (words[1] << 17 | words[1] >> 47) ^ (words[2] << 31 | words[2] >> 33) ^ (words[3] << 47 | words[3] >> 17);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+NullifierFilter::FilterBlock NullifierFilter::MaskForKey(uint32_t key)
+{
+    FilterBlock mask;
+    for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+    {
+        mask[i] = 1U << ((key * BLOCK_SALTS[i]) >> 27);
+    }
+
+    return mask;
+}
+
+size_t NullifierFilter::BlockIndexForHash(uint64_t hash) const
+{
+    // Multiply-shift maps the upper hash bits onto [0, blocks.size()) without a modulo
+    return static_cast<size_t>(((hash >> 32) * static_cast<uint64_t>(this->blocks.size())) >> 32);
+}
+
+bool NullifierFilter::DecodeHex(std::string_view hex, uint8_t *nullifierOut)
+{
+    if (hex.size() >= 2 && hex[0] == '\\' && hex[1] == 'x')
+    {
+        hex.remove_prefix(2);
+    }
+
+    if (hex.size() != NULLIFIER_SIZE * 2)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < NULLIFIER_SIZE; ++i)
+    {
+        int high = HexDigitValue(hex[2 * i]);
+        int low = HexDigitValue(hex[2 * i + 1]);
+
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+
+        nullifierOut[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+
+    return true;
+}
+
+void NullifierFilter::Insert(const uint8_t *nullifier)
+{
+    uint64_t hash = HashNullifier(nullifier);
+    FilterBlock mask = MaskForKey(static_cast<uint32_t>(hash));
+
+    std::unique_lock<std::shared_mutex> lock(cs_filter);
+    FilterBlock &block = this->blocks[this->BlockIndexForHash(hash)];
+    for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+    {
+        block[i] |= mask[i];
+    }
+
+    ++this->numInserted;
+}
+
+void NullifierFilter::InsertHex(std::string_view nullifierHex)
+{
+    uint8_t nullifier[NULLIFIER_SIZE];
+    if (!DecodeHex(nullifierHex, nullifier))
+    {
+        throw std::invalid_argument("Invalid nullifier hex: " + std::string(nullifierHex));
+    }
+
+    this->Insert(nullifier);
+}
+
+bool NullifierFilter::MayContain(const uint8_t *nullifier) const
+{
+    uint64_t hash = HashNullifier(nullifier);
+    FilterBlock mask = MaskForKey(static_cast<uint32_t>(hash));
+
+    std::shared_lock<std::shared_mutex> lock(cs_filter);
+    const FilterBlock &block = this->blocks[this->BlockIndexForHash(hash)];
+    for (size_t i = 0; i < WORDS_PER_BLOCK; ++i)
+    {
+        if ((block[i] & mask[i]) == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool NullifierFilter::MayContainHex(std::string_view nullifierHex) const
+{
+    uint8_t nullifier[NULLIFIER_SIZE];
+    if (!DecodeHex(nullifierHex, nullifier))
+    {
+        return false;
+    }
+
+    return this->MayContain(nullifier);
+}
+
+uint64_t NullifierFilter::Size() const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_filter);
+    return this->numInserted;
+}
+
+void NullifierFilter::Clear()
+{
+    std::unique_lock<std::shared_mutex> lock(cs_filter);
+    std::fill(this->blocks.begin(), this->blocks.end(), FilterBlock{});
+    this->numInserted = 0;
+}
+
+bool NullifierFilter::LoadSnapshot(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        __INFO__(("No nullifier filter snapshot found at " + path).c_str());
+        return false;
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < sizeof(SnapshotHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(fileStat.st_size);
+    void *mapped = ::mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        __ERROR__(("Failed to map nullifier filter snapshot " + path).c_str());
+        return false;
+    }
+
+    auto *header = static_cast<SnapshotHeader *>(mapped);
+    bool isUsable = std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 &&
+                    header->isClean == 1 &&
+                    header->numBlocks == this->blocks.size() &&
+                    fileSize == sizeof(SnapshotHeader) + header->numBlocks * sizeof(FilterBlock);
+
+    if (isUsable)
+    {
+        std::unique_lock<std::shared_mutex> lock(cs_filter);
+        std::memcpy(this->blocks.data(), static_cast<const char *>(mapped) + sizeof(SnapshotHeader), header->numBlocks * sizeof(FilterBlock));
+        this->numInserted = header->numInserted;
+
+        // Nullifiers stored from here on are not in the snapshot until the next clean save
+        header->isClean = 0;
+        ::msync(mapped, sizeof(SnapshotHeader), MS_SYNC);
+    }
+    else
+    {
+        __INFO__("Nullifier filter snapshot is stale or was sized differently. Rebuilding from database.");
+    }
+
+    ::munmap(mapped, fileSize);
+    return isUsable;
+}
+
+void NullifierFilter::SaveSnapshot(const std::string &path) const
+{
+    const std::string tmpPath = path + ".tmp";
+
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            throw std::runtime_error("Unable to open nullifier filter snapshot for writing: " + tmpPath);
+        }
+
+        std::shared_lock<std::shared_mutex> lock(cs_filter);
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.numBlocks = this->blocks.size();
+        header.numInserted = this->numInserted;
+        header.isClean = 1;
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(this->blocks.data()), this->blocks.size() * sizeof(FilterBlock));
+
+        if (!out)
+        {
+            throw std::runtime_error("Failed writing nullifier filter snapshot: " + tmpPath);
+        }
+    }
+
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        throw std::runtime_error("Unable to replace nullifier filter snapshot: " + path);
+    }
+
+    __INFO__(("Saved nullifier filter snapshot with " + std::to_string(this->Size()) + " nullifiers.").c_str());
+}
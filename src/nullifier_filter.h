@@ -0,0 +1,99 @@
+#ifndef NULLIFIER_FILTER_H
+#define NULLIFIER_FILTER_H
+
+#include <array>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * NullifierFilter
+ * An in-process split block Bloom filter over every revealed shielded nullifier. Each key touches
+ * exactly one 256 bit block (one cache line half), so a membership test is a handful of loads and
+ * never leaves the process. A negative answer is definitive; a positive answer must be confirmed
+ * against the nullifiers table.
+ *
+ * The filter is persisted as a snapshot file on clean shutdown and mapped back in at startup. A
+ * snapshot is only trusted if it was written cleanly, since nullifiers committed after a snapshot
+ * would otherwise become false negatives.
+ */
+class NullifierFilter
+{
+private:
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+    static constexpr char SNAPSHOT_MAGIC[8] = {'Z', 'N', 'F', 'L', 'T', 'R', '0', '1'};
+
+    using FilterBlock = std::array<uint32_t, WORDS_PER_BLOCK>;
+
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint64_t numBlocks;
+        uint64_t numInserted;
+        uint64_t isClean;
+    };
+
+    mutable std::shared_mutex cs_filter;
+    std::vector<FilterBlock> blocks;
+    uint64_t numInserted{0};
+
+    static uint64_t HashNullifier(const uint8_t *nullifier);
+    static FilterBlock MaskForKey(uint32_t key);
+    size_t BlockIndexForHash(uint64_t hash) const;
+
+public:
+    static constexpr size_t NULLIFIER_SIZE = 32;
+
+    /**
+     * @brief Constructs an empty filter sized for the expected number of nullifiers.
+     *
+     * @param expectedNullifiers The number of nullifiers the filter should hold at its target false positive rate.
+     * @param bitsPerNullifier The number of filter bits budgeted per nullifier.
+     */
+    NullifierFilter(uint64_t expectedNullifiers, uint64_t bitsPerNullifier);
+
+    NullifierFilter(const NullifierFilter &rhs) = delete;
+    NullifierFilter &operator=(const NullifierFilter &rhs) = delete;
+
+    /**
+     * @brief Decodes a 32 byte nullifier from its hex representation.
+     *
+     * Accepts both plain hex and the Postgres bytea text form ("\x" prefixed).
+     *
+     * @return False if the input is not a 32 byte hex value.
+     */
+    static bool DecodeHex(std::string_view hex, uint8_t *nullifierOut);
+
+    void Insert(const uint8_t *nullifier);
+    void InsertHex(std::string_view nullifierHex);
+
+    /**
+     * @brief Tests whether a nullifier may have been revealed.
+     *
+     * @return False if the nullifier has definitely not been indexed.
+     */
+    bool MayContain(const uint8_t *nullifier) const;
+    bool MayContainHex(std::string_view nullifierHex) const;
+
+    uint64_t Size() const;
+    void Clear();
+
+    /**
+     * @brief Loads a clean snapshot written by SaveSnapshot.
+     *
+     * The snapshot file is memory mapped, validated and copied into the filter. The snapshot is then
+     * marked dirty on disk so a crash before the next clean save forces a rebuild.
+     *
+     * @return False if no usable snapshot exists and the filter must be rebuilt from the database.
+     */
+    bool LoadSnapshot(const std::string &path);
+
+    /**
+     * @brief Atomically writes the filter to a clean snapshot file.
+     */
+    void SaveSnapshot(const std::string &path) const;
+};
+
+#endif // NULLIFIER_FILTER_H
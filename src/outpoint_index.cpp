@@ -0,0 +1,489 @@
+#include "outpoint_index.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr size_t OutpointIndex::TXID_PREFIX_SIZE;
+constexpr char OutpointIndex::FILE_MAGIC[8];
+constexpr double OutpointIndex::MAX_LOAD_FACTOR;
+
+namespace
+{
+    constexpr uint64_t MIN_CAPACITY = 1024;
+
+    int HexDigitValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    uint64_t RoundUpToPowerOfTwo(uint64_t value)
+    {
+        uint64_t capacity = MIN_CAPACITY;
+        while (capacity < value)
+        {
+            capacity <<= 1;
+        }
+
+        return capacity;
+    }
+
+    std::runtime_error SystemError(const std::string &message)
+    {
+        return std::runtime_error(message + ": " + std::strerror(errno));
+    }
+
+    // "{}" is by far the most common recipient list, so it takes no space in the side file
+    constexpr std::string_view EMPTY_RECIPIENTS{"{}"};
+}
+
+OutpointIndex::OutpointIndex(const std::string &pathIn, uint64_t initialCapacity) : path(pathIn)
+{
+    this->tableFd = ::open(this->path.c_str(), O_RDWR | O_CREAT, 0644);
+    this->recipientsFd = ::open((this->path + ".recipients").c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->tableFd < 0 || this->recipientsFd < 0)
+    {
+        throw SystemError("Unable to open outpoint index at " + this->path);
+    }
+
+    struct stat fileStat;
+    if (::fstat(this->tableFd, &fileStat) != 0)
+    {
+        throw SystemError("Unable to stat outpoint index at " + this->path);
+    }
+
+    Header existing{};
+    bool isUsable = static_cast<size_t>(fileStat.st_size) >= sizeof(Header) &&
+                    ::pread(this->tableFd, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing)) &&
+                    std::memcmp(existing.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0 &&
+                    existing.capacity >= MIN_CAPACITY && (existing.capacity & (existing.capacity - 1)) == 0 &&
+                    static_cast<uint64_t>(fileStat.st_size) == sizeof(Header) + existing.capacity * sizeof(Slot);
+
+    if (isUsable)
+    {
+        this->MapTable(this->tableFd, existing.capacity, false);
+
+        std::ifstream appliedFile(this->AppliedHeightsPath(), std::ios::binary);
+        std::string appliedBytes((std::istreambuf_iterator<char>(appliedFile)), std::istreambuf_iterator<char>());
+
+        if (!appliedBytes.empty() && !this->appliedHeights.Deserialize(appliedBytes))
+        {
+            __ERROR__("Outpoint index applied heights are corrupt. All heights will be replayed.");
+        }
+
+        __INFO__(("Opened outpoint index with " + std::to_string(this->header->unspent) + " unspent outputs and " +
+                  std::to_string(this->appliedHeights.Cardinality()) + " applied heights.")
+                     .c_str());
+        return;
+    }
+
+    if (fileStat.st_size > 0)
+    {
+        __ERROR__(("Outpoint index at " + this->path + " is invalid. Recreating it.").c_str());
+    }
+
+    const uint64_t capacity = RoundUpToPowerOfTwo(initialCapacity);
+    if (::ftruncate(this->tableFd, 0) != 0 || ::ftruncate(this->tableFd, sizeof(Header) + capacity * sizeof(Slot)) != 0 || ::ftruncate(this->recipientsFd, 0) != 0)
+    {
+        throw SystemError("Unable to size outpoint index at " + this->path);
+    }
+
+    std::remove(this->AppliedHeightsPath().c_str());
+    this->MapTable(this->tableFd, capacity, true);
+}
+
+OutpointIndex::~OutpointIndex() noexcept
+{
+    try
+    {
+        this->Flush();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+
+    this->UnmapTable();
+
+    if (this->tableFd >= 0)
+    {
+        ::close(this->tableFd);
+    }
+
+    if (this->recipientsFd >= 0)
+    {
+        ::close(this->recipientsFd);
+    }
+}
+
+void OutpointIndex::MapTable(int fd, uint64_t capacity, bool initialize)
+{
+    const size_t size = sizeof(Header) + capacity * sizeof(Slot);
+    void *mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        throw SystemError("Unable to map outpoint index at " + this->path);
+    }
+
+    this->mapping = mapped;
+    this->mappingSize = size;
+    this->header = static_cast<Header *>(mapped);
+    this->slots = reinterpret_cast<Slot *>(this->header + 1);
+
+    if (initialize)
+    {
+        // The file was just truncated, so every slot is already zero (empty)
+        std::memcpy(this->header->magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+        this->header->capacity = capacity;
+    }
+}
+
+void OutpointIndex::UnmapTable()
+{
+    if (this->mapping != nullptr)
+    {
+        ::munmap(this->mapping, this->mappingSize);
+    }
+
+    this->mapping = nullptr;
+    this->header = nullptr;
+    this->slots = nullptr;
+    this->mappingSize = 0;
+}
+
+bool OutpointIndex::DecodeTxidPrefix(std::string_view txidHex, uint8_t *prefixOut)
+{
+    if (txidHex.size() < TXID_PREFIX_SIZE * 2)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < TXID_PREFIX_SIZE; ++i)
+    {
+        int high = HexDigitValue(txidHex[2 * i]);
+        int low = HexDigitValue(txidHex[2 * i + 1]);
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+
+        prefixOut[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+
+    return true;
+}
+
+uint64_t OutpointIndex::HashKey(const uint8_t *prefix, uint32_t vout)
+{
+    // Txids are uniformly distributed, so eight of their bytes mixed with the output index suffice
+    uint64_t hash;
+    std::memcpy(&hash, prefix, sizeof(hash));
+
+    hash ^= static_cast<uint64_t>(vout) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+OutpointIndex::Slot *OutpointIndex::ProbeIn(Slot *table, uint64_t capacity, const uint8_t *prefix, uint32_t vout)
+{
+    const uint64_t mask = capacity - 1;
+
+    for (uint64_t i = HashKey(prefix, vout) & mask;; i = (i + 1) & mask)
+    {
+        Slot *slot = &table[i];
+        if (slot->state == SlotState::Empty || (slot->vout == vout && std::memcmp(slot->txidPrefix, prefix, TXID_PREFIX_SIZE) == 0))
+        {
+            return slot;
+        }
+    }
+}
+
+void OutpointIndex::Rehash(uint64_t newCapacity)
+{
+    const std::string growPath = this->path + ".grow";
+
+    int newFd = ::open(growPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (newFd < 0 || ::ftruncate(newFd, sizeof(Header) + newCapacity * sizeof(Slot)) != 0)
+    {
+        if (newFd >= 0)
+        {
+            ::close(newFd);
+        }
+
+        throw SystemError("Unable to grow outpoint index at " + growPath);
+    }
+
+    const size_t newSize = sizeof(Header) + newCapacity * sizeof(Slot);
+    void *newMapping = ::mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, newFd, 0);
+    if (newMapping == MAP_FAILED)
+    {
+        ::close(newFd);
+        throw SystemError("Unable to map outpoint index at " + growPath);
+    }
+
+    auto *newHeader = static_cast<Header *>(newMapping);
+    auto *newSlots = reinterpret_cast<Slot *>(newHeader + 1);
+
+    std::memcpy(newHeader->magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    newHeader->capacity = newCapacity;
+    newHeader->recipientsBytes = this->header->recipientsBytes;
+
+    // Outputs are funded below their spend, so once every lower height is applied a pending spend's output never arrives
+    const uint64_t appliedWatermark = this->appliedHeights.NextMissing(0);
+
+    // Spent outputs are never looked up again once their spend is committed, so they are not carried over
+    for (uint64_t i = 0; i < this->header->capacity; ++i)
+    {
+        const Slot &slot = this->slots[i];
+        const bool isAwaitingOutput = slot.state == SlotState::PendingSpend && slot.height > appliedWatermark;
+        if (slot.state != SlotState::Unspent && !isAwaitingOutput)
+        {
+            continue;
+        }
+
+        *ProbeIn(newSlots, newCapacity, slot.txidPrefix, slot.vout) = slot;
+        ++newHeader->occupied;
+        ++(isAwaitingOutput ? newHeader->pendingSpends : newHeader->unspent);
+    }
+
+    ::msync(newMapping, newSize, MS_SYNC);
+
+    if (std::rename(growPath.c_str(), this->path.c_str()) != 0)
+    {
+        ::munmap(newMapping, newSize);
+        ::close(newFd);
+        throw SystemError("Unable to replace outpoint index at " + this->path);
+    }
+
+    __INFO__(("Rehashed outpoint index from " + std::to_string(this->header->capacity) + " to " + std::to_string(newCapacity) + " slots, dropping " +
+              std::to_string(this->header->occupied - newHeader->occupied) + " spent outputs.")
+                 .c_str());
+
+    this->UnmapTable();
+    ::close(this->tableFd);
+
+    this->tableFd = newFd;
+    this->mapping = newMapping;
+    this->mappingSize = newSize;
+    this->header = newHeader;
+    this->slots = newSlots;
+}
+
+void OutpointIndex::ReserveSlot()
+{
+    if (static_cast<double>(this->header->occupied + 1) > static_cast<double>(this->header->capacity) * MAX_LOAD_FACTOR)
+    {
+        // When most occupied slots are spent, dropping them frees enough room without doubling
+        const bool isMostlySpent = static_cast<double>(this->header->unspent + this->header->pendingSpends + 1) <=
+                                   static_cast<double>(this->header->capacity) * MAX_LOAD_FACTOR / 2;
+        this->Rehash(isMostlySpent ? this->header->capacity : this->header->capacity * 2);
+    }
+}
+
+std::string OutpointIndex::ReadRecipients(const Slot &slot) const
+{
+    if (slot.recipientsLength == 0)
+    {
+        return std::string(EMPTY_RECIPIENTS);
+    }
+
+    std::string recipients(slot.recipientsLength, '\0');
+    if (::pread(this->recipientsFd, recipients.data(), recipients.size(), static_cast<off_t>(slot.recipientsOffset)) != static_cast<ssize_t>(recipients.size()))
+    {
+        throw SystemError("Unable to read outpoint recipients");
+    }
+
+    return recipients;
+}
+
+std::string OutpointIndex::AppliedHeightsPath() const
+{
+    return this->path + ".applied";
+}
+
+std::optional<OutpointIndex::Entry> OutpointIndex::Find(std::string_view txidHex, uint32_t vout) const
+{
+    uint8_t prefix[TXID_PREFIX_SIZE];
+    if (!DecodeTxidPrefix(txidHex, prefix))
+    {
+        return std::nullopt;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(cs_index);
+
+    const Slot *slot = ProbeIn(this->slots, this->header->capacity, prefix, vout);
+    if (slot->state == SlotState::Empty || slot->state == SlotState::PendingSpend)
+    {
+        return std::nullopt;
+    }
+
+    return Entry{slot->value, this->ReadRecipients(*slot), slot->height, slot->state == SlotState::Spent};
+}
+
+void OutpointIndex::Insert(std::string_view txidHex, uint32_t vout, double value, std::string_view recipients, uint64_t height)
+{
+    uint8_t prefix[TXID_PREFIX_SIZE];
+    if (!DecodeTxidPrefix(txidHex, prefix))
+    {
+        throw std::invalid_argument("Invalid txid for outpoint index: " + std::string(txidHex));
+    }
+
+    std::unique_lock<std::shared_mutex> lock(cs_index);
+
+    this->ReserveSlot();
+
+    Slot *slot = ProbeIn(this->slots, this->header->capacity, prefix, vout);
+    // A replayed output that was spent since stays spent, its spend is not replayed with it
+    if (slot->state == SlotState::Spent)
+    {
+        return;
+    }
+
+    const bool isNew = slot->state == SlotState::Empty || slot->state == SlotState::PendingSpend;
+    if (slot->state == SlotState::Empty)
+    {
+        std::memcpy(slot->txidPrefix, prefix, TXID_PREFIX_SIZE);
+        slot->vout = vout;
+        ++this->header->occupied;
+    }
+
+    // A replayed output keeps the recipients it was first written with
+    if (isNew && recipients != EMPTY_RECIPIENTS && !recipients.empty())
+    {
+        const uint64_t offset = this->header->recipientsBytes;
+        if (::pwrite(this->recipientsFd, recipients.data(), recipients.size(), static_cast<off_t>(offset)) != static_cast<ssize_t>(recipients.size()))
+        {
+            throw SystemError("Unable to write outpoint recipients");
+        }
+
+        slot->recipientsOffset = offset;
+        slot->recipientsLength = static_cast<uint32_t>(recipients.size());
+        this->header->recipientsBytes += recipients.size();
+    }
+
+    slot->value = value;
+    slot->height = static_cast<uint32_t>(height);
+
+    // The spend of an output whose block committed after the spending block's was applied first
+    if (slot->state == SlotState::PendingSpend)
+    {
+        --this->header->pendingSpends;
+        slot->state = SlotState::Spent;
+        return;
+    }
+
+    if (slot->state == SlotState::Empty)
+    {
+        ++this->header->unspent;
+    }
+
+    slot->state = SlotState::Unspent;
+}
+
+void OutpointIndex::MarkSpent(std::string_view txidHex, uint32_t vout, uint64_t height)
+{
+    uint8_t prefix[TXID_PREFIX_SIZE];
+    if (!DecodeTxidPrefix(txidHex, prefix))
+    {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(cs_index);
+
+    this->ReserveSlot();
+
+    Slot *slot = ProbeIn(this->slots, this->header->capacity, prefix, vout);
+    if (slot->state == SlotState::Unspent)
+    {
+        slot->state = SlotState::Spent;
+        --this->header->unspent;
+    }
+    else if (slot->state == SlotState::Empty)
+    {
+        // The output's block has not been committed yet, so its insert must find it already spent
+        std::memcpy(slot->txidPrefix, prefix, TXID_PREFIX_SIZE);
+        slot->vout = vout;
+        slot->value = 0.0;
+        slot->recipientsOffset = 0;
+        slot->recipientsLength = 0;
+        slot->height = static_cast<uint32_t>(height);
+        slot->state = SlotState::PendingSpend;
+        ++this->header->occupied;
+        ++this->header->pendingSpends;
+    }
+}
+
+void OutpointIndex::MarkHeightApplied(uint64_t height)
+{
+    this->appliedHeights.Add(height);
+}
+
+const HeightBitmap &OutpointIndex::GetAppliedHeights() const
+{
+    return this->appliedHeights;
+}
+
+void OutpointIndex::Flush()
+{
+    // Writers are held off so the applied heights describe exactly what is on disk
+    std::unique_lock<std::shared_mutex> lock(cs_index);
+
+    if (this->mapping == nullptr)
+    {
+        return;
+    }
+
+    if (::msync(this->mapping, this->mappingSize, MS_SYNC) != 0 || ::fdatasync(this->recipientsFd) != 0)
+    {
+        throw SystemError("Unable to sync outpoint index at " + this->path);
+    }
+
+    const std::string appliedPath = this->AppliedHeightsPath();
+    const std::string tmpPath = appliedPath + ".tmp";
+
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        const std::string appliedBytes = this->appliedHeights.Serialize();
+        out.write(appliedBytes.data(), static_cast<std::streamsize>(appliedBytes.size()));
+
+        if (!out)
+        {
+            throw std::runtime_error("Failed writing outpoint index applied heights: " + tmpPath);
+        }
+    }
+
+    if (std::rename(tmpPath.c_str(), appliedPath.c_str()) != 0)
+    {
+        throw SystemError("Unable to replace outpoint index applied heights at " + appliedPath);
+    }
+}
+
+uint64_t OutpointIndex::GetUnspentCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_index);
+    return this->header->unspent;
+}
+
+uint64_t OutpointIndex::GetCapacity() const
+{
+    std::shared_lock<std::shared_mutex> lock(cs_index);
+    return this->header->capacity;
+}
@@ -0,0 +1,159 @@
+#ifndef OUTPOINT_INDEX_H
+#define OUTPOINT_INDEX_H
+
+#include "height_bitmap.h"
+
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+/**
+ * OutpointIndex
+ * Embedded on-disk index of transparent outputs, so the value and recipients of the output an input
+ * spends are found without a database round trip. The index is an open addressing hash table in a
+ * memory mapped file, keyed by the first 12 bytes of the funding txid plus the output index. At 96
+ * bits the prefix makes collisions between distinct txids negligible for the size of the chain.
+ * Recipient lists are variable length and live in an append-only side file referenced from each slot.
+ *
+ * Outputs are inserted and marked spent only after their block has been committed. Blocks commit out
+ * of order, so a spend can arrive before its output; it then leaves a pending spend tombstone that the
+ * output fills in as spent. The heights applied to the index are persisted next to it whenever it is
+ * flushed, so after a crash the heights that were committed but not yet flushed are replayed from the
+ * database.
+ */
+class OutpointIndex
+{
+public:
+    static constexpr size_t TXID_PREFIX_SIZE = 12;
+
+    struct Entry
+    {
+        double value{0.0};
+        std::string recipients;
+        uint64_t height{0};
+        bool isSpent{false};
+    };
+
+private:
+    static constexpr char FILE_MAGIC[8] = {'Z', 'O', 'U', 'T', 'I', 'X', '0', '1'};
+    static constexpr double MAX_LOAD_FACTOR = 0.75;
+
+    enum class SlotState : uint32_t
+    {
+        Empty = 0,
+        Unspent = 1,
+        Spent = 2,
+        // Spent before its output was inserted. Holds no value or recipients, and height is the spend's
+        PendingSpend = 3
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint64_t capacity;
+        uint64_t occupied;
+        uint64_t unspent;
+        uint64_t recipientsBytes;
+        uint64_t pendingSpends;
+        uint64_t reserved[2];
+    };
+
+    struct Slot
+    {
+        uint8_t txidPrefix[TXID_PREFIX_SIZE];
+        uint32_t vout;
+        double value;
+        uint64_t recipientsOffset;
+        uint32_t recipientsLength;
+        uint32_t height;
+        SlotState state;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(Header) == 64, "Outpoint index header layout changed");
+    static_assert(sizeof(Slot) == 48, "Outpoint index slot layout changed");
+
+    mutable std::shared_mutex cs_index;
+
+    std::string path;
+    int tableFd{-1};
+    int recipientsFd{-1};
+    void *mapping{nullptr};
+    size_t mappingSize{0};
+    Header *header{nullptr};
+    Slot *slots{nullptr};
+
+    HeightBitmap appliedHeights;
+
+    static bool DecodeTxidPrefix(std::string_view txidHex, uint8_t *prefixOut);
+    static uint64_t HashKey(const uint8_t *prefix, uint32_t vout);
+
+    void MapTable(int fd, uint64_t capacity, bool initialize);
+    void UnmapTable();
+
+    // Slot holding the key, or the empty slot where it would be inserted
+    static Slot *ProbeIn(Slot *table, uint64_t capacity, const uint8_t *prefix, uint32_t vout);
+    /**
+     * @brief Rebuilds the table at newCapacity slots, dropping spent outputs and the pending spends
+     * whose output can no longer arrive because every height below the spend has been applied.
+     */
+    void Rehash(uint64_t newCapacity);
+    // Grows or compacts the table so one more slot can be occupied
+    void ReserveSlot();
+
+    std::string ReadRecipients(const Slot &slot) const;
+    std::string AppliedHeightsPath() const;
+
+public:
+    /**
+     * @brief Opens the index at path, creating it with initialCapacity slots if it does not exist.
+     *
+     * A file that cannot be validated is recreated empty; its heights are then missing from
+     * GetAppliedHeights() and are replayed by the caller.
+     */
+    OutpointIndex(const std::string &path, uint64_t initialCapacity);
+    ~OutpointIndex() noexcept;
+
+    OutpointIndex(const OutpointIndex &rhs) = delete;
+    OutpointIndex &operator=(const OutpointIndex &rhs) = delete;
+
+    /**
+     * @brief Returns the output, or nothing if it has not been inserted, even when its spend has.
+     */
+    std::optional<Entry> Find(std::string_view txidHex, uint32_t vout) const;
+
+    /**
+     * @brief Adds an output as unspent.
+     *
+     * Inserting an output again keeps its recipients and leaves it spent if it was, so replaying a
+     * block whose outputs were spent since does not revive them. An output whose spend was applied
+     * first is added as spent.
+     */
+    void Insert(std::string_view txidHex, uint32_t vout, double value, std::string_view recipients, uint64_t height);
+
+    /**
+     * @brief Marks an output spent. Spent outputs are dropped when the table is rehashed.
+     *
+     * @param height Height of the spending block. An output that has not been inserted yet is kept
+     * as a pending spend until every height below this one has been applied.
+     */
+    void MarkSpent(std::string_view txidHex, uint32_t vout, uint64_t height);
+
+    /**
+     * @brief Records that every output and spend of a block has been applied.
+     */
+    void MarkHeightApplied(uint64_t height);
+    const HeightBitmap &GetAppliedHeights() const;
+
+    /**
+     * @brief Syncs the table and side file to disk, then persists the applied heights.
+     */
+    void Flush();
+
+    uint64_t GetUnspentCount() const;
+    uint64_t GetCapacity() const;
+};
+
+#endif // OUTPOINT_INDEX_H
@@ -0,0 +1,188 @@
+#include "pinned_worker_pool.h"
+#include "logger.h"
+#include "tracer.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <string>
+
+PinnedWorkerPool::PinnedWorkerPool(size_t numWorkers, ThreadHook onThreadStartIn, ThreadHook onThreadStopIn)
+    : onThreadStart(std::move(onThreadStartIn)), onThreadStop(std::move(onThreadStopIn))
+{
+    const unsigned numCores = std::max(1u, std::thread::hardware_concurrency());
+    if (numWorkers == 0)
+    {
+        numWorkers = numCores;
+    }
+
+    this->workers.reserve(numWorkers);
+    for (size_t i = 0; i < numWorkers; ++i)
+    {
+        auto worker = std::make_unique<Worker>();
+        worker->core = static_cast<unsigned>(i % numCores);
+        this->workers.push_back(std::move(worker));
+    }
+
+    for (auto &worker : this->workers)
+    {
+        worker->thread = std::thread{&PinnedWorkerPool::Run, this, std::ref(*worker)};
+        PinnedWorkerPool::PinToCore(worker->thread, worker->core);
+    }
+
+    __INFO__(("Started " + std::to_string(numWorkers) + " pinned workers.").c_str());
+}
+
+PinnedWorkerPool::~PinnedWorkerPool() noexcept
+{
+    this->Drain();
+}
+
+void PinnedWorkerPool::PinToCore(std::thread &thread, unsigned core)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+
+    // The worker still runs unpinned if the container's cpuset does not include the core
+    const int result = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus);
+    if (result != 0)
+    {
+        __ERROR__(("Unable to pin worker to core " + std::to_string(core) + ", error " + std::to_string(result)).c_str());
+    }
+}
+
+void PinnedWorkerPool::Run(Worker &worker)
+{
+    Tracer::SetThreadName("pinned worker " + std::to_string(worker.core));
+
+    try
+    {
+        if (this->onThreadStart)
+        {
+            this->onThreadStart();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(("Pinned worker on core " + std::to_string(worker.core) + " failed to start: " + e.what()).c_str());
+    }
+
+    while (true)
+    {
+        std::pair<Task, uint64_t> task;
+        {
+            std::unique_lock<std::mutex> lock(worker.cs_queue);
+            worker.cv_queue.wait(lock, [&worker]()
+                                 { return worker.isStopping || !worker.queue.empty(); });
+
+            // Queued tasks are run before stopping, so nothing submitted is dropped
+            if (worker.queue.empty())
+            {
+                break;
+            }
+
+            task = std::move(worker.queue.front());
+            worker.queue.pop_front();
+            worker.isRunningTask = true;
+        }
+        worker.cv_queue.notify_all();
+
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            task.first(worker.arena);
+        }
+        catch (const std::exception &e)
+        {
+            __ERROR__(e.what());
+        }
+
+        worker.busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        worker.blocks += task.second;
+        ++worker.tasks;
+
+        {
+            std::lock_guard<std::mutex> lock(worker.cs_queue);
+            worker.isRunningTask = false;
+        }
+        worker.cv_queue.notify_all();
+    }
+
+    try
+    {
+        if (this->onThreadStop)
+        {
+            this->onThreadStop();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+}
+
+void PinnedWorkerPool::Submit(uint64_t key, uint64_t numBlocks, Task task)
+{
+    Worker &worker = *this->workers[key % this->workers.size()];
+
+    {
+        std::unique_lock<std::mutex> lock(worker.cs_queue);
+        worker.cv_queue.wait(lock, [&worker]()
+                             { return worker.queue.size() < PinnedWorkerPool::MAX_QUEUED_TASKS; });
+
+        worker.queue.emplace_back(std::move(task), numBlocks);
+    }
+    worker.cv_queue.notify_all();
+}
+
+void PinnedWorkerPool::WaitUntilIdle()
+{
+    for (auto &worker : this->workers)
+    {
+        std::unique_lock<std::mutex> lock(worker->cs_queue);
+        worker->cv_queue.wait(lock, [&worker]()
+                              { return worker->queue.empty() && !worker->isRunningTask; });
+    }
+}
+
+void PinnedWorkerPool::Drain()
+{
+    for (auto &worker : this->workers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(worker->cs_queue);
+            worker->isStopping = true;
+        }
+        worker->cv_queue.notify_all();
+    }
+
+    for (auto &worker : this->workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+size_t PinnedWorkerPool::GetNumWorkers() const
+{
+    return this->workers.size();
+}
+
+std::vector<PinnedWorkerPool::WorkerStats> PinnedWorkerPool::GetStats() const
+{
+    std::vector<WorkerStats> stats;
+    stats.reserve(this->workers.size());
+
+    for (const auto &worker : this->workers)
+    {
+        stats.push_back(WorkerStats{worker->core, worker->tasks.load(), worker->blocks.load(), static_cast<double>(worker->busyMicroseconds.load()) / 1e6});
+    }
+
+    return stats;
+}
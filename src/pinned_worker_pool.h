@@ -0,0 +1,105 @@
+#ifndef PINNED_WORKER_POOL_H
+#define PINNED_WORKER_POOL_H
+
+#include "chunk_arena.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * PinnedWorkerPool
+ * One worker thread per core, each pinned to its core, for the thread-per-core ingest mode. A worker
+ * owns its queue shard and its scratch ChunkArena, and the thread start hook gives it a database
+ * connection of its own, so workers never contend on a pool or a shared queue.
+ *
+ * Tasks are routed by key modulo the number of workers. The syncer keys segments by the order they
+ * are submitted in, so consecutive segments go to consecutive workers.
+ * A shard holds at most MAX_QUEUED_TASKS tasks and Submit() waits for room, which keeps the
+ * downloader from running ahead of a slow worker.
+ */
+class PinnedWorkerPool
+{
+public:
+    using Task = std::function<void(ChunkArena &)>;
+    using ThreadHook = std::function<void()>;
+
+    struct WorkerStats
+    {
+        unsigned core{0};
+        uint64_t tasks{0};
+        uint64_t blocks{0};
+        // Time spent running tasks, so blocks / busySeconds is the worker's own throughput
+        double busySeconds{0.0};
+    };
+
+private:
+    static constexpr size_t MAX_QUEUED_TASKS = 2;
+
+    struct Worker
+    {
+        unsigned core{0};
+        std::thread thread;
+
+        std::mutex cs_queue;
+        std::condition_variable cv_queue;
+        std::deque<std::pair<Task, uint64_t>> queue;
+        bool isRunningTask{false};
+        bool isStopping{false};
+
+        ChunkArena arena;
+
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> blocks{0};
+        std::atomic<uint64_t> busyMicroseconds{0};
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    const ThreadHook onThreadStart;
+    const ThreadHook onThreadStop;
+
+    void Run(Worker &worker);
+
+    static void PinToCore(std::thread &thread, unsigned core);
+
+public:
+    /**
+     * @param numWorkers Workers to start, pinned to cores 0 to numWorkers - 1. Zero starts one per hardware thread.
+     * @param onThreadStart Runs on each worker thread before it takes tasks.
+     * @param onThreadStop Runs on each worker thread after its last task.
+     */
+    PinnedWorkerPool(size_t numWorkers, ThreadHook onThreadStart, ThreadHook onThreadStop);
+
+    PinnedWorkerPool(const PinnedWorkerPool &rhs) = delete;
+    PinnedWorkerPool &operator=(const PinnedWorkerPool &rhs) = delete;
+
+    ~PinnedWorkerPool() noexcept;
+
+    /**
+     * @brief Queues the task on the worker owning the key, waiting while that worker's shard is full.
+     *
+     * @param numBlocks Blocks the task stores, counted towards the worker's throughput.
+     */
+    void Submit(uint64_t key, uint64_t numBlocks, Task task);
+
+    /**
+     * @brief Waits until every worker has run all of its queued tasks.
+     */
+    void WaitUntilIdle();
+
+    /**
+     * @brief Runs every queued task and joins the workers.
+     */
+    void Drain();
+
+    size_t GetNumWorkers() const;
+    std::vector<WorkerStats> GetStats() const;
+};
+
+#endif // PINNED_WORKER_POOL_H
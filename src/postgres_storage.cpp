@@ -0,0 +1,884 @@
+#include "postgres_storage.h"
+#include "database.h"
+#include "logger.h"
+#include "tracer.h"
+
+#include <algorithm>
+#include <map>
+#include <memory_resource>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+// Column order of each table populated from Storeable::DataToOrmStorageMap
+static const std::map<std::string, std::vector<std::string>> ormTableColumns{
+    {"blocks", {"hash", "height", "timestamp", "nonce", "size", "num_transactions", "total_block_output", "difficulty", "chainwork", "merkle_root", "version", "bits", "transaction_ids", "num_outputs", "num_inputs", "total_block_input", "miner"}},
+    {"transactions", {"tx_id", "size", "is_overwintered", "version", "total_public_input", "total_public_output", "hex", "hash", "timestamp", "height", "num_inputs", "num_outputs"}},
+    {"transparent_inputs", {"tx_id", "vin_tx_id", "v_out_idx", "value", "senders", "coinbase", "input_index"}},
+    {"transparent_outputs", {"tx_id", "output_index", "recipients", "value"}},
+    {"nullifiers", {"nullifier", "pool", "tx_id", "height"}},
+    {"note_commitments", {"commitment", "pool", "tx_id", "output_index", "height"}},
+    {"transaction_raw", {"tx_id", "height", "raw"}},
+    // Written in the dictionary schema mode instead of the transparent tables above
+    {"tx_ids", {"id", "tx_id"}},
+    {"addresses", {"id", "address"}},
+    {"transparent_inputs_encoded", {"tx_ref", "vin_tx_ref", "v_out_idx", "value", "sender_refs", "coinbase", "input_index"}},
+    {"transparent_outputs_encoded", {"tx_ref", "output_index", "recipient_refs", "value"}}};
+
+namespace
+{
+    // Inputs of coinbase transactions carry this in place of the txid they spend
+    constexpr std::string_view COINBASE_VIN_TX_ID{"-1"};
+
+    // Where spends are recorded in each schema mode. The pending table has the outputs' key and spend columns.
+    struct SpendTables
+    {
+        const char *outputs;
+        const char *pending;
+        const char *txColumn;
+        const char *spentColumn;
+        const char *keyType;
+    };
+
+    constexpr SpendTables TEXT_SPEND_TABLES{"transparent_outputs", "pending_spends", "tx_id", "spent_tx_id", "text"};
+    constexpr SpendTables ENCODED_SPEND_TABLES{"transparent_outputs_encoded", "pending_spends_encoded", "tx_ref", "spent_tx_ref", "bigint"};
+
+    // Position of transaction_ids, the array literal of every txid in the block, in a blocks row
+    constexpr size_t BLOCK_TRANSACTION_IDS_COLUMN = 12;
+
+    // Appends a txid, id or index to an array literal opened with '{'. Quoted elements parse as any array type.
+    void AppendArrayElement(std::string &literal, const BlockData &value)
+    {
+        literal += literal.size() > 1 ? ",\"" : "\"";
+        std::visit([&literal](auto &&arg)
+                   {
+                       using T = std::decay_t<decltype(arg)>;
+                       if constexpr (std::is_same_v<T, std::string_view>)
+                           literal += arg;
+                       else
+                           literal += std::to_string(arg); },
+                   value);
+        literal += "\"";
+    }
+
+    // Calls visit with each element of a text array literal such as {"t1a","t1b"} or {t1a,t1b}. Addresses contain no commas or quotes.
+    template <typename Visit>
+    void ForEachArrayElement(std::string_view literal, Visit &&visit)
+    {
+        if (literal.size() < 2 || literal.front() != '{' || literal.back() != '}')
+        {
+            return;
+        }
+
+        literal = literal.substr(1, literal.size() - 2);
+        while (!literal.empty())
+        {
+            const size_t separator = literal.find(',');
+            std::string_view element = literal.substr(0, separator);
+            if (element.size() >= 2 && element.front() == '"' && element.back() == '"')
+            {
+                element = element.substr(1, element.size() - 2);
+            }
+
+            visit(element);
+
+            if (separator == std::string_view::npos)
+            {
+                break;
+            }
+            literal.remove_prefix(separator + 1);
+        }
+    }
+}
+
+/**
+ * A block's transparent rows with txids and addresses replaced by ids, and the dictionary rows for the
+ * ids that are not stored yet, sorted by id.
+ */
+struct PostgresStorage::EncodedRows
+{
+    std::pmr::monotonic_buffer_resource storage;
+    OrmRows inputs{&storage};
+    OrmRows outputs{&storage};
+    OrmRows txIds{&storage};
+    OrmRows addresses{&storage};
+    std::vector<KeyDictionary::NewKey> newTxIds;
+    std::vector<KeyDictionary::NewKey> newAddresses;
+
+    std::string_view Intern(const std::string &value)
+    {
+        char *copy = static_cast<char *>(this->storage.allocate(std::max<size_t>(value.size(), 1), 1));
+        std::copy(value.begin(), value.end(), copy);
+        return std::string_view(copy, value.size());
+    }
+
+    void AppendRow(OrmRows &rows, std::initializer_list<BlockData> values)
+    {
+        OrmRow &row = rows.emplace_back();
+        row.reserve(values.size());
+        row.insert(row.end(), values.begin(), values.end());
+    }
+
+    // Concurrent blocks adding the same keys insert them in the same order, so they cannot deadlock
+    void AppendDictionaryRows(OrmRows &rows, std::vector<KeyDictionary::NewKey> &newKeys)
+    {
+        std::sort(newKeys.begin(), newKeys.end(), [](const KeyDictionary::NewKey &lhs, const KeyDictionary::NewKey &rhs)
+                  { return lhs.id < rhs.id; });
+        newKeys.erase(std::unique(newKeys.begin(), newKeys.end(), [](const KeyDictionary::NewKey &lhs, const KeyDictionary::NewKey &rhs)
+                                  { return lhs.id == rhs.id; }),
+                      newKeys.end());
+
+        for (const KeyDictionary::NewKey &newKey : newKeys)
+        {
+            this->AppendRow(rows, {newKey.id, newKey.key});
+        }
+    }
+};
+
+PostgresStorage::PostgresStorage(Database &database, bool isDictionaryEncoded) : database(database)
+{
+    if (!isDictionaryEncoded)
+    {
+        return;
+    }
+
+    this->txIdDictionary = std::make_unique<KeyDictionary>();
+    this->addressDictionary = std::make_unique<KeyDictionary>();
+
+    this->LoadDictionary(*this->txIdDictionary, "tx_ids", "tx_id");
+    this->LoadDictionary(*this->addressDictionary, "addresses", "address");
+}
+
+void PostgresStorage::LoadDictionary(KeyDictionary &dictionary, const std::string &table, const std::string &keyColumn)
+{
+    try
+    {
+        ManagedConnection conn(this->database);
+        pqxx::work tx(*conn);
+
+        // Keyset pagination over the primary key keeps each round trip bounded
+        uint64_t lastId{0};
+        while (true)
+        {
+            pqxx::result result = tx.exec_params("SELECT id, " + keyColumn + " FROM " + table + " WHERE id > $1 ORDER BY id LIMIT $2", lastId, DICTIONARY_LOAD_BATCH_SIZE);
+
+            for (const auto &row : result)
+            {
+                lastId = row[0].as<uint64_t>();
+                const char *key = row[1].c_str();
+                dictionary.InsertStored(std::string_view(key, row[1].size()), lastId);
+            }
+
+            if (result.size() < DICTIONARY_LOAD_BATCH_SIZE)
+            {
+                break;
+            }
+        }
+
+        tx.commit();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+
+    __INFO__(("Loaded " + std::to_string(dictionary.Size()) + " ids from " + table + ".").c_str());
+}
+
+std::unique_ptr<PostgresStorage::EncodedRows> PostgresStorage::EncodeTransparentRows(const OrmStorageMap &orm_storage_map)
+{
+    auto encoded = std::make_unique<EncodedRows>();
+    std::string refs;
+
+    const auto encodeAddresses = [this, &encoded, &refs](std::string_view literal) -> std::string_view
+    {
+        refs = "{";
+        ForEachArrayElement(literal, [this, &encoded, &refs](std::string_view address)
+                            {
+                                if (refs.size() > 1)
+                                {
+                                    refs += ",";
+                                }
+                                refs += std::to_string(this->addressDictionary->GetOrAssign(address, encoded->newAddresses)); });
+        refs += "}";
+        return encoded->Intern(refs);
+    };
+
+    auto inputs = orm_storage_map.find("transparent_inputs");
+    if (inputs != orm_storage_map.end())
+    {
+        for (const OrmRow &row : inputs->second)
+        {
+            // tx_id, vin_tx_id, v_out_idx, value, senders, coinbase, input_index
+            const std::string_view vinTxId = std::get<std::string_view>(row[1]);
+            const uint64_t vinTxRef = vinTxId == COINBASE_VIN_TX_ID ? 0 : this->txIdDictionary->GetOrAssign(vinTxId, encoded->newTxIds);
+
+            encoded->AppendRow(encoded->inputs, {this->txIdDictionary->GetOrAssign(std::get<std::string_view>(row[0]), encoded->newTxIds), vinTxRef, row[2], row[3],
+                                                 encodeAddresses(std::get<std::string_view>(row[4])), row[5], row[6]});
+        }
+    }
+
+    auto outputs = orm_storage_map.find("transparent_outputs");
+    if (outputs != orm_storage_map.end())
+    {
+        for (const OrmRow &row : outputs->second)
+        {
+            // tx_id, output_index, recipients, value
+            encoded->AppendRow(encoded->outputs, {this->txIdDictionary->GetOrAssign(std::get<std::string_view>(row[0]), encoded->newTxIds), row[1],
+                                                  encodeAddresses(std::get<std::string_view>(row[2])), row[3]});
+        }
+    }
+
+    encoded->AppendDictionaryRows(encoded->txIds, encoded->newTxIds);
+    encoded->AppendDictionaryRows(encoded->addresses, encoded->newAddresses);
+
+    return encoded;
+}
+
+std::string PostgresStorage::GetName() const
+{
+    return "postgres";
+}
+
+StorageBackend::WriteResult PostgresStorage::WriteBlock(uint64_t height, std::string_view hash, const OrmStorageMap &orm_storage_map)
+{
+    ManagedConnection conn(this->database);
+
+    try
+    {
+        pqxx::work batch_insert_txn(*conn);
+
+        // The block row goes first. If it is already stored the block was committed whole, as every
+        // table is written in the same transaction, and nothing else needs to be sent.
+        const auto blocks = orm_storage_map.find("blocks");
+        if (blocks != orm_storage_map.end() && !blocks->second.empty())
+        {
+            if (this->BatchInsertStatements(batch_insert_txn, blocks->first, ormTableColumns.at(blocks->first), blocks->second) == 0)
+            {
+                batch_insert_txn.abort();
+                __DEBUG__(("Block at height " + std::to_string(height) + " is already stored").c_str());
+                return WriteResult::AlreadyStored;
+            }
+        }
+
+        std::unique_ptr<EncodedRows> encoded;
+        if (this->txIdDictionary)
+        {
+            encoded = this->EncodeTransparentRows(orm_storage_map);
+
+            // Mappings go first, so every id the block references is stored with it
+            for (const auto &[tableName, tableData] : {std::make_pair("tx_ids", &encoded->txIds), std::make_pair("addresses", &encoded->addresses),
+                                                       std::make_pair("transparent_inputs_encoded", &encoded->inputs), std::make_pair("transparent_outputs_encoded", &encoded->outputs)})
+            {
+                if (!tableData->empty())
+                {
+                    this->BatchInsertStatements(batch_insert_txn, tableName, ormTableColumns.at(tableName), *tableData);
+                }
+            }
+        }
+
+        for (const auto &[tableName, tableData] : orm_storage_map)
+        {
+            if (encoded && (tableName == "transparent_inputs" || tableName == "transparent_outputs"))
+            {
+                continue;
+            }
+
+            if (tableName == "blocks" || tableData.empty())
+            {
+                continue;
+            }
+
+            if (tableName == "transaction_raw")
+            {
+                this->InsertRawTransactions(batch_insert_txn, height, tableData);
+            }
+            else
+            {
+                this->BatchInsertStatements(batch_insert_txn, tableName, ormTableColumns.at(tableName), tableData);
+            }
+        }
+
+        {
+            TraceSpan span("mark spends", height);
+
+            static const OrmRows noRows;
+            const auto inputs = orm_storage_map.find("transparent_inputs");
+            const OrmRows &inputRows = encoded ? encoded->inputs : (inputs != orm_storage_map.end() ? inputs->second : noRows);
+            const std::string_view blockTxIds = blocks != orm_storage_map.end() && !blocks->second.empty()
+                                                    ? std::get<std::string_view>(blocks->second.front()[BLOCK_TRANSACTION_IDS_COLUMN])
+                                                    : std::string_view{"{}"};
+
+            this->MarkSpentOutputs(batch_insert_txn, height, inputRows, blockTxIds);
+        }
+
+        {
+            TraceSpan span("commit", height);
+            batch_insert_txn.commit();
+        }
+
+        if (encoded)
+        {
+            this->txIdDictionary->MarkStored(encoded->newTxIds);
+            this->addressDictionary->MarkStored(encoded->newAddresses);
+        }
+        return WriteResult::Written;
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(("Unable to write block " + std::string(hash) + " at height " + std::to_string(height) + ": " + e.what()).c_str());
+        throw;
+    }
+}
+
+void PostgresStorage::MarkSpentOutputs(pqxx::work &batch_insert_txn, uint64_t height, const OrmRows &inputs, std::string_view blockTxIds) const
+{
+    const SpendTables &tables = this->txIdDictionary ? ENCODED_SPEND_TABLES : TEXT_SPEND_TABLES;
+    const std::string outputsTable = tables.outputs;
+    const std::string pendingTable = tables.pending;
+    const std::string txColumn = tables.txColumn;
+    const std::string spentColumn = tables.spentColumn;
+    const std::string keyType = tables.keyType;
+
+    // Spent outpoints and their spenders as three parallel arrays, so the block is marked in one statement
+    std::string spentTxs{"{"};
+    std::string spentIndexes{"{"};
+    std::string spenders{"{"};
+    for (const OrmRow &row : inputs)
+    {
+        // tx_id, vin_tx_id, v_out_idx, ... or their encoded equivalents
+        if (row[1] == BlockData(COINBASE_VIN_TX_ID) || row[1] == BlockData(uint64_t{0}))
+        {
+            continue;
+        }
+
+        AppendArrayElement(spentTxs, row[1]);
+        AppendArrayElement(spentIndexes, row[2]);
+        AppendArrayElement(spenders, row[0]);
+    }
+    spentTxs += "}";
+    spentIndexes += "}";
+    spenders += "}";
+
+    if (spenders.size() > 2)
+    {
+        // Outputs that are not stored yet are spent by the block that stores them
+        batch_insert_txn.exec_params("WITH spends AS (SELECT * FROM unnest($1::" + keyType + "[], $2::int[], $3::" + keyType + "[]) AS s(tx, output_index, spender)), "
+                                     "marked AS (UPDATE " + outputsTable + " o SET " + spentColumn + " = s.spender, spent_height = $4 FROM spends s "
+                                     "WHERE o." + txColumn + " = s.tx AND o.output_index = s.output_index RETURNING o." + txColumn + " AS tx, o.output_index) "
+                                     "INSERT INTO " + pendingTable + " (" + txColumn + ", output_index, " + spentColumn + ", spent_height) "
+                                     "SELECT s.tx, s.output_index, s.spender, $4 FROM spends s "
+                                     "WHERE NOT EXISTS (SELECT 1 FROM marked m WHERE m.tx = s.tx AND m.output_index = s.output_index) "
+                                     "ON CONFLICT DO NOTHING",
+                                     spentTxs, spentIndexes, spenders, height);
+    }
+
+    if (blockTxIds.size() > 2)
+    {
+        // Every output of a transaction is in its block, so pending spends of all its txids are claimed whether or not their output was stored
+        const std::string claimedFrom = this->txIdDictionary ? "DELETE FROM " + pendingTable + " p USING tx_ids t WHERE t.tx_id = ANY($1::text[]) AND p." + txColumn + " = t.id "
+                                                             : "DELETE FROM " + pendingTable + " p WHERE p." + txColumn + " = ANY($1::text[]) ";
+        batch_insert_txn.exec_params("WITH claimed AS (" + claimedFrom +
+                                         "RETURNING p." + txColumn + " AS tx, p.output_index, p." + spentColumn + " AS spender, p.spent_height) "
+                                         "UPDATE " + outputsTable + " o SET " + spentColumn + " = c.spender, spent_height = c.spent_height FROM claimed c "
+                                         "WHERE o." + txColumn + " = c.tx AND o.output_index = c.output_index",
+                                     std::string(blockTxIds));
+    }
+}
+
+void PostgresStorage::InsertRawTransactions(pqxx::work &batch_insert_txn, uint64_t height, const OrmRows &rawTransactions) const
+{
+    // tx_id, height, raw
+    std::string txIds{"{"};
+    std::string offsets{"{"};
+    std::string lengths{"{"};
+    std::string frames;
+    for (const OrmRow &row : rawTransactions)
+    {
+        const std::string_view frame = std::get<std::string_view>(row[2]);
+
+        AppendArrayElement(txIds, row[0]);
+        AppendArrayElement(offsets, uint64_t{frames.size()});
+        AppendArrayElement(lengths, uint64_t{frame.size()});
+        frames += frame;
+    }
+    txIds += "}";
+    offsets += "}";
+    lengths += "}";
+
+    batch_insert_txn.exec_params("INSERT INTO transaction_raw (tx_id, height, raw) "
+                                 "SELECT r.tx_id, $2, substring($3::bytea FROM r.frame_offset + 1 FOR r.frame_length) "
+                                 "FROM unnest($1::text[], $4::bigint[], $5::int[]) AS r(tx_id, frame_offset, frame_length) "
+                                 "ON CONFLICT DO NOTHING",
+                                 txIds, height, pqxx::binarystring(frames), offsets, lengths);
+}
+
+size_t PostgresStorage::ResolvePendingSpends(uint64_t committedWatermark)
+{
+    const SpendTables &tables = this->txIdDictionary ? ENCODED_SPEND_TABLES : TEXT_SPEND_TABLES;
+    const std::string outputsTable = tables.outputs;
+    const std::string pendingTable = tables.pending;
+    const std::string txColumn = tables.txColumn;
+    const std::string spentColumn = tables.spentColumn;
+
+    ManagedConnection conn(this->database);
+
+    try
+    {
+        pqxx::work tx(*conn);
+
+        // Pending spends whose output is visible now, left by a spending block that committed while the output's block was in flight
+        pqxx::result result = tx.exec("WITH claimed AS (DELETE FROM " + pendingTable + " p USING " + outputsTable + " o "
+                                      "WHERE o." + txColumn + " = p." + txColumn + " AND o.output_index = p.output_index "
+                                      "RETURNING p." + txColumn + " AS tx, p.output_index, p." + spentColumn + " AS spender, p.spent_height) "
+                                      "UPDATE " + outputsTable + " o SET " + spentColumn + " = c.spender, spent_height = c.spent_height FROM claimed c "
+                                      "WHERE o." + txColumn + " = c.tx AND o.output_index = c.output_index");
+
+        // Every block below the watermark has claimed its pending spends, so those left are of outputs the rules did not store
+        pqxx::result dropped = tx.exec_params("DELETE FROM " + pendingTable + " WHERE spent_height <= $1", committedWatermark);
+        tx.commit();
+
+        if (result.affected_rows() > 0 || dropped.affected_rows() > 0)
+        {
+            __DEBUG__(("Applied " + std::to_string(result.affected_rows()) + " pending spends, dropped " + std::to_string(dropped.affected_rows()) + " of unstored outputs").c_str());
+        }
+
+        return result.affected_rows();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+size_t PostgresStorage::UnmarkSpendsAbove(uint64_t height)
+{
+    const SpendTables &tables = this->txIdDictionary ? ENCODED_SPEND_TABLES : TEXT_SPEND_TABLES;
+    const std::string outputsTable = tables.outputs;
+    const std::string pendingTable = tables.pending;
+    const std::string spentColumn = tables.spentColumn;
+
+    ManagedConnection conn(this->database);
+
+    try
+    {
+        pqxx::work tx(*conn);
+
+        // Rollbacks are rare, so finding the marks by scanning the outputs is preferred to indexing spent_height
+        pqxx::result result = tx.exec_params("UPDATE " + outputsTable + " SET " + spentColumn + " = NULL, spent_height = NULL WHERE spent_height > $1", height);
+        tx.exec_params("DELETE FROM " + pendingTable + " WHERE spent_height > $1", height);
+        tx.commit();
+
+        __INFO__(("Unmarked " + std::to_string(result.affected_rows()) + " outputs spent above height " + std::to_string(height)).c_str());
+        return result.affected_rows();
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+PrevoutMap PostgresStorage::ResolvePrevouts(const std::vector<Outpoint> &outpoints)
+{
+    PrevoutMap prevouts;
+    if (outpoints.empty())
+    {
+        return prevouts;
+    }
+
+    if (this->txIdDictionary)
+    {
+        return this->ResolveEncodedPrevouts(outpoints);
+    }
+
+    // All outpoints are found in one round trip by joining against them passed as two parallel arrays
+    std::string txIds{"{"};
+    std::string outputIndexes{"{"};
+    for (const Outpoint &outpoint : outpoints)
+    {
+        if (txIds.size() > 1)
+        {
+            txIds += ",";
+            outputIndexes += ",";
+        }
+
+        txIds += "\"";
+        txIds += outpoint.txId;
+        txIds += "\"";
+        outputIndexes += std::to_string(outpoint.vout);
+    }
+    txIds += "}";
+    outputIndexes += "}";
+
+    const std::unordered_set<Outpoint, OutpointHash> pending(outpoints.begin(), outpoints.end());
+
+    ManagedConnection conn(this->database);
+    pqxx::work tx(*conn);
+    pqxx::result result = tx.exec_params("SELECT o.tx_id, o.output_index, o.value, o.recipients "
+                                         "FROM unnest($1::text[], $2::int[]) AS r(tx_id, output_index) "
+                                         "JOIN transparent_outputs o ON o.tx_id = r.tx_id AND o.output_index = r.output_index",
+                                         txIds, outputIndexes);
+    tx.commit();
+
+    prevouts.reserve(result.size());
+    for (const auto &row : result)
+    {
+        // Keys view the block's JSON, so the returned txid is only used to find the requested outpoint
+        auto requested = pending.find(Outpoint{row[0].c_str(), row[1].as<uint32_t>()});
+        if (requested != pending.end())
+        {
+            prevouts.emplace(*requested, Prevout{row[2].as<double>(), row[3].as<std::string>()});
+        }
+    }
+
+    return prevouts;
+}
+
+PrevoutMap PostgresStorage::ResolveEncodedPrevouts(const std::vector<Outpoint> &outpoints)
+{
+    PrevoutMap prevouts;
+
+    // Txids are mapped to ids in process, so the lookup is an integer join. A txid without an id has no stored outputs.
+    std::string txRefs{"{"};
+    std::string outputIndexes{"{"};
+    std::unordered_map<uint64_t, std::string_view> requestedTxIds;
+    for (const Outpoint &outpoint : outpoints)
+    {
+        const std::optional<uint64_t> txRef = this->txIdDictionary->Find(outpoint.txId);
+        if (!txRef)
+        {
+            continue;
+        }
+
+        if (txRefs.size() > 1)
+        {
+            txRefs += ",";
+            outputIndexes += ",";
+        }
+
+        txRefs += std::to_string(*txRef);
+        outputIndexes += std::to_string(outpoint.vout);
+        requestedTxIds.emplace(*txRef, outpoint.txId);
+    }
+    txRefs += "}";
+    outputIndexes += "}";
+
+    if (requestedTxIds.empty())
+    {
+        return prevouts;
+    }
+
+    const std::unordered_set<Outpoint, OutpointHash> pending(outpoints.begin(), outpoints.end());
+
+    ManagedConnection conn(this->database);
+    pqxx::work tx(*conn);
+    pqxx::result result = tx.exec_params("SELECT o.tx_ref, o.output_index, o.value, "
+                                         "ARRAY(SELECT a.address FROM unnest(o.recipient_refs) WITH ORDINALITY AS u(id, position) JOIN addresses a ON a.id = u.id ORDER BY u.position) "
+                                         "FROM unnest($1::bigint[], $2::int[]) AS r(tx_ref, output_index) "
+                                         "JOIN transparent_outputs_encoded o ON o.tx_ref = r.tx_ref AND o.output_index = r.output_index",
+                                         txRefs, outputIndexes);
+    tx.commit();
+
+    prevouts.reserve(result.size());
+    for (const auto &row : result)
+    {
+        auto requestedTxId = requestedTxIds.find(row[0].as<uint64_t>());
+        if (requestedTxId == requestedTxIds.end())
+        {
+            continue;
+        }
+
+        auto requested = pending.find(Outpoint{requestedTxId->second, row[1].as<uint32_t>()});
+        if (requested != pending.end())
+        {
+            prevouts.emplace(*requested, Prevout{row[2].as<double>(), row[3].as<std::string>()});
+        }
+    }
+
+    return prevouts;
+}
+
+std::optional<uint64_t> PostgresStorage::GetTipHeight()
+{
+    ManagedConnection conn(this->database);
+    pqxx::work tx(*conn);
+
+    pqxx::row row = tx.exec1("SELECT max(height) FROM blocks");
+    tx.commit();
+
+    if (row[0].is_null())
+    {
+        return std::nullopt;
+    }
+
+    return row[0].as<uint64_t>();
+}
+
+void PostgresStorage::LoadStoredHeights(HeightBitmap &heights)
+{
+    ManagedConnection conn(this->database);
+    pqxx::work tx(*conn);
+
+    pqxx::result result = tx.exec("SELECT height FROM blocks");
+    for (const auto &row : result)
+    {
+        heights.Add(row[0].as<uint64_t>());
+    }
+
+    tx.commit();
+}
+
+const std::vector<std::string> &PostgresStorage::GetTableColumns(const std::string &table_name)
+{
+    return ormTableColumns.at(table_name);
+}
+
+std::string PostgresStorage::BuildInsertStatement(const std::string &table_name, const std::vector<std::string> &columns, const OrmRows &orm_values, const QuoteFunction &quote)
+{
+    std::stringstream query;
+    query << "INSERT INTO ";
+
+    query << table_name << " (";
+    for (size_t j = 0; j < columns.size(); ++j)
+    {
+        query << columns[j];
+
+        if (j != columns.size() - 1)
+        {
+            query << ", ";
+        }
+        else
+        {
+            query << ") VALUES ";
+        }
+    }
+
+    for (size_t i = 0; i < orm_values.size(); ++i)
+    {
+        const auto &row = orm_values[i];
+        query << "(";
+
+        for (size_t j = 0; j < row.size(); ++j)
+        {
+            // std::visit is used to obtain the string representation of the variant
+            std::string value = std::visit([](auto &&arg) -> std::string
+                                           {
+                                               using T = std::decay_t<decltype(arg)>;
+                                               if constexpr (std::is_same_v<T, std::string_view>)
+                                                   return std::string(arg); // If it's a string, use it directly
+                                               else
+                                                   return std::to_string(arg); // Convert numbers to string
+                                               // Handle other types as needed
+                                           },
+                                           row[j]);
+
+            query << quote(value); // Use the obtained string value
+            if (j < row.size() - 1)
+            {
+                query << ", ";
+            }
+        }
+        query << ")";
+
+        if (i < orm_values.size() - 1)
+        {
+            query << ", ";
+        }
+    }
+
+    query << " ON CONFLICT DO NOTHING;";
+    return query.str();
+}
+
+size_t PostgresStorage::BatchInsertStatements(pqxx::work &batch_insert_txn, const std::string &table_name, const std::vector<std::string> &columns, const OrmRows &orm_values) const
+{
+    const std::string query = PostgresStorage::BuildInsertStatement(table_name, columns, orm_values, [&batch_insert_txn](const std::string &value)
+                                                                    { return batch_insert_txn.quote(value); });
+
+    return batch_insert_txn.exec(query).affected_rows();
+}
+
+void PostgresStorage::UpdateChunkCheckpoint(size_t chunkStartHeight, size_t currentProcessingChunkHeight)
+{
+
+    ManagedConnection conn(this->database);
+
+    try
+    {
+        pqxx::work transaction(*conn);
+
+        conn->prepare(
+            "update_checkpoint",
+            "UPDATE checkpoints "
+            "SET last_checkpoint = $2 "
+            "WHERE chunk_start_height = $1;");
+
+        transaction.exec_prepared("update_checkpoint", chunkStartHeight, currentProcessingChunkHeight);
+        transaction.commit();
+
+        std::string message = "Updating checkpoint from start value " + std::to_string(chunkStartHeight) + " to " + std::to_string(currentProcessingChunkHeight);
+        __DEBUG__(message.c_str());
+
+        conn->unprepare("update_checkpoint");
+    }
+    catch (std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+std::optional<StorageBackend::Checkpoint> PostgresStorage::GetCheckpoint(size_t chunkStartHeight)
+{
+    ManagedConnection conn(this->database);
+    try
+    {
+
+        pqxx::work transaction(*conn);
+
+        pqxx::result result = transaction.exec(
+            "SELECT chunk_start_height, chunk_end_height, last_checkpoint "
+            "FROM checkpoints WHERE chunk_start_height = " +
+            transaction.quote(chunkStartHeight));
+
+        if (result.empty())
+        {
+            return std::nullopt;
+        }
+        else
+        {
+            pqxx::row row = result[0];
+
+            Checkpoint checkpoint;
+
+            checkpoint.chunkStartHeight = row["chunk_start_height"].as<size_t>();
+            checkpoint.chunkEndHeight = row["chunk_end_height"].as<size_t>();
+            checkpoint.lastCheckpoint = row["last_checkpoint"].as<size_t>();
+
+            return checkpoint;
+        }
+    }
+    catch (const pqxx::sql_error &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+void PostgresStorage::CreateCheckpointIfNonExistent(size_t chunkStartHeight, size_t chunkEndHeight)
+{
+    ManagedConnection conn(this->database);
+
+    try
+    {
+
+        std::string insertCheckpointStatement = R"(
+    INSERT INTO checkpoints (
+        chunk_start_height, 
+        chunk_end_height, 
+        last_checkpoint
+    ) VALUES ($1, $2, $3);
+)";
+
+        conn->prepare("insert_checkpoint", insertCheckpointStatement);
+        pqxx::work transaction(*conn);
+
+        transaction.exec_prepared("insert_checkpoint", chunkStartHeight, chunkEndHeight, chunkStartHeight);
+        transaction.commit();
+
+        __DEBUG__(("Checkpoint created at height " + std::to_string(chunkStartHeight) + " to " + std::to_string(chunkEndHeight)).c_str());
+
+        conn->unprepare("insert_checkpoint");
+    }
+    catch (std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+}
+
+void PostgresStorage::SplitCheckpoint(size_t chunkStartHeight, size_t newChunkEndHeight)
+{
+    ManagedConnection conn(this->database);
+
+    try
+    {
+        pqxx::work transaction(*conn);
+
+        pqxx::row existing = transaction.exec_params1("SELECT chunk_end_height FROM checkpoints WHERE chunk_start_height = $1", chunkStartHeight);
+        size_t chunkEndHeight = existing[0].as<size_t>();
+
+        if (newChunkEndHeight >= chunkEndHeight)
+        {
+            return;
+        }
+
+        transaction.exec_params("UPDATE checkpoints SET chunk_end_height = $2 WHERE chunk_start_height = $1", chunkStartHeight, newChunkEndHeight);
+        transaction.exec_params("INSERT INTO checkpoints (chunk_start_height, chunk_end_height, last_checkpoint) VALUES ($1, $2, $1)", newChunkEndHeight + 1, chunkEndHeight);
+        transaction.commit();
+
+        __DEBUG__(("Split checkpoint " + std::to_string(chunkStartHeight) + " at height " + std::to_string(newChunkEndHeight)).c_str());
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+        throw;
+    }
+}
+
+std::stack<StorageBackend::Checkpoint> PostgresStorage::GetUnfinishedCheckpoints()
+{
+    ManagedConnection conn(this->database);
+
+    try
+    {
+
+        pqxx::work transaction(*conn);
+
+        std::string query = R"(
+            SELECT chunk_start_height, chunk_end_height, last_checkpoint
+            FROM checkpoints
+            WHERE chunk_end_height != last_checkpoint
+        )";
+
+        // Execute query
+        pqxx::result result = transaction.exec(query);
+
+        // Process the sql rows for each checkpoint
+        std::stack<Checkpoint> checkpoints;
+        Checkpoint currentCheckpoint;
+
+        pqxx::result::const_iterator row_iterator = result.cbegin();
+        while (row_iterator != result.cend())
+        {
+            currentCheckpoint.chunkStartHeight = row_iterator["chunk_start_height"].as<size_t>();
+            currentCheckpoint.chunkEndHeight = row_iterator["chunk_end_height"].as<size_t>();
+            currentCheckpoint.lastCheckpoint = row_iterator["last_checkpoint"].as<size_t>();
+            checkpoints.push(currentCheckpoint);
+
+            ++row_iterator;
+        }
+        return checkpoints;
+    }
+    catch (const pqxx::sql_error &e)
+    {
+        __ERROR__(e.what());
+
+        std::stack<Checkpoint> empty_stack;
+        return empty_stack;
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+
+        std::stack<Checkpoint> empty_stack;
+        return empty_stack;
+    }
+}
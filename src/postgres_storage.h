@@ -0,0 +1,125 @@
+#ifndef POSTGRES_STORAGE_H
+#define POSTGRES_STORAGE_H
+
+#include "key_dictionary.h"
+#include "storage_backend.h"
+
+#include <pqxx/pqxx>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Database;
+
+/**
+ * PostgresStorage
+ * Stores blocks in the PostgreSQL tables created by Database::CreateTables(), one transaction per
+ * block, on connections borrowed from the Database pool.
+ *
+ * Writes are idempotent. Every row is inserted with ON CONFLICT DO NOTHING, so replaying a block that
+ * was committed before a crash, or re-syncing the overlap of a checkpoint, never aborts the batch.
+ *
+ * In the dictionary schema mode input and output rows are encoded before they are written: txids and
+ * addresses are replaced by ids from in-process dictionaries, seeded from tx_ids and addresses at
+ * startup, and the mappings a block introduces are written in the block's own transaction.
+ *
+ * Outputs record the transaction and height that spent them. A block marks the outputs its inputs
+ * spend in its own transaction, so the marks commit and abort with the block. Blocks are written out
+ * of order, so a spend whose output is not stored yet waits in a pending table until the output's
+ * block, or ResolvePendingSpends() for blocks committed concurrently, applies it. A block claims the
+ * pending spends of all its transactions, including those whose outputs indexing rules left out. Spends
+ * of such outputs in blocks committed after the output's are dropped by ResolvePendingSpends() once
+ * every lower height is committed.
+ */
+class PostgresStorage : public StorageBackend
+{
+private:
+    struct EncodedRows;
+
+    static constexpr size_t DICTIONARY_LOAD_BATCH_SIZE = 100000;
+
+    Database &database;
+
+    // Set in the dictionary schema mode only
+    std::unique_ptr<KeyDictionary> txIdDictionary;
+    std::unique_ptr<KeyDictionary> addressDictionary;
+
+    void LoadDictionary(KeyDictionary &dictionary, const std::string &table, const std::string &keyColumn);
+
+    /**
+     * @brief Encodes the block's transparent input and output rows, assigning ids to the txids and addresses they hold.
+     */
+    std::unique_ptr<EncodedRows> EncodeTransparentRows(const OrmStorageMap &orm_storage_map);
+
+    PrevoutMap ResolveEncodedPrevouts(const std::vector<Outpoint> &outpoints);
+
+    /**
+     * @brief Marks the outputs spent by the block's inputs, and applies pending spends of the block's own outputs.
+     *
+     * @param inputs The block's input rows, encoded in the dictionary schema mode.
+     * @param blockTxIds Array literal of every txid in the block, stored or not.
+     */
+    void MarkSpentOutputs(pqxx::work &batch_insert_txn, uint64_t height, const OrmRows &inputs, std::string_view blockTxIds) const;
+
+    /**
+     * @brief Inserts compressed raw transactions in a single statement. Their bytes are sent as one binary
+     * parameter and split by offset on the server, so they are never escaped into the statement text.
+     */
+    void InsertRawTransactions(pqxx::work &batch_insert_txn, uint64_t height, const OrmRows &rawTransactions) const;
+
+    /**
+     * @brief Inserts the rows in a single statement, skipping any row that conflicts with one already stored.
+     *
+     * @return The number of rows inserted.
+     */
+    size_t BatchInsertStatements(pqxx::work &batch_insert_txn, const std::string &table_name, const std::vector<std::string> &columns, const OrmRows &orm_values) const;
+
+public:
+    using QuoteFunction = std::function<std::string(const std::string &)>;
+
+    /**
+     * @param isDictionaryEncoded Whether the tables were created in the dictionary schema mode. If so the dictionaries are loaded here.
+     */
+    PostgresStorage(Database &database, bool isDictionaryEncoded);
+
+    /**
+     * @brief Returns the columns rows of the table are written to, in row order.
+     */
+    static const std::vector<std::string> &GetTableColumns(const std::string &table_name);
+
+    /**
+     * @brief Builds the multi-row INSERT ... ON CONFLICT DO NOTHING statement for the rows, quoting every value with quote.
+     */
+    static std::string BuildInsertStatement(const std::string &table_name, const std::vector<std::string> &columns, const OrmRows &orm_values, const QuoteFunction &quote);
+
+    PostgresStorage(const PostgresStorage &rhs) = delete;
+    PostgresStorage &operator=(const PostgresStorage &rhs) = delete;
+
+    std::string GetName() const override;
+
+    WriteResult WriteBlock(uint64_t height, std::string_view hash, const OrmStorageMap &orm_storage_map) override;
+
+    /**
+     * @brief Resolves every outpoint with a single query, so a block costs one round trip however many inputs it has.
+     */
+    PrevoutMap ResolvePrevouts(const std::vector<Outpoint> &outpoints) override;
+
+    std::optional<uint64_t> GetTipHeight() override;
+    void LoadStoredHeights(HeightBitmap &heights) override;
+
+    // Every block is durable once its transaction commits
+    void Flush() override {}
+
+    size_t ResolvePendingSpends(uint64_t committedWatermark) override;
+    size_t UnmarkSpendsAbove(uint64_t height) override;
+
+    void CreateCheckpointIfNonExistent(size_t chunkStartHeight, size_t chunkEndHeight) override;
+    void UpdateChunkCheckpoint(size_t chunkStartHeight, size_t checkpointUpdateValue) override;
+    void SplitCheckpoint(size_t chunkStartHeight, size_t newChunkEndHeight) override;
+    std::optional<Checkpoint> GetCheckpoint(size_t chunkStartHeight) override;
+    std::stack<Checkpoint> GetUnfinishedCheckpoints() override;
+};
+
+#endif // POSTGRES_STORAGE_H
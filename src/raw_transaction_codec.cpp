@@ -0,0 +1,100 @@
+#include "raw_transaction_codec.h"
+
+#include <zstd.h>
+
+#include <memory>
+#include <stdexcept>
+
+namespace
+{
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    int HexDigitValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    std::string FromHex(std::string_view hex)
+    {
+        if (hex.size() % 2 != 0)
+        {
+            throw std::invalid_argument("Odd length hex");
+        }
+
+        std::string bytes(hex.size() / 2, '\0');
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            const int high = HexDigitValue(hex[2 * i]);
+            const int low = HexDigitValue(hex[2 * i + 1]);
+            if (high < 0 || low < 0)
+            {
+                throw std::invalid_argument("Invalid hex digit");
+            }
+
+            bytes[i] = static_cast<char>(high << 4 | low);
+        }
+
+        return bytes;
+    }
+
+    void AppendHex(std::string &out, std::string_view bytes)
+    {
+        out.reserve(out.size() + bytes.size() * 2);
+        for (unsigned char byte : bytes)
+        {
+            out.push_back(HEX_DIGITS[byte >> 4]);
+            out.push_back(HEX_DIGITS[byte & 0x0f]);
+        }
+    }
+
+    struct CompressionContextDeleter
+    {
+        void operator()(ZSTD_CCtx *context) const { ZSTD_freeCCtx(context); }
+    };
+}
+
+std::string RawTransactionCodec::CompressHex(std::string_view hex, int level)
+{
+    // Ingest workers compress concurrently, so each keeps its own context
+    thread_local std::unique_ptr<ZSTD_CCtx, CompressionContextDeleter> context{ZSTD_createCCtx()};
+
+    const std::string bytes = FromHex(hex);
+    std::string compressed(ZSTD_compressBound(bytes.size()), '\0');
+
+    const size_t compressedSize = ZSTD_compressCCtx(context.get(), compressed.data(), compressed.size(), bytes.data(), bytes.size(), level);
+    if (ZSTD_isError(compressedSize))
+    {
+        throw std::runtime_error(std::string("Unable to compress raw transaction: ") + ZSTD_getErrorName(compressedSize));
+    }
+
+    compressed.resize(compressedSize);
+    return compressed;
+}
+
+std::string RawTransactionCodec::DecompressHex(std::string_view compressedHex)
+{
+    const std::string compressed = FromHex(compressedHex);
+
+    const unsigned long long rawSize = ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+    if (rawSize == ZSTD_CONTENTSIZE_ERROR || rawSize == ZSTD_CONTENTSIZE_UNKNOWN)
+    {
+        throw std::runtime_error("Compressed raw transaction has no valid zstd frame");
+    }
+
+    std::string bytes(rawSize, '\0');
+    const size_t decompressedSize = ZSTD_decompress(bytes.data(), bytes.size(), compressed.data(), compressed.size());
+    if (ZSTD_isError(decompressedSize) || decompressedSize != rawSize)
+    {
+        throw std::runtime_error("Unable to decompress raw transaction");
+    }
+
+    std::string hex;
+    AppendHex(hex, bytes);
+    return hex;
+}
@@ -0,0 +1,31 @@
+#ifndef RAW_TRANSACTION_CODEC_H
+#define RAW_TRANSACTION_CODEC_H
+
+#include <string>
+#include <string_view>
+
+/**
+ * RawTransactionCodec
+ * Converts raw transactions between the hex returned by the node and zstd compressed bytes, as kept in
+ * the transaction_raw table when RAW_TRANSACTION_STORAGE is "compressed". Each transaction is its own
+ * zstd frame, so any one of them is decompressed without reading its neighbours.
+ */
+class RawTransactionCodec
+{
+public:
+    /**
+     * @brief Compresses a raw transaction given as hex.
+     *
+     * @return The compressed bytes, a single zstd frame.
+     */
+    static std::string CompressHex(std::string_view hex, int level);
+
+    /**
+     * @brief Decompresses the hex encoded bytes of a compressed transaction, as read with encode(raw, 'hex').
+     *
+     * @return The raw transaction as hex.
+     */
+    static std::string DecompressHex(std::string_view compressedHex);
+};
+
+#endif // RAW_TRANSACTION_CODEC_H
@@ -0,0 +1,160 @@
+#include "response_cache.h"
+
+#include <algorithm>
+
+ResponseCache::ResponseCache(size_t maxBytes, size_t numShards) : maxBytesPerShard(maxBytes / std::max<size_t>(1, numShards))
+{
+    for (size_t i = 0; i < std::max<size_t>(1, numShards); ++i)
+    {
+        this->shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+ResponseCache::Shard &ResponseCache::ShardFor(const std::string &key)
+{
+    return *this->shards[std::hash<std::string>()(key) % this->shards.size()];
+}
+
+void ResponseCache::InsertLocked(Shard &shard, const std::string &key, Response response)
+{
+    const size_t bytes = key.size() + response->size() + ENTRY_OVERHEAD_BYTES;
+    if (bytes > this->maxBytesPerShard)
+    {
+        return;
+    }
+
+    auto existing = shard.entries.find(key);
+    if (existing != shard.entries.end())
+    {
+        shard.bytes -= existing->second->bytes;
+        shard.lru.erase(existing->second);
+        shard.entries.erase(existing);
+    }
+
+    shard.lru.push_front(Entry{key, std::move(response), bytes});
+    shard.entries.emplace(key, shard.lru.begin());
+    shard.bytes += bytes;
+
+    while (shard.bytes > this->maxBytesPerShard)
+    {
+        const Entry &oldest = shard.lru.back();
+        shard.bytes -= oldest.bytes;
+        shard.entries.erase(oldest.key);
+        shard.lru.pop_back();
+        ++this->evictions;
+    }
+}
+
+ResponseCache::Response ResponseCache::GetOrLoad(const std::string &key, const Loader &load, bool isCacheable)
+{
+    Shard &shard = this->ShardFor(key);
+
+    std::promise<Response> promise;
+    uint64_t generation;
+
+    {
+        std::unique_lock<std::mutex> lock(shard.cs_shard);
+
+        auto cached = shard.entries.find(key);
+        if (cached != shard.entries.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, cached->second);
+            ++this->hits;
+            return cached->second->response;
+        }
+
+        auto pending = shard.inFlight.find(key);
+        if (pending != shard.inFlight.end())
+        {
+            std::shared_future<Response> result = pending->second;
+            lock.unlock();
+
+            ++this->coalesced;
+            return result.get();
+        }
+
+        ++this->misses;
+        shard.inFlight.emplace(key, promise.get_future().share());
+        generation = shard.generation;
+    }
+
+    Response response;
+    try
+    {
+        std::optional<std::string> body = load();
+        if (body.has_value())
+        {
+            response = std::make_shared<const std::string>(std::move(body.value()));
+        }
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(shard.cs_shard);
+            shard.inFlight.erase(key);
+        }
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(shard.cs_shard);
+        shard.inFlight.erase(key);
+
+        if (response != nullptr && isCacheable && generation == shard.generation)
+        {
+            this->InsertLocked(shard, key, response);
+        }
+    }
+
+    promise.set_value(response);
+    return response;
+}
+
+void ResponseCache::Invalidate(const std::string &key)
+{
+    Shard &shard = this->ShardFor(key);
+    std::lock_guard<std::mutex> lock(shard.cs_shard);
+
+    ++shard.generation;
+
+    auto cached = shard.entries.find(key);
+    if (cached != shard.entries.end())
+    {
+        shard.bytes -= cached->second->bytes;
+        shard.lru.erase(cached->second);
+        shard.entries.erase(cached);
+    }
+}
+
+void ResponseCache::Clear()
+{
+    for (auto &shard : this->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->cs_shard);
+
+        ++shard->generation;
+        shard->entries.clear();
+        shard->lru.clear();
+        shard->bytes = 0;
+    }
+}
+
+ResponseCache::Stats ResponseCache::GetStats() const
+{
+    Stats stats;
+    stats.hits = this->hits;
+    stats.misses = this->misses;
+    stats.coalesced = this->coalesced;
+    stats.evictions = this->evictions;
+
+    for (const auto &shard : this->shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->cs_shard);
+        stats.entries += shard->entries.size();
+        stats.bytes += shard->bytes;
+    }
+
+    return stats;
+}
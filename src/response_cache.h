@@ -0,0 +1,99 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * ResponseCache
+ * In-process LRU of serialized API responses, split into shards that are locked independently so
+ * concurrent requests for different keys rarely contend. Each shard evicts its least recently used
+ * responses once it holds more than its share of the byte limit.
+ *
+ * Concurrent misses on the same key are coalesced: the first caller loads the response and the
+ * others wait for its result instead of repeating the query. A load that overlaps an invalidation of
+ * its shard is returned to its callers but not cached, so ingest never races a stale response in.
+ */
+class ResponseCache
+{
+public:
+    using Response = std::shared_ptr<const std::string>;
+
+    /**
+     * Produces the response for a key, or std::nullopt if there is nothing to return.
+     */
+    using Loader = std::function<std::optional<std::string>()>;
+
+    struct Stats
+    {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t coalesced{0};
+        uint64_t evictions{0};
+        uint64_t entries{0};
+        uint64_t bytes{0};
+    };
+
+private:
+    // Bookkeeping charged per entry on top of its key and body
+    static constexpr size_t ENTRY_OVERHEAD_BYTES = 96;
+
+    struct Entry
+    {
+        std::string key;
+        Response response;
+        size_t bytes;
+    };
+
+    struct Shard
+    {
+        std::mutex cs_shard;
+        std::list<Entry> lru;
+        std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+        std::unordered_map<std::string, std::shared_future<Response>> inFlight;
+        size_t bytes{0};
+        uint64_t generation{0};
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t maxBytesPerShard;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> evictions{0};
+
+    Shard &ShardFor(const std::string &key);
+    void InsertLocked(Shard &shard, const std::string &key, Response response);
+
+public:
+    ResponseCache(size_t maxBytes, size_t numShards);
+
+    ResponseCache(const ResponseCache &rhs) = delete;
+    ResponseCache &operator=(const ResponseCache &rhs) = delete;
+
+    /**
+     * @brief Returns the cached response for key, loading it on a miss.
+     *
+     * @param isCacheable False to coalesce concurrent loads without keeping the result.
+     * @return The response, or nullptr if the loader found nothing. Loader exceptions are rethrown
+     *         to every caller waiting on the load.
+     */
+    Response GetOrLoad(const std::string &key, const Loader &load, bool isCacheable = true);
+
+    void Invalidate(const std::string &key);
+    void Clear();
+
+    Stats GetStats() const;
+};
+
+#endif // RESPONSE_CACHE_H
@@ -0,0 +1,117 @@
+#include "scheduler.h"
+#include "logger.h"
+#include "tracer.h"
+
+#include <exception>
+
+Scheduler::~Scheduler() noexcept
+{
+    this->Stop();
+}
+
+void Scheduler::SchedulePeriodic(const std::string &name, std::chrono::milliseconds interval, Task task)
+{
+    std::lock_guard<std::mutex> lock(cs_scheduler);
+    if (this->isStopping)
+    {
+        return;
+    }
+
+    this->intervals[name] = interval;
+    this->tasks.emplace_back([this, name, task = std::move(task)]()
+                             {
+                                Tracer::SetThreadName(name);
+
+                                do
+                                {
+                                    try
+                                    {
+                                        task();
+                                    }
+                                    catch (const std::exception &e)
+                                    {
+                                        __ERROR__(("Scheduled task " + name + " failed: " + e.what()).c_str());
+                                    }
+                                } while (this->WaitForNextRun(name));
+
+                                __DEBUG__(("Scheduled task " + name + " stopped.").c_str()); });
+}
+
+bool Scheduler::WaitForNextRun(const std::string &name)
+{
+    std::unique_lock<std::mutex> lock(cs_scheduler);
+    const auto lastRun = std::chrono::steady_clock::now();
+
+    while (!this->isStopping)
+    {
+        const auto nextRun = lastRun + this->intervals.at(name);
+        if (std::chrono::steady_clock::now() >= nextRun)
+        {
+            return true;
+        }
+
+        this->cv_scheduler.wait_until(lock, nextRun);
+    }
+
+    return false;
+}
+
+bool Scheduler::SetInterval(const std::string &name, std::chrono::milliseconds interval)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_scheduler);
+        auto scheduled = this->intervals.find(name);
+        if (scheduled == this->intervals.end())
+        {
+            return false;
+        }
+
+        scheduled->second = interval;
+    }
+    this->cv_scheduler.notify_all();
+
+    __INFO__(("Scheduled task " + name + " now runs every " + std::to_string(interval.count()) + "ms.").c_str());
+    return true;
+}
+
+std::optional<std::chrono::milliseconds> Scheduler::GetInterval(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(cs_scheduler);
+    auto scheduled = this->intervals.find(name);
+    if (scheduled == this->intervals.end())
+    {
+        return std::nullopt;
+    }
+
+    return scheduled->second;
+}
+
+bool Scheduler::WaitFor(std::chrono::milliseconds duration)
+{
+    std::unique_lock<std::mutex> lock(cs_scheduler);
+    return !this->cv_scheduler.wait_for(lock, duration, [this]()
+                                        { return this->isStopping; });
+}
+
+bool Scheduler::IsStopping()
+{
+    std::lock_guard<std::mutex> lock(cs_scheduler);
+    return this->isStopping;
+}
+
+void Scheduler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_scheduler);
+        this->isStopping = true;
+    }
+    this->cv_scheduler.notify_all();
+
+    for (std::thread &task : this->tasks)
+    {
+        if (task.joinable())
+        {
+            task.join();
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Scheduler
+ * Runs periodic background tasks, each on a thread of its own, and waits between runs on a condition
+ * variable rather than sleeping. Stop() interrupts every wait at once, so a task with an interval of
+ * hours still ends as soon as its current run returns.
+ */
+class Scheduler
+{
+private:
+    std::mutex cs_scheduler;
+    std::condition_variable cv_scheduler;
+    bool isStopping{false};
+
+    std::map<std::string, std::chrono::milliseconds> intervals;
+    std::vector<std::thread> tasks;
+
+    /**
+     * @brief Waits for the task's interval from now, picking up interval changes made while waiting.
+     *
+     * @return False if the wait was interrupted by Stop().
+     */
+    bool WaitForNextRun(const std::string &name);
+
+public:
+    using Task = std::function<void()>;
+
+    Scheduler() = default;
+
+    Scheduler(const Scheduler &rhs) = delete;
+    Scheduler &operator=(const Scheduler &rhs) = delete;
+
+    ~Scheduler() noexcept;
+
+    /**
+     * @brief Runs the task now and then again each time the interval has passed since its last run returned.
+     *
+     * Exceptions thrown by the task are logged and do not end the schedule.
+     *
+     * @param name Unique name the interval can later be changed by.
+     */
+    void SchedulePeriodic(const std::string &name, std::chrono::milliseconds interval, Task task);
+
+    /**
+     * @brief Changes the interval of a scheduled task, including the wait it is currently in.
+     *
+     * @return False if no task of that name is scheduled.
+     */
+    bool SetInterval(const std::string &name, std::chrono::milliseconds interval);
+
+    std::optional<std::chrono::milliseconds> GetInterval(const std::string &name);
+
+    /**
+     * @brief Waits for the duration or until the scheduler is stopped.
+     *
+     * @return False if the wait was interrupted by Stop().
+     */
+    bool WaitFor(std::chrono::milliseconds duration);
+
+    bool IsStopping();
+
+    /**
+     * @brief Interrupts every wait and joins the task threads once their current runs return.
+     */
+    void Stop();
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,88 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include "chain_resource.h"
+#include "height_bitmap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * StorageBackend
+ * The storage surface block ingest depends on: writing a block's rows atomically, chunk checkpoints,
+ * prevout lookup for inputs and the stored tip. Database keeps the sync state, missed blocks and the
+ * in-memory indexes, and hands block data to the backend chosen by STORAGE_BACKEND.
+ *
+ * Implementations are called from every ingest worker at once and must be thread safe.
+ */
+class StorageBackend
+{
+public:
+    struct Checkpoint
+    {
+        size_t chunkStartHeight;
+        size_t chunkEndHeight;
+        size_t lastCheckpoint;
+    };
+
+    enum class WriteResult
+    {
+        Written,
+        AlreadyStored // Stored before the committed heights were last persisted
+    };
+
+    virtual ~StorageBackend() = default;
+
+    virtual std::string GetName() const = 0;
+
+    /**
+     * @brief Writes every row of a block, or none of them. Throws if the block could not be written.
+     */
+    virtual WriteResult WriteBlock(uint64_t height, std::string_view hash, const OrmStorageMap &orm_storage_map) = 0;
+
+    /**
+     * @brief Finds the value and recipients of stored outputs. Outpoints that are not found are left out.
+     */
+    virtual PrevoutMap ResolvePrevouts(const std::vector<Outpoint> &outpoints) = 0;
+
+    virtual std::optional<uint64_t> GetTipHeight() = 0;
+
+    /**
+     * @brief Adds the height of every stored block to heights.
+     */
+    virtual void LoadStoredHeights(HeightBitmap &heights) = 0;
+
+    /**
+     * @brief Makes every block written so far durable. Called before the committed heights are persisted.
+     */
+    virtual void Flush() = 0;
+
+    /**
+     * @brief Marks outputs spent by inputs that were written before the outputs were, by blocks committed concurrently.
+     *
+     * @param committedWatermark Height below which every block is committed. Spends at or below it whose output is
+     * still not stored never will be, as indexing rules left it out, and are dropped.
+     * @return The number of outputs marked.
+     */
+    virtual size_t ResolvePendingSpends(uint64_t committedWatermark) = 0;
+
+    /**
+     * @brief Undoes the spends recorded by blocks above height, so outputs they spent are unspent again. Call before those blocks are removed.
+     *
+     * @return The number of outputs unmarked.
+     */
+    virtual size_t UnmarkSpendsAbove(uint64_t height) = 0;
+
+    virtual void CreateCheckpointIfNonExistent(size_t chunkStartHeight, size_t chunkEndHeight) = 0;
+    virtual void UpdateChunkCheckpoint(size_t chunkStartHeight, size_t checkpointUpdateValue) = 0;
+    virtual void SplitCheckpoint(size_t chunkStartHeight, size_t newChunkEndHeight) = 0;
+    virtual std::optional<Checkpoint> GetCheckpoint(size_t chunkStartHeight) = 0;
+    virtual std::stack<Checkpoint> GetUnfinishedCheckpoints() = 0;
+};
+
+#endif // STORAGE_BACKEND_H
@@ -14,38 +14,195 @@
 #include <boost/process.hpp>
 #include <fstream>
 #include <queue>
+#include <deque>
+#include <future>
+#include <random>
+#include <cmath>
 #include "config.h"
+#include "tracer.h"
 
-size_t Syncer::CHUNK_SIZE = std::stoi(Config::getBlockChunkProcessingSize());
+std::atomic<size_t> Syncer::CHUNK_SIZE{std::stoull(Config::getBlockChunkProcessingSize())};
 const uint8_t Syncer::MAX_CONCURRENT_THREADS = std::thread::hardware_concurrency();
 
-Syncer::Syncer(CustomClient &httpClientIn, Database &databaseIn) : httpClient(httpClientIn), database(databaseIn), latestBlockSynced{0}, latestBlockCount{0}, isSyncing{false}, worker_pool{ThreadPool()}
+Syncer::Syncer(CustomClient &httpClientIn, AsyncRpcClient &asyncRpcClientIn, Database &databaseIn) : httpClient(httpClientIn), asyncRpcClient(asyncRpcClientIn), database(databaseIn),
+                                                                    chunk_planner([this](uint64_t height) { return this->ProbeBlockCost(height); },
+                                                                                  Syncer::CHUNK_SIZE,
+                                                                                  std::stoull(Config::getSegmentTargetBytes()),
+                                                                                  std::stod(Config::getSegmentTargetSeconds()),
+                                                                                  std::stoull(Config::getSegmentProbeStride())),
+                                                                    memory_budget(std::stoull(Config::getMemoryBudgetBytes())),
+                                                                    latestBlockSynced{0}, latestBlockCount{0}, isSyncing{false}
 {
+    if (Config::getIngestMode() == "pinned")
+    {
+        this->pinned_workers = std::make_unique<PinnedWorkerPool>(std::stoull(Config::getPinnedWorkers()),
+                                                                  [this]()
+                                                                  { this->database.PinConnectionToThread(); },
+                                                                  [this]()
+                                                                  { this->database.UnpinConnectionFromThread(); });
+    }
 }
 
-Syncer::~Syncer() noexcept {}
+Syncer::~Syncer() noexcept
+{
+    // Pinned workers run segments against members declared after them, so they are stopped first
+    if (this->pinned_workers != nullptr)
+    {
+        this->pinned_workers->Drain();
+    }
+}
 
 void Syncer::DoConcurrentSyncOnChunk(const std::vector<size_t> &chunkToProcess)
 {
-    std::vector<Block> downloadedBlocks;
-    downloadedBlocks.reserve(chunkToProcess.size());
-    this->DownloadBlocksFromHeights(downloadedBlocks, chunkToProcess);
-
-    worker_pool.SubmitTask([this, capturedDownloadedBlocks = std::move(downloadedBlocks)](uint64_t c, uint64_t d, uint64_t e) mutable
-                           { 
-                            this->database.BatchStoreBlocks(capturedDownloadedBlocks, c, d, e);
-                            this->worker_pool.TaskCompleted(); },
-                           Database::InvalidHeight, Database::InvalidHeight, Database::InvalidHeight);
+    size_t numHeightsDownloaded{0};
+
+    while (numHeightsDownloaded < chunkToProcess.size() && !this->IsStopping())
+    {
+        std::vector<size_t> remainingHeights(chunkToProcess.begin() + numHeightsDownloaded, chunkToProcess.end());
+
+        std::vector<Block> downloadedBlocks;
+        downloadedBlocks.reserve(remainingHeights.size());
+        numHeightsDownloaded += this->DownloadBlocksFromHeights(downloadedBlocks, remainingHeights);
+
+        this->SubmitSegment(std::move(downloadedBlocks), Database::InvalidHeight, Database::InvalidHeight, Database::InvalidHeight, std::nullopt);
+    }
+}
+
+void Syncer::SubmitSegment(std::vector<Block> &&blocks, uint64_t segmentStartHeight, uint64_t segmentEndHeight, uint64_t trueRangeStartHeight, std::optional<ChunkPlanner::Segment> plannedSegment)
+{
+    // Held by a shared pointer as tasks must be copyable and blocks are not
+    auto segmentBlocks = std::make_shared<std::vector<Block>>(std::move(blocks));
+
+    auto store = [this, segmentBlocks, segmentStartHeight, segmentEndHeight, trueRangeStartHeight, plannedSegment](ChunkArena *scratchArena)
+    {
+        auto storeStart = std::chrono::steady_clock::now();
+        this->StoreSegment(*segmentBlocks, segmentStartHeight, segmentEndHeight, trueRangeStartHeight, scratchArena);
+
+        if (plannedSegment.has_value())
+        {
+            this->chunk_planner.RecordSegmentCompleted(*plannedSegment, std::chrono::steady_clock::now() - storeStart);
+        }
+    };
+
+    if (this->pinned_workers == nullptr)
+    {
+        this->worker_pool.SubmitTask([this, store]()
+                                     {
+                                        store(nullptr);
+                                        this->worker_pool.TaskCompleted(); });
+        return;
+    }
+
+    // Segments go to the workers in turn. A key derived from heights would pile neighbouring segments on one worker whenever they are shorter than CHUNK_SIZE.
+    // Blocks committed in height order all go to the first worker, whose queue runs them one at a time.
+    const uint64_t routingKey = this->database.IsCommittingInHeightOrder() ? 0 : this->submitted_segments.fetch_add(1, std::memory_order_relaxed);
+    this->pinned_workers->Submit(routingKey, segmentBlocks->size(), [store](ChunkArena &arena)
+                                 { store(&arena); });
+}
+
+void Syncer::WaitForSegments()
+{
+    this->worker_pool.RefreshThreadPool();
+
+    if (this->pinned_workers != nullptr)
+    {
+        this->pinned_workers->WaitUntilIdle();
+        this->LogWorkerThroughput();
+    }
+}
+
+void Syncer::LogWorkerThroughput() const
+{
+    for (const PinnedWorkerPool::WorkerStats &stats : this->GetWorkerStats())
+    {
+        const double blocksPerSecond = stats.busySeconds > 0.0 ? static_cast<double>(stats.blocks) / stats.busySeconds : 0.0;
+        __INFO__(("Core " + std::to_string(stats.core) + ": " + std::to_string(stats.blocks) + " blocks in " + std::to_string(stats.tasks) + " segments, " +
+                  std::to_string(static_cast<uint64_t>(blocksPerSecond)) + " blocks/s while busy")
+                     .c_str());
+    }
+}
+
+std::vector<PinnedWorkerPool::WorkerStats> Syncer::GetWorkerStats() const
+{
+    if (this->pinned_workers == nullptr)
+    {
+        return {};
+    }
+
+    return this->pinned_workers->GetStats();
+}
+
+void Syncer::StoreSegment(std::vector<Block> &blocks, uint64_t segmentStartHeight, uint64_t segmentEndHeight, uint64_t trueRangeStartHeight, ChunkArena *scratchArena)
+{
+    try
+    {
+        this->database.BatchStoreBlocks(blocks, segmentStartHeight, segmentEndHeight, trueRangeStartHeight, &this->memory_budget, scratchArena);
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(e.what());
+    }
+
+    // Blocks left behind by a failed store are still charged to the budget
+    for (Block &block : blocks)
+    {
+        if (block.isValid())
+        {
+            this->memory_budget.Release(block.GetEstimatedMemoryUsage());
+            block = Block();
+        }
+    }
+
+    __DEBUG__(this->memory_budget.Describe().c_str());
 }
 
-size_t Syncer::GetNextSegmentIndex(size_t chunkEndpoint, size_t segmentStart)
+bool Syncer::ChargeDownloadedBlock(const Block &block, bool isFirstBlockInSegment)
 {
-    if (chunkEndpoint - segmentStart + 1 >= Syncer::CHUNK_SIZE)
+    const uint64_t blockMemoryUsage = block.GetEstimatedMemoryUsage();
+
+    if (this->memory_budget.TryAcquire(blockMemoryUsage))
     {
-        return segmentStart + Syncer::CHUNK_SIZE - 1;
+        return true;
     }
 
-    return chunkEndpoint;
+    // Nothing of this segment is held yet, so wait for workers to commit and free memory
+    if (isFirstBlockInSegment)
+    {
+        this->memory_budget.Acquire(blockMemoryUsage);
+        return true;
+    }
+
+    // Keep the block that was already downloaded but cut the segment here
+    this->memory_budget.Reserve(blockMemoryUsage);
+    return false;
+}
+
+void Syncer::SetChunkSize(size_t chunkSize)
+{
+    chunkSize = std::max<size_t>(chunkSize, 1);
+    Syncer::CHUNK_SIZE = chunkSize;
+    this->chunk_planner.SetMaxBlocksPerSegment(chunkSize);
+
+    __INFO__(("Segments now hold at most " + std::to_string(chunkSize) + " blocks.").c_str());
+}
+
+ChunkPlanner::BlockCost Syncer::ProbeBlockCost(uint64_t height)
+{
+    Json::Value probeParams{Json::nullValue};
+    probeParams.append(Json::Value(std::to_string(height)));
+    probeParams.append(Json::Value(Syncer::BLOCK_PROBE_VERBOSE_LEVEL));
+
+    try
+    {
+        Json::Value blockSummary = this->asyncRpcClient.CallMethod("getblock", probeParams).get();
+
+        return ChunkPlanner::BlockCost{blockSummary["size"].asUInt64(), static_cast<uint64_t>(blockSummary["tx"].size())};
+    }
+    catch (const std::exception &e)
+    {
+        __ERROR__(("Failed to probe block cost at height " + std::to_string(height) + ": " + e.what()).c_str());
+        return ChunkPlanner::BlockCost{};
+    }
 }
 
 void Syncer::DoConcurrentSyncOnRange(uint64_t rangeStart, uint64_t rangeEnd, bool isPreExistingCheckpoint)
@@ -67,92 +224,128 @@ void Syncer::DoConcurrentSyncOnRange(uint64_t rangeStart, uint64_t rangeEnd, boo
 
         segmentStartIndex = checkpointOpt.value().lastCheckpoint;
         segmentEndIndex = checkpointOpt.value().chunkEndHeight;
+        uint64_t checkpointStartHeight = rangeStart;
 
-        downloadedBlocks.reserve(segmentEndIndex - segmentStartIndex);
-        this->DownloadBlocks(downloadedBlocks, segmentStartIndex, segmentEndIndex);
+        while (segmentStartIndex <= segmentEndIndex && !this->IsStopping())
+        {
+            downloadedBlocks.reserve(segmentEndIndex - segmentStartIndex + 1);
+            uint64_t downloadedEndIndex = this->DownloadBlocks(downloadedBlocks, segmentStartIndex, segmentEndIndex);
 
-        __INFO__("Starting new thread to sync chunk for checkpoint.");
-        this->worker_pool.SubmitTask([this, capturedDownloadedBlocks = std::move(downloadedBlocks), segmentStartIndex, segmentEndIndex, rangeStart] () mutable
-                                     { 
-                                        this->database.BatchStoreBlocks(capturedDownloadedBlocks, segmentStartIndex, segmentEndIndex, rangeStart); 
-                                        this->worker_pool.TaskCompleted(); });
+            // The memory budget cut the download short, so the remainder gets its own checkpoint
+            if (downloadedEndIndex < segmentEndIndex)
+            {
+                this->database.SplitCheckpoint(checkpointStartHeight, downloadedEndIndex);
+            }
+
+            __INFO__("Starting new thread to sync chunk for checkpoint.");
+            this->SubmitSegment(std::move(downloadedBlocks), segmentStartIndex, downloadedEndIndex, checkpointStartHeight, std::nullopt);
+            downloadedBlocks.clear();
+
+            segmentStartIndex = downloadedEndIndex + 1;
+            checkpointStartHeight = segmentStartIndex;
+        }
     }
     else
     {
 
-        segmentEndIndex = this->GetNextSegmentIndex(rangeEnd, segmentStartIndex);
-        while (segmentStartIndex <= rangeEnd)
+        while (segmentStartIndex <= rangeEnd && !this->IsStopping())
         {
-            this->database.CreateCheckpointIfNonExistent(segmentStartIndex, segmentEndIndex);
+            ChunkPlanner::Segment segment = this->chunk_planner.PlanNextSegment(segmentStartIndex, rangeEnd);
 
-            downloadedBlocks.reserve(segmentEndIndex - segmentStartIndex);
-            this->DownloadBlocks(downloadedBlocks, segmentStartIndex, segmentEndIndex);
+            downloadedBlocks.reserve(segment.endHeight - segmentStartIndex + 1);
+            segmentEndIndex = this->DownloadBlocks(downloadedBlocks, segmentStartIndex, segment.endHeight);
+
+            if (segmentEndIndex < segment.endHeight)
+            {
+                segment = this->chunk_planner.TruncateSegment(segment, segmentEndIndex);
+            }
+
+            this->database.CreateCheckpointIfNonExistent(segmentStartIndex, segmentEndIndex);
 
             __INFO__("Starting new thread to sync chunk.");
-            this->worker_pool.SubmitTask([this, capturedDownloadedBlocks = std::move(downloadedBlocks), segmentStartIndex, segmentEndIndex] () mutable
-                                         { 
-                                        this->database.BatchStoreBlocks(capturedDownloadedBlocks, segmentStartIndex, segmentEndIndex, segmentStartIndex); 
-                                        this->worker_pool.TaskCompleted(); });
+            this->SubmitSegment(std::move(downloadedBlocks), segment.startHeight, segment.endHeight, segment.startHeight, segment);
+            downloadedBlocks.clear();
 
             segmentStartIndex = segmentEndIndex + 1;
-            segmentEndIndex = this->GetNextSegmentIndex(rangeEnd, segmentStartIndex);
         }
     }
 }
 
-void Syncer::StartSyncLoop()
+void Syncer::SyncIfBehind()
 {
-    const std::chrono::hours syncInterval(6);
+    std::lock_guard<std::mutex> syncLock(cs_sync);
 
-    while (this->run_syncing)
+    if (!this->IsStopping() && this->ShouldSyncWallet())
     {
-        std::lock_guard<std::mutex> syncLock(cs_sync);
-
-        if (this->ShouldSyncWallet())
-        {
-            this->Sync();
-        }
-
-        std::this_thread::sleep_for(syncInterval);
+        this->Sync();
     }
 }
 
-void Syncer::InvokePeersListRefreshLoop() noexcept
+void Syncer::RetryMissedBlocks()
 {
-    while (this->run_peer_monitoring)
+    std::vector<Database::MissedBlock> dueBlocks = this->database.GetDueMissedBlocks(std::stoull(Config::getMissedBlockRetryBatchSize()));
+    if (dueBlocks.empty())
     {
-        try
-        {
-            std::lock_guard<std::mutex> lock(httpClientMutex);
-            Json::Value peer_info = this->httpClient.getpeerinfo();
-            this->database.StorePeers(peer_info);
-        }
-        catch (const std::exception &e)
-        {
-            __ERROR__(e.what());
-        }
+        return;
+    }
+
+    __INFO__(("Retrying " + std::to_string(dueBlocks.size()) + " missed blocks.").c_str());
 
-        std::this_thread::sleep_for(std::chrono::hours(24));
+    // The client queues requests beyond its in-flight limit, so every download can be issued up front
+    std::vector<std::future<Json::Value>> requests;
+    requests.reserve(dueBlocks.size());
+    for (const Database::MissedBlock &missedBlock : dueBlocks)
+    {
+        requests.push_back(this->asyncRpcClient.getblock(Json::Value(std::to_string(missedBlock.height)), Json::Value(Syncer::BLOCK_DOWNLOAD_VERBOSE_LEVEL)));
     }
-}
 
-void Syncer::InvokeChainInfoRefreshLoop() noexcept
-{
-    while (this->run_chain_info_monitoring)
+    ChunkArena arena;
+    size_t numRecovered{0};
+
+    for (size_t i = 0; i < dueBlocks.size() && this->run_missed_block_retry; ++i)
     {
         try
         {
-            std::lock_guard<std::mutex> lock(httpClientMutex);
-            Json::Value chain_info = this->httpClient.getblockchaininfo();
-            this->database.StoreChainInfo(chain_info);
+            Json::Value blockResultSerialized = requests[i].get();
+            if (blockResultSerialized.isNull())
+            {
+                throw std::runtime_error("Empty getblock result at height " + std::to_string(dueBlocks[i].height));
+            }
+
+            Block block(blockResultSerialized);
+            this->memory_budget.Acquire(block.GetEstimatedMemoryUsage());
+
+            if (!this->database.StoreBlock(block, arena, &this->memory_budget))
+            {
+                throw std::runtime_error("Failed to store block at height " + std::to_string(dueBlocks[i].height));
+            }
+
+            ++numRecovered;
         }
         catch (const std::exception &e)
         {
-            __ERROR__(e.what());
+            double delaySeconds = Syncer::GetMissedBlockRetryDelay(dueBlocks[i].attempts);
+            __ERROR__(("Retry of missed block " + std::to_string(dueBlocks[i].height) + " failed, next attempt in " + std::to_string(static_cast<uint64_t>(delaySeconds)) + "s: " + e.what()).c_str());
+            this->database.RescheduleMissedBlock(dueBlocks[i], delaySeconds, e.what());
         }
-
-        std::this_thread::sleep_for(std::chrono::hours(6));
     }
+
+    Database::MissedBlockStats stats = this->database.GetMissedBlockStats();
+    __INFO__(("Recovered " + std::to_string(numRecovered) + "/" + std::to_string(dueBlocks.size()) + " missed blocks. " +
+              std::to_string(stats.count) + " still missing, oldest for " + std::to_string(static_cast<uint64_t>(stats.oldestAgeSeconds)) + "s.")
+                 .c_str());
+}
+
+double Syncer::GetMissedBlockRetryDelay(uint32_t attempts)
+{
+    static const double baseSeconds = std::stod(Config::getMissedBlockRetryBaseSeconds());
+    static const double maxSeconds = std::stod(Config::getMissedBlockRetryMaxSeconds());
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+
+    double ceiling = std::min(maxSeconds, baseSeconds * std::pow(2.0, std::min<uint32_t>(attempts, 32)));
+    std::uniform_real_distribution<double> jitter(0.5, 1.0);
+
+    return ceiling * jitter(generator);
 }
 
 void Syncer::SyncUnfinishedCheckpoints(std::stack<Database::Checkpoint> &checkpoints)
@@ -162,7 +355,7 @@ void Syncer::SyncUnfinishedCheckpoints(std::stack<Database::Checkpoint> &checkpo
     Database::Checkpoint currentCheckpoint;
 
     __DEBUG__(("Syncing " + std::to_string(checkpoints.size()) + " checkpoints.").c_str());
-    while (!checkpoints.empty())
+    while (!checkpoints.empty() && !this->IsStopping())
     {
         currentCheckpoint = checkpoints.top();
 
@@ -176,6 +369,40 @@ void Syncer::SyncUnfinishedCheckpoints(std::stack<Database::Checkpoint> &checkpo
     }
 }
 
+void Syncer::ValueDeferredInputs()
+{
+    if (!this->database.IsDeferringInputValuation() || this->IsStopping())
+    {
+        return;
+    }
+
+    std::vector<Database::InputValuationPartition> partitions = this->database.GetUnvaluedInputPartitions();
+    if (partitions.empty())
+    {
+        return;
+    }
+
+    __INFO__(("Valuing deferred inputs in " + std::to_string(partitions.size()) + " partitions.").c_str());
+
+    for (const Database::InputValuationPartition &partition : partitions)
+    {
+        this->worker_pool.SubmitTask([this, partition]()
+                                     {
+                                        try
+                                        {
+                                            this->database.ValueInputPartition(partition);
+                                        }
+                                        catch (const std::exception &e)
+                                        {
+                                            // The partition's checkpoint is left behind and it is resumed on the next pass
+                                            __ERROR__(e.what());
+                                        }
+                                        this->worker_pool.TaskCompleted(); });
+    }
+
+    this->worker_pool.RefreshThreadPool();
+}
+
 void Syncer::Sync()
 {
     try
@@ -192,40 +419,61 @@ void Syncer::Sync()
         {
             __DEBUG__("Syncing path: Unfinished checkpoints");
             this->SyncUnfinishedCheckpoints(checkpoints);
-            this->worker_pool.RefreshThreadPool();
+            this->WaitForSegments();
         }
 
-        // Sync new blocks
+        // Sync new blocks and back-fill every gap below them
         this->LoadTotalBlockCountFromChain();
         this->LoadSyncedBlockCountFromDB();
-        uint64_t num_blocks_to_index = this->latestBlockCount - this->latestBlockSynced;
+        std::vector<HeightBitmap::HeightRange> missingRanges = this->database.GetMissingHeightRanges(0, this->latestBlockCount);
 
-        if (num_blocks_to_index == 0)
+        if (missingRanges.empty())
         {
+            this->ValueDeferredInputs();
             this->isSyncing = false;
             return;
         }
-        else if (num_blocks_to_index >= CHUNK_SIZE)
-        {
-            __DEBUG__("Syncing path: By range");
-            uint64_t startRangeChunk = this->latestBlockSynced == 0 ? this->latestBlockSynced : this->latestBlockSynced + 1;
-            this->DoConcurrentSyncOnRange(true, startRangeChunk, this->latestBlockCount);
-        }
-        else
+
+        __DEBUG__(("Syncing " + std::to_string(missingRanges.size()) + " missing ranges up to height " + std::to_string(this->latestBlockCount)).c_str());
+
+        std::vector<size_t> heights;
+        for (const auto &[rangeStart, rangeEnd] : missingRanges)
         {
-            __DEBUG__("Syncing path: By chunk");
-            std::vector<size_t> heights;
-            heights.reserve(num_blocks_to_index);
+            if (this->IsStopping())
+            {
+                break;
+            }
 
-            for (size_t i = 1; i <= num_blocks_to_index; ++i)
+            if (rangeEnd - rangeStart + 1 >= CHUNK_SIZE)
             {
-                heights.push_back(this->latestBlockSynced + i);
+                __DEBUG__("Syncing path: By range");
+                this->DoConcurrentSyncOnRange(rangeStart, rangeEnd, false);
+                continue;
             }
 
+            // Small gaps are batched together, at most CHUNK_SIZE heights at a time
+            for (uint64_t height = rangeStart; height <= rangeEnd && !this->IsStopping(); ++height)
+            {
+                heights.push_back(height);
+
+                if (heights.size() >= CHUNK_SIZE)
+                {
+                    __DEBUG__("Syncing path: By chunk");
+                    this->DoConcurrentSyncOnChunk(heights);
+                    heights.clear();
+                }
+            }
+        }
+
+        if (!heights.empty() && !this->IsStopping())
+        {
+            __DEBUG__("Syncing path: By chunk");
             this->DoConcurrentSyncOnChunk(heights);
         }
 
-        this->worker_pool.RefreshThreadPool();
+        this->WaitForSegments();
+        this->database.SaveSyncState(true);
+        this->ValueDeferredInputs();
         this->isSyncing = false;
     }
     catch (std::exception &e)
@@ -234,90 +482,115 @@ void Syncer::Sync()
     }
 }
 
-void Syncer::DownloadBlocksFromHeights(std::vector<Block> &downloadedBlocks, std::vector<size_t> heightsToDownload)
+size_t Syncer::DownloadBlocksFromHeights(std::vector<Block> &downloadedBlocks, std::vector<size_t> heightsToDownload)
 {
     __DEBUG__("Downloading blocks: DownloadBlocksFromHeights");
-    auto numHeightsToDownload{heightsToDownload.size()};
-    if (numHeightsToDownload > Syncer::CHUNK_SIZE)
+    if (heightsToDownload.size() > Syncer::CHUNK_SIZE)
     {
         throw std::runtime_error("Desired download size is greater than allowed per configuration");
     }
 
-    Json::Value getblockParams;
-    Json::Value blockResultSerialized;
-
-    std::lock_guard<std::mutex> lock(this->httpClientMutex);
-    size_t i{0};
+    return this->DownloadBlocksPipelined(downloadedBlocks, heightsToDownload);
+}
 
-    while (i < numHeightsToDownload)
-    {
-        getblockParams.append(Json::Value(std::to_string(heightsToDownload.at(i))));
-        getblockParams.append(Json::Value(2));
+uint64_t Syncer::DownloadBlocks(std::vector<Block> &downloadedBlocks, uint64_t startRange, uint64_t endRange)
+{
+    __DEBUG__("Downloading blocks: DownloadBlocks");
 
-        try
-        {
-            blockResultSerialized = httpClient.CallMethod("getblock", getblockParams);
+    std::vector<size_t> heightsToDownload;
+    heightsToDownload.reserve(endRange - startRange + 1);
 
-            if (blockResultSerialized.isNull())
-            {
-                throw std::exception();
-            }
+    for (uint64_t height = startRange; height <= endRange; ++height)
+    {
+        heightsToDownload.push_back(height);
+    }
 
-            downloadedBlocks.emplace_back(Block(blockResultSerialized));
-        }
-        catch (jsonrpc::JsonRpcException &e)
-        {
-            __ERROR__(e.what());
-            this->database.AddMissedBlock(i);
-            downloadedBlocks.emplace_back(Block());
-        }
+    size_t numHeightsDownloaded = this->DownloadBlocksPipelined(downloadedBlocks, heightsToDownload);
 
-        blockResultSerialized.clear();
-        getblockParams.clear();
-        ++i;
-    }
+    return startRange + numHeightsDownloaded - 1;
 }
 
-void Syncer::DownloadBlocks(std::vector<Block> &downloadedBlocks, uint64_t startRange, uint64_t endRange)
+size_t Syncer::DownloadBlocksPipelined(std::vector<Block> &downloadedBlocks, const std::vector<size_t> &heightsToDownload)
 {
-    __DEBUG__("Downloading blocks: DownloadBlocks");
+    const size_t numHeightsToDownload = heightsToDownload.size();
+    const size_t window = std::max<size_t>(this->asyncRpcClient.GetMaxInFlight(), 1);
+
+    // Requests are kept in flight ahead of the block being consumed, results are consumed in height order
+    std::deque<std::future<Json::Value>> inFlight;
+    size_t numRequested{0};
+    size_t i{0};
 
-    std::lock_guard<std::mutex> lock(this->httpClientMutex);
-    Json::Value getblockParams{Json::nullValue};
-    Json::Value blockResultSerialized{Json::nullValue};
+    // Largest block downloaded so far, used to size the window to what the memory budget can still hold
+    uint64_t largestBlockBytes{0};
 
-    while (startRange <= endRange)
+    while (i < numHeightsToDownload)
     {
-        getblockParams.append(Json::Value(std::to_string(startRange)));
-        getblockParams.append(Json::Value(Syncer::BLOCK_DOWNLOAD_VERBOSE_LEVEL));
+        // At least one block is kept, so the caller always has a non-empty segment to cut at
+        if (i > 0 && this->IsStopping())
+        {
+            __DEBUG__(("Stopping download after " + std::to_string(i) + " blocks.").c_str());
+            break;
+        }
+
+        // Every request in flight becomes a resident block, so near the budget's limit fewer are sent
+        // rather than downloading blocks that would be dropped when the segment is cut
+        size_t affordableWindow = window;
+        if (largestBlockBytes > 0)
+        {
+            const uint64_t usedBytes = this->memory_budget.GetUsedBytes();
+            const uint64_t headroomBytes = this->memory_budget.GetLimitBytes() > usedBytes ? this->memory_budget.GetLimitBytes() - usedBytes : 0;
+            affordableWindow = std::clamp<uint64_t>(headroomBytes / largestBlockBytes, 1, window);
+        }
+
+        while (numRequested < numHeightsToDownload && inFlight.size() < affordableWindow)
+        {
+            Json::Value height(std::to_string(heightsToDownload.at(numRequested)));
+            inFlight.push_back(this->asyncRpcClient.getblock(height, Json::Value(Syncer::BLOCK_DOWNLOAD_VERBOSE_LEVEL)));
+            ++numRequested;
+        }
+
+        bool isWithinBudget{true};
 
         try
         {
-            blockResultSerialized = httpClient.CallMethod("getblock", getblockParams);
+            // The download itself is traced by the RPC client, from writing the request to parsing the response
+            Json::Value blockResultSerialized = inFlight.front().get();
 
             if (blockResultSerialized.isNull())
             {
-                throw new std::exception();
+                throw std::runtime_error("Empty getblock result at height " + std::to_string(heightsToDownload.at(i)));
             }
 
-            downloadedBlocks.emplace_back(Block(blockResultSerialized));
+            TraceSpan decodeSpan("decode", heightsToDownload.at(i));
+            Block downloadedBlock(blockResultSerialized);
+            largestBlockBytes = std::max<uint64_t>(largestBlockBytes, downloadedBlock.GetEstimatedMemoryUsage());
+            isWithinBudget = this->ChargeDownloadedBlock(downloadedBlock, downloadedBlocks.empty());
+            downloadedBlocks.emplace_back(std::move(downloadedBlock));
         }
-        catch (jsonrpc::JsonRpcException &e)
+        catch (const std::exception &e)
         {
             __ERROR__(e.what());
-            this->database.AddMissedBlock(startRange);
+            this->database.AddMissedBlock(heightsToDownload.at(i), e.what());
             downloadedBlocks.emplace_back(Block());
         }
 
-        blockResultSerialized.clear();
-        getblockParams.clear();
-        startRange++;
+        inFlight.pop_front();
+        ++i;
+
+        if (!isWithinBudget)
+        {
+            // Requests still in flight are dropped, their heights are downloaded again with the next segment
+            __DEBUG__(("Memory budget exhausted after " + std::to_string(i) + " blocks. " + this->memory_budget.Describe()).c_str());
+            break;
+        }
     }
+
+    return i;
 }
 
 void Syncer::LoadSyncedBlockCountFromDB()
 {
-    this->latestBlockSynced = this->database.GetSyncedBlockCountFromDB();
+    this->latestBlockSynced = this->database.GetLatestCommittedHeight().value_or(0);
 }
 
 void Syncer::LoadTotalBlockCountFromChain()
@@ -356,7 +629,7 @@ bool Syncer::ShouldSyncWallet()
     this->LoadTotalBlockCountFromChain();
     this->LoadSyncedBlockCountFromDB();
 
-    return this->latestBlockSynced < this->latestBlockCount;
+    return !this->database.GetMissingHeightRanges(0, this->latestBlockCount).empty();
 }
 
 bool Syncer::GetSyncingStatus() const
@@ -364,9 +637,19 @@ bool Syncer::GetSyncingStatus() const
     return this->isSyncing;
 }
 
-void Syncer::StopPeerMonitoring()
+std::vector<ChunkPlanner::Segment> Syncer::GetChunkPlan() const
+{
+    return this->chunk_planner.GetPlan();
+}
+
+const MemoryBudget &Syncer::GetMemoryBudget() const
 {
-    this->run_peer_monitoring = false;
+    return this->memory_budget;
+}
+
+Database::MissedBlockStats Syncer::GetMissedBlockStats()
+{
+    return this->database.GetMissedBlockStats();
 }
 
 void Syncer::StopSyncing()
@@ -374,10 +657,24 @@ void Syncer::StopSyncing()
     this->run_syncing = false;
 }
 
+bool Syncer::IsStopping() const
+{
+    return !this->run_syncing;
+}
+
 void Syncer::Stop()
 {
-    this->StopPeerMonitoring();
     this->StopSyncing();
-    this->worker_pool.RefreshThreadPool();
-    this->worker_pool.End();
+    this->run_missed_block_retry = false;
+}
+
+void Syncer::DrainWorkers()
+{
+    this->worker_pool.Drain();
+
+    if (this->pinned_workers != nullptr)
+    {
+        this->pinned_workers->Drain();
+        this->LogWorkerThroughput();
+    }
 }
\ No newline at end of file
@@ -7,9 +7,13 @@
 
 #include "database.h"
 #include "httpclient.h"
+#include "async_rpc_client.h"
 #include "logger.h"
 #include "chain_resource.h"
 #include "thread_pool.h"
+#include "pinned_worker_pool.h"
+#include "chunk_planner.h"
+#include "memory_budget.h"
 #include <iostream>
 #include <string>
 #include <optional>
@@ -41,9 +45,16 @@ class Syncer
 private:
     static constexpr uint8_t JOINABLE_THREAD_COOL_OFF_TIME_IN_SECONDS = 10;
     CustomClient &httpClient;
+    AsyncRpcClient &asyncRpcClient;
     Database &database;
 
     ThreadPool worker_pool;
+    // Set in the pinned ingest mode, where segments are stored on it instead of worker_pool
+    std::unique_ptr<PinnedWorkerPool> pinned_workers;
+    // Segments submitted to pinned_workers so far, the routing key of the next one
+    std::atomic<uint64_t> submitted_segments{0};
+    ChunkPlanner chunk_planner;
+    MemoryBudget memory_budget;
 
     std::mutex db_mutex;
     std::mutex httpClientMutex;
@@ -53,8 +64,7 @@ private:
     uint64_t latestBlockCount;
 
     std::atomic<bool> run_syncing{true};
-    std::atomic<bool> run_peer_monitoring{true};
-    std::atomic<bool> run_chain_info_monitoring{true};
+    std::atomic<bool> run_missed_block_retry{true};
 
     bool isSyncing;
 
@@ -65,18 +75,27 @@ private:
      * has not been completed during a previous sync, it will recognize its state
      * through checkpoints and continue from where it left off. Although 'start' and
      * 'end' represent the true start and end of the range, the 'chunkStart' and
-     * 'chunkEnd' reflect the actual portion left to be synchronized. This methodology
-     * ensures synchronization occurs in fixed ranges, defined by CHUNK_SIZE(s).
+     * 'chunkEnd' reflect the actual portion left to be synchronized. New ranges are cut
+     * into segments of similar estimated cost by the chunk planner.
      *
      * @param start The true starting point of the range.
      * @param end The true ending point of the range.
      *
      * @return Void.
      *
-     * @note The synchronization only operates in fixed ranges as defined by CHUNK_SIZE(s).
+     * @note A segment never holds more than CHUNK_SIZE blocks.
      */
     void DoConcurrentSyncOnRange(uint64_t rangeStart, uint64_t rangeEnd, bool isPreExistingCheckpoint);
-    void StartSyncLoop();
+
+    /**
+     * @brief Syncs if the chain has heights that are not indexed yet. Run periodically by the Controller's scheduler.
+     */
+    void SyncIfBehind();
+
+    /**
+     * @brief Returns true once Stop() has been called. Downloads stop at the next block boundary.
+     */
+    bool IsStopping() const;
 
     /**
      * @brief Sync unfinished checkpoints
@@ -95,29 +114,75 @@ private:
      *
      * This function attempts to download blocks from the blockchain for each height specified in the input vector.
      * It places the resulting blocks (or placeholders in case of failure) into the downloadedBlocks vector.
-     * TODO: Implement network robustness features such as retries and backoff strategies for handling network-related issues.
+     *
+     * Downloading stops early once the memory budget is exhausted; the caller submits what was
+     * downloaded and continues with the remaining heights.
      *
      * @param downloadedBlocks A reference to a vector where the downloaded blocks will be stored.
      * @param heightsToDownload A vector containing the heights of the blocks to be downloaded.
+     * @return The number of heights downloaded.
      */
-    void DownloadBlocksFromHeights(std::vector<Block> &downloadedBlocks, std::vector<size_t> heightsToDownload);
+    size_t DownloadBlocksFromHeights(std::vector<Block> &downloadedBlocks, std::vector<size_t> heightsToDownload);
 
     /**
      * @brief Downloads a range of blocks from the blockchain.
      *
      * Attempts to download blocks within the specified start and end range. The downloaded blocks are added to the downloadBlocks vector.
-     * TODO: Implement network robustness features such as retries and backoff strategies for handling network-related issues.
      *
      * @param downloadBlocks A reference to a vector where the downloaded blocks will be stored.
+     * Downloading stops early once the memory budget is exhausted; the caller submits what was
+     * downloaded as its own segment and continues after it.
+     *
      * @param startRange The starting block height for the download.
      * @param endRange The ending block height for the download.
+     * @return The height of the last block downloaded.
+     */
+    uint64_t DownloadBlocks(std::vector<Block> &downloadBlocks, uint64_t startRange, uint64_t endRange);
+
+    /**
+     * @brief Downloads blocks through the asynchronous RPC client, keeping up to RPC_MAX_IN_FLIGHT requests outstanding.
+     *
+     * Blocks are appended in the order of the given heights. Failed downloads are recorded as missed blocks
+     * and leave an invalid placeholder.
+     *
+     * @return The number of heights consumed, fewer than requested if the memory budget cut the download short.
+     */
+    size_t DownloadBlocksPipelined(std::vector<Block> &downloadedBlocks, const std::vector<size_t> &heightsToDownload);
+
+    /**
+     * @brief Hands a downloaded segment to the workers. In the pinned mode it goes to the worker owning its height range.
+     *
+     * @param plannedSegment The planner's segment, whose store time is recorded once it is stored.
+     */
+    void SubmitSegment(std::vector<Block> &&blocks, uint64_t segmentStartHeight, uint64_t segmentEndHeight, uint64_t trueRangeStartHeight, std::optional<ChunkPlanner::Segment> plannedSegment);
+
+    /**
+     * @brief Stores a downloaded segment on a worker thread and returns any memory it still holds to the budget.
+     */
+    void StoreSegment(std::vector<Block> &blocks, uint64_t segmentStartHeight, uint64_t segmentEndHeight, uint64_t trueRangeStartHeight, ChunkArena *scratchArena);
+
+    /**
+     * @brief Waits until every submitted segment has been stored.
+     */
+    void WaitForSegments();
+
+    void LogWorkerThroughput() const;
+
+    /**
+     * @brief Charges a downloaded block to the memory budget.
+     *
+     * Blocks while the budget is exhausted if the segment holds no blocks yet. Otherwise the block
+     * is charged regardless and false is returned so the caller cuts the segment after it.
+     *
+     * @return False if the segment should end with this block.
      */
-    void DownloadBlocks(std::vector<Block> &downloadBlocks, uint64_t startRange, uint64_t endRange);
+    bool ChargeDownloadedBlock(const Block &block, bool isFirstBlockInSegment);
 
     /**
-     * @brief Loads the count of blocks that have been synced from the database.
+     * @brief Loads the height of the latest committed block.
      *
-     * Retrieves the count of the latest block that has been successfully synced and stored in the database. The count is stored in the member variable latestBlockSynced.
+     * Read from the committed height bitmap rather than the blocks table. Lower heights may still be
+     * missing; those are found with Database::GetMissingHeightRanges. The height is stored in the member variable latestBlockSynced.
      */
     void LoadSyncedBlockCountFromDB();
 
@@ -129,23 +194,25 @@ private:
     void LoadTotalBlockCountFromChain();
 
     /**
-     * @brief Continuously monitors peer information.
-     *
-     * Periodically queries the blockchain network for peer information and stores this data in the database. The loop runs continuously until signalled to stop.
+     * Values deferred inputs below the committed height watermark, one worker task per partition.
+     * Does nothing unless input valuation is deferred.
      */
-    void InvokePeersListRefreshLoop() noexcept;
+    void ValueDeferredInputs();
 
     /**
-     * @brief Continuously monitors chain info
-    */
-    void InvokeChainInfoRefreshLoop() noexcept;
+     * @brief Downloads and stores one batch of due missed blocks.
+     *
+     * Blocks that fail again are rescheduled with a jittered exponential backoff.
+     */
+    void RetryMissedBlocks();
 
     /**
-     * @brief Signals to stop the peer monitoring loop.
+     * @brief Returns the delay before the next retry of a block that has failed the given number of retries.
      *
-     * Sets the run_peer_monitoring atomic flag to false, which will cause the peer monitoring loop to exit on its next iteration.
+     * The delay doubles per attempt from MISSED_BLOCK_RETRY_BASE_SECONDS up to MISSED_BLOCK_RETRY_MAX_SECONDS
+     * and is jittered so blocks missed together are not retried together.
      */
-    void StopPeerMonitoring();
+    static double GetMissedBlockRetryDelay(uint32_t attempts);
 
     /**
      * @brief Signals to stop the syncing process.
@@ -155,22 +222,41 @@ private:
     void StopSyncing();
 
     /**
-     * @brief Stops all ongoing Syncer operations.
+     * @brief Stops fetching blocks.
      *
-     * Signals to stop both peer monitoring and syncing processes by calling StopPeerMonitoring and StopSyncing respectively.
+     * Downloads stop at the next block boundary. Blocks already downloaded are still handed to the
+     * workers, and the checkpoint of a cut segment is split at the last downloaded height, so a
+     * restart resumes exactly where this run stopped.
      */
     void Stop();
 
-    size_t GetNextSegmentIndex(size_t chunkEndpoint, size_t segmentStartpoint);
+    /**
+     * @brief Waits for the workers to commit every submitted segment, then joins them.
+     */
+    void DrainWorkers();
+
+    /**
+     * @brief Changes CHUNK_SIZE and the planner's block cap for the segments planned from now on.
+     */
+    void SetChunkSize(size_t chunkSize);
+
+    /**
+     * @brief Probes the size and transaction count of a block without downloading its transactions.
+     *
+     * Used by the chunk planner to estimate segment cost. Probe failures are logged and reported as an empty block.
+     */
+    ChunkPlanner::BlockCost ProbeBlockCost(uint64_t height);
 
 public:
     static constexpr uint8_t BLOCK_DOWNLOAD_VERBOSE_LEVEL = 2;
+    static constexpr uint8_t BLOCK_PROBE_VERBOSE_LEVEL = 1;
     static const uint8_t MAX_CONCURRENT_THREADS;
     
     /**
-     * @brief Static variable representing the size of each chunk of blocks to be synchronized.
+     * @brief Static variable representing the maximum number of blocks in a synchronized segment.
+     * Read once per segment, so a change through SetChunkSize() applies from the next segment.
      */
-    static size_t CHUNK_SIZE;
+    static std::atomic<size_t> CHUNK_SIZE;
 
     /**
      * @brief Checks if the Syncer is currently in the process of syncing.
@@ -179,6 +265,26 @@ public:
      */
     bool GetSyncingStatus() const;
 
+    /**
+     * @brief Returns the recently planned segments and their estimated and observed cost.
+     */
+    std::vector<ChunkPlanner::Segment> GetChunkPlan() const;
+
+    /**
+     * @brief Returns the budget that bounds resident block data, including current and peak usage.
+     */
+    const MemoryBudget &GetMemoryBudget() const;
+
+    /**
+     * @brief Returns the blocks stored and time spent by each pinned worker. Empty unless INGEST_MODE is "pinned".
+     */
+    std::vector<PinnedWorkerPool::WorkerStats> GetWorkerStats() const;
+
+    /**
+     * @brief Returns how many blocks are waiting to be retried and how long the oldest has been missing.
+     */
+    Database::MissedBlockStats GetMissedBlockStats();
+
     /**
      * @brief Determines if the wallet should initiate a syncing process.
      *
@@ -210,9 +316,10 @@ public:
      * Initializes a Syncer instance with the provided HTTP client and database references, setting up necessary resources for syncing operations.
      *
      * @param httpClientIn Reference to the CustomClient object for HTTP requests.
+     * @param asyncRpcClientIn Reference to the AsyncRpcClient used to download blocks concurrently.
      * @param databaseIn Reference to the Database object for data storage and retrieval.
      */
-    Syncer(CustomClient &httpClientIn, Database &databaseIn);
+    Syncer(CustomClient &httpClientIn, AsyncRpcClient &asyncRpcClientIn, Database &databaseIn);
 
     Syncer(const Syncer& syncer) noexcept = delete;
     Syncer& operator=(const Syncer& syncer) noexcept = delete;
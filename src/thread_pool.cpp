@@ -1,10 +1,12 @@
 #include "thread_pool.h"
 #include <boost/bind/bind.hpp>
 #include <thread>
+#include <algorithm>
 
 const uint8_t ThreadPool::MAX_HARDWARE_THREADS = std::thread::hardware_concurrency() - 2;
 
-ThreadPool::ThreadPool() : work(new boost::asio::io_service::work(this->io_service)), active_task(0)
+ThreadPool::ThreadPool() : work(new boost::asio::io_service::work(this->io_service)), active_task(0),
+                           max_active_tasks(ThreadPool::MAX_HARDWARE_THREADS), num_threads(ThreadPool::MAX_HARDWARE_THREADS)
 {
     __DEBUG__(("Creating " + std::to_string(ThreadPool::MAX_HARDWARE_THREADS) + " worker threads.").c_str());
     for (size_t i = 0; i < ThreadPool::MAX_HARDWARE_THREADS; ++i)
@@ -19,7 +21,7 @@ void ThreadPool::TaskCompleted()
     __INFO__("ThreadPool::TaskCompleted");
     std::lock_guard<std::mutex> cs_task_lock(cs_task_mutex);
     --this->active_task;
-    cv_task.notify_one();
+    cv_task.notify_all();
 }
 
 void ThreadPool::RefreshThreadPool()
@@ -27,6 +29,8 @@ void ThreadPool::RefreshThreadPool()
     __INFO__(("Refreshing thread pool. Active task=: " + std::to_string(this->active_task)).c_str());
 
     if (this->active_task > 0) {
+        // Without work the workers return once every queued task has run
+        this->work.reset();
         this->worker_threads.join_all();
     }
 
@@ -38,7 +42,7 @@ void ThreadPool::RefreshThreadPool()
 
     this->InitNewWork();
 
-    for (size_t i = 0; i < ThreadPool::MAX_HARDWARE_THREADS; ++i)
+    for (size_t i = 0; i < this->num_threads; ++i)
     {
         this->worker_threads.create_thread(
             boost::bind(&boost::asio::io_service::run, &this->io_service));
@@ -62,6 +66,35 @@ void ThreadPool::End()
     this->io_service.stop();
 }
 
+void ThreadPool::Drain()
+{
+    this->work.reset();
+    this->worker_threads.join_all();
+}
+
+void ThreadPool::SetMaxActiveTasks(size_t maxActiveTasks)
+{
+    maxActiveTasks = std::max<size_t>(maxActiveTasks, 1);
+
+    std::lock_guard<std::mutex> cs_task_lock(cs_task_mutex);
+    for (size_t i = this->num_threads; i < maxActiveTasks; ++i)
+    {
+        this->worker_threads.create_thread(
+            boost::bind(&boost::asio::io_service::run, &this->io_service));
+    }
+
+    this->num_threads = std::max<size_t>(this->num_threads, maxActiveTasks);
+    this->max_active_tasks = maxActiveTasks;
+    cv_task.notify_all();
+
+    __INFO__(("Thread pool now runs up to " + std::to_string(maxActiveTasks) + " tasks at once on " + std::to_string(this->num_threads) + " workers.").c_str());
+}
+
+size_t ThreadPool::GetMaxActiveTasks() const
+{
+    return this->max_active_tasks;
+}
+
 bool ThreadPool::isEmpty() {
     return this->active_task == 0;
 }
@@ -18,7 +18,9 @@ private:
     boost::asio::io_service io_service;
     boost::thread_group worker_threads;
     std::unique_ptr<boost::asio::io_service::work> work;
-    std::atomic<uint8_t> active_task{0};
+    std::atomic<size_t> active_task{0};
+    std::atomic<size_t> max_active_tasks;
+    std::atomic<size_t> num_threads;
 
     void InitNewWork();
 public:
@@ -32,9 +34,21 @@ public:
     ThreadPool(ThreadPool &&pool) noexcept = default;
     ~ThreadPool() noexcept;
 
+    /**
+     * Changes how many tasks may run at once, starting workers if there are fewer. Workers are never
+     * stopped, lowering the limit leaves the extra ones idle.
+     */
+    void SetMaxActiveTasks(size_t maxActiveTasks);
+    size_t GetMaxActiveTasks() const;
+
     bool isEmpty();
     void RefreshThreadPool();
     void TaskCompleted();
+
+    /**
+     * Runs every queued task and joins the workers. Unlike End(), no submitted task is dropped.
+     */
+    void Drain();
     void End();
 
     template <typename F, typename... Args>
@@ -42,7 +56,7 @@ public:
     {
         std::unique_lock<std::mutex> cs_task_lock(cs_task_mutex);
         cv_task.wait(cs_task_lock, [this]{ 
-            return static_cast<int>(this->active_task) < static_cast<int>(ThreadPool::MAX_HARDWARE_THREADS);
+            return this->active_task < this->max_active_tasks;
             });
 
         this->io_service.post(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
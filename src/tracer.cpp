@@ -0,0 +1,213 @@
+#include "tracer.h"
+#include "logger.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+std::atomic<bool> Tracer::isEnabled{false};
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char *name;
+        uint64_t height;
+        int64_t startMicroseconds;
+        int64_t durationMicroseconds;
+    };
+
+    struct ThreadBuffer
+    {
+        uint32_t tid{0};
+        std::string name;
+
+        // Only contended while Dump() copies the buffer
+        std::mutex cs_buffer;
+        // A ring once full, next being the oldest event
+        std::vector<TraceEvent> events;
+        size_t next{0};
+        uint64_t numDropped{0};
+    };
+
+    std::mutex cs_buffers;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    // Buffers of threads that have exited, taken by the next threads to record
+    std::vector<std::shared_ptr<ThreadBuffer>> freeBuffers;
+    size_t maxEventsPerThread{0};
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+    // Returns its buffer to freeBuffers when the thread exits. The registry keeps the buffer, so its spans are still dumped.
+    struct LocalBufferHolder
+    {
+        std::shared_ptr<ThreadBuffer> buffer;
+
+        LocalBufferHolder()
+        {
+            std::lock_guard<std::mutex> lock(cs_buffers);
+            if (!freeBuffers.empty())
+            {
+                this->buffer = std::move(freeBuffers.back());
+                freeBuffers.pop_back();
+
+                std::lock_guard<std::mutex> bufferLock(this->buffer->cs_buffer);
+                this->buffer->name = "thread " + std::to_string(this->buffer->tid);
+                return;
+            }
+
+            this->buffer = std::make_shared<ThreadBuffer>();
+            this->buffer->tid = static_cast<uint32_t>(buffers.size() + 1);
+            this->buffer->name = "thread " + std::to_string(this->buffer->tid);
+            buffers.push_back(this->buffer);
+        }
+
+        LocalBufferHolder(const LocalBufferHolder &rhs) = delete;
+        LocalBufferHolder &operator=(const LocalBufferHolder &rhs) = delete;
+
+        ~LocalBufferHolder()
+        {
+            std::lock_guard<std::mutex> lock(cs_buffers);
+            freeBuffers.push_back(std::move(this->buffer));
+        }
+    };
+
+    ThreadBuffer &LocalBuffer()
+    {
+        thread_local LocalBufferHolder holder;
+        return *holder.buffer;
+    }
+
+    int64_t MicrosecondsSinceOrigin(std::chrono::steady_clock::time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time - origin).count();
+    }
+
+    std::string EscapeJson(const std::string &value)
+    {
+        std::string escaped;
+        escaped.reserve(value.size());
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+}
+
+void Tracer::Enable(size_t maxEventsPerThreadIn)
+{
+    maxEventsPerThread = maxEventsPerThreadIn;
+    isEnabled.store(true, std::memory_order_relaxed);
+
+    __INFO__(("Tracing enabled, keeping up to " + std::to_string(maxEventsPerThreadIn) + " spans per thread.").c_str());
+}
+
+void Tracer::SetThreadName(const std::string &name)
+{
+    if (!Tracer::IsEnabled())
+    {
+        return;
+    }
+
+    ThreadBuffer &buffer = LocalBuffer();
+    std::lock_guard<std::mutex> lock(buffer.cs_buffer);
+    buffer.name = name;
+}
+
+void Tracer::Record(const char *name, uint64_t height, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    ThreadBuffer &buffer = LocalBuffer();
+    std::lock_guard<std::mutex> lock(buffer.cs_buffer);
+
+    const TraceEvent event{name, height, MicrosecondsSinceOrigin(start), std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()};
+
+    if (buffer.events.size() < maxEventsPerThread)
+    {
+        buffer.events.push_back(event);
+        return;
+    }
+
+    if (buffer.events.empty())
+    {
+        ++buffer.numDropped;
+        return;
+    }
+
+    // Full, so the oldest event makes room
+    buffer.events[buffer.next] = event;
+    buffer.next = (buffer.next + 1) % buffer.events.size();
+    ++buffer.numDropped;
+}
+
+void Tracer::Dump(const std::string &path)
+{
+    if (!Tracer::IsEnabled())
+    {
+        return;
+    }
+
+    std::vector<std::shared_ptr<ThreadBuffer>> threadBuffers;
+    {
+        std::lock_guard<std::mutex> lock(cs_buffers);
+        threadBuffers = buffers;
+    }
+
+    const std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Unable to open trace file " + temporaryPath);
+    }
+
+    const pid_t pid = getpid();
+    size_t numEvents{0};
+    uint64_t numDropped{0};
+    bool isFirstEvent{true};
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (const auto &buffer : threadBuffers)
+    {
+        std::vector<TraceEvent> events;
+        std::string threadName;
+        {
+            std::lock_guard<std::mutex> lock(buffer->cs_buffer);
+            // Oldest first
+            events.reserve(buffer->events.size());
+            events.insert(events.end(), buffer->events.begin() + static_cast<std::ptrdiff_t>(buffer->next), buffer->events.end());
+            events.insert(events.end(), buffer->events.begin(), buffer->events.begin() + static_cast<std::ptrdiff_t>(buffer->next));
+            threadName = buffer->name;
+            numDropped += buffer->numDropped;
+        }
+
+        file << (isFirstEvent ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+             << ",\"args\":{\"name\":\"" << EscapeJson(threadName) << "\"}}";
+        isFirstEvent = false;
+
+        for (const TraceEvent &event : events)
+        {
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+                 << ",\"ts\":" << event.startMicroseconds << ",\"dur\":" << event.durationMicroseconds
+                 << ",\"args\":{\"height\":" << event.height << "}}";
+        }
+
+        numEvents += events.size();
+    }
+    file << "\n]}\n";
+    file.close();
+
+    if (!file || std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        throw std::runtime_error("Unable to write trace file " + path);
+    }
+
+    __INFO__(("Wrote " + std::to_string(numEvents) + " trace spans to " + path + ", " + std::to_string(numDropped) + " older spans overwritten.").c_str());
+}
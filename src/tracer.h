@@ -0,0 +1,82 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Tracer
+ * Optional per-block timeline of the ingest stages, exported in the Chrome trace event format for
+ * chrome://tracing or ui.perfetto.dev. Spans are tagged with the block height and the thread.
+ *
+ * Each thread records into a buffer of its own, so recording takes no shared lock; the buffers are
+ * only walked by Dump(). A buffer is a ring of TRACE_MAX_EVENTS_PER_THREAD spans, so once full each
+ * span overwrites the oldest. The buffer of an exited thread is reused by the next new thread, whose
+ * spans continue its timeline row. While tracing is disabled a span costs one relaxed load.
+ */
+class Tracer
+{
+private:
+    static std::atomic<bool> isEnabled;
+
+public:
+    static void Enable(size_t maxEventsPerThread);
+
+    static bool IsEnabled()
+    {
+        return isEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Names the calling thread in the exported timeline.
+     */
+    static void SetThreadName(const std::string &name);
+
+    /**
+     * @brief Records a completed span on the calling thread.
+     *
+     * @param name A string literal, as only the pointer is kept.
+     */
+    static void Record(const char *name, uint64_t height, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    /**
+     * @brief Writes every span recorded so far to path as Chrome trace JSON, via a temporary file.
+     */
+    static void Dump(const std::string &path);
+};
+
+/**
+ * Records the time from its construction to its destruction as a span, if tracing is enabled.
+ */
+class TraceSpan
+{
+private:
+    const char *name;
+    uint64_t height;
+    std::chrono::steady_clock::time_point start;
+    bool isRecording;
+
+public:
+    TraceSpan(const char *nameIn, uint64_t heightIn) : name(nameIn), height(heightIn), isRecording(Tracer::IsEnabled())
+    {
+        if (this->isRecording)
+        {
+            this->start = std::chrono::steady_clock::now();
+        }
+    }
+
+    TraceSpan(const TraceSpan &rhs) = delete;
+    TraceSpan &operator=(const TraceSpan &rhs) = delete;
+
+    ~TraceSpan()
+    {
+        if (this->isRecording)
+        {
+            Tracer::Record(this->name, this->height, this->start, std::chrono::steady_clock::now());
+        }
+    }
+};
+
+#endif // TRACER_H